@@ -41,6 +41,14 @@ pub fn build(b: *std.Build) void {
     );
     b.getInstallStep().dependOn(&install_header.step);
 
+    // Header-only C++ wrapper over it
+    const install_cpp_header = b.addInstallFileWithDir(
+        b.path("src/zigrtf.hpp"),
+        .header,
+        "zigrtf.hpp",
+    );
+    b.getInstallStep().dependOn(&install_cpp_header.step);
+
     // Zig executable
     const exe = b.addExecutable(.{
         .name = "zigrtf",
@@ -193,6 +201,7 @@ pub fn build(b: *std.Build) void {
         .optimize = optimize,
     });
     c_api_security_tests.linkLibC();
+    c_api_security_tests.addIncludePath(b.path("src")); // c_api.h, for the layout test
     
     const run_c_api_security_tests = b.addRunArtifact(c_api_security_tests);
     run_c_api_security_tests.step.dependOn(&lib.step);
@@ -204,6 +213,7 @@ pub fn build(b: *std.Build) void {
         .optimize = optimize,
     });
     generation_tests.linkLibC();
+    generation_tests.addIncludePath(b.path("src")); // c_api.h, for the layout test
     
     const run_generation_tests = b.addRunArtifact(generation_tests);
     run_generation_tests.step.dependOn(&lib.step);
@@ -235,6 +245,26 @@ pub fn build(b: *std.Build) void {
     run_extreme_benchmark.step.dependOn(b.getInstallStep());
     const extreme_benchmark_step = b.step("extreme-benchmark", "Generate and test massive RTF files");
     extreme_benchmark_step.dependOn(&run_extreme_benchmark.step);
+    
+    // C++ wrapper benchmark (zigrtf.hpp against the raw C calls)
+    const cpp_benchmark = b.addExecutable(.{
+        .name = "cpp_benchmark",
+        .target = target,
+        .optimize = optimize,
+    });
+    cpp_benchmark.addCSourceFile(.{
+        .file = b.path("src/cpp_benchmark.cpp"),
+        .flags = &[_][]const u8{"-std=c++20"},
+    });
+    cpp_benchmark.addIncludePath(b.path("src"));
+    cpp_benchmark.linkLibrary(c_lib);
+    cpp_benchmark.linkLibCpp();
+    b.installArtifact(cpp_benchmark);
+    
+    const run_cpp_benchmark = b.addRunArtifact(cpp_benchmark);
+    run_cpp_benchmark.step.dependOn(b.getInstallStep());
+    const cpp_benchmark_step = b.step("cpp-benchmark", "Compare the C++ wrapper with raw C API calls");
+    cpp_benchmark_step.dependOn(&run_cpp_benchmark.step);
 
     const test_step = b.step("test", "Run unit tests");
     test_step.dependOn(&run_lib_tests.step);
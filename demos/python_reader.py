@@ -5,6 +5,7 @@ Uses ZigRTF C Library via ctypes
 """
 
 import ctypes
+import json
 import sys
 import os
 import time
@@ -39,6 +40,38 @@ def find_library():
     
     raise FileNotFoundError("Could not find ZigRTF shared library. Run 'zig build' first.")
 
+# rtf_writer callback: int write(void* context, const void* data, size_t count)
+WRITE_FUNC = ctypes.CFUNCTYPE(ctypes.c_int, ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t)
+
+class RtfWriter(ctypes.Structure):
+    _fields_ = [("write", WRITE_FUNC), ("context", ctypes.c_void_p)]
+
+RTF_JSON_LINES = 0x1
+
+# rtf_run from c_api.h
+class RtfRun(ctypes.Structure):
+    _fields_ = [
+        ("text", ctypes.c_char_p),
+        ("length", ctypes.c_size_t),
+        ("bold", ctypes.c_uint8),
+        ("italic", ctypes.c_uint8),
+        ("underline", ctypes.c_uint8),
+        ("strikethrough", ctypes.c_uint8),
+        ("superscript", ctypes.c_uint8),
+        ("subscript", ctypes.c_uint8),
+        ("font_id", ctypes.c_uint16),
+        ("font_size", ctypes.c_uint16),
+        ("color_id", ctypes.c_uint16),
+        ("font_name", ctypes.c_char_p),
+        ("color_rgb", ctypes.c_uint32),
+        ("alignment", ctypes.c_uint8),
+        ("left_indent", ctypes.c_int32),
+        ("right_indent", ctypes.c_int32),
+        ("first_line_indent", ctypes.c_int32),
+        ("space_before", ctypes.c_uint16),
+        ("space_after", ctypes.c_uint16),
+    ]
+
 # Load library and define C API
 def setup_rtf_api():
     """Setup the RTF API using ctypes"""
@@ -67,12 +100,34 @@ def setup_rtf_api():
     lib.rtf_get_run_count.argtypes = [ctypes.c_void_p]
     lib.rtf_get_run_count.restype = ctypes.c_size_t
     
+    # const rtf_run* rtf_get_runs_ptr(rtf_document* doc, size_t* count)
+    lib.rtf_get_runs_ptr.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_size_t)]
+    lib.rtf_get_runs_ptr.restype = ctypes.c_void_p
+    
     # const char* rtf_errmsg()
     lib.rtf_errmsg.argtypes = []
     lib.rtf_errmsg.restype = ctypes.c_char_p
     
+    # int rtf_export_json_input(const void* data, size_t length, rtf_writer* writer, unsigned flags)
+    lib.rtf_export_json_input.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.POINTER(RtfWriter), ctypes.c_uint]
+    lib.rtf_export_json_input.restype = ctypes.c_int
+    
     return lib
 
+def export_json_lines(lib, rtf_data: bytes) -> list:
+    """Parse and export a document as JSON Lines in one call - far cheaper
+    than one FFI call per run"""
+    chunks = []
+    
+    def write(_context, data, count):
+        chunks.append(ctypes.string_at(data, count))
+        return count
+    
+    writer = RtfWriter(WRITE_FUNC(write), None)
+    if lib.rtf_export_json_input(rtf_data, len(rtf_data), ctypes.byref(writer), RTF_JSON_LINES) != 0:
+        raise RuntimeError(f"JSON export failed: {lib.rtf_errmsg().decode('utf-8')}")
+    return [json.loads(line) for line in b"".join(chunks).splitlines()]
+
 class RTFDocument:
     """Python wrapper for RTF document"""
     
@@ -117,6 +172,15 @@ class RTFDocument:
         if not self.doc_ptr:
             return 0
         return self.lib.rtf_get_run_count(self.doc_ptr)
+    
+    def get_runs(self):
+        """All runs as one ctypes array over the document's memory - a
+        single call instead of one per run. Valid while the document is."""
+        count = ctypes.c_size_t(0)
+        address = self.lib.rtf_get_runs_ptr(self.doc_ptr, ctypes.byref(count)) if self.doc_ptr else None
+        if not address:
+            return (RtfRun * 0)()
+        return (RtfRun * count.value).from_address(address)
 
 def print_header():
     """Print demo header"""
@@ -158,13 +222,16 @@ def main():
         text = doc.get_text()
         text_length = doc.get_text_length()
         run_count = doc.get_run_count()
+        bold_runs = sum(1 for run in doc.get_runs() if run.bold)
+        records = export_json_lines(doc.lib, content)
         
         # Display results
         print_header()
         print(f"File: {filename}")
         print(f"RTF Size: {len(content)} bytes")
         print(f"Text Length: {text_length} characters")
-        print(f"Text Runs: {run_count}")
+        print(f"Text Runs: {run_count} ({bold_runs} bold)")
+        print(f"JSON Records: {len(records)}")
         print(f"Parse Time: {parse_time_ms:.2f} ms")
         print_separator()
         
@@ -43,7 +43,7 @@ void example_parse_memory(void) {
         if (run->italic) printf(" [ITALIC]");
         if (run->underline) printf(" [UNDERLINE]");
         if (run->font_size > 0) printf(" [SIZE=%d]", run->font_size);
-        if (run->color > 0) printf(" [COLOR=0x%06X]", run->color);
+        if (run->color_id > 0) printf(" [COLOR=0x%06X]", (unsigned)run->color_rgb);
         
         printf("\n");
     }
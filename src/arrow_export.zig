@@ -0,0 +1,670 @@
+const std = @import("std");
+const builtin = @import("builtin");
+const doc_model = @import("document_model.zig");
+const io = @import("io.zig");
+const text_index = @import("text_index.zig");
+
+// =============================================================================
+// ARROW IPC EXPORT
+// =============================================================================
+// Writes the text runs of one or more documents as an Arrow IPC stream, the
+// format DuckDB, Polars and pyarrow read directly (pyarrow.ipc.open_stream,
+// polars.read_ipc_stream). One row per run, in rtf_get_run() order:
+//
+//   doc_id     uint32   Which document, as numbered by the caller
+//   text       utf8
+//   style_id   uint32   Same id for the same character formatting, across
+//                       the whole stream, numbered as first seen
+//   bold, italic, underline   bool
+//   font_id    uint16   Null if the run sets no font
+//   font_size  uint16   Half-points, the document default if not set
+//   color_rgb  uint32   0xRRGGBB, null for the automatic color
+//   paragraph  uint32   As rtf_get_paragraph() numbers them, per document
+//   alignment  uint8    0 left, 1 center, 2 right, 3 justify
+//
+// The stream is a schema message, record batches of up to
+// Options.batch_rows rows and the end-of-stream marker. Messages are
+// hand-built flatbuffers (Schema.fbs, Message.fbs), since nothing else
+// here needs a flatbuffers library. Columns are built for one batch at a
+// time, so memory stays bounded however many documents are added.
+
+pub const Options = struct {
+    batch_rows: usize = 64 * 1024,
+};
+
+pub const Input = struct {
+    document: *const doc_model.Document,
+    index: *const text_index.TextIndex, // Built from `document`
+};
+
+// Write the runs of `inputs`, numbering the documents from 0
+pub fn exportRuns(allocator: std.mem.Allocator, inputs: []const Input, writer: anytype, options: Options) !void {
+    var exporter = try RunExporter(@TypeOf(writer)).init(allocator, writer, options);
+    defer exporter.deinit();
+    for (inputs, 0..) |input, doc_id| try exporter.addDocument(@intCast(doc_id), input.document, input.index);
+    try exporter.finish();
+}
+
+pub fn RunExporter(comptime Writer: type) type {
+    return struct {
+        buffered: io.ExportWriter(Writer),
+        options: Options,
+        columns: Columns,
+        styles: std.AutoHashMap(u64, u32),
+        schema_written: bool = false,
+
+        const Self = @This();
+
+        pub fn init(allocator: std.mem.Allocator, writer: Writer, options: Options) !Self {
+            // Column buffers are written as they sit in memory
+            if (builtin.cpu.arch.endian() != .little) return error.UnsupportedPlatform;
+            return .{
+                .buffered = io.exportWriter(writer),
+                .options = options,
+                .columns = Columns.init(allocator),
+                .styles = std.AutoHashMap(u64, u32).init(allocator),
+            };
+        }
+
+        pub fn deinit(self: *Self) void {
+            self.columns.deinit();
+            self.styles.deinit();
+        }
+
+        pub fn addDocument(self: *Self, doc_id: u32, document: *const doc_model.Document, index: *const text_index.TextIndex) !void {
+            var rows = RunRows{ .exporter = self, .doc_id = doc_id, .document = document, .paragraphs = index.paragraphs };
+            // Runs in Document.getTextRuns() order, which the index numbers
+            for (document.content.items) |element| {
+                switch (element) {
+                    .text_run => |run| try rows.add(run),
+                    .hyperlink => |link| try rows.add(doc_model.TextRun.init(link.display_text, .{}, .{})),
+                    .table => |table| for (table.runs.items) |run| try rows.add(run),
+                    else => {},
+                }
+            }
+        }
+
+        // Write the last batch and the end-of-stream marker
+        pub fn finish(self: *Self) !void {
+            try self.writeBatch();
+            try self.buffered.writer().writeAll(&.{ 0xff, 0xff, 0xff, 0xff, 0, 0, 0, 0 });
+            try self.buffered.flush();
+        }
+
+        const RunRows = struct {
+            exporter: *Self,
+            doc_id: u32,
+            document: *const doc_model.Document,
+            paragraphs: []const text_index.Paragraph,
+            run_index: usize = 0,
+            paragraph: usize = 0,
+
+            fn add(rows: *RunRows, run: doc_model.TextRun) !void {
+                // Every run belongs to a paragraph, and they are in run order
+                while (rows.paragraph + 1 < rows.paragraphs.len and
+                    rows.run_index >= rows.paragraphs[rows.paragraph].first_run + rows.paragraphs[rows.paragraph].run_count)
+                {
+                    rows.paragraph += 1;
+                }
+                try rows.exporter.addRow(rows.doc_id, rows.document, run, @intCast(rows.paragraph));
+                rows.run_index += 1;
+            }
+        };
+
+        fn addRow(self: *Self, doc_id: u32, document: *const doc_model.Document, run: doc_model.TextRun, paragraph: u32) !void {
+            // Offsets into the text column are 32-bit. Decoding a code page
+            // byte to UTF-8 takes at most 3 bytes.
+            const max_len = run.text.len * 3;
+            if (max_len > std.math.maxInt(i32)) return error.RunTooLong;
+            if (self.columns.text_data.items.len + max_len > std.math.maxInt(i32)) try self.writeBatch();
+
+            const format = run.char_format;
+            const style = try self.styles.getOrPut(format.key());
+            if (!style.found_existing) style.value_ptr.* = @intCast(self.styles.count() - 1);
+
+            const color: ?u32 = if (format.color_id) |id| blk: {
+                if (id == 0) break :blk null; // Automatic
+                const info = document.getColor(id) orelse break :blk null;
+                break :blk @as(u32, info.red) << 16 | @as(u32, info.green) << 8 | info.blue;
+            } else null;
+
+            const columns = &self.columns;
+            if (columns.text_offsets.items.len == 0) try columns.text_offsets.append(0);
+            try columns.doc_id.append(doc_id);
+            try doc_model.appendDecoded(&columns.text_data, run.text, document.code_page);
+            try columns.text_offsets.append(@intCast(columns.text_data.items.len));
+            try columns.style_id.append(style.value_ptr.*);
+            try columns.bold.append(format.bold);
+            try columns.italic.append(format.italic);
+            try columns.underline.append(format.underline);
+            try columns.font_id.append(format.font_id);
+            try columns.font_size.append(format.font_size orelse document.default_font_size);
+            try columns.color_rgb.append(color);
+            try columns.paragraph.append(paragraph);
+            try columns.alignment.append(@intFromEnum(run.para_format.alignment));
+            columns.rows += 1;
+
+            if (columns.rows >= self.options.batch_rows) try self.writeBatch();
+        }
+
+        fn writeBatch(self: *Self) !void {
+            const out = self.buffered.writer();
+            if (!self.schema_written) {
+                var schema = FlatBuilder{};
+                try writeMessage(out, try schema.schemaMessage());
+                self.schema_written = true;
+            }
+            const columns = &self.columns;
+            if (columns.rows == 0) return;
+
+            const buffers = columns.buffers();
+            var layout: [buffers.len]BufferSpec = undefined;
+            var body_length: usize = 0;
+            for (buffers, &layout) |buffer, *spec| {
+                spec.* = .{ .offset = @intCast(body_length), .length = @intCast(buffer.len) };
+                body_length += padded(buffer.len);
+            }
+
+            var batch = FlatBuilder{};
+            try writeMessage(out, try batch.recordBatchMessage(columns.rows, columns.nodes(), &layout, body_length));
+            for (buffers) |buffer| {
+                try out.writeAll(buffer);
+                try out.writeByteNTimes(0, padded(buffer.len) - buffer.len);
+            }
+            columns.clear();
+        }
+    };
+}
+
+fn padded(length: usize) usize {
+    return std.mem.alignForward(usize, length, 8);
+}
+
+// Encapsulated message: continuation marker, metadata size, flatbuffer.
+// The body, if any, follows.
+fn writeMessage(out: anytype, metadata: []const u8) !void {
+    try out.writeInt(u32, 0xffffffff, .little);
+    try out.writeInt(i32, @intCast(metadata.len), .little);
+    try out.writeAll(metadata);
+}
+
+// =============================================================================
+// COLUMNS
+// =============================================================================
+
+const Kind = enum { int, utf8, boolean };
+
+const Column = struct {
+    name: []const u8,
+    kind: Kind,
+    bits: u8 = 0, // Unsigned integers only
+    nullable: bool = false,
+};
+
+// Schema order, matching Columns.buffers() and Columns.nodes()
+const schema_columns = [_]Column{
+    .{ .name = "doc_id", .kind = .int, .bits = 32 },
+    .{ .name = "text", .kind = .utf8 },
+    .{ .name = "style_id", .kind = .int, .bits = 32 },
+    .{ .name = "bold", .kind = .boolean },
+    .{ .name = "italic", .kind = .boolean },
+    .{ .name = "underline", .kind = .boolean },
+    .{ .name = "font_id", .kind = .int, .bits = 16, .nullable = true },
+    .{ .name = "font_size", .kind = .int, .bits = 16 },
+    .{ .name = "color_rgb", .kind = .int, .bits = 32, .nullable = true },
+    .{ .name = "paragraph", .kind = .int, .bits = 32 },
+    .{ .name = "alignment", .kind = .int, .bits = 8 },
+};
+
+// A validity bitmap, then the values, for every column; utf8 has offsets
+// between them
+const buffer_count = blk: {
+    var count = 0;
+    for (schema_columns) |column| count += if (column.kind == .utf8) 3 else 2;
+    break :blk count;
+};
+
+// LSB-first bits, as Arrow stores booleans and validity
+const Bitmap = struct {
+    bytes: std.ArrayList(u8),
+    len: usize = 0,
+    set: usize = 0,
+
+    fn init(allocator: std.mem.Allocator) Bitmap {
+        return .{ .bytes = std.ArrayList(u8).init(allocator) };
+    }
+
+    fn deinit(self: *Bitmap) void {
+        self.bytes.deinit();
+    }
+
+    fn append(self: *Bitmap, bit: bool) !void {
+        if (self.len % 8 == 0) try self.bytes.append(0);
+        if (bit) {
+            self.bytes.items[self.bytes.items.len - 1] |= @as(u8, 1) << @intCast(self.len % 8);
+            self.set += 1;
+        }
+        self.len += 1;
+    }
+
+    fn clear(self: *Bitmap) void {
+        self.bytes.clearRetainingCapacity();
+        self.len = 0;
+        self.set = 0;
+    }
+};
+
+fn Nullable(comptime T: type) type {
+    return struct {
+        values: std.ArrayList(T),
+        valid: Bitmap,
+
+        const Self = @This();
+
+        fn init(allocator: std.mem.Allocator) Self {
+            return .{ .values = std.ArrayList(T).init(allocator), .valid = Bitmap.init(allocator) };
+        }
+
+        fn deinit(self: *Self) void {
+            self.values.deinit();
+            self.valid.deinit();
+        }
+
+        fn append(self: *Self, value: ?T) !void {
+            try self.values.append(value orelse 0);
+            try self.valid.append(value != null);
+        }
+
+        fn nullCount(self: *const Self) usize {
+            return self.valid.len - self.valid.set;
+        }
+
+        // Arrow allows leaving the bitmap out when nothing is null
+        fn validity(self: *const Self) []const u8 {
+            return if (self.nullCount() == 0) &.{} else self.valid.bytes.items;
+        }
+
+        fn clear(self: *Self) void {
+            self.values.clearRetainingCapacity();
+            self.valid.clear();
+        }
+    };
+}
+
+const Columns = struct {
+    rows: usize = 0,
+    doc_id: std.ArrayList(u32),
+    text_offsets: std.ArrayList(i32), // rows + 1 entries, once a row is added
+    text_data: std.ArrayList(u8),
+    style_id: std.ArrayList(u32),
+    bold: Bitmap,
+    italic: Bitmap,
+    underline: Bitmap,
+    font_id: Nullable(u16),
+    font_size: std.ArrayList(u16),
+    color_rgb: Nullable(u32),
+    paragraph: std.ArrayList(u32),
+    alignment: std.ArrayList(u8),
+
+    fn init(allocator: std.mem.Allocator) Columns {
+        var columns: Columns = undefined;
+        columns.rows = 0;
+        inline for (std.meta.fields(Columns)) |field| {
+            if (field.type == usize) continue;
+            @field(columns, field.name) = field.type.init(allocator);
+        }
+        return columns;
+    }
+
+    fn deinit(self: *Columns) void {
+        inline for (std.meta.fields(Columns)) |field| {
+            if (field.type == usize) continue;
+            @field(self, field.name).deinit();
+        }
+    }
+
+    fn clear(self: *Columns) void {
+        inline for (std.meta.fields(Columns)) |field| {
+            if (field.type == usize) continue;
+            if (@hasDecl(field.type, "clearRetainingCapacity")) {
+                @field(self, field.name).clearRetainingCapacity();
+            } else {
+                @field(self, field.name).clear();
+            }
+        }
+        self.rows = 0;
+    }
+
+    // Only called with rows in the batch
+    fn buffers(self: *const Columns) [buffer_count][]const u8 {
+        const bytes = std.mem.sliceAsBytes;
+        return .{
+            &.{}, bytes(self.doc_id.items),
+            &.{}, bytes(self.text_offsets.items), self.text_data.items,
+            &.{}, bytes(self.style_id.items),
+            &.{}, self.bold.bytes.items,
+            &.{}, self.italic.bytes.items,
+            &.{}, self.underline.bytes.items,
+            self.font_id.validity(), bytes(self.font_id.values.items),
+            &.{}, bytes(self.font_size.items),
+            self.color_rgb.validity(), bytes(self.color_rgb.values.items),
+            &.{}, bytes(self.paragraph.items),
+            &.{}, self.alignment.items,
+        };
+    }
+
+    // Row and null counts per column
+    fn nodes(self: *const Columns) [schema_columns.len]FieldNode {
+        var result: [schema_columns.len]FieldNode = undefined;
+        for (schema_columns, &result) |column, *node| {
+            node.* = .{ .length = @intCast(self.rows), .null_count = 0 };
+            if (std.mem.eql(u8, column.name, "font_id")) node.null_count = @intCast(self.font_id.nullCount());
+            if (std.mem.eql(u8, column.name, "color_rgb")) node.null_count = @intCast(self.color_rgb.nullCount());
+        }
+        return result;
+    }
+};
+
+// =============================================================================
+// FLATBUFFERS
+// =============================================================================
+// Just enough of a flatbuffers builder for Arrow's Schema and RecordBatch
+// messages. Like the reference builder it works back to front, so children
+// are written before the tables that point at them; positions are counted
+// from the end of the buffer, and alignment is kept relative to the end,
+// which lines up with the start once finish() rounds the size to 8.
+
+const FieldNode = struct { length: i64, null_count: i64 };
+const BufferSpec = struct { offset: i64, length: i64 };
+
+// Union and enum values from Schema.fbs and Message.fbs
+const metadata_v5: i16 = 4;
+const header_schema: u8 = 1;
+const header_record_batch: u8 = 3;
+const type_int: u8 = 2;
+const type_utf8: u8 = 5;
+const type_bool: u8 = 6;
+
+const FlatBuilder = struct {
+    buf: [4096]u8 = undefined,
+    size: usize = 0, // Bytes in use, at the end of buf
+    table_start: usize = 0,
+    slots: [8]usize = undefined, // Position of each field of the open table, 0 if absent
+    slot_count: usize = 0,
+
+    fn push(self: *FlatBuilder, bytes: []const u8) !void {
+        if (self.size + bytes.len > self.buf.len) return error.NoSpaceLeft;
+        self.size += bytes.len;
+        @memcpy(self.buf[self.buf.len - self.size ..][0..bytes.len], bytes);
+    }
+
+    fn pushInt(self: *FlatBuilder, comptime T: type, value: T) !void {
+        var bytes: [@sizeOf(T)]u8 = undefined;
+        std.mem.writeInt(T, &bytes, value, .little);
+        try self.push(&bytes);
+    }
+
+    // Pad so that the size is a multiple of `alignment` once `additional`
+    // more bytes are pushed
+    fn prep(self: *FlatBuilder, alignment: usize, additional: usize) !void {
+        const padding = (alignment - (self.size + additional) % alignment) % alignment;
+        for (0..padding) |_| try self.push(&.{0});
+    }
+
+    fn scalar(self: *FlatBuilder, comptime T: type, value: T) !void {
+        try self.prep(@sizeOf(T), 0);
+        try self.pushInt(T, value);
+    }
+
+    // A uoffset from here to the object at `target`
+    fn offset(self: *FlatBuilder, target: usize) !void {
+        try self.prep(4, 0);
+        try self.pushInt(u32, @intCast(self.size + 4 - target));
+    }
+
+    fn startTable(self: *FlatBuilder) void {
+        self.table_start = self.size;
+        self.slot_count = 0;
+    }
+
+    fn markSlot(self: *FlatBuilder, slot: usize) void {
+        while (self.slot_count <= slot) : (self.slot_count += 1) self.slots[self.slot_count] = 0;
+        self.slots[slot] = self.size;
+    }
+
+    fn field(self: *FlatBuilder, slot: usize, comptime T: type, value: T) !void {
+        try self.scalar(T, value);
+        self.markSlot(slot);
+    }
+
+    fn fieldOffset(self: *FlatBuilder, slot: usize, target: usize) !void {
+        try self.offset(target);
+        self.markSlot(slot);
+    }
+
+    // The table's vtable goes right before it
+    fn endTable(self: *FlatBuilder) !usize {
+        try self.prep(4, 0);
+        try self.pushInt(i32, 0); // Patched below
+        const table = self.size;
+
+        var slot = self.slot_count;
+        while (slot > 0) {
+            slot -= 1;
+            const at = self.slots[slot];
+            try self.pushInt(u16, if (at == 0) 0 else @intCast(table - at));
+        }
+        try self.pushInt(u16, @intCast(table - self.table_start));
+        try self.pushInt(u16, @intCast(4 + 2 * self.slot_count));
+
+        std.mem.writeInt(i32, self.buf[self.buf.len - table ..][0..4], @intCast(self.size - table), .little);
+        return table;
+    }
+
+    fn string(self: *FlatBuilder, text: []const u8) !usize {
+        try self.prep(4, text.len + 1);
+        try self.push(&.{0});
+        try self.push(text);
+        try self.pushInt(u32, @intCast(text.len));
+        return self.size;
+    }
+
+    fn offsetVector(self: *FlatBuilder, targets: []const usize) !usize {
+        try self.prep(4, 4 * targets.len);
+        var index = targets.len;
+        while (index > 0) {
+            index -= 1;
+            try self.offset(targets[index]);
+        }
+        try self.pushInt(u32, @intCast(targets.len));
+        return self.size;
+    }
+
+    // FieldNode and Buffer are both structs of two longs
+    fn pairVector(self: *FlatBuilder, comptime T: type, items: []const T) !usize {
+        try self.prep(4, 16 * items.len);
+        try self.prep(8, 16 * items.len);
+        var index = items.len;
+        while (index > 0) {
+            index -= 1;
+            const fields = std.meta.fields(T);
+            try self.pushInt(i64, @field(items[index], fields[1].name));
+            try self.pushInt(i64, @field(items[index], fields[0].name));
+        }
+        try self.pushInt(u32, @intCast(items.len));
+        return self.size;
+    }
+
+    fn finish(self: *FlatBuilder, root: usize) ![]const u8 {
+        try self.prep(8, 4);
+        try self.offset(root);
+        return self.buf[self.buf.len - self.size ..];
+    }
+
+    fn message(self: *FlatBuilder, header_type: u8, header: usize, body_length: usize) ![]const u8 {
+        self.startTable();
+        try self.field(0, i16, metadata_v5);
+        try self.field(1, u8, header_type);
+        try self.fieldOffset(2, header);
+        try self.field(3, i64, @intCast(body_length));
+        return self.finish(try self.endTable());
+    }
+
+    fn schemaMessage(self: *FlatBuilder) ![]const u8 {
+        var fields: [schema_columns.len]usize = undefined;
+        for (schema_columns, &fields) |column, *field_table| {
+            self.startTable();
+            if (column.kind == .int) {
+                try self.field(0, i32, column.bits); // bitWidth
+                try self.field(1, u8, 0); // is_signed
+            }
+            const type_table = try self.endTable();
+            const name = try self.string(column.name);
+            const children = try self.offsetVector(&.{});
+
+            self.startTable();
+            try self.fieldOffset(0, name);
+            try self.field(1, u8, @intFromBool(column.nullable));
+            try self.field(2, u8, switch (column.kind) {
+                .int => type_int,
+                .utf8 => type_utf8,
+                .boolean => type_bool,
+            });
+            try self.fieldOffset(3, type_table);
+            try self.fieldOffset(5, children); // Readers expect it even when empty
+            field_table.* = try self.endTable();
+        }
+        const field_vector = try self.offsetVector(&fields);
+
+        self.startTable();
+        try self.fieldOffset(1, field_vector); // Endianness defaults to little
+        const schema = try self.endTable();
+        return self.message(header_schema, schema, 0);
+    }
+
+    fn recordBatchMessage(self: *FlatBuilder, rows: usize, nodes: [schema_columns.len]FieldNode, buffers: []const BufferSpec, body_length: usize) ![]const u8 {
+        const buffer_vector = try self.pairVector(BufferSpec, buffers);
+        const node_vector = try self.pairVector(FieldNode, &nodes);
+
+        self.startTable();
+        try self.field(0, i64, @intCast(rows));
+        try self.fieldOffset(1, node_vector);
+        try self.fieldOffset(2, buffer_vector);
+        const batch = try self.endTable();
+        return self.message(header_record_batch, batch, body_length);
+    }
+};
+
+// =============================================================================
+// TESTS
+// =============================================================================
+
+const formatted_parser = @import("formatted_parser.zig");
+
+// Minimal flatbuffer reading, to check what the builder wrote
+const FlatReader = struct {
+    bytes: []const u8,
+
+    fn int(self: FlatReader, comptime T: type, at: usize) T {
+        return std.mem.readInt(T, self.bytes[at..][0..@sizeOf(T)], .little);
+    }
+
+    fn follow(self: FlatReader, at: usize) usize {
+        return at + self.int(u32, at);
+    }
+
+    // Position of field `slot` of the table at `table`, if present
+    fn slot(self: FlatReader, table: usize, index: usize) ?usize {
+        const vtable: usize = @intCast(@as(i64, @intCast(table)) - self.int(i32, table));
+        if (4 + 2 * index >= self.int(u16, vtable)) return null;
+        const field_offset = self.int(u16, vtable + 4 + 2 * index);
+        return if (field_offset == 0) null else table + field_offset;
+    }
+};
+
+test "arrow ipc export of runs" {
+    const testing = std.testing;
+
+    const rtf_data = "{\\rtf1{\\colortbl;\\red255\\green0\\blue0;}Plain \\b\\cf1 red bold\\b0\\cf0\\par " ++
+        "\\qc\\f2\\fs20 Next\\par}";
+
+    var stream = std.io.fixedBufferStream(rtf_data);
+    var parser = try formatted_parser.FormattedParser.init(stream.reader().any(), testing.allocator);
+    defer parser.deinit();
+    var document = try parser.parse();
+    defer document.deinit();
+    var index = try text_index.TextIndex.build(&document, testing.allocator);
+    defer index.deinit(testing.allocator);
+
+    var output = std.ArrayList(u8).init(testing.allocator);
+    defer output.deinit();
+    const inputs = [_]Input{ .{ .document = &document, .index = &index }, .{ .document = &document, .index = &index } };
+    try exportRuns(testing.allocator, &inputs, output.writer(), .{ .batch_rows = 4 });
+
+    // Schema, a full batch of 4 rows, one of 2, then the end marker
+    var at: usize = 0;
+    var batches = std.ArrayList([2]usize).init(testing.allocator); // Rows, body start
+    defer batches.deinit();
+    while (true) {
+        try testing.expectEqual(@as(u32, 0xffffffff), std.mem.readInt(u32, output.items[at..][0..4], .little));
+        const metadata_len: usize = @intCast(std.mem.readInt(i32, output.items[at + 4 ..][0..4], .little));
+        at += 8;
+        if (metadata_len == 0) break;
+        try testing.expect(metadata_len % 8 == 0);
+
+        const reader = FlatReader{ .bytes = output.items[at .. at + metadata_len] };
+        const message = reader.follow(0);
+        try testing.expectEqual(metadata_v5, reader.int(i16, reader.slot(message, 0).?));
+        const body_length: usize = @intCast(reader.int(i64, reader.slot(message, 3).?));
+        const header = reader.follow(reader.slot(message, 2).?);
+        if (reader.int(u8, reader.slot(message, 1).?) == header_schema) {
+            const fields = reader.follow(reader.slot(header, 1).?);
+            try testing.expectEqual(@as(u32, schema_columns.len), reader.int(u32, fields));
+            const text_field = reader.follow(fields + 4 + 4 * 1);
+            const name = reader.follow(reader.slot(text_field, 0).?);
+            try testing.expectEqualStrings("text", reader.bytes[name + 4 ..][0..reader.int(u32, name)]);
+            try testing.expectEqual(type_utf8, reader.int(u8, reader.slot(text_field, 2).?));
+        } else {
+            const rows: usize = @intCast(reader.int(i64, reader.slot(header, 0).?));
+            try batches.append(.{ rows, at + metadata_len });
+
+            // The text offsets and data buffers of the second column
+            const buffers = reader.follow(reader.slot(header, 2).?);
+            try testing.expectEqual(@as(u32, buffer_count), reader.int(u32, buffers));
+            const body = output.items[at + metadata_len ..][0..body_length];
+            const offsets_at: usize = @intCast(reader.int(i64, buffers + 4 + 16 * 3));
+            const data_at: usize = @intCast(reader.int(i64, buffers + 4 + 16 * 4));
+            const first_end: usize = @intCast(std.mem.readInt(i32, body[offsets_at + 4 ..][0..4], .little));
+            const first = body[data_at..][0..first_end];
+            try testing.expectEqualStrings(if (batches.items.len == 1) "Plain " else "red bold", first);
+        }
+        at += metadata_len + body_length;
+    }
+    try testing.expectEqual(output.items.len, at);
+    try testing.expectEqual(@as(usize, 2), batches.items.len);
+    try testing.expectEqual(@as(usize, 4), batches.items[0][0]);
+    try testing.expectEqual(@as(usize, 2), batches.items[1][0]);
+}
+
+test "arrow export decodes code page bytes" {
+    const testing = std.testing;
+
+    const rtf_data = "{\\rtf1 Caf\\'e9 \\'93hi\\'94 \\u8364?}";
+
+    var stream = std.io.fixedBufferStream(rtf_data);
+    var parser = try formatted_parser.FormattedParser.init(stream.reader().any(), testing.allocator);
+    defer parser.deinit();
+    var document = try parser.parse();
+    defer document.deinit();
+    var index = try text_index.TextIndex.build(&document, testing.allocator);
+    defer index.deinit(testing.allocator);
+
+    var output = std.ArrayList(u8).init(testing.allocator);
+    defer output.deinit();
+    var exporter = try RunExporter(@TypeOf(output.writer())).init(testing.allocator, output.writer(), .{});
+    defer exporter.deinit();
+    try exporter.addDocument(0, &document, &index);
+
+    // The text column is valid UTF-8, as its utf8 type says
+    try testing.expectEqualStrings("Caf\u{e9} \u{201c}hi\u{201d} \u{20ac}", exporter.columns.text_data.items);
+}
@@ -29,22 +29,77 @@ extern "C" {
 /* Opaque document handle - like sqlite3* */
 typedef struct rtf_document rtf_document;
 
-/* Text run with formatting - minimal, cache-friendly */
+/*
+ * Text run with formatting. Documents store their runs as one array of
+ * these (see rtf_get_runs_ptr), so the layout is fixed: 64 bytes, one cache
+ * line, on 64-bit platforms.
+ */
 typedef struct rtf_run {
     const char* text;        /* Zero-terminated text content */
     size_t      length;      /* Text length in bytes */
     
-    /* Formatting flags - packed for efficiency */
-    uint32_t    bold      : 1;
-    uint32_t    italic    : 1; 
-    uint32_t    underline : 1;
-    uint32_t    reserved  : 29;
+    /* Character formatting, 0 or 1 */
+    uint8_t     bold;
+    uint8_t     italic;
+    uint8_t     underline;
+    uint8_t     strikethrough;
+    uint8_t     superscript;
+    uint8_t     subscript;
     
     /* Font and color */
-    int         font_size;   /* Half-points (24 = 12pt), 0 = default */
-    uint32_t    color;       /* RGB color, 0 = default */
+    uint16_t    font_id;
+    uint16_t    font_size;   /* Half-points (24 = 12pt) */
+    uint16_t    color_id;    /* 0 = automatic */
+    const char* font_name;   /* Resolved from the font table */
+    uint32_t    color_rgb;   /* 0xRRGGBB resolved from the color table */
+    
+    /* Paragraph formatting */
+    uint8_t     alignment;   /* 0 left, 1 center, 2 right, 3 justify */
+    int32_t     left_indent;       /* Twips */
+    int32_t     right_indent;      /* Twips */
+    int32_t     first_line_indent; /* Twips */
+    uint16_t    space_before;      /* Twips */
+    uint16_t    space_after;       /* Twips */
 } rtf_run;
 
+/* rtf_run_v2 and rtf_style flag bits */
+#define RTF_RUN_BOLD          0x1
+#define RTF_RUN_ITALIC        0x2
+#define RTF_RUN_UNDERLINE     0x4
+#define RTF_RUN_STRIKETHROUGH 0x8
+#define RTF_RUN_SUPERSCRIPT   0x10
+#define RTF_RUN_SUBSCRIPT     0x20
+
+/*
+ * Compact text run, 32 bytes on every platform (see rtf_get_runs_v2). The
+ * text is not a pointer but a byte range of rtf_get_text(), and the full
+ * character format is the style entry, with the fields most readers want
+ * repeated inline.
+ */
+typedef struct rtf_run_v2 {
+    uint64_t    text_offset; /* Bytes into rtf_get_text() */
+    uint32_t    text_length; /* Bytes */
+    uint32_t    style;       /* Index into rtf_get_styles() */
+    uint32_t    paragraph;   /* As rtf_get_paragraph() numbers them */
+    uint16_t    flags;       /* RTF_RUN_* bits */
+    uint8_t     alignment;   /* 0 left, 1 center, 2 right, 3 justify */
+    uint8_t     reserved;    /* 0 */
+    uint16_t    font_id;
+    uint16_t    font_size;   /* Half-points (24 = 12pt) */
+    uint32_t    color_rgb;   /* 0xRRGGBB resolved from the color table */
+} rtf_run_v2;
+
+/* One distinct character format, shared by every run that uses it */
+typedef struct rtf_style {
+    const char* font_name;   /* Resolved from the font table */
+    uint32_t    color_rgb;   /* 0xRRGGBB resolved from the color table */
+    uint16_t    font_id;
+    uint16_t    font_size;   /* Half-points (24 = 12pt) */
+    uint16_t    color_id;    /* 0 = automatic */
+    uint16_t    flags;       /* RTF_RUN_* bits */
+    uint32_t    reserved;    /* 0 */
+} rtf_style;
+
 /* Table structure - opaque, access via rtf_table_* functions */
 typedef struct rtf_table rtf_table;
 
@@ -74,6 +129,30 @@ typedef struct rtf_reader {
     void* context;
 } rtf_reader;
 
+/* Writer interface - mirror of rtf_reader */
+typedef struct rtf_writer {
+    /* Write function - return bytes written, -1 for error */
+    int (*write)(void* context, const void* data, size_t count);
+    void* context;
+} rtf_writer;
+
+/* Paragraph - a span of the plain text and the runs in it */
+typedef struct rtf_paragraph {
+    size_t text_offset;  /* Byte offset into rtf_get_text() */
+    size_t text_length;  /* Bytes, excluding the break that ends it */
+    size_t first_run;    /* Index of the first run (see rtf_get_run) */
+    size_t run_count;    /* Number of runs in the paragraph */
+} rtf_paragraph;
+
+/* Byte range [start, end) of the RTF input - see rtf_get_run_source() */
+typedef struct rtf_source_range {
+    size_t start;
+    size_t end;
+} rtf_source_range;
+
+/* "No such position" result of the offset lookups */
+#define RTF_NPOS ((size_t)-1)
+
 /* Result codes - simple like SQLite */
 #define RTF_OK          0
 #define RTF_ERROR       1
@@ -97,6 +176,34 @@ typedef struct rtf_reader {
  */
 rtf_document* rtf_parse(const void* data, size_t length);
 
+/* Parse flags for rtf_parse_ex() */
+#define RTF_PARSE_SOURCE_MAP  0x01  /* Record input byte ranges (SOURCE MAP) */
+
+/*
+ * Parse RTF from memory buffer with RTF_PARSE_* flags.
+ * rtf_parse_ex(data, length, 0) is the same as rtf_parse().
+ * 
+ * Thread-safe. Can be called from any thread.
+ */
+rtf_document* rtf_parse_ex(const void* data, size_t length, unsigned flags);
+
+/*
+ * Parse only the start of a document: the first 'max_chars' characters of
+ * visible text or the first 'max_paragraphs' paragraphs (table rows count
+ * as paragraphs), whichever comes first; 0 means no limit. Formatting,
+ * fonts and colors are as in a full parse. The rest of the input, trailing
+ * tables and images included, is not read, so previews of large documents
+ * cost no more than previews of small ones.
+ * 
+ * *truncated, if not NULL, is set to 1 if anything was left unread, 0 if
+ * the whole document fit.
+ * Returns NULL on error (check rtf_errmsg() for details).
+ * 
+ * Thread-safe. Can be called from any thread.
+ */
+rtf_document* rtf_parse_preview(const void* data, size_t length, size_t max_chars,
+                                size_t max_paragraphs, int* truncated);
+
 /*
  * Parse RTF from reader stream.
  * 
@@ -109,16 +216,52 @@ rtf_document* rtf_parse_stream(rtf_reader* reader);
 
 /*
  * Free document and all associated memory.
+ * For documents shared through a parse cache this releases the caller's
+ * reference; memory is freed with the last reference.
  * Safe to call with NULL pointer.
  * 
  * Thread-safe. Document can be freed from any thread.
  */
 void rtf_free(rtf_document* doc);
 
+/*
+ * ============================================================================
+ * SHARED OWNERSHIP
+ * ============================================================================
+ */
+
+/*
+ * Take an additional reference to a document.
+ * 
+ * Documents are immutable once returned by a parse function and carry an
+ * atomic reference count starting at one. Share a document between
+ * threads by retaining it once per owner; each owner calls rtf_release()
+ * (or rtf_free()) when done, and the last one frees the memory.
+ * Returns 'doc' for convenience; NULL stays NULL.
+ * 
+ * Thread-safe. Lock-free.
+ */
+rtf_document* rtf_retain(rtf_document* doc);
+
+/*
+ * Drop a reference taken by a parse function or rtf_retain().
+ * Same as rtf_free(). Safe to call with NULL pointer.
+ * 
+ * Thread-safe. Lock-free.
+ */
+void rtf_release(rtf_document* doc);
+
 /*
  * ============================================================================
  * DOCUMENT ACCESS
  * ============================================================================
+ *
+ * All views below are built when the document is created and never change
+ * afterwards, so every rtf_get_* and rtf_table_* accessor is wait-free:
+ * any number of threads holding a reference may call them concurrently
+ * without locks. Only the thread-local rtf_errmsg() state is written.
+ * The one lazy view - text of table cells with several runs - is built
+ * by the first rtf_table_get_cell_text() call and published atomically.
  */
 
 /*
@@ -155,6 +298,49 @@ size_t rtf_get_run_count(rtf_document* doc);
  */
 const rtf_run* rtf_get_run(rtf_document* doc, size_t index);
 
+/*
+ * Copy up to `count` runs, starting at run `start`, into `out`. Returns the
+ * number copied: fewer than `count` at the end of the document, 0 past it.
+ * Text and font name pointers still point into the document.
+ * 
+ * Thread-safe.
+ */
+size_t rtf_get_runs(rtf_document* doc, size_t start, size_t count, rtf_run* out);
+
+/*
+ * Get all runs at once: the document's own run array, rtf_get_run() order,
+ * with the number of runs stored in *count. Bindings can map it in one
+ * call (a ctypes array, a direct buffer, a slice) instead of calling
+ * rtf_get_run() per run. NULL if there are none.
+ * 
+ * The array is immutable and valid until rtf_free().
+ * 
+ * Thread-safe.
+ */
+const rtf_run* rtf_get_runs_ptr(rtf_document* doc, size_t* count);
+
+/*
+ * Get all runs in the compact layout, rtf_get_run() order, with the number
+ * of runs stored in *count. Half the size of rtf_run and free of pointers,
+ * so the array can be copied or mapped as is. NULL if there are none.
+ * 
+ * The array is immutable and valid until rtf_free().
+ * 
+ * Thread-safe.
+ */
+const rtf_run_v2* rtf_get_runs_v2(rtf_document* doc, size_t* count);
+
+/*
+ * Get the document's style table, which rtf_run_v2.style indexes, with the
+ * number of styles stored in *count. Styles are numbered in order of first
+ * use. NULL if there are none.
+ * 
+ * The array is immutable and valid until rtf_free().
+ * 
+ * Thread-safe.
+ */
+const rtf_style* rtf_get_styles(rtf_document* doc, size_t* count);
+
 /*
  * Get number of images in document.
  * 
@@ -172,6 +358,16 @@ size_t rtf_get_image_count(rtf_document* doc);
  */
 const rtf_image* rtf_get_image(rtf_document* doc, size_t index);
 
+/*
+ * Get all images at once: the document's own image array, rtf_get_image()
+ * order, with the number of images stored in *count. NULL if there are none.
+ * 
+ * The array is immutable and valid until rtf_free().
+ * 
+ * Thread-safe.
+ */
+const rtf_image* rtf_get_images_ptr(rtf_document* doc, size_t* count);
+
 /*
  * Get number of tables in document.
  * 
@@ -208,8 +404,10 @@ size_t rtf_table_get_cell_count(const struct rtf_table* table, size_t row_index)
  * 
  * Returns plain text content of the cell, NULL if invalid indices.
  * Returned pointer valid until rtf_free().
+ * Cells with a single run return the run's text without copying; text of
+ * multi-run cells is joined for the whole table on first request.
  * 
- * Thread-safe for read access.
+ * Thread-safe for read access. Lock-free.
  */
 const char* rtf_table_get_cell_text(const struct rtf_table* table, size_t row_index, size_t cell_index);
 
@@ -220,6 +418,128 @@ const char* rtf_table_get_cell_text(const struct rtf_table* table, size_t row_in
  */
 uint32_t rtf_table_get_cell_width(const struct rtf_table* table, size_t row_index, size_t cell_index);
 
+/*
+ * ============================================================================
+ * TEXT POSITIONS
+ * ============================================================================
+ *
+ * Offsets are byte offsets into rtf_get_text(). The index is built with
+ * the document, so lookups are O(log n) binary searches - use them to find
+ * what is on screen without walking runs from the start.
+ *
+ * Paragraphs end at paragraph and page breaks; each table row is a
+ * paragraph of its own, with cells separated by tabs.
+ */
+
+/*
+ * Get the text offset of a run.
+ * Returns RTF_NPOS if index >= rtf_get_run_count().
+ * 
+ * Thread-safe.
+ */
+size_t rtf_get_run_offset(rtf_document* doc, size_t index);
+
+/*
+ * Find the run at a text offset: the last run starting at or before it.
+ * Offsets in breaks or cell separators resolve to the run before them.
+ * Returns RTF_NPOS past the end of the text.
+ * 
+ * Thread-safe.
+ */
+size_t rtf_find_run_at(rtf_document* doc, size_t char_offset);
+
+/*
+ * Find the runs overlapping the text range [start, end).
+ * Returns the number of runs and stores the first one's index in
+ * *first_run (may be NULL). Runs are contiguous in rtf_get_run order.
+ * 
+ * Thread-safe.
+ */
+size_t rtf_get_runs_in_range(rtf_document* doc, size_t start, size_t end, size_t* first_run);
+
+/*
+ * Get number of paragraphs in document.
+ * 
+ * Thread-safe.
+ */
+size_t rtf_get_paragraph_count(rtf_document* doc);
+
+/*
+ * Get paragraph by index.
+ * 
+ * Returns NULL if index >= rtf_get_paragraph_count().
+ * Returned pointer valid until rtf_free().
+ * 
+ * Thread-safe.
+ */
+const rtf_paragraph* rtf_get_paragraph(rtf_document* doc, size_t index);
+
+/*
+ * Find the paragraph containing a text offset (or the one before a break).
+ * Returns RTF_NPOS past the end of the text.
+ * 
+ * Thread-safe.
+ */
+size_t rtf_find_paragraph_at(rtf_document* doc, size_t char_offset);
+
+/*
+ * Get the text offset where a table starts.
+ * 
+ * Thread-safe.
+ */
+size_t rtf_table_get_text_offset(const struct rtf_table* table);
+
+/*
+ * ============================================================================
+ * SOURCE MAP
+ * ============================================================================
+ *
+ * Documents parsed with RTF_PARSE_SOURCE_MAP remember which bytes of the
+ * input each run, table, table cell and image came from, so callers can
+ * patch or highlight the original RTF without parsing it again. Ranges are
+ * stored delta-encoded (a few bytes per entry) and decoded on lookup.
+ *
+ * All functions return RTF_OK and fill *range, or RTF_INVALID when the
+ * document has no source map or the index is out of bounds.
+ */
+
+/*
+ * Input range of a run: its text, escapes included, without the
+ * formatting control words before it.
+ * 
+ * Thread-safe.
+ */
+int rtf_get_run_source(rtf_document* doc, size_t index, rtf_source_range* range);
+
+/*
+ * Input range of a paragraph, from its first run to its last.
+ * Paragraphs without text have none.
+ * 
+ * Thread-safe.
+ */
+int rtf_get_paragraph_source(rtf_document* doc, size_t index, rtf_source_range* range);
+
+/*
+ * Input range of an image: the whole {\pict ...} or {\object ...} group.
+ * 
+ * Thread-safe.
+ */
+int rtf_get_image_source(rtf_document* doc, size_t index, rtf_source_range* range);
+
+/*
+ * Input range of a table, from the first \trowd to the last \row.
+ * 
+ * Thread-safe.
+ */
+int rtf_table_get_source(const struct rtf_table* table, rtf_source_range* range);
+
+/*
+ * Input range of a cell's content, up to and including its \cell.
+ * 
+ * Thread-safe.
+ */
+int rtf_table_get_cell_source(const struct rtf_table* table, size_t row_index, size_t cell_index, rtf_source_range* range);
+
 /*
  * ============================================================================
  * RTF GENERATION
@@ -244,6 +564,632 @@ char* rtf_generate(rtf_document* doc);
  */
 void rtf_free_string(char* rtf_string);
 
+/*
+ * ============================================================================
+ * PARSE CONTEXTS
+ * ============================================================================
+ */
+
+/* Opaque parser context handle */
+typedef struct rtf_context rtf_context;
+
+/*
+ * Create a reusable parser context.
+ * 
+ * A context keeps parser stacks and scratch buffers between documents, and
+ * documents parsed with it return their storage to it when freed. Use one
+ * for workloads with many small documents, where per-document setup and
+ * teardown would otherwise dominate.
+ * Returns NULL on error.
+ */
+rtf_context* rtf_context_new(void);
+
+/*
+ * Free the context. Documents parsed with it stay valid until their own
+ * rtf_free() - the context's memory goes with the last of them.
+ * Safe to call with NULL pointer.
+ */
+void rtf_context_free(rtf_context* ctx);
+
+/*
+ * Parse RTF from memory using a context.
+ * 
+ * Same result as rtf_parse(); a NULL context behaves like rtf_parse().
+ * 
+ * Not thread-safe per context: use one context per parsing thread.
+ * Documents may still be used and freed from any thread.
+ */
+rtf_document* rtf_parse_with(rtf_context* ctx, const void* data, size_t length);
+
+/*
+ * ============================================================================
+ * CHECKPOINTS
+ * ============================================================================
+ *
+ * For paging through huge documents. A checkpointed parse records the
+ * parser state (group depth, formatting and destination stacks, table
+ * state) every 'interval' bytes of input; rtf_parse_range() then resumes
+ * from the nearest checkpoint instead of parsing from byte 0.
+ */
+
+/* Opaque checkpoint set */
+typedef struct rtf_checkpoints rtf_checkpoints;
+
+/*
+ * Parse RTF from memory buffer, recording a checkpoint about every
+ * 'interval' bytes (0 = 64KB) into *checkpoints.
+ * 
+ * Returns NULL on error (check rtf_errmsg() for details), and then
+ * *checkpoints is NULL too. The checkpoints are independent of the
+ * document: free them with rtf_checkpoints_free().
+ * 
+ * Thread-safe. Can be called from any thread.
+ */
+rtf_document* rtf_parse_checkpointed(const void* data, size_t length, size_t interval,
+                                     rtf_checkpoints** checkpoints);
+
+/*
+ * Parse only bytes [start, end) of the same input, with the formatting,
+ * fonts and colors in effect there.
+ * 
+ * Parsing resumes at the last checkpoint at or before 'start' and stops at
+ * the first token boundary at or after 'end', closing open tables and runs
+ * as if the input ended there. Use checkpoint offsets as page boundaries
+ * for exact, non-overlapping pages.
+ * Returns NULL on error, or if 'data' is not the checkpointed input.
+ * 
+ * Thread-safe. Checkpoints can be shared by concurrent range parses.
+ */
+rtf_document* rtf_parse_range(const void* data, size_t length, const rtf_checkpoints* checkpoints,
+                              size_t start, size_t end);
+
+/*
+ * Number of checkpoints, and the input offset of each.
+ * rtf_checkpoint_offset() returns RTF_NPOS if index is out of bounds.
+ * 
+ * Thread-safe.
+ */
+size_t rtf_checkpoints_count(const rtf_checkpoints* checkpoints);
+size_t rtf_checkpoint_offset(const rtf_checkpoints* checkpoints, size_t index);
+
+/*
+ * Free checkpoints. Safe to call with NULL pointer.
+ */
+void rtf_checkpoints_free(rtf_checkpoints* checkpoints);
+
+/*
+ * Update a checkpointed document after an edit of its input. 'data' is the
+ * whole new input, in which bytes [edit_start, edit_end) of the old input
+ * were replaced by 'inserted_length' bytes at edit_start.
+ * 
+ * Only the neighbourhood of the edit is parsed again: from the checkpoint
+ * before it until the parser is back in the state it had at a later
+ * checkpoint, after which the old content is kept (with source ranges
+ * shifted). Edits near the start fall back to a full parse. The document
+ * and the checkpoints are updated in place and must come from
+ * rtf_parse_checkpointed() on the old input.
+ * 
+ * Replaced content is not freed right away: it is kept until it makes up
+ * half of the document's memory, and then the whole input is parsed again.
+ * A document under repeated edits thus uses up to about twice the memory
+ * of a freshly parsed one.
+ * 
+ * Returns RTF_OK on success. On failure the content is unchanged.
+ * Run, table, image and text pointers obtained from the document before
+ * the call are invalid afterwards, whatever the result.
+ * 
+ * Not thread-safe: the document must not be shared (rtf_retain, parse
+ * cache) - shared documents are rejected with RTF_INVALID.
+ */
+int rtf_reparse_edit(rtf_document* doc, rtf_checkpoints* checkpoints,
+                     const void* data, size_t length,
+                     size_t edit_start, size_t edit_end, size_t inserted_length);
+
+/*
+ * ============================================================================
+ * EDITING
+ * ============================================================================
+ *
+ * Documents are immutable; an editor is an editable copy of one. Text is
+ * kept in a piece table, so edits cost O(log n) in the number of pieces
+ * however large the document is.
+ *
+ * Offsets are bytes into the editor text (rtf_editor_get_text), where every
+ * break is one byte as in Word: '\n' ends a paragraph, 0x0B is a line break
+ * and 0x0C a page break. Tables, images and hyperlinks are kept whole, each
+ * as a single 0x01 byte.
+ *
+ * Editing functions return RTF_OK, RTF_INVALID (bad offset or text, see
+ * rtf_errmsg) or RTF_NOMEM, and leave the editor unchanged on failure.
+ * An editor must not be used from several threads at once.
+ */
+
+/* Opaque editor handle */
+typedef struct rtf_editor rtf_editor;
+
+/* Character styles for rtf_editor_set_style() */
+#define RTF_STYLE_BOLD           0x01
+#define RTF_STYLE_ITALIC         0x02
+#define RTF_STYLE_UNDERLINE      0x04
+#define RTF_STYLE_STRIKETHROUGH  0x08
+#define RTF_STYLE_SUPERSCRIPT    0x10
+#define RTF_STYLE_SUBSCRIPT      0x20
+
+/*
+ * Create an editor holding a copy of 'doc'. The document can be freed
+ * afterwards. Returns NULL on error.
+ */
+rtf_editor* rtf_editor_new(rtf_document* doc);
+
+/*
+ * Free editor. Safe to call with NULL pointer.
+ */
+void rtf_editor_free(rtf_editor* editor);
+
+/*
+ * Length and contents of the editor text. The text must be freed with
+ * rtf_free_string().
+ */
+size_t rtf_editor_length(const rtf_editor* editor);
+char* rtf_editor_get_text(const rtf_editor* editor);
+
+/*
+ * Insert 'length' bytes of text at 'offset', formatted like the text before
+ * it. Breaks in the text ('\n', 0x0B, 0x0C) become paragraph, line and page
+ * breaks; 0x01 is rejected.
+ */
+int rtf_editor_insert_text(rtf_editor* editor, size_t offset, const char* text, size_t length);
+
+/*
+ * Delete [start, end).
+ */
+int rtf_editor_delete(rtf_editor* editor, size_t start, size_t end);
+
+/*
+ * Turn the RTF_STYLE_* flags in 'set' on and those in 'clear' off for
+ * [start, end). Other formatting is kept. rtf_editor_clear_format()
+ * resets all character formatting of the range instead.
+ */
+int rtf_editor_set_style(rtf_editor* editor, size_t start, size_t end, unsigned set, unsigned clear);
+int rtf_editor_clear_format(rtf_editor* editor, size_t start, size_t end);
+
+/*
+ * Insert a paragraph break at 'offset'.
+ */
+int rtf_editor_insert_paragraph(rtf_editor* editor, size_t offset);
+
+/*
+ * Offset of the 0x01 byte standing for the table_index'th table, or
+ * RTF_NPOS. O(n) in the number of pieces.
+ */
+size_t rtf_editor_table_offset(const rtf_editor* editor, size_t table_index);
+
+/*
+ * Insert a row of 'cell_count' cells before row 'row_index' (or append it,
+ * at the row count) of the table at 'table_offset'. Cell widths are taken
+ * from the row above, or the row below for a new first row.
+ */
+int rtf_editor_insert_table_row(rtf_editor* editor, size_t table_offset, size_t row_index,
+                                const char* const* cells, size_t cell_count);
+
+/*
+ * Snapshot the current state as a new document, for the rtf_get_* accessors.
+ * The document is independent of the editor. Returns NULL on error.
+ */
+rtf_document* rtf_editor_to_document(const rtf_editor* editor);
+
+/*
+ * Generate RTF from the current state. Free with rtf_free_string().
+ * Returns NULL on error.
+ */
+char* rtf_editor_generate(const rtf_editor* editor);
+
+/*
+ * Write RTF for the current state to `writer`, copying from `original` -
+ * the input the editor's document was parsed from, parsed with
+ * RTF_PARSE_SOURCE_MAP - everything edits did not touch. The header (font
+ * and color tables, stylesheet, info), the end of the input and every
+ * top-level paragraph or table whose content is unchanged are passed to
+ * the writer byte for byte, including control words this library does not
+ * understand. Only edited paragraphs are serialized again. The writer gets
+ * slices of `original` directly, so a writer backed by a file descriptor
+ * and an mmap of the input writes them without another copy.
+ * 
+ * Without a source map `original` is ignored (it may be NULL) and the
+ * output is that of rtf_editor_generate().
+ * Returns RTF_OK, or RTF_INVALID if `original` is shorter than the input
+ * the source map describes.
+ */
+int rtf_editor_write(const rtf_editor* editor, const void* original, size_t length, rtf_writer* writer);
+
+/*
+ * ============================================================================
+ * DIFF
+ * ============================================================================
+ */
+
+typedef enum rtf_diff_kind {
+    RTF_DIFF_INSERT = 1,  /* b_start..b_end was inserted at a_start */
+    RTF_DIFF_DELETE = 2,  /* a_start..a_end was deleted, at b_start in b */
+    RTF_DIFF_FORMAT = 3   /* Same text, formatted differently */
+} rtf_diff_kind;
+
+/* One change - offsets are into rtf_get_text() of each document */
+typedef struct rtf_diff_change {
+    rtf_diff_kind kind;
+    size_t a_start;
+    size_t a_end;
+    size_t b_start;
+    size_t b_end;
+} rtf_diff_change;
+
+/* Return 0 to continue, anything else to stop */
+typedef int (*rtf_diff_callback)(void* context, const rtf_diff_change* change);
+
+/*
+ * Compare two documents, calling 'callback' for each inserted, deleted or
+ * reformatted stretch of text, in document order. Adjacent changes of the
+ * same kind are merged.
+ *
+ * Paragraphs are matched by hash first and only changed paragraphs are
+ * compared character by character, so mostly similar documents diff in
+ * near-linear time. Heavily rewritten paragraphs are reported as a whole
+ * deletion and insertion.
+ *
+ * Returns RTF_OK, RTF_ERROR if the callback stopped the diff, or
+ * RTF_INVALID / RTF_NOMEM.
+ *
+ * Thread-safe.
+ */
+int rtf_diff(rtf_document* a, rtf_document* b, rtf_diff_callback callback, void* context);
+
+/*
+ * ============================================================================
+ * EXPORT
+ * ============================================================================
+ */
+
+/* Export flags */
+#define RTF_JSON_LINES 0x1  /* One record per line (JSON Lines) */
+
+/*
+ * Write the document as JSON to `writer` in one call: fonts, colors, then
+ * paragraphs (with their runs, links, line breaks and image metadata),
+ * tables and page breaks in document order. Each is one record, e.g.
+ * 
+ *   {"type":"paragraph","index":0,"runs":[{"text":"Hi","bold":true}]}
+ * 
+ * With RTF_JSON_LINES every record is written on its own line; otherwise
+ * the output is {"fonts":[...],"colors":[...],"blocks":[...]}. Formatting
+ * keys only appear when set. Output is buffered, so the writer sees few
+ * large writes.
+ * 
+ * Returns RTF_OK, RTF_ERROR if the writer fails, RTF_NOMEM.
+ * 
+ * Thread-safe.
+ */
+int rtf_export_json(rtf_document* doc, rtf_writer* writer, unsigned flags);
+
+/*
+ * Parse `data` and export it as rtf_export_json() does, without creating
+ * an rtf_document - for pipelines that only want the JSON.
+ * 
+ * Thread-safe.
+ */
+int rtf_export_json_input(const void* data, size_t length, rtf_writer* writer, unsigned flags);
+
+/* Conversion flags */
+#define RTF_CONVERT_IMAGE_REFS 0x1  /* Reference images as image<N>.<ext> */
+
+/*
+ * Parse `data` and write it to `writer` as an HTML fragment: a <p> per
+ * paragraph, <b>, <i>, <u>, <s>, <sup>, <sub> and styled <span>s where the
+ * formatting changes, <br> for line breaks, <table> for tables and <hr>
+ * for page breaks. Hyperlinks are written as their display text. Text is
+ * escaped for HTML and written as UTF-8.
+ * 
+ * Images are embedded as data: URIs. With RTF_CONVERT_IMAGE_REFS they are
+ * referenced as image0.png, image1.jpg, ... instead, numbered in document
+ * order, for callers that store them separately.
+ * 
+ * The input is parsed whole before anything is written, so memory use is
+ * proportional to the document, as for rtf_parse(). No rtf_document handle
+ * is created and nothing is kept once the call returns. Output is
+ * buffered, so the writer sees few large writes.
+ * 
+ * Returns RTF_OK, RTF_ERROR if parsing or the writer fails, RTF_NOMEM.
+ * 
+ * Thread-safe.
+ */
+int rtf_to_html(const void* data, size_t length, rtf_writer* writer, unsigned flags);
+
+/*
+ * As rtf_to_html(), but writes Markdown: **bold**, *italic*, ~~struck~~,
+ * ![](images) and pipe tables whose first row is the header. Underline, superscript and subscript use inline HTML; fonts,
+ * colors and paragraph layout are dropped.
+ * 
+ * Thread-safe.
+ */
+int rtf_to_markdown(const void* data, size_t length, rtf_writer* writer, unsigned flags);
+
+/* Table export flags */
+#define RTF_CSV_TSV 0x1                /* Tab-separated instead of commas */
+#define RTF_ALL_TABLES ((size_t)-1)    /* Every table, not just one */
+
+/*
+ * Parse `data` and write the rows of its tables to `writer` as CSV: one
+ * line per row, one field per cell. Fields containing the separator, a
+ * quote or a line break are quoted with quotes doubled (RFC 4180).
+ * 
+ * `table` picks one table by index in document order (as rtf_get_table()
+ * counts them), or RTF_ALL_TABLES for all of them separated by empty lines.
+ * 
+ * Each row is written as soon as the parser has finished it and then
+ * dropped, so memory does not grow with the size of the tables.
+ * 
+ * Returns RTF_OK, or RTF_ERROR if parsing or the writer fails.
+ * 
+ * Thread-safe.
+ */
+int rtf_tables_to_csv(const void* data, size_t length, rtf_writer* writer, unsigned flags, size_t table);
+
+/*
+ * Write the runs of `count` documents to `writer` as an Arrow IPC stream,
+ * which DuckDB, Polars and pyarrow read directly. One row per run, in
+ * rtf_get_run() order, with columns
+ * 
+ *   doc_id (uint32, index into docs), text (utf8), style_id (uint32, equal
+ *   for equal character formatting), bold, italic, underline (bool),
+ *   font_id (uint16, null if unset), font_size (uint16, half-points),
+ *   color_rgb (uint32 0xRRGGBB, null for auto), paragraph (uint32, as
+ *   rtf_get_paragraph() numbers them), alignment (uint8, 0-3 as rtf_run)
+ * 
+ * Rows are written in record batches of up to 65536. `flags` is reserved
+ * and must be 0.
+ * 
+ * Returns RTF_OK, RTF_ERROR if the writer fails, RTF_NOMEM, or
+ * RTF_INVALID for null arguments or unknown flags.
+ * 
+ * Thread-safe.
+ */
+int rtf_export_arrow(rtf_document* const* docs, size_t count, rtf_writer* writer, unsigned flags);
+
+/*
+ * ============================================================================
+ * SEARCH
+ * ============================================================================
+ */
+
+/* Search flags */
+#define RTF_SEARCH_IGNORE_CASE 0x1  /* ASCII letters match either case */
+#define RTF_SEARCH_LINES 0x2        /* `pattern` holds one pattern per line */
+
+/* One match */
+typedef struct rtf_search_hit {
+    const char* text;      /* Matched text as decoded (not NUL-terminated) */
+    size_t text_length;
+    size_t text_offset;    /* In the visible text */
+    size_t start;          /* Input bytes the match was decoded from */
+    size_t end;
+    size_t pattern;        /* Which pattern, counting lines for RTF_SEARCH_LINES */
+} rtf_search_hit;
+
+/* Return 0 to continue, anything else to stop */
+typedef int (*rtf_search_callback)(void* context, const rtf_search_hit* hit);
+
+/*
+ * Find `pattern` (a NUL-terminated UTF-8 literal) in the visible text of
+ * `data` without parsing it into a document, calling 'callback' for each
+ * match in text order. With RTF_SEARCH_LINES each non-empty line of
+ * `pattern` is a pattern of its own; the longest one matching at a
+ * position wins and matches do not overlap.
+ * 
+ * Text is decoded as it is read: \'xx (Windows-1252 unless \ansicpg says
+ * otherwise), \uN and the special-character control words, with font and
+ * color tables, pictures, field instructions, headers, footers and {\*...}
+ * groups skipped. A match may cross control words that display nothing,
+ * so "Re\b port" matches "Report". Paragraph and line breaks read as "\n"
+ * and cells and tabs as "\t". The hit's text is valid during the call.
+ * 
+ * Memory use does not depend on the input size.
+ * 
+ * Returns RTF_OK, RTF_ERROR if the callback stopped the search,
+ * RTF_INVALID for bad input or an empty pattern, RTF_NOMEM.
+ * 
+ * Thread-safe.
+ */
+int rtf_search(const void* data, size_t length, const char* pattern, unsigned flags,
+               rtf_search_callback callback, void* context);
+
+/*
+ * ============================================================================
+ * STATISTICS
+ * ============================================================================
+ */
+
+typedef struct rtf_counts {
+    size_t characters;                 /* Visible characters, breaks excluded */
+    size_t characters_without_spaces;
+    size_t words;
+    size_t paragraphs;                 /* Holding text other than spaces, cells included */
+    size_t page_breaks;
+    size_t tables;
+    size_t rows;
+    size_t cells;
+    size_t images;
+    size_t objects;                    /* Embedded or linked OLE objects */
+    size_t fonts;                      /* Distinct fonts used by the text */
+    size_t colors;                     /* Distinct text colors, auto excluded */
+} rtf_counts;
+
+/*
+ * Count the characters, words, paragraphs, tables, rows, cells, images,
+ * objects and the distinct fonts and colors of `data` in one pass, without
+ * parsing it into a document. The visible text is read as rtf_search()
+ * reads it. Characters are Unicode code points. Words are separated by
+ * spaces, tabs and breaks.
+ * 
+ * Memory use is fixed, whatever the input size.
+ * 
+ * Returns RTF_OK, or RTF_INVALID for bad input.
+ * 
+ * Thread-safe.
+ */
+int rtf_count(const void* data, size_t length, rtf_counts* counts);
+
+/*
+ * ============================================================================
+ * HEADER PROBE
+ * ============================================================================
+ */
+
+#define RTF_COLOR_AUTO 0xFFFFFFFFu   /* Color table entry without components */
+
+typedef struct rtf_time {
+    uint16_t year;                     /* All zero when not given */
+    uint8_t  month;
+    uint8_t  day;
+    uint8_t  hour;
+    uint8_t  minute;
+    uint8_t  second;
+    uint8_t  reserved;
+} rtf_time;
+
+typedef struct rtf_probe_font {
+    const char* name;
+    uint16_t    id;                    /* \fN */
+    uint8_t     family;                /* 0 unknown, 1 roman, 2 swiss, 3 modern, 4 script, 5 decorative */
+    uint8_t     charset;               /* \fcharsetN */
+} rtf_probe_font;
+
+typedef struct rtf_probe_info {
+    uint32_t    version;               /* \rtfN */
+    uint32_t    code_page;             /* \ansicpgN, 0 if not given */
+    int32_t     default_font;          /* \deffN, -1 if not given */
+    const char* charset;               /* "ansi", "mac", "pc" or "pca" */
+    const rtf_probe_font* fonts;       /* In font table order */
+    size_t      font_count;
+    const uint32_t* colors;            /* 0xRRGGBB or RTF_COLOR_AUTO, by color number */
+    size_t      color_count;
+    
+    /* \info - zero-terminated UTF-8, "" when not given */
+    const char* title;
+    const char* subject;
+    const char* author;
+    const char* manager;
+    const char* company;
+    const char* last_author;           /* \operator */
+    const char* category;
+    const char* keywords;
+    const char* comment;
+    rtf_time    created;
+    rtf_time    revised;
+    rtf_time    printed;
+    int64_t     pages;                 /* As last saved, -1 when not given */
+    int64_t     words;
+    int64_t     characters;
+    int64_t     characters_with_spaces;
+    int64_t     editing_minutes;
+    
+    size_t      header_length;         /* Input bytes before the body */
+    void*       storage;               /* Internal, released by rtf_probe_free() */
+} rtf_probe_info;
+
+/*
+ * Read the header of `data` - version, character set, code page, default
+ * font, font and color tables and the \info group (title, author, company,
+ * dates, page and word counts) - and stop at the first body content. The
+ * rest of the document, images and tables included, is never read, so
+ * this takes about as long for a 100MB document as for a 1KB one.
+ * 
+ * Release `info` with rtf_probe_free(). On error only `storage` is set (to
+ * NULL), so rtf_probe_free() is a no-op and the other fields are undefined.
+ * 
+ * Returns RTF_OK, RTF_NOMEM, or RTF_INVALID for bad input.
+ * 
+ * Thread-safe.
+ */
+int rtf_probe(const void* data, size_t length, rtf_probe_info* info);
+
+/* Release the names, fonts and colors of a probe. Safe to call twice. */
+void rtf_probe_free(rtf_probe_info* info);
+
+/*
+ * ============================================================================
+ * PARSE CACHE
+ * ============================================================================
+ */
+
+/* Opaque cache handle */
+typedef struct rtf_cache rtf_cache;
+
+/*
+ * Create a parse cache holding at most 'max_bytes' of parsed documents.
+ * Any document up to 'max_bytes' is cached; larger ones are returned
+ * uncached.
+ * 
+ * Documents are keyed by a hash of their RTF input and evicted least
+ * recently used first. The cache is sharded - lookups of different
+ * inputs from different threads rarely contend.
+ * Returns NULL on error.
+ */
+rtf_cache* rtf_cache_new(size_t max_bytes);
+
+/*
+ * Free the cache. Documents still held by callers stay valid until
+ * their own rtf_free().
+ * Safe to call with NULL pointer.
+ */
+void rtf_cache_free(rtf_cache* cache);
+
+/*
+ * Parse RTF through the cache.
+ * 
+ * Returns the shared document if the same input was parsed before,
+ * otherwise parses it and caches the result. Cached documents are
+ * compacted into a single allocation. The returned document is
+ * immutable and may be shared with other callers - release it with
+ * rtf_free() as usual. A NULL cache behaves like rtf_parse().
+ * 
+ * Thread-safe.
+ */
+rtf_document* rtf_parse_cached(rtf_cache* cache, const void* data, size_t length);
+
+/*
+ * ============================================================================
+ * SNAPSHOTS
+ * ============================================================================
+ */
+
+/*
+ * Save a binary snapshot of the parsed document.
+ * 
+ * Snapshots are versioned and position-independent: text, fonts, colors,
+ * interned formats, runs, tables and images are stored as flat records
+ * with offsets, so rtf_document_load_mmap() can use them in place.
+ * Snapshots are a cache format, not an interchange format: each records
+ * its snapshot format version, and only snapshots of the format version
+ * this library writes can be loaded.
+ * 
+ * Returns RTF_OK on success, RTF_ERROR / RTF_NOMEM / RTF_INVALID on failure.
+ * 
+ * Thread-safe.
+ */
+int rtf_document_save(rtf_document* doc, rtf_writer* writer);
+
+/*
+ * Load a snapshot written by rtf_document_save().
+ * 
+ * The file is memory-mapped read-only and used in place - no RTF parsing.
+ * All accessors work as for a parsed document; text and image pointers
+ * point into the mapping, which stays alive until rtf_free().
+ * Returns NULL on error (bad file, corrupt snapshot, or one of another
+ * snapshot format version).
+ * 
+ * Thread-safe.
+ */
+rtf_document* rtf_document_load_mmap(const char* path);
+
 /*
  * ============================================================================
  * ERROR HANDLING
@@ -1,6 +1,21 @@
 const std = @import("std");
 const doc_model = @import("document_model.zig");
 const formatted_parser = @import("formatted_parser.zig");
+const snapshot = @import("snapshot.zig");
+const parse_cache = @import("parse_cache.zig");
+const text_index = @import("text_index.zig");
+const source_map = @import("source_map.zig");
+const reparse = @import("reparse.zig");
+const editing = @import("editor.zig");
+const doc_diff = @import("diff.zig");
+const json_export = @import("json_export.zig");
+const convert = @import("convert.zig");
+const csv_export = @import("csv_export.zig");
+const arrow_export = @import("arrow_export.zig");
+const text_search = @import("search.zig");
+const stats = @import("stats.zig");
+const header_probe = @import("probe.zig");
+const table_parsers = @import("table_parser.zig");
 
 // =============================================================================
 // REAL C API WITH FORMATTING SUPPORT
@@ -11,37 +26,121 @@ const formatted_parser = @import("formatted_parser.zig");
 threadlocal var g_error_msg: [512]u8 = undefined;
 threadlocal var g_has_error: bool = false;
 
+// Result codes (match c_api.h)
+const RTF_OK: c_int = 0;
+const RTF_ERROR: c_int = 1;
+const RTF_NOMEM: c_int = 2;
+const RTF_INVALID: c_int = 3;
+
+// Parse flags (match c_api.h)
+const RTF_PARSE_SOURCE_MAP: c_uint = 0x1;
+
+// Export flags (match c_api.h)
+const RTF_JSON_LINES: c_uint = 0x1;
+const RTF_CONVERT_IMAGE_REFS: c_uint = 0x1;
+const RTF_CSV_TSV: c_uint = 0x1;
+const RTF_ALL_TABLES: usize = std.math.maxInt(usize);
+
+// Search flags (match c_api.h)
+const RTF_SEARCH_IGNORE_CASE: c_uint = 0x1;
+const RTF_SEARCH_LINES: c_uint = 0x2;
+
 // Enhanced document structure
+// Text, run text and font names are borrowed from the document's own storage
+// (arena, block or snapshot mapping), and the C-facing arrays live in its
+// arena too, or at the end of the block of a cached document.
+// Every view is built in buildViews() and never changes after, so the
+// rtf_get_* accessors are plain loads and wait-free on shared documents.
 pub const EnhancedDocument = struct {
     document_ptr: *doc_model.Document,  // Store pointer, not value!
-    runs: []FormattedRun,
-    text: []const u8,
-    images: []ImageInfo,
-    tables: []TableInfo,
+    runs: []FormattedRun = &.{},
+    runs_v2: []RunV2 = &.{},
+    styles: []RunStyle = &.{},
+    text: [:0]const u8 = "",
+    images: []ImageInfo = &.{},
+    tables: []TableInfo = &.{},
+    index: text_index.TextIndex = .{ .runs = &.{}, .paragraphs = &.{}, .table_starts = &.{}, .text_len = 0 },
+    
+    // Shared ownership - rtf_free() drops one reference (see parse cache)
+    ref_count: std.atomic.Value(u32) = std.atomic.Value(u32).init(1),
+    
+    // Context the document returns to when released (rtf_parse_with)
+    context: ?*ParseContext = null,
+    
+    // Views and plain text rebuilt after edits (rtf_reparse_edit), reset on
+    // every rebuild so an editing session does not grow the document arena
+    edit_views: ?std.heap.ArenaAllocator = null,
+    
+    pub fn retain(self: *EnhancedDocument) void {
+        _ = self.ref_count.fetchAdd(1, .monotonic);
+    }
     
-    fn deinit(self: *EnhancedDocument, allocator: std.mem.Allocator) void {
-        allocator.free(self.runs);
-        allocator.free(self.text);
-        allocator.free(self.images);
+    // Drop a reference, destroying or recycling the document with the last one
+    pub fn release(self: *EnhancedDocument) void {
+        if (self.ref_count.fetchSub(1, .acq_rel) != 1) return;
         
-        // Free table text data
-        for (self.tables) |table| {
-            for (table.rows) |row| {
-                for (row.cells) |cell| {
-                    allocator.free(std.mem.span(cell.text));
-                }
-                allocator.free(row.cells);
-            }
-            allocator.free(table.rows);
+        if (self.context) |context| {
+            context.recycle(self);
+        } else {
+            self.destroy();
+        }
+    }
+    
+    // Approximate bytes held by the document, for cache budgets
+    pub fn memoryFootprint(self: *const EnhancedDocument) usize {
+        const document = self.document_ptr;
+        
+        var size: usize = @sizeOf(EnhancedDocument) + @sizeOf(doc_model.Document);
+        size += document.arena.queryCapacity(); // Text, runs and table views
+        if (document.mapping) |mapping| size += mapping.bytes.len;
+        if (document.block) |block| {
+            size += block.len; // The lists are views into it
+        } else {
+            size += document.content.capacity * @sizeOf(doc_model.ContentElement);
+            size += document.font_table.capacity * @sizeOf(doc_model.FontInfo);
+            size += document.color_table.capacity * @sizeOf(doc_model.ColorInfo);
         }
-        allocator.free(self.tables);
         
-        // Document will be deinitialized separately
+        return size;
+    }
+    
+    // Heap slots for a document and its views, filled in by the caller
+    fn createShell(allocator: std.mem.Allocator) !*EnhancedDocument {
+        const doc_ptr = try allocator.create(doc_model.Document);
+        errdefer allocator.destroy(doc_ptr);
+        
+        const enhanced = try allocator.create(EnhancedDocument);
+        enhanced.* = .{ .document_ptr = doc_ptr };
+        return enhanced;
+    }
+    
+    // Free cell strings joined on demand; the other views live in the arena
+    fn releaseViews(self: *EnhancedDocument) void {
+        for (self.tables) |*table| table.deinit();
+        self.tables = &.{};
+    }
+    
+    fn freeEditViews(self: *EnhancedDocument) void {
+        if (self.edit_views) |*arena| arena.deinit();
+        self.edit_views = null;
+    }
+    
+    fn destroy(self: *EnhancedDocument) void {
+        const allocator = std.heap.page_allocator;
+        
+        // The C views live in the document's arena and go with it
+        self.releaseViews();
+        self.freeEditViews();
+        self.document_ptr.deinit();
+        allocator.destroy(self.document_ptr);
+        allocator.destroy(self);
     }
 };
 
-// C-compatible formatted run structure
-const FormattedRun = struct {
+// C-compatible formatted run structure (rtf_run). Documents keep them in
+// one array, which rtf_get_runs_ptr() hands out as is, so the layout is
+// fixed: 64 bytes on 64-bit targets.
+const FormattedRun = extern struct {
     text: [*:0]const u8,
     length: usize,
     
@@ -71,8 +170,76 @@ const FormattedRun = struct {
     space_after: u16, // Twips
 };
 
+comptime {
+    if (@sizeOf(usize) == 8) {
+        std.debug.assert(@sizeOf(FormattedRun) == 64);
+        std.debug.assert(@offsetOf(FormattedRun, "font_id") == 22);
+        std.debug.assert(@offsetOf(FormattedRun, "font_name") == 32);
+        std.debug.assert(@offsetOf(FormattedRun, "left_indent") == 48);
+    }
+}
+
+// Compact run (rtf_run_v2), 32 bytes on every target. Text is an offset into
+// rtf_get_text(), and the formatting is a style id into the document's style
+// table plus the commonly read fields inline.
+const RunV2 = extern struct {
+    text_offset: u64, // Bytes into the document text
+    text_length: u32,
+    style: u32, // Index into rtf_get_styles()
+    paragraph: u32, // As rtf_get_paragraph() numbers them
+    flags: u16, // RTF_RUN_* bits
+    alignment: u8, // 0=left, 1=center, 2=right, 3=justify
+    reserved: u8 = 0,
+    font_id: u16,
+    font_size: u16, // Half-points
+    color_rgb: u32,
+};
+
+// One distinct character format (rtf_style), shared by the runs using it
+const RunStyle = extern struct {
+    font_name: [*:0]const u8,
+    color_rgb: u32,
+    font_id: u16,
+    font_size: u16, // Half-points
+    color_id: u16,
+    flags: u16, // RTF_RUN_* bits
+    reserved: u32 = 0,
+};
+
+// Run flag bits (match c_api.h)
+const RTF_RUN_BOLD: u16 = 0x1;
+const RTF_RUN_ITALIC: u16 = 0x2;
+const RTF_RUN_UNDERLINE: u16 = 0x4;
+const RTF_RUN_STRIKETHROUGH: u16 = 0x8;
+const RTF_RUN_SUPERSCRIPT: u16 = 0x10;
+const RTF_RUN_SUBSCRIPT: u16 = 0x20;
+
+comptime {
+    std.debug.assert(@sizeOf(RunV2) == 32);
+    std.debug.assert(@offsetOf(RunV2, "text_length") == 8);
+    std.debug.assert(@offsetOf(RunV2, "paragraph") == 16);
+    std.debug.assert(@offsetOf(RunV2, "flags") == 20);
+    std.debug.assert(@offsetOf(RunV2, "font_id") == 24);
+    std.debug.assert(@offsetOf(RunV2, "color_rgb") == 28);
+    if (@sizeOf(usize) == 8) {
+        std.debug.assert(@sizeOf(RunStyle) == 24);
+        std.debug.assert(@offsetOf(RunStyle, "flags") == 18);
+    }
+}
+
+fn runFlags(format: doc_model.CharFormat) u16 {
+    var flags: u16 = 0;
+    if (format.bold) flags |= RTF_RUN_BOLD;
+    if (format.italic) flags |= RTF_RUN_ITALIC;
+    if (format.underline) flags |= RTF_RUN_UNDERLINE;
+    if (format.strikethrough) flags |= RTF_RUN_STRIKETHROUGH;
+    if (format.superscript) flags |= RTF_RUN_SUPERSCRIPT;
+    if (format.subscript) flags |= RTF_RUN_SUBSCRIPT;
+    return flags;
+}
+
 // C-compatible image format enum
-const ImageFormat = enum(u8) {
+const ImageFormat = enum(c_int) {
     unknown = 0,
     wmf = 1,
     emf = 2,
@@ -81,8 +248,8 @@ const ImageFormat = enum(u8) {
     png = 5,
 };
 
-// C-compatible image structure
-const ImageInfo = struct {
+// C-compatible image structure (rtf_image), one array per document
+const ImageInfo = extern struct {
     format: ImageFormat,
     width: u32,
     height: u32,
@@ -90,23 +257,107 @@ const ImageInfo = struct {
     data_size: usize,
 };
 
-// C-compatible table structure
+// C-compatible table handle. Rows and cells are read straight from the flat
+// document table; zero-terminated text for multi-run cells is joined on the
+// first request and published atomically, so shared documents stay lock-free.
 const TableInfo = struct {
-    rows: []TableRowInfo,
-};
-
-const TableRowInfo = struct {
-    cells: []TableCellInfo,
-    height: u32,
+    table: *const doc_model.Table,
+    text_offset: usize = 0, // Where the table starts in the plain text
+    
+    // Position in the document's source map, when it has one
+    source: ?*const doc_model.SourceMap = null,
+    source_index: usize = 0,
+    first_source_cell: usize = 0,
+    joined: std.atomic.Value(?*JoinedCells) = std.atomic.Value(?*JoinedCells).init(null),
+    
+    // Index into table.cells, or null (with error set) when out of bounds
+    fn cellIndex(self: *const TableInfo, row_index: usize, cell_index: usize) ?usize {
+        if (row_index >= self.table.rowCount()) {
+            setError("Row index out of bounds");
+            return null;
+        }
+        
+        if (cell_index >= self.table.rowCells(row_index).len) {
+            setError("Cell index out of bounds");
+            return null;
+        }
+        
+        return self.table.rows.items[row_index].first_cell + cell_index;
+    }
+    
+    fn cellText(self: *TableInfo, index: usize) ?[*:0]const u8 {
+        // Empty and single-run cells need no copy - run text is zero-terminated
+        const runs = self.table.cellRuns(self.table.cells.items[index]);
+        switch (runs.len) {
+            0 => return "",
+            1 => return runs[0].text.ptr,
+            else => {},
+        }
+        
+        const joined = self.joined.load(.acquire) orelse self.join() orelse return null;
+        return @ptrCast(joined.text[joined.offsets[index]..].ptr);
+    }
+    
+    fn join(self: *TableInfo) ?*JoinedCells {
+        const built = JoinedCells.create(self.table.*) catch {
+            setError("Out of memory");
+            return null;
+        };
+        
+        // Another thread may have won the race - use its copy
+        if (self.joined.cmpxchgStrong(null, built, .acq_rel, .acquire)) |winner| {
+            built.destroy();
+            return winner.?;
+        }
+        return built;
+    }
+    
+    fn deinit(self: *TableInfo) void {
+        if (self.joined.load(.acquire)) |joined| joined.destroy();
+        self.joined.store(null, .release);
+    }
 };
 
-const TableCellInfo = struct {
-    text: [*:0]const u8,
-    width: u32,
-    border_left: bool,
-    border_right: bool,
-    border_top: bool,
-    border_bottom: bool,
+// Text of every cell of a table, each zero-terminated, in cell order
+const JoinedCells = struct {
+    text: []u8,
+    offsets: []u32,
+    
+    fn create(table: doc_model.Table) !*JoinedCells {
+        const allocator = std.heap.page_allocator;
+        
+        var size: usize = 0;
+        for (table.cells.items) |table_cell| {
+            for (table.cellRuns(table_cell)) |run| size += run.text.len;
+            size += 1;
+        }
+        
+        const joined = try allocator.create(JoinedCells);
+        errdefer allocator.destroy(joined);
+        joined.text = try allocator.alloc(u8, size);
+        errdefer allocator.free(joined.text);
+        joined.offsets = try allocator.alloc(u32, table.cells.items.len);
+        
+        var end: usize = 0;
+        for (table.cells.items, joined.offsets) |table_cell, *offset| {
+            offset.* = @intCast(end);
+            for (table.cellRuns(table_cell)) |run| {
+                @memcpy(joined.text[end..][0..run.text.len], run.text);
+                end += run.text.len;
+            }
+            joined.text[end] = 0;
+            end += 1;
+        }
+        
+        return joined;
+    }
+    
+    fn destroy(self: *JoinedCells) void {
+        const allocator = std.heap.page_allocator;
+        allocator.free(self.text);
+        allocator.free(self.offsets);
+        allocator.destroy(self);
+    }
 };
 
 // =============================================================================
@@ -147,10 +398,56 @@ pub export fn rtf_parse(data: [*]const u8, length: usize) ?*EnhancedDocument {
         return null;
     }
     
+    const document = parseDocument(data[0..length], .{}) orelse return null;
+    return wrapDocument(document, std.heap.page_allocator);
+}
+
+pub export fn rtf_parse_ex(data: [*]const u8, length: usize, flags: c_uint) ?*EnhancedDocument {
+    clearError();
+    
+    if (length == 0) {
+        setError("Invalid input data");
+        return null;
+    }
+    
+    const document = parseDocument(data[0..length], .{ .flags = flags }) orelse return null;
+    return wrapDocument(document, std.heap.page_allocator);
+}
+
+pub export fn rtf_parse_preview(data: [*]const u8, length: usize, max_chars: usize, max_paragraphs: usize, truncated: ?*c_int) ?*EnhancedDocument {
+    clearError();
+    
+    if (length == 0) {
+        setError("Invalid input data");
+        return null;
+    }
+    
+    var preview = formatted_parser.FormattedParser.Preview{};
+    if (max_chars != 0) preview.max_characters = max_chars;
+    if (max_paragraphs != 0) preview.max_paragraphs = max_paragraphs;
+    const document = parseDocument(data[0..length], .{ .preview = &preview }) orelse return null;
+    if (truncated) |flag| flag.* = @intFromBool(preview.truncated);
+    return wrapDocument(document, std.heap.page_allocator);
+}
+
+// What parseDocument() records, and which part of the input it parses
+const ParseOptions = struct {
+    flags: c_uint = 0,
+    checkpoints: ?*formatted_parser.Checkpoints = null, // Recorded during the parse
+    range: ?struct {
+        checkpoints: *const formatted_parser.Checkpoints,
+        start: usize,
+        end: usize,
+    } = null,
+    table_rows: ?table_parsers.TableParser.RowSink = null, // Tables are streamed, not kept
+    preview: ?*formatted_parser.FormattedParser.Preview = null, // Limits in, counts and truncation out
+};
+
+// Parse an in-memory buffer, reporting failures through setError()
+fn parseDocument(input_data: []const u8, options: ParseOptions) ?doc_model.Document {
     const allocator = std.heap.page_allocator;
     
     // Create input stream
-    const input_data = data[0..length];
     var stream = std.io.fixedBufferStream(input_data);
     
     // Parse with formatted parser
@@ -159,10 +456,20 @@ pub export fn rtf_parse(data: [*]const u8, length: usize) ?*EnhancedDocument {
         return null;
     };
     defer parser.deinit();
+    if (options.flags & RTF_PARSE_SOURCE_MAP != 0) parser.recordSourceMap();
+    if (options.checkpoints) |checkpoints| parser.recordCheckpoints(checkpoints);
+    if (options.table_rows) |sink| parser.streamTableRows(sink);
+    if (options.preview) |preview| parser.limitPreview(preview.max_characters, preview.max_paragraphs);
     
-    var document = parser.parse() catch |err| {
+    const result = if (options.range) |range|
+        parser.parseRange(input_data, range.checkpoints, range.start, range.end)
+    else
+        parser.parse();
+    
+    const document = result catch |err| {
         switch (err) {
             error.InvalidRtf => setError("Invalid RTF format"),
+            error.CheckpointMismatch => setError("Checkpoints do not match input"),
             error.EmptyInput => setError("Empty input"),
             error.TooManyNestedGroups => setError("RTF too deeply nested"),
             error.OutOfMemory => setError("Out of memory"),
@@ -170,32 +477,49 @@ pub export fn rtf_parse(data: [*]const u8, length: usize) ?*EnhancedDocument {
         }
         return null;
     };
+    if (options.preview) |preview| preview.* = parser.preview.?;
+    
+    return document;
+}
+
+// Move a parsed or loaded document to the heap and build its C views.
+// Takes ownership of `document` - it is released on failure.
+fn wrapDocument(document: doc_model.Document, allocator: std.mem.Allocator) ?*EnhancedDocument {
+    var owned = document;
     
     // Allocate document on heap to ensure stable pointers
-    const doc_ptr = allocator.create(doc_model.Document) catch {
-        document.deinit();
+    const enhanced = EnhancedDocument.createShell(allocator) catch {
+        owned.deinit();
         setError("Out of memory");
         return null;
     };
-    doc_ptr.* = document;
+    enhanced.document_ptr.* = owned;
     
     // Convert to enhanced document
-    const enhanced = createEnhancedDocument(doc_ptr, allocator) catch |err| {
-        doc_ptr.deinit();
-        allocator.destroy(doc_ptr);
-        switch (err) {
-            error.OutOfMemory => setError("Out of memory creating enhanced document"),
-        }
+    buildViews(enhanced, enhanced.document_ptr.arena.allocator(), allocator) catch |err| {
+        enhanced.destroy();
+        setViewsError(err);
         return null;
     };
     
     return enhanced;
 }
 
-fn createEnhancedDocument(document_ptr: *doc_model.Document, allocator: std.mem.Allocator) !*EnhancedDocument {
-    // Extract plain text
+fn setViewsError(err: anyerror) void {
+    switch (err) {
+        error.OutOfMemory => setError("Out of memory creating enhanced document"),
+        error.RunTooLong, error.TooManyParagraphs, error.TooManyStyles => setError("Document too large for rtf_run_v2"),
+        else => setError("Could not create enhanced document"),
+    }
+}
+
+// Build the C views of `enhanced.document_ptr`. Final arrays are allocated
+// from `views` at their exact size; `allocator` is only used for temporaries.
+fn buildViews(enhanced: *EnhancedDocument, views: std.mem.Allocator, allocator: std.mem.Allocator) !void {
+    const document_ptr = enhanced.document_ptr;
+    
+    // Extract plain text (cached in the document, zero-terminated)
     const plain_text = try document_ptr.getPlainText();
-    const owned_text = try allocator.dupeZ(u8, plain_text);
     
     // Get text runs from document
     const doc_runs = try document_ptr.getTextRuns(allocator);
@@ -207,7 +531,7 @@ fn createEnhancedDocument(document_ptr: *doc_model.Document, allocator: std.mem.
     
     for (doc_runs) |run| {
         const c_run = FormattedRun{
-            .text = @ptrCast(try allocator.dupeZ(u8, run.text)),
+            .text = run.text.ptr,
             .length = run.text.len,
             .bold = run.char_format.bold,
             .italic = run.char_format.italic,
@@ -218,7 +542,7 @@ fn createEnhancedDocument(document_ptr: *doc_model.Document, allocator: std.mem.
             .font_id = run.char_format.font_id orelse 0,
             .font_size = run.char_format.font_size orelse document_ptr.default_font_size,
             .color_id = run.char_format.color_id orelse 0,
-            .font_name = resolveFontName(document_ptr, run.char_format.font_id orelse 0, allocator) catch "Unknown",
+            .font_name = resolveFontName(document_ptr, run.char_format.font_id orelse 0),
             .color_rgb = resolveColorRgb(document_ptr, run.char_format.color_id orelse 0),
             .alignment = @intFromEnum(run.para_format.alignment),
             .left_indent = run.para_format.left_indent,
@@ -260,77 +584,117 @@ fn createEnhancedDocument(document_ptr: *doc_model.Document, allocator: std.mem.
         }
     }
     
-    // Extract tables from document
+    // Tables are viewed in place - cell strings are built on demand
     var tables = std.ArrayList(TableInfo).init(allocator);
     defer tables.deinit();
     
-    for (document_ptr.content.items) |element| {
-        switch (element) {
-            .table => |tbl| {
-                var c_rows = std.ArrayList(TableRowInfo).init(allocator);
-                defer c_rows.deinit();
-                
-                for (tbl.rows.items) |row| {
-                    var c_cells = std.ArrayList(TableCellInfo).init(allocator);
-                    defer c_cells.deinit();
-                    
-                    for (row.cells.items) |cell| {
-                        // Extract text from cell content
-                        var cell_text = std.ArrayList(u8).init(allocator);
-                        defer cell_text.deinit();
-                        
-                        for (cell.content.items) |cell_element| {
-                            switch (cell_element) {
-                                .text_run => |run| try cell_text.appendSlice(run.text),
-                                else => {},
-                            }
-                        }
-                        
-                        const c_cell = TableCellInfo{
-                            .text = @ptrCast(try allocator.dupeZ(u8, cell_text.items)),
-                            .width = cell.width,
-                            .border_left = cell.border_left,
-                            .border_right = cell.border_right,
-                            .border_top = cell.border_top,
-                            .border_bottom = cell.border_bottom,
-                        };
-                        try c_cells.append(c_cell);
-                    }
-                    
-                    const c_row = TableRowInfo{
-                        .cells = try allocator.dupe(TableCellInfo, c_cells.items),
-                        .height = row.height,
-                    };
-                    try c_rows.append(c_row);
-                }
-                
-                const c_table = TableInfo{
-                    .rows = try allocator.dupe(TableRowInfo, c_rows.items),
-                };
-                try tables.append(c_table);
+    const source = if (document_ptr.source_map) |*map| map else null;
+    var source_cells: usize = 0;
+    
+    for (document_ptr.content.items) |*element| {
+        switch (element.*) {
+            .table => |*tbl| {
+                try tables.append(.{
+                    .table = tbl,
+                    .source = source,
+                    .source_index = tables.items.len,
+                    .first_source_cell = source_cells,
+                });
+                source_cells += tbl.cells.items.len;
             },
             else => {},
         }
     }
     
-    // Create enhanced document
-    const enhanced = try allocator.create(EnhancedDocument);
-    enhanced.* = EnhancedDocument{
-        .document_ptr = document_ptr,
-        .runs = try allocator.dupe(FormattedRun, runs.items),
-        .text = owned_text,
-        .images = try allocator.dupe(ImageInfo, images.items),
-        .tables = try allocator.dupe(TableInfo, tables.items),
+    enhanced.runs = try views.dupe(FormattedRun, runs.items);
+    enhanced.text = plain_text;
+    enhanced.images = try views.dupe(ImageInfo, images.items);
+    enhanced.tables = try views.dupe(TableInfo, tables.items);
+    
+    // Character offsets of runs, paragraphs and tables
+    var index = try text_index.TextIndex.build(document_ptr, allocator);
+    defer index.deinit(allocator);
+    enhanced.index = .{
+        .runs = try views.dupe(text_index.Span, index.runs),
+        .paragraphs = try views.dupe(text_index.Paragraph, index.paragraphs),
+        .table_starts = try views.dupe(usize, index.table_starts),
+        .text_len = index.text_len,
     };
+    for (enhanced.tables, enhanced.index.table_starts) |*table, start| table.text_offset = start;
     
-    return enhanced;
+    try buildCompactRuns(enhanced, doc_runs, views, allocator);
 }
 
-fn resolveFontName(document: *doc_model.Document, font_id: u16, allocator: std.mem.Allocator) ![:0]const u8 {
-    if (document.getFont(font_id)) |font| {
-        return try allocator.dupeZ(u8, font.name);
+// Bytes buildViews() takes from `views` for the views of `enhanced`, with
+// room to align each array
+fn viewsSize(enhanced: *const EnhancedDocument) usize {
+    var size: usize = 0;
+    inline for (.{
+        enhanced.runs,             enhanced.runs_v2,         enhanced.styles,
+        enhanced.images,           enhanced.tables,          enhanced.index.runs,
+        enhanced.index.paragraphs, enhanced.index.table_starts,
+    }) |view| {
+        const Item = @typeInfo(@TypeOf(view)).pointer.child;
+        size += view.len * @sizeOf(Item) + @alignOf(Item);
     }
-    return try allocator.dupeZ(u8, "Default");
+    return size;
+}
+
+// rtf_run_v2 array and style table, from the runs and the character index
+fn buildCompactRuns(enhanced: *EnhancedDocument, doc_runs: []const doc_model.TextRun, views: std.mem.Allocator, allocator: std.mem.Allocator) !void {
+    const document_ptr = enhanced.document_ptr;
+    const paragraphs = enhanced.index.paragraphs;
+    
+    var style_ids = std.AutoHashMap(u64, u32).init(allocator);
+    defer style_ids.deinit();
+    var styles = std.ArrayList(RunStyle).init(allocator);
+    defer styles.deinit();
+    
+    const runs = try views.alloc(RunV2, doc_runs.len);
+    var paragraph: usize = 0;
+    for (doc_runs, enhanced.index.runs, runs, 0..) |run, span, *c_run, run_index| {
+        // Every run belongs to a paragraph, and they are in run order
+        while (paragraph + 1 < paragraphs.len and
+               run_index >= paragraphs[paragraph].first_run + paragraphs[paragraph].run_count)
+        {
+            paragraph += 1;
+        }
+        
+        const format = run.char_format;
+        const style = try style_ids.getOrPut(format.key());
+        if (!style.found_existing) {
+            style.value_ptr.* = std.math.cast(u32, styles.items.len) orelse return error.TooManyStyles;
+            try styles.append(.{
+                .font_name = resolveFontName(document_ptr, format.font_id orelse 0),
+                .color_rgb = resolveColorRgb(document_ptr, format.color_id orelse 0),
+                .font_id = format.font_id orelse 0,
+                .font_size = format.font_size orelse document_ptr.default_font_size,
+                .color_id = format.color_id orelse 0,
+                .flags = runFlags(format),
+            });
+        }
+        
+        const run_style = styles.items[style.value_ptr.*];
+        c_run.* = .{
+            .text_offset = span.start,
+            .text_length = std.math.cast(u32, span.len) orelse return error.RunTooLong,
+            .style = style.value_ptr.*,
+            .paragraph = std.math.cast(u32, paragraph) orelse return error.TooManyParagraphs,
+            .flags = run_style.flags,
+            .alignment = @intFromEnum(run.para_format.alignment),
+            .font_id = run_style.font_id,
+            .font_size = run_style.font_size,
+            .color_rgb = run_style.color_rgb,
+        };
+    }
+    
+    enhanced.runs_v2 = runs;
+    enhanced.styles = try views.dupe(RunStyle, styles.items);
+}
+
+fn resolveFontName(document: *doc_model.Document, font_id: u16) [*:0]const u8 {
+    if (document.getFont(font_id)) |font| return font.name.ptr;
+    return "Default";
 }
 
 fn resolveColorRgb(document: *doc_model.Document, color_id: u16) u32 {
@@ -349,7 +713,7 @@ pub export fn rtf_get_text(doc: ?*EnhancedDocument) [*:0]const u8 {
         setError("Null document");
         return "";
     }
-    return @ptrCast(doc.?.text.ptr);
+    return doc.?.text.ptr;
 }
 
 pub export fn rtf_get_text_length(doc: ?*EnhancedDocument) usize {
@@ -382,6 +746,60 @@ pub export fn rtf_get_run(doc: ?*EnhancedDocument, index: usize) ?*const Formatt
     return &doc.?.runs[index];
 }
 
+pub export fn rtf_get_runs(doc: ?*EnhancedDocument, start: usize, count: usize, out: ?[*]FormattedRun) usize {
+    clearError();
+    if (doc == null or (out == null and count > 0)) {
+        setError("Null document or output");
+        return 0;
+    }
+    
+    const runs = doc.?.runs;
+    if (start >= runs.len) return 0;
+    const copied = @min(count, runs.len - start);
+    if (copied == 0) return 0; // `out` may be null
+    @memcpy(out.?[0..copied], runs[start..][0..copied]);
+    return copied;
+}
+
+pub export fn rtf_get_runs_ptr(doc: ?*EnhancedDocument, count: ?*usize) ?[*]const FormattedRun {
+    clearError();
+    if (doc == null) {
+        setError("Null document");
+        if (count) |result| result.* = 0;
+        return null;
+    }
+    
+    const runs = doc.?.runs;
+    if (count) |result| result.* = runs.len;
+    return if (runs.len == 0) null else runs.ptr;
+}
+
+pub export fn rtf_get_runs_v2(doc: ?*EnhancedDocument, count: ?*usize) ?[*]const RunV2 {
+    clearError();
+    if (doc == null) {
+        setError("Null document");
+        if (count) |result| result.* = 0;
+        return null;
+    }
+    
+    const runs = doc.?.runs_v2;
+    if (count) |result| result.* = runs.len;
+    return if (runs.len == 0) null else runs.ptr;
+}
+
+pub export fn rtf_get_styles(doc: ?*EnhancedDocument, count: ?*usize) ?[*]const RunStyle {
+    clearError();
+    if (doc == null) {
+        setError("Null document");
+        if (count) |result| result.* = 0;
+        return null;
+    }
+    
+    const styles = doc.?.styles;
+    if (count) |result| result.* = styles.len;
+    return if (styles.len == 0) null else styles.ptr;
+}
+
 // Image access
 pub export fn rtf_get_image_count(doc: ?*EnhancedDocument) usize {
     if (doc == null) {
@@ -405,6 +823,19 @@ pub export fn rtf_get_image(doc: ?*EnhancedDocument, index: usize) ?*const Image
     return &doc.?.images[index];
 }
 
+pub export fn rtf_get_images_ptr(doc: ?*EnhancedDocument, count: ?*usize) ?[*]const ImageInfo {
+    clearError();
+    if (doc == null) {
+        setError("Null document");
+        if (count) |result| result.* = 0;
+        return null;
+    }
+    
+    const images = doc.?.images;
+    if (count) |result| result.* = images.len;
+    return if (images.len == 0) null else images.ptr;
+}
+
 // Table access
 pub export fn rtf_get_table_count(doc: ?*EnhancedDocument) usize {
     if (doc == null) {
@@ -433,7 +864,7 @@ pub export fn rtf_table_get_row_count(table: ?*const TableInfo) usize {
         setError("Null table");
         return 0;
     }
-    return table.?.rows.len;
+    return table.?.table.rowCount();
 }
 
 pub export fn rtf_table_get_cell_count(table: ?*const TableInfo, row_index: usize) usize {
@@ -442,12 +873,12 @@ pub export fn rtf_table_get_cell_count(table: ?*const TableInfo, row_index: usiz
         return 0;
     }
     
-    if (row_index >= table.?.rows.len) {
+    if (row_index >= table.?.table.rowCount()) {
         setError("Row index out of bounds");
         return 0;
     }
     
-    return table.?.rows[row_index].cells.len;
+    return table.?.table.rowCells(row_index).len;
 }
 
 pub export fn rtf_table_get_cell_text(table: ?*const TableInfo, row_index: usize, cell_index: usize) ?[*:0]const u8 {
@@ -456,18 +887,10 @@ pub export fn rtf_table_get_cell_text(table: ?*const TableInfo, row_index: usize
         return null;
     }
     
-    if (row_index >= table.?.rows.len) {
-        setError("Row index out of bounds");
-        return null;
-    }
-    
-    const row = &table.?.rows[row_index];
-    if (cell_index >= row.cells.len) {
-        setError("Cell index out of bounds");
-        return null;
-    }
+    const index = table.?.cellIndex(row_index, cell_index) orelse return null;
     
-    return row.cells[cell_index].text;
+    // The lazily joined cell text is the only part of a table view that changes
+    return @constCast(table.?).cellText(index);
 }
 
 pub export fn rtf_table_get_cell_width(table: ?*const TableInfo, row_index: usize, cell_index: usize) u32 {
@@ -476,18 +899,8 @@ pub export fn rtf_table_get_cell_width(table: ?*const TableInfo, row_index: usiz
         return 0;
     }
     
-    if (row_index >= table.?.rows.len) {
-        setError("Row index out of bounds");
-        return 0;
-    }
-    
-    const row = &table.?.rows[row_index];
-    if (cell_index >= row.cells.len) {
-        setError("Cell index out of bounds");
-        return 0;
-    }
-    
-    return row.cells[cell_index].width;
+    const index = table.?.cellIndex(row_index, cell_index) orelse return 0;
+    return table.?.table.cells.items[index].width;
 }
 
 // RTF Generation
@@ -540,10 +953,7 @@ pub export fn rtf_get_font_name(doc: ?*EnhancedDocument, font_id: u16) [*:0]cons
         return "";
     }
     
-    if (doc.?.document_ptr.getFont(font_id)) |font| {
-        // dupeZ ensures null termination, we just need to cast the pointer correctly
-        return @as([*:0]const u8, @ptrCast(font.name.ptr));
-    }
+    if (doc.?.document_ptr.getFont(font_id)) |font| return font.name.ptr;
     
     setError("Font not found");
     return "";
@@ -573,29 +983,1227 @@ export fn rtf_get_color_rgb(doc: ?*EnhancedDocument, color_id: u16) u32 {
 }
 
 // =============================================================================
-// CLEANUP
+// CHARACTER OFFSET INDEX
+// =============================================================================
+
+// Returned when an offset lies past the end of the text (matches RTF_NPOS)
+const RTF_NPOS: usize = std.math.maxInt(usize);
+
+const Paragraph = text_index.Paragraph;
+
+pub export fn rtf_get_run_offset(doc: ?*EnhancedDocument, index: usize) usize {
+    if (doc == null) {
+        setError("Null document");
+        return RTF_NPOS;
+    }
+    
+    if (index >= doc.?.index.runs.len) {
+        setError("Run index out of bounds");
+        return RTF_NPOS;
+    }
+    
+    return doc.?.index.runs[index].start;
+}
+
+pub export fn rtf_find_run_at(doc: ?*EnhancedDocument, char_offset: usize) usize {
+    if (doc == null) {
+        setError("Null document");
+        return RTF_NPOS;
+    }
+    return doc.?.index.findRun(char_offset) orelse RTF_NPOS;
+}
+
+pub export fn rtf_get_runs_in_range(doc: ?*EnhancedDocument, start: usize, end: usize, first_run: ?*usize) usize {
+    if (doc == null) {
+        setError("Null document");
+        return 0;
+    }
+    
+    const range = doc.?.index.runsInRange(start, end);
+    if (first_run) |first| first.* = range.first;
+    return range.count;
+}
+
+pub export fn rtf_get_paragraph_count(doc: ?*EnhancedDocument) usize {
+    if (doc == null) {
+        setError("Null document");
+        return 0;
+    }
+    return doc.?.index.paragraphs.len;
+}
+
+pub export fn rtf_get_paragraph(doc: ?*EnhancedDocument, index: usize) ?*const Paragraph {
+    if (doc == null) {
+        setError("Null document");
+        return null;
+    }
+    
+    if (index >= doc.?.index.paragraphs.len) {
+        setError("Paragraph index out of bounds");
+        return null;
+    }
+    
+    return &doc.?.index.paragraphs[index];
+}
+
+pub export fn rtf_find_paragraph_at(doc: ?*EnhancedDocument, char_offset: usize) usize {
+    if (doc == null) {
+        setError("Null document");
+        return RTF_NPOS;
+    }
+    return doc.?.index.findParagraph(char_offset) orelse RTF_NPOS;
+}
+
+pub export fn rtf_table_get_text_offset(table: ?*const TableInfo) usize {
+    if (table == null) {
+        setError("Null table");
+        return RTF_NPOS;
+    }
+    return table.?.text_offset;
+}
+
 // =============================================================================
+// SOURCE MAP
+// =============================================================================
+
+// Layout matches rtf_source_range in c_api.h
+const SourceRange = extern struct {
+    start: usize,
+    end: usize,
+};
+
+const no_source_map = "Document has no source map (parse with RTF_PARSE_SOURCE_MAP)";
+
+// Store `range` for the caller, or report `missing` when there is none
+fn storeSourceRange(range: ?source_map.Range, out: ?*SourceRange, missing: []const u8) c_int {
+    const found = range orelse {
+        setError(missing);
+        return RTF_INVALID;
+    };
+    if (out) |result| result.* = .{ .start = found.start, .end = found.end };
+    return RTF_OK;
+}
+
+fn documentSourceMap(doc: ?*EnhancedDocument) ?*const doc_model.SourceMap {
+    const enhanced = doc orelse {
+        setError("Null document");
+        return null;
+    };
+    if (enhanced.document_ptr.source_map) |*map| return map;
+    setError(no_source_map);
+    return null;
+}
+
+pub export fn rtf_get_run_source(doc: ?*EnhancedDocument, index: usize, range: ?*SourceRange) c_int {
+    const map = documentSourceMap(doc) orelse return RTF_INVALID;
+    return storeSourceRange(map.runs.get(index), range, "Run index out of bounds");
+}
+
+pub export fn rtf_get_paragraph_source(doc: ?*EnhancedDocument, index: usize, range: ?*SourceRange) c_int {
+    const map = documentSourceMap(doc) orelse return RTF_INVALID;
+    
+    if (index >= doc.?.index.paragraphs.len) {
+        setError("Paragraph index out of bounds");
+        return RTF_INVALID;
+    }
+    
+    // From the start of its first run to the end of its last
+    const paragraph = doc.?.index.paragraphs[index];
+    if (paragraph.run_count == 0) {
+        setError("Paragraph has no text");
+        return RTF_INVALID;
+    }
+    
+    const first = map.runs.get(paragraph.first_run);
+    const last = map.runs.get(paragraph.first_run + paragraph.run_count - 1);
+    if (first == null or last == null) return storeSourceRange(null, range, "Run index out of bounds");
+    return storeSourceRange(.{ .start = first.?.start, .end = last.?.end }, range, "");
+}
+
+pub export fn rtf_get_image_source(doc: ?*EnhancedDocument, index: usize, range: ?*SourceRange) c_int {
+    const map = documentSourceMap(doc) orelse return RTF_INVALID;
+    return storeSourceRange(map.images.get(index), range, "Image index out of bounds");
+}
+
+pub export fn rtf_table_get_source(table: ?*const TableInfo, range: ?*SourceRange) c_int {
+    const info = table orelse {
+        setError("Null table");
+        return RTF_INVALID;
+    };
+    const map = info.source orelse {
+        setError(no_source_map);
+        return RTF_INVALID;
+    };
+    return storeSourceRange(map.tables.get(info.source_index), range, "Table index out of bounds");
+}
+
+pub export fn rtf_table_get_cell_source(table: ?*const TableInfo, row_index: usize, cell_index: usize, range: ?*SourceRange) c_int {
+    const info = table orelse {
+        setError("Null table");
+        return RTF_INVALID;
+    };
+    const map = info.source orelse {
+        setError(no_source_map);
+        return RTF_INVALID;
+    };
+    
+    const index = info.cellIndex(row_index, cell_index) orelse return RTF_INVALID;
+    return storeSourceRange(map.cells.get(info.first_source_cell + index), range, "Cell index out of bounds");
+}
+
+// =============================================================================
+// CLEANUP
+// =============================================================================
+
+pub export fn rtf_free(doc: ?*EnhancedDocument) void {
+    if (doc == null) return;
+    
+    // Documents may be shared (parse cache) - the last reference frees them
+    doc.?.release();
+}
+
+// =============================================================================
+// SHARED OWNERSHIP
+// =============================================================================
+
+pub export fn rtf_retain(doc: ?*EnhancedDocument) ?*EnhancedDocument {
+    if (doc == null) return null;
+    
+    doc.?.retain();
+    return doc;
+}
+
+pub export fn rtf_release(doc: ?*EnhancedDocument) void {
+    rtf_free(doc);
+}
+
+// =============================================================================
+// PARSE CACHE
+// =============================================================================
+
+const DocumentCache = parse_cache.ParseCache(EnhancedDocument);
+
+pub export fn rtf_cache_new(max_bytes: usize) ?*DocumentCache {
+    clearError();
+    
+    const allocator = std.heap.page_allocator;
+    const cache = allocator.create(DocumentCache) catch {
+        setError("Out of memory");
+        return null;
+    };
+    cache.* = DocumentCache.init(allocator, max_bytes);
+    
+    return cache;
+}
+
+pub export fn rtf_cache_free(cache: ?*DocumentCache) void {
+    if (cache == null) return;
+    
+    cache.?.deinit();
+    std.heap.page_allocator.destroy(cache.?);
+}
+
+pub export fn rtf_parse_cached(cache: ?*DocumentCache, data: [*]const u8, length: usize) ?*EnhancedDocument {
+    if (cache == null) return rtf_parse(data, length);
+    
+    clearError();
+    
+    if (length == 0) {
+        setError("Invalid input data");
+        return null;
+    }
+    
+    const key = cache.?.keyFor(data[0..length]);
+    if (cache.?.get(key)) |doc| return doc;
+    
+    // Miss - parse outside any lock; concurrent misses on the same input
+    // both parse, and put() keeps the first document
+    const document = parseDocument(data[0..length], .{}) orelse return null;
+    const doc = wrapCompacted(document) orelse return null;
+    return cache.?.put(key, doc);
+}
+
+// As wrapDocument(), for long-lived documents: the document and its views are
+// packed into a single allocation. Views are built once to size them, then
+// again in the room compaction leaves for them at the end of the block.
+// Compaction is an optimization - on failure the document is wrapped as is.
+fn wrapCompacted(document: doc_model.Document) ?*EnhancedDocument {
+    const allocator = std.heap.page_allocator;
+    var owned = document;
+    
+    var scratch = std.heap.ArenaAllocator.init(allocator);
+    defer scratch.deinit();
+    var sizing = EnhancedDocument{ .document_ptr = &owned };
+    buildViews(&sizing, scratch.allocator(), scratch.allocator()) catch return wrapDocument(owned, allocator);
+    const room = owned.compactReserving(viewsSize(&sizing)) catch return wrapDocument(owned, allocator);
+    
+    const enhanced = EnhancedDocument.createShell(allocator) catch {
+        owned.deinit();
+        setError("Out of memory");
+        return null;
+    };
+    enhanced.document_ptr.* = owned;
+    
+    var views = std.heap.FixedBufferAllocator.init(room);
+    buildViews(enhanced, views.allocator(), allocator) catch |err| {
+        enhanced.destroy();
+        setViewsError(err);
+        return null;
+    };
+    return enhanced;
+}
+
+// =============================================================================
+// PARSE CONTEXTS
+// =============================================================================
+
+// Long-lived parser state for rtf_parse_with(). The parser's stacks and
+// scratch buffers stay warm between documents, and released documents come
+// back here so their lists and arena chunks are reused.
+pub const ParseContext = struct {
+    input: std.io.FixedBufferStream([]const u8),
+    parser: formatted_parser.FormattedParser,
+    scratch: std.heap.ArenaAllocator, // Temporaries while building C views
+    
+    // Released documents waiting for reuse - rtf_free() may run on any thread
+    mutex: std.Thread.Mutex = .{},
+    spares: [max_spares]*EnhancedDocument = undefined,
+    spare_count: usize = 0,
+    
+    // One reference for the owner plus one per live document
+    ref_count: std.atomic.Value(u32) = std.atomic.Value(u32).init(1),
+    
+    const max_spares = 4;
+    
+    // Arena bytes kept per recycled document, so one huge input doesn't pin memory
+    const retain_limit = 256 * 1024;
+    
+    fn create() !*ParseContext {
+        const allocator = std.heap.page_allocator;
+        
+        const context = try allocator.create(ParseContext);
+        errdefer allocator.destroy(context);
+        
+        context.input = std.io.fixedBufferStream(@as([]const u8, ""));
+        context.parser = try formatted_parser.FormattedParser.init(context.input.reader().any(), allocator);
+        context.scratch = std.heap.ArenaAllocator.init(allocator);
+        context.mutex = .{};
+        context.spare_count = 0;
+        context.ref_count = std.atomic.Value(u32).init(1);
+        
+        return context;
+    }
+    
+    fn release(self: *ParseContext) void {
+        if (self.ref_count.fetchSub(1, .acq_rel) != 1) return;
+        
+        for (self.spares[0..self.spare_count]) |spare| spare.destroy();
+        self.parser.deinit();
+        self.scratch.deinit();
+        std.heap.page_allocator.destroy(self);
+    }
+    
+    // Not thread-safe: one thread parses with a context at a time
+    fn parse(self: *ParseContext, data: []const u8) ?*EnhancedDocument {
+        const allocator = std.heap.page_allocator;
+        
+        self.input = std.io.fixedBufferStream(data);
+        self.parser.reset(self.input.reader().any());
+        defer _ = self.scratch.reset(.{ .retain_with_limit = retain_limit });
+        
+        // Parse into a released document's storage when one is waiting
+        const spare = self.takeSpare();
+        if (spare) |enhanced| self.parser.recycleDocument(enhanced.document_ptr.*);
+        
+        const document = self.parser.parse() catch |err| {
+            switch (err) {
+                error.InvalidRtf => setError("Invalid RTF format"),
+                error.EmptyInput => setError("Empty input"),
+                error.TooManyNestedGroups => setError("RTF too deeply nested"),
+                error.OutOfMemory => setError("Out of memory"),
+                else => setError("Parse error"),
+            }
+            // Its document storage stays with the parser for the next attempt
+            if (spare) |enhanced| {
+                allocator.destroy(enhanced.document_ptr);
+                allocator.destroy(enhanced);
+            }
+            return null;
+        };
+        
+        const enhanced = spare orelse (EnhancedDocument.createShell(allocator) catch {
+            var owned = document;
+            owned.deinit();
+            setError("Out of memory");
+            return null;
+        });
+        // Recycled shells start over with fresh views and one reference
+        const doc_ptr = enhanced.document_ptr;
+        doc_ptr.* = document;
+        enhanced.* = .{ .document_ptr = doc_ptr };
+        
+        buildViews(enhanced, doc_ptr.arena.allocator(), self.scratch.allocator()) catch |err| {
+            enhanced.destroy();
+            setViewsError(err);
+            return null;
+        };
+        
+        // The document keeps its context alive until it is recycled
+        _ = self.ref_count.fetchAdd(1, .monotonic);
+        enhanced.context = self;
+        return enhanced;
+    }
+    
+    fn takeSpare(self: *ParseContext) ?*EnhancedDocument {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        
+        if (self.spare_count == 0) return null;
+        self.spare_count -= 1;
+        return self.spares[self.spare_count];
+    }
+    
+    // Called with the document's last reference, on whichever thread drops it
+    fn recycle(self: *ParseContext, enhanced: *EnhancedDocument) void {
+        enhanced.releaseViews();
+        enhanced.freeEditViews();
+        enhanced.document_ptr.reset(retain_limit);
+        
+        const kept = keep: {
+            self.mutex.lock();
+            defer self.mutex.unlock();
+            
+            if (self.spare_count == max_spares) break :keep false;
+            self.spares[self.spare_count] = enhanced;
+            self.spare_count += 1;
+            break :keep true;
+        };
+        if (!kept) enhanced.destroy();
+        
+        self.release();
+    }
+};
+
+pub export fn rtf_context_new() ?*ParseContext {
+    clearError();
+    
+    return ParseContext.create() catch {
+        setError("Out of memory");
+        return null;
+    };
+}
+
+pub export fn rtf_context_free(context: ?*ParseContext) void {
+    if (context == null) return;
+    
+    // Documents parsed with the context keep it alive until they are freed
+    context.?.release();
+}
+
+pub export fn rtf_parse_with(context: ?*ParseContext, data: [*]const u8, length: usize) ?*EnhancedDocument {
+    if (context == null) return rtf_parse(data, length);
+    
+    clearError();
+    
+    if (length == 0) {
+        setError("Invalid input data");
+        return null;
+    }
+    
+    return context.?.parse(data[0..length]);
+}
+
+// =============================================================================
+// CHECKPOINTS
+// =============================================================================
+
+const Checkpoints = formatted_parser.Checkpoints;
+
+pub export fn rtf_parse_checkpointed(data: [*]const u8, length: usize, interval: usize, checkpoints_out: ?*?*Checkpoints) ?*EnhancedDocument {
+    clearError();
+    const allocator = std.heap.page_allocator;
+    
+    if (length == 0 or checkpoints_out == null) {
+        setError("Invalid input data");
+        return null;
+    }
+    checkpoints_out.?.* = null;
+    
+    const checkpoints = allocator.create(Checkpoints) catch {
+        setError("Out of memory");
+        return null;
+    };
+    checkpoints.* = Checkpoints.init(allocator, interval);
+    
+    const document = parseDocument(data[0..length], .{ .checkpoints = checkpoints }) orelse {
+        checkpoints.deinit();
+        allocator.destroy(checkpoints);
+        return null;
+    };
+    
+    const doc = wrapDocument(document, allocator) orelse {
+        checkpoints.deinit();
+        allocator.destroy(checkpoints);
+        return null;
+    };
+    checkpoints_out.?.* = checkpoints;
+    return doc;
+}
+
+pub export fn rtf_parse_range(data: [*]const u8, length: usize, checkpoints: ?*const Checkpoints, start: usize, end: usize) ?*EnhancedDocument {
+    clearError();
+    
+    if (length == 0 or checkpoints == null) {
+        setError("Invalid input data");
+        return null;
+    }
+    
+    const document = parseDocument(data[0..length], .{
+        .range = .{ .checkpoints = checkpoints.?, .start = start, .end = end },
+    }) orelse return null;
+    return wrapDocument(document, std.heap.page_allocator);
+}
+
+pub export fn rtf_checkpoints_count(checkpoints: ?*const Checkpoints) usize {
+    if (checkpoints == null) {
+        setError("Null checkpoints");
+        return 0;
+    }
+    return checkpoints.?.count();
+}
+
+pub export fn rtf_checkpoint_offset(checkpoints: ?*const Checkpoints, index: usize) usize {
+    if (checkpoints == null) {
+        setError("Null checkpoints");
+        return RTF_NPOS;
+    }
+    
+    if (index >= checkpoints.?.count()) {
+        setError("Checkpoint index out of bounds");
+        return RTF_NPOS;
+    }
+    
+    return checkpoints.?.points.items[index].offset;
+}
+
+pub export fn rtf_checkpoints_free(checkpoints: ?*Checkpoints) void {
+    if (checkpoints) |owned| {
+        owned.deinit();
+        std.heap.page_allocator.destroy(owned);
+    }
+}
+
+pub export fn rtf_reparse_edit(
+    doc: ?*EnhancedDocument,
+    checkpoints: ?*Checkpoints,
+    data: [*]const u8,
+    length: usize,
+    edit_start: usize,
+    edit_end: usize,
+    inserted_length: usize,
+) c_int {
+    clearError();
+    
+    if (doc == null or checkpoints == null or length == 0) {
+        setError("Invalid input data");
+        return RTF_INVALID;
+    }
+    const enhanced = doc.?;
+    if (enhanced.ref_count.load(.acquire) != 1) {
+        setError("Document is shared");
+        return RTF_INVALID;
+    }
+    
+    const edit = reparse.Edit{ .start = edit_start, .end = edit_end, .inserted_len = inserted_length };
+    
+    // Views point into the content being replaced - rebuilt either way, in
+    // an arena that only ever holds the latest ones
+    enhanced.releaseViews();
+    enhanced.document_ptr.plain_text = null;
+    if (enhanced.edit_views) |*arena| {
+        _ = arena.reset(.retain_capacity);
+    } else {
+        enhanced.edit_views = std.heap.ArenaAllocator.init(std.heap.page_allocator);
+    }
+    const views = enhanced.edit_views.?.allocator();
+    var code = RTF_OK;
+    if (reparse.reparseEdit(enhanced.document_ptr, checkpoints.?, data[0..length], edit)) |_| {} else |err| {
+        switch (err) {
+            error.CheckpointMismatch => setError("Checkpoints do not match input"),
+            error.ReadOnlyDocument => setError("Document is read-only"),
+            error.TooManyNestedGroups => setError("RTF too deeply nested"),
+            error.OutOfMemory => setError("Out of memory"),
+            else => setError("Parse error"),
+        }
+        code = if (err == error.OutOfMemory) RTF_NOMEM else RTF_INVALID;
+    }
+    
+    _ = enhanced.document_ptr.refreshPlainText(views) catch {
+        setError("Out of memory");
+        return RTF_NOMEM;
+    };
+    buildViews(enhanced, views, std.heap.page_allocator) catch |err| {
+        setViewsError(err);
+        return if (err == error.OutOfMemory) RTF_NOMEM else RTF_ERROR;
+    };
+    return code;
+}
+
+// =============================================================================
+// EDITING
+// =============================================================================
+
+const Editor = editing.Editor;
+
+const RTF_STYLE_BOLD: c_uint = 0x01;
+const RTF_STYLE_ITALIC: c_uint = 0x02;
+const RTF_STYLE_UNDERLINE: c_uint = 0x04;
+const RTF_STYLE_STRIKETHROUGH: c_uint = 0x08;
+const RTF_STYLE_SUPERSCRIPT: c_uint = 0x10;
+const RTF_STYLE_SUBSCRIPT: c_uint = 0x20;
+
+fn editStatus(result: Editor.Error!void) c_int {
+    result catch |err| {
+        switch (err) {
+            error.OutOfBounds => setError("Offset out of bounds"),
+            error.InvalidText => setError("Text contains an object mark"),
+            error.NotATable => setError("No table at offset"),
+            error.OutOfMemory => setError("Out of memory"),
+        }
+        return if (err == error.OutOfMemory) RTF_NOMEM else RTF_INVALID;
+    };
+    return RTF_OK;
+}
+
+pub export fn rtf_editor_new(doc: ?*EnhancedDocument) ?*Editor {
+    clearError();
+    if (doc == null) {
+        setError("Null document");
+        return null;
+    }
+    
+    const allocator = std.heap.page_allocator;
+    const editor = allocator.create(Editor) catch {
+        setError("Out of memory");
+        return null;
+    };
+    editor.* = Editor.init(allocator, doc.?.document_ptr) catch {
+        allocator.destroy(editor);
+        setError("Out of memory");
+        return null;
+    };
+    return editor;
+}
+
+pub export fn rtf_editor_free(editor: ?*Editor) void {
+    if (editor) |owned| {
+        owned.deinit();
+        std.heap.page_allocator.destroy(owned);
+    }
+}
+
+pub export fn rtf_editor_length(editor: ?*const Editor) usize {
+    clearError();
+    if (editor == null) {
+        setError("Null editor");
+        return 0;
+    }
+    return editor.?.len();
+}
+
+pub export fn rtf_editor_get_text(editor: ?*const Editor) ?[*:0]u8 {
+    clearError();
+    if (editor == null) {
+        setError("Null editor");
+        return null;
+    }
+    
+    const allocator = std.heap.page_allocator;
+    const text = editor.?.getText(allocator) catch {
+        setError("Out of memory");
+        return null;
+    };
+    defer allocator.free(text);
+    
+    // Free with rtf_free_string(), like generated RTF
+    const text_z = allocator.dupeZ(u8, text) catch {
+        setError("Out of memory");
+        return null;
+    };
+    return text_z.ptr;
+}
+
+pub export fn rtf_editor_insert_text(editor: ?*Editor, offset: usize, text: ?[*]const u8, length: usize) c_int {
+    clearError();
+    if (editor == null or (text == null and length > 0)) {
+        setError("Invalid input data");
+        return RTF_INVALID;
+    }
+    const bytes = if (text) |ptr| ptr[0..length] else "";
+    return editStatus(editor.?.insertText(offset, bytes));
+}
+
+pub export fn rtf_editor_delete(editor: ?*Editor, start: usize, end: usize) c_int {
+    clearError();
+    if (editor == null) {
+        setError("Null editor");
+        return RTF_INVALID;
+    }
+    return editStatus(editor.?.delete(start, end));
+}
+
+pub export fn rtf_editor_set_style(editor: ?*Editor, start: usize, end: usize, set: c_uint, clear: c_uint) c_int {
+    clearError();
+    if (editor == null) {
+        setError("Null editor");
+        return RTF_INVALID;
+    }
+    
+    const style = struct {
+        fn change(set_flags: c_uint, clear_flags: c_uint, flag: c_uint) ?bool {
+            if (set_flags & flag != 0) return true;
+            if (clear_flags & flag != 0) return false;
+            return null;
+        }
+    }.change;
+    
+    return editStatus(editor.?.applyFormat(start, end, .{
+        .bold = style(set, clear, RTF_STYLE_BOLD),
+        .italic = style(set, clear, RTF_STYLE_ITALIC),
+        .underline = style(set, clear, RTF_STYLE_UNDERLINE),
+        .strikethrough = style(set, clear, RTF_STYLE_STRIKETHROUGH),
+        .superscript = style(set, clear, RTF_STYLE_SUPERSCRIPT),
+        .subscript = style(set, clear, RTF_STYLE_SUBSCRIPT),
+    }));
+}
+
+pub export fn rtf_editor_clear_format(editor: ?*Editor, start: usize, end: usize) c_int {
+    clearError();
+    if (editor == null) {
+        setError("Null editor");
+        return RTF_INVALID;
+    }
+    return editStatus(editor.?.clearFormat(start, end));
+}
+
+pub export fn rtf_editor_insert_paragraph(editor: ?*Editor, offset: usize) c_int {
+    clearError();
+    if (editor == null) {
+        setError("Null editor");
+        return RTF_INVALID;
+    }
+    return editStatus(editor.?.insertParagraph(offset));
+}
+
+pub export fn rtf_editor_table_offset(editor: ?*const Editor, table_index: usize) usize {
+    clearError();
+    if (editor == null) {
+        setError("Null editor");
+        return RTF_NPOS;
+    }
+    return editor.?.tableOffset(table_index) orelse RTF_NPOS;
+}
+
+pub export fn rtf_editor_insert_table_row(
+    editor: ?*Editor,
+    table_offset: usize,
+    row_index: usize,
+    cells: ?[*]const ?[*:0]const u8,
+    cell_count: usize,
+) c_int {
+    clearError();
+    if (editor == null or (cells == null and cell_count > 0)) {
+        setError("Invalid input data");
+        return RTF_INVALID;
+    }
+    
+    const allocator = std.heap.page_allocator;
+    const texts = allocator.alloc([]const u8, cell_count) catch {
+        setError("Out of memory");
+        return RTF_NOMEM;
+    };
+    defer allocator.free(texts);
+    for (texts, 0..) |*text, index| {
+        text.* = if (cells.?[index]) |cell| std.mem.span(cell) else "";
+    }
+    
+    return editStatus(editor.?.insertTableRow(table_offset, row_index, texts));
+}
+
+pub export fn rtf_editor_to_document(editor: ?*const Editor) ?*EnhancedDocument {
+    clearError();
+    if (editor == null) {
+        setError("Null editor");
+        return null;
+    }
+    
+    const allocator = std.heap.page_allocator;
+    const document = editor.?.toDocument(allocator) catch {
+        setError("Out of memory");
+        return null;
+    };
+    return wrapDocument(document, allocator);
+}
+
+pub export fn rtf_editor_generate(editor: ?*const Editor) ?[*:0]u8 {
+    clearError();
+    if (editor == null) {
+        setError("Null editor");
+        return null;
+    }
+    
+    const allocator = std.heap.page_allocator;
+    const rtf_data = editor.?.generateRtf(allocator) catch {
+        setError("Out of memory generating RTF");
+        return null;
+    };
+    defer allocator.free(rtf_data);
+    
+    const rtf_string = allocator.dupeZ(u8, rtf_data) catch {
+        setError("Out of memory creating null-terminated string");
+        return null;
+    };
+    return rtf_string.ptr;
+}
+
+pub export fn rtf_editor_write(editor: ?*const Editor, original: ?*const anyopaque, length: usize, writer: ?*RtfWriter) c_int {
+    clearError();
+    if (editor == null or writer == null) {
+        setError("Null editor or writer");
+        return RTF_INVALID;
+    }
+    
+    const bytes: []const u8 = if (original) |data| @as([*]const u8, @ptrCast(data))[0..length] else &.{};
+    var adapter = WriterAdapter{ .rtf_writer = writer.? };
+    editor.?.writeRtfFrom(bytes, adapter.getWriter()) catch |err| {
+        switch (err) {
+            error.OutOfMemory => {
+                setError("Out of memory generating RTF");
+                return RTF_NOMEM;
+            },
+            error.SourceMismatch => {
+                setError("Original input is shorter than the document's source map");
+                return RTF_INVALID;
+            },
+            else => setError("Could not write RTF"),
+        }
+        return RTF_ERROR;
+    };
+    return RTF_OK;
+}
+
+// =============================================================================
+// DIFF
+// =============================================================================
+
+const DiffCallback = *const fn (context: ?*anyopaque, change: *const doc_diff.Change) callconv(.C) c_int;
+
+const DiffForwarder = struct {
+    callback: DiffCallback,
+    context: ?*anyopaque,
+    
+    fn emit(context: *anyopaque, change: *const doc_diff.Change) bool {
+        const self: *DiffForwarder = @ptrCast(@alignCast(context));
+        return self.callback(self.context, change) == 0;
+    }
+};
+
+pub export fn rtf_diff(doc_a: ?*EnhancedDocument, doc_b: ?*EnhancedDocument, callback: ?DiffCallback, context: ?*anyopaque) c_int {
+    clearError();
+    if (doc_a == null or doc_b == null or callback == null) {
+        setError("Invalid input data");
+        return RTF_INVALID;
+    }
+    
+    const allocator = std.heap.page_allocator;
+    const runs_a = doc_a.?.document_ptr.getTextRuns(allocator) catch {
+        setError("Out of memory");
+        return RTF_NOMEM;
+    };
+    defer allocator.free(runs_a);
+    const runs_b = doc_b.?.document_ptr.getTextRuns(allocator) catch {
+        setError("Out of memory");
+        return RTF_NOMEM;
+    };
+    defer allocator.free(runs_b);
+    
+    var forwarder = DiffForwarder{ .callback = callback.?, .context = context };
+    doc_diff.diff(
+        allocator,
+        .{ .text = doc_a.?.text, .index = &doc_a.?.index, .runs = runs_a },
+        .{ .text = doc_b.?.text, .index = &doc_b.?.index, .runs = runs_b },
+        .{ .context = &forwarder, .emit = DiffForwarder.emit },
+    ) catch |err| {
+        switch (err) {
+            error.OutOfMemory => setError("Out of memory"),
+            else => setError("Stopped by callback"),
+        }
+        return if (err == error.OutOfMemory) RTF_NOMEM else RTF_ERROR;
+    };
+    return RTF_OK;
+}
+
+// =============================================================================
+// EXPORT
+// =============================================================================
+
+fn exportDocumentJson(document: *const doc_model.Document, writer: *RtfWriter, flags: c_uint) c_int {
+    var adapter = WriterAdapter{ .rtf_writer = writer };
+    json_export.exportJson(document, adapter.getWriter(), .{ .lines = flags & RTF_JSON_LINES != 0 }) catch |err| {
+        if (err == error.OutOfMemory) {
+            setError("Out of memory");
+            return RTF_NOMEM;
+        }
+        setError("Could not write JSON");
+        return RTF_ERROR;
+    };
+    return RTF_OK;
+}
+
+pub export fn rtf_export_json(doc: ?*EnhancedDocument, writer: ?*RtfWriter, flags: c_uint) c_int {
+    clearError();
+    if (doc == null or writer == null) {
+        setError("Null document or writer");
+        return RTF_INVALID;
+    }
+    return exportDocumentJson(doc.?.document_ptr, writer.?, flags);
+}
+
+pub export fn rtf_export_json_input(data: ?[*]const u8, length: usize, writer: ?*RtfWriter, flags: c_uint) c_int {
+    clearError();
+    if (data == null or length == 0 or writer == null) {
+        setError("Invalid input data");
+        return RTF_INVALID;
+    }
+    
+    // Straight from the parser's document - no C views are built
+    var document = parseDocument(data.?[0..length], .{}) orelse return RTF_ERROR;
+    defer document.deinit();
+    return exportDocumentJson(&document, writer.?, flags);
+}
+
+pub export fn rtf_export_arrow(docs: ?[*]const ?*EnhancedDocument, count: usize, writer: ?*RtfWriter, flags: c_uint) c_int {
+    clearError();
+    if ((docs == null and count > 0) or writer == null) {
+        setError("Null documents or writer");
+        return RTF_INVALID;
+    }
+    if (flags != 0) {
+        setError("Unknown flags");
+        return RTF_INVALID;
+    }
+    
+    const allocator = std.heap.page_allocator;
+    var adapter = WriterAdapter{ .rtf_writer = writer.? };
+    var exporter = arrow_export.RunExporter(@TypeOf(adapter.getWriter())).init(allocator, adapter.getWriter(), .{}) catch |err| {
+        if (err == error.UnsupportedPlatform) {
+            setError("Arrow export needs a little-endian platform");
+            return RTF_ERROR;
+        }
+        return arrowStatus(err);
+    };
+    defer exporter.deinit();
+    
+    for (0..count) |doc_id| {
+        const doc = docs.?[doc_id] orelse {
+            setError("Null document");
+            return RTF_INVALID;
+        };
+        exporter.addDocument(@intCast(doc_id), doc.document_ptr, &doc.index) catch |err| return arrowStatus(err);
+    }
+    exporter.finish() catch |err| return arrowStatus(err);
+    return RTF_OK;
+}
+
+fn arrowStatus(err: anyerror) c_int {
+    switch (err) {
+        error.OutOfMemory => {
+            setError("Out of memory");
+            return RTF_NOMEM;
+        },
+        error.RunTooLong => setError("Run longer than 2 GiB"),
+        else => setError("Could not write Arrow stream"),
+    }
+    return RTF_ERROR;
+}
+
+// Parse, convert and drop the document - no handle or C views are kept.
+// The converters need paragraph formats, images and whole tables, which the
+// parser's text and row sinks do not carry, so the document is built whole.
+fn convertInput(data: ?[*]const u8, length: usize, writer: ?*RtfWriter, flags: c_uint, comptime markdown: bool) c_int {
+    clearError();
+    if (data == null or length == 0 or writer == null) {
+        setError("Invalid input data");
+        return RTF_INVALID;
+    }
+    
+    var document = parseDocument(data.?[0..length], .{}) orelse return RTF_ERROR;
+    defer document.deinit();
+    
+    const allocator = std.heap.page_allocator;
+    var adapter = WriterAdapter{ .rtf_writer = writer.? };
+    const options = convert.Options{ .image_refs = flags & RTF_CONVERT_IMAGE_REFS != 0 };
+    const result = if (markdown)
+        convert.toMarkdown(allocator, &document, adapter.getWriter(), options)
+    else
+        convert.toHtml(&document, adapter.getWriter(), options);
+    result catch |err| {
+        if (err == error.OutOfMemory) {
+            setError("Out of memory");
+            return RTF_NOMEM;
+        }
+        setError(if (markdown) "Could not write Markdown" else "Could not write HTML");
+        return RTF_ERROR;
+    };
+    return RTF_OK;
+}
+
+pub export fn rtf_to_html(data: ?[*]const u8, length: usize, writer: ?*RtfWriter, flags: c_uint) c_int {
+    return convertInput(data, length, writer, flags, false);
+}
+
+pub export fn rtf_to_markdown(data: ?[*]const u8, length: usize, writer: ?*RtfWriter, flags: c_uint) c_int {
+    return convertInput(data, length, writer, flags, true);
+}
+
+pub export fn rtf_tables_to_csv(data: ?[*]const u8, length: usize, writer: ?*RtfWriter, flags: c_uint, table: usize) c_int {
+    clearError();
+    if (data == null or length == 0 or writer == null) {
+        setError("Invalid input data");
+        return RTF_INVALID;
+    }
+    
+    var adapter = WriterAdapter{ .rtf_writer = writer.? };
+    const Csv = csv_export.CsvWriter(@TypeOf(adapter.getWriter()));
+    var csv = Csv.init(adapter.getWriter(), .{
+        .separator = if (flags & RTF_CSV_TSV != 0) '\t' else ',',
+        .table = if (table == RTF_ALL_TABLES) null else table,
+    });
+    
+    // Rows are written as the parser finishes them; the rest of the
+    // document is dropped once the parse is done
+    var document = parseDocument(data.?[0..length], .{ .table_rows = csv.rowSink() }) orelse {
+        if (csv.failed) setError("Could not write CSV");
+        return RTF_ERROR;
+    };
+    document.deinit();
+    csv.finish() catch {
+        setError("Could not write CSV");
+        return RTF_ERROR;
+    };
+    return RTF_OK;
+}
+
+// =============================================================================
+// SEARCH
+// =============================================================================
+
+const SearchCallback = *const fn (context: ?*anyopaque, hit: *const text_search.Hit) callconv(.C) c_int;
+
+const SearchForwarder = struct {
+    callback: SearchCallback,
+    context: ?*anyopaque,
+    
+    fn emit(context: *anyopaque, hit: *const text_search.Hit) bool {
+        const self: *SearchForwarder = @ptrCast(@alignCast(context));
+        return self.callback(self.context, hit) == 0;
+    }
+};
+
+pub export fn rtf_search(data: ?[*]const u8, length: usize, pattern: ?[*:0]const u8, flags: c_uint, callback: ?SearchCallback, context: ?*anyopaque) c_int {
+    clearError();
+    if (data == null or length == 0 or pattern == null or callback == null) {
+        setError("Invalid input data");
+        return RTF_INVALID;
+    }
+    
+    const allocator = std.heap.page_allocator;
+    var patterns = std.ArrayList([]const u8).init(allocator);
+    defer patterns.deinit();
+    const text = std.mem.span(pattern.?);
+    if (flags & RTF_SEARCH_LINES != 0) {
+        var lines = std.mem.tokenizeAny(u8, text, "\r\n");
+        while (lines.next()) |line| patterns.append(line) catch {
+            setError("Out of memory");
+            return RTF_NOMEM;
+        };
+    } else {
+        patterns.append(text) catch {
+            setError("Out of memory");
+            return RTF_NOMEM;
+        };
+    }
+    
+    var forwarder = SearchForwarder{ .callback = callback.?, .context = context };
+    text_search.search(
+        allocator,
+        data.?[0..length],
+        patterns.items,
+        .{ .ignore_case = flags & RTF_SEARCH_IGNORE_CASE != 0 },
+        .{ .context = &forwarder, .emit = SearchForwarder.emit },
+    ) catch |err| {
+        switch (err) {
+            error.Stopped => setError("Stopped by callback"),
+            error.EmptyPattern => setError("Empty pattern"),
+            error.InvalidRtf => setError("Invalid RTF format"),
+            error.TooManyNestedGroups => setError("RTF too deeply nested"),
+            error.OutOfMemory => setError("Out of memory"),
+        }
+        return switch (err) {
+            error.Stopped => RTF_ERROR,
+            error.OutOfMemory => RTF_NOMEM,
+            else => RTF_INVALID,
+        };
+    };
+    return RTF_OK;
+}
+
+// =============================================================================
+// STATISTICS
+// =============================================================================
+
+pub export fn rtf_count(data: ?[*]const u8, length: usize, counts: ?*stats.Counts) c_int {
+    clearError();
+    if (data == null or length == 0 or counts == null) {
+        setError("Invalid input data");
+        return RTF_INVALID;
+    }
+    
+    counts.?.* = stats.count(data.?[0..length]) catch |err| {
+        switch (err) {
+            error.InvalidRtf => setError("Invalid RTF format"),
+            error.TooManyNestedGroups => setError("RTF too deeply nested"),
+        }
+        return RTF_INVALID;
+    };
+    return RTF_OK;
+}
+
+// =============================================================================
+// HEADER PROBE
+// =============================================================================
+
+const RTF_COLOR_AUTO: u32 = 0xFFFFFFFF; // (match c_api.h)
+
+// Layout matches rtf_probe_font in c_api.h
+const ProbeFont = extern struct {
+    name: [*:0]const u8,
+    id: u16,
+    family: u8,
+    charset: u8,
+};
+
+// Layout matches rtf_probe_info in c_api.h
+const ProbeInfo = extern struct {
+    version: u32,
+    code_page: u32,
+    default_font: i32,
+    charset: [*:0]const u8,
+    fonts: [*]const ProbeFont,
+    font_count: usize,
+    colors: [*]const u32,
+    color_count: usize,
+    title: [*:0]const u8,
+    subject: [*:0]const u8,
+    author: [*:0]const u8,
+    manager: [*:0]const u8,
+    company: [*:0]const u8,
+    last_author: [*:0]const u8,
+    category: [*:0]const u8,
+    keywords: [*:0]const u8,
+    comment: [*:0]const u8,
+    created: header_probe.Time,
+    revised: header_probe.Time,
+    printed: header_probe.Time,
+    pages: i64,
+    words: i64,
+    characters: i64,
+    characters_with_spaces: i64,
+    editing_minutes: i64,
+    header_length: usize,
+    storage: ?*anyopaque, // Arena holding the names, fonts and colors
+};
+
+pub export fn rtf_probe(data: ?[*]const u8, length: usize, info: ?*ProbeInfo) c_int {
+    clearError();
+    // Nothing to release unless the probe succeeds
+    if (info) |result| result.storage = null;
+    if (data == null or length == 0 or info == null) {
+        setError("Invalid input data");
+        return RTF_INVALID;
+    }
+    
+    const allocator = std.heap.page_allocator;
+    const arena = allocator.create(std.heap.ArenaAllocator) catch {
+        setError("Out of memory");
+        return RTF_NOMEM;
+    };
+    arena.* = std.heap.ArenaAllocator.init(allocator);
+    
+    fillProbeInfo(arena, data.?[0..length], info.?) catch |err| {
+        arena.deinit();
+        allocator.destroy(arena);
+        switch (err) {
+            error.OutOfMemory => {
+                setError("Out of memory");
+                return RTF_NOMEM;
+            },
+            error.InvalidRtf => setError("Invalid RTF format"),
+            error.TooManyNestedGroups => setError("RTF too deeply nested"),
+        }
+        return RTF_INVALID;
+    };
+    return RTF_OK;
+}
 
-pub export fn rtf_free(doc: ?*EnhancedDocument) void {
-    if (doc == null) return;
-    
-    const allocator = std.heap.page_allocator;
+fn fillProbeInfo(arena: *std.heap.ArenaAllocator, data: []const u8, info: *ProbeInfo) !void {
+    const allocator = arena.allocator();
+    const probed = try header_probe.probe(allocator, data);
     
-    // Free formatted runs text
-    for (doc.?.runs) |run| {
-        allocator.free(std.mem.span(run.text));
-        allocator.free(std.mem.span(run.font_name));
+    const fonts = try allocator.alloc(ProbeFont, probed.fonts.len);
+    for (fonts, probed.fonts) |*font, entry| {
+        font.* = .{ .name = entry.name.ptr, .id = entry.id, .family = @intFromEnum(entry.family), .charset = entry.charset };
     }
-    
-    // Free enhanced document data
-    doc.?.deinit(allocator);
-    
-    // Free document itself
-    doc.?.document_ptr.deinit();
-    allocator.destroy(doc.?.document_ptr);
-    
-    // Free enhanced document struct
-    allocator.destroy(doc.?);
+    const colors = try allocator.alloc(u32, probed.colors.len);
+    for (colors, probed.colors) |*color, entry| color.* = entry orelse RTF_COLOR_AUTO;
+    
+    info.* = .{
+        .version = probed.version,
+        .code_page = probed.code_page orelse 0,
+        .default_font = if (probed.default_font) |font| font else -1,
+        .charset = @tagName(probed.charset),
+        .fonts = fonts.ptr,
+        .font_count = fonts.len,
+        .colors = colors.ptr,
+        .color_count = colors.len,
+        .title = probed.title.ptr,
+        .subject = probed.subject.ptr,
+        .author = probed.author.ptr,
+        .manager = probed.manager.ptr,
+        .company = probed.company.ptr,
+        .last_author = probed.last_author.ptr,
+        .category = probed.category.ptr,
+        .keywords = probed.keywords.ptr,
+        .comment = probed.comment.ptr,
+        .created = probed.created,
+        .revised = probed.revised,
+        .printed = probed.printed,
+        .pages = if (probed.pages) |value| value else -1,
+        .words = if (probed.words) |value| value else -1,
+        .characters = if (probed.characters) |value| value else -1,
+        .characters_with_spaces = if (probed.characters_with_spaces) |value| value else -1,
+        .editing_minutes = if (probed.editing_minutes) |value| value else -1,
+        .header_length = probed.header_length,
+        .storage = arena,
+    };
+}
+
+pub export fn rtf_probe_free(info: ?*ProbeInfo) void {
+    const probed = info orelse return;
+    const arena: *std.heap.ArenaAllocator = @ptrCast(@alignCast(probed.storage orelse return));
+    arena.deinit();
+    std.heap.page_allocator.destroy(arena);
+    probed.storage = null;
 }
 
 // =============================================================================
@@ -621,6 +2229,88 @@ pub export fn rtf_parse_file(filename: [*:0]const u8) ?*EnhancedDocument {
     return rtf_parse(@ptrCast(content.ptr), content.len);
 }
 
+// =============================================================================
+// SNAPSHOTS
+// =============================================================================
+
+// Snapshot writer interface - mirror of RtfReader
+const RtfWriter = extern struct {
+    write: *const fn (context: ?*anyopaque, data: ?*const anyopaque, count: usize) callconv(.C) c_int,
+    context: ?*anyopaque,
+};
+
+// std.io writer over an RtfWriter
+const WriterAdapter = struct {
+    rtf_writer: *RtfWriter,
+    
+    const Error = error{WriteFailed};
+    const Writer = std.io.Writer(*@This(), Error, write);
+    
+    fn write(self: *@This(), bytes: []const u8) Error!usize {
+        // The callback reports an int, so hand it at most that much at once
+        const count = @min(bytes.len, std.math.maxInt(c_int));
+        const written = self.rtf_writer.write(self.rtf_writer.context, bytes.ptr, count);
+        if (written <= 0) return Error.WriteFailed;
+        return @min(@as(usize, @intCast(written)), count);
+    }
+    
+    fn getWriter(self: *@This()) Writer {
+        return .{ .context = self };
+    }
+};
+
+pub export fn rtf_document_save(doc: ?*EnhancedDocument, writer: ?*RtfWriter) c_int {
+    clearError();
+    
+    if (doc == null) {
+        setError("Null document");
+        return RTF_INVALID;
+    }
+    if (writer == null) {
+        setError("Null writer");
+        return RTF_INVALID;
+    }
+    
+    var adapter = WriterAdapter{ .rtf_writer = writer.? };
+    
+    snapshot.save(doc.?.document_ptr, adapter.getWriter()) catch |err| {
+        switch (err) {
+            error.OutOfMemory => {
+                setError("Out of memory writing snapshot");
+                return RTF_NOMEM;
+            },
+            else => setError("Could not write snapshot"),
+        }
+        return RTF_ERROR;
+    };
+    
+    return RTF_OK;
+}
+
+pub export fn rtf_document_load_mmap(path: ?[*:0]const u8) ?*EnhancedDocument {
+    clearError();
+    
+    if (path == null) {
+        setError("Null path");
+        return null;
+    }
+    
+    const allocator = std.heap.page_allocator;
+    
+    const document = snapshot.loadFile(std.mem.span(path.?), allocator) catch |err| {
+        switch (err) {
+            error.InvalidSnapshot => setError("Invalid snapshot"),
+            error.UnsupportedSnapshotVersion => setError("Unsupported snapshot version"),
+            error.OutOfMemory => setError("Out of memory"),
+            error.FileNotFound => setError("Could not open file"),
+            else => setError("Could not load snapshot"),
+        }
+        return null;
+    };
+    
+    return wrapDocument(document, allocator);
+}
+
 export fn rtf_version() [*:0]const u8 {
     return "ZigRTF 1.0.0 - Formatted Edition";
 }
@@ -663,7 +2353,7 @@ pub export fn rtf_parse_stream(reader: *RtfReader) ?*EnhancedDocument {
     };
     defer parser.deinit();
     
-    var document = parser.parse() catch |err| {
+    const document = parser.parse() catch |err| {
         switch (err) {
             error.InvalidRtf => setError("Invalid RTF format"),
             error.EmptyInput => setError("Empty input"),
@@ -674,25 +2364,7 @@ pub export fn rtf_parse_stream(reader: *RtfReader) ?*EnhancedDocument {
         return null;
     };
     
-    // Allocate document on heap to ensure stable pointers
-    const doc_ptr = allocator.create(doc_model.Document) catch {
-        document.deinit();
-        setError("Out of memory");
-        return null;
-    };
-    doc_ptr.* = document;
-    
-    // Convert to enhanced document
-    const enhanced = createEnhancedDocument(doc_ptr, allocator) catch |err| {
-        doc_ptr.deinit();
-        allocator.destroy(doc_ptr);
-        switch (err) {
-            error.OutOfMemory => setError("Out of memory creating enhanced document"),
-        }
-        return null;
-    };
-    
-    return enhanced;
+    return wrapDocument(document, allocator);
 }
 
 export fn rtf_file_reader(file_handle: ?*anyopaque) RtfReader {
@@ -721,6 +2393,14 @@ export fn rtf_file_reader(file_handle: ?*anyopaque) RtfReader {
 // TESTS
 // =============================================================================
 
+// RtfWriter callback collecting the output in the std.ArrayList(u8) passed as context
+fn appendToBuffer(context: ?*anyopaque, data: ?*const anyopaque, count: usize) callconv(.C) c_int {
+    const buffer: *std.ArrayList(u8) = @ptrCast(@alignCast(context));
+    const bytes: [*]const u8 = @ptrCast(data);
+    buffer.appendSlice(bytes[0..count]) catch return -1;
+    return @intCast(count);
+}
+
 test "c api formatted - simple document" {
     const testing = std.testing;
     
@@ -1180,4 +2860,681 @@ test "c api formatted - table access" {
     // Check cell widths are present
     const width1 = rtf_table_get_cell_width(table, 0, 0);
     try testing.expect(width1 > 0);
-}
\ No newline at end of file
+}
+
+test "c api formatted - snapshot save and load" {
+    const testing = std.testing;
+    
+    const doc = rtf_parse_file("test/data/rtf_with_table.rtf").?;
+    defer rtf_free(doc);
+    
+    // Collect the snapshot through the C writer callback
+    var buffer = std.ArrayList(u8).init(testing.allocator);
+    defer buffer.deinit();
+    var writer = RtfWriter{ .write = appendToBuffer, .context = &buffer };
+    try testing.expectEqual(RTF_OK, rtf_document_save(doc, &writer));
+    
+    var tmp = testing.tmpDir(.{});
+    defer tmp.cleanup();
+    try tmp.dir.writeFile(.{ .sub_path = "doc.zrtf", .data = buffer.items });
+    
+    const path = try std.fmt.allocPrintZ(testing.allocator, ".zig-cache/tmp/{s}/doc.zrtf", .{tmp.sub_path});
+    defer testing.allocator.free(path);
+    
+    const loaded = rtf_document_load_mmap(path.ptr) orelse return error.LoadFailed;
+    defer rtf_free(loaded);
+    
+    // Same views as the parsed document, without re-parsing
+    try testing.expectEqualStrings(std.mem.span(rtf_get_text(doc)), std.mem.span(rtf_get_text(loaded)));
+    try testing.expectEqual(rtf_get_run_count(doc), rtf_get_run_count(loaded));
+    try testing.expectEqual(rtf_get_table_count(doc), rtf_get_table_count(loaded));
+    
+    const cell_text = rtf_table_get_cell_text(rtf_get_table(loaded, 0), 0, 0).?;
+    try testing.expect(std.mem.indexOf(u8, std.mem.span(cell_text), "Header 1") != null);
+    
+    // Garbage is rejected rather than trusted
+    try testing.expect(rtf_document_load_mmap("test/data/simple.rtf") == null);
+}
+
+test "c api formatted - parse cache shares documents" {
+    const testing = std.testing;
+    
+    const cache = rtf_cache_new(16 * 1024 * 1024).?;
+    defer rtf_cache_free(cache);
+    
+    const rtf_data = "{\\rtf1 Hello \\b cached\\b0  world}";
+    
+    const first = rtf_parse_cached(cache, rtf_data.ptr, rtf_data.len).?;
+    const second = rtf_parse_cached(cache, rtf_data.ptr, rtf_data.len).?;
+    try testing.expect(first == second);
+    
+    // The document and its views share one block
+    const block = first.document_ptr.block.?;
+    try testing.expectEqual(@as(usize, 0), first.document_ptr.arena.queryCapacity());
+    try testing.expect(@intFromPtr(first.runs.ptr) > @intFromPtr(block.ptr));
+    try testing.expect(@intFromPtr(first.runs.ptr) < @intFromPtr(block.ptr) + block.len);
+    try testing.expectEqual(@as(usize, 3), rtf_get_run_count(first));
+    
+    // Only the block is charged, not the lists viewed in it as well
+    const uncompacted = rtf_parse(rtf_data.ptr, rtf_data.len).?;
+    defer rtf_free(uncompacted);
+    const base = @sizeOf(EnhancedDocument) + @sizeOf(doc_model.Document);
+    try testing.expectEqual(base + block.len, first.memoryFootprint());
+    try testing.expect(first.memoryFootprint() < uncompacted.memoryFootprint());
+    
+    // Caller references are independent of the cache's own
+    rtf_free(first);
+    try testing.expectEqualStrings("Hello cached world", std.mem.span(rtf_get_text(second)));
+    rtf_free(second);
+    
+    const other = "{\\rtf1 Something else}";
+    const third = rtf_parse_cached(cache, other.ptr, other.len).?;
+    defer rtf_free(third);
+    try testing.expectEqualStrings("Something else", std.mem.span(rtf_get_text(third)));
+}
+
+test "c api formatted - retained document shared across threads" {
+    const testing = std.testing;
+    
+    const rtf_data = "{\\rtf1 Shared \\b across\\b0  threads}";
+    const doc = rtf_parse(rtf_data.ptr, rtf_data.len).?;
+    
+    const Reader = struct {
+        fn run(shared: *EnhancedDocument, ok: *bool) void {
+            // Each worker owns one reference and drops it when done
+            defer rtf_release(shared);
+            
+            var matches = true;
+            for (0..1000) |_| {
+                matches = matches and std.mem.eql(u8, "Shared across threads", std.mem.span(rtf_get_text(shared)));
+                matches = matches and rtf_get_run(shared, 1).?.bold;
+            }
+            ok.* = matches;
+        }
+    };
+    
+    var ok = [_]bool{false} ** 4;
+    var threads: [4]std.Thread = undefined;
+    for (&threads, &ok) |*thread, *result| {
+        thread.* = try std.Thread.spawn(.{}, Reader.run, .{ rtf_retain(doc).?, result });
+    }
+    
+    // The creating reference can go first - workers keep the document alive
+    rtf_release(doc);
+    
+    for (threads) |thread| thread.join();
+    for (ok) |result| try testing.expect(result);
+    
+    try testing.expect(rtf_retain(null) == null);
+}
+
+test "c api formatted - parse context reuses storage" {
+    const testing = std.testing;
+    
+    const context = rtf_context_new().?;
+    
+    const notes = [_][]const u8{
+        "{\\rtf1{\\fonttbl{\\f0 Arial;}}\\f0 First \\b note\\b0}",
+        "{\\rtf1 Second}",
+        "{\\rtf1 Third \\i line\\i0}",
+    };
+    const expected = [_][]const u8{ "First note", "Second", "Third line" };
+    
+    // Documents freed between parses come back as spares
+    for (0..3) |_| {
+        for (notes, expected) |note, text| {
+            const doc = rtf_parse_with(context, note.ptr, note.len).?;
+            defer rtf_free(doc);
+            try testing.expectEqualStrings(text, std.mem.span(rtf_get_text(doc)));
+        }
+    }
+    
+    // A recycled document carries nothing over from its previous use
+    const plain = rtf_parse_with(context, notes[1].ptr, notes[1].len).?;
+    try testing.expectEqual(@as(usize, 0), rtf_get_font_count(plain));
+    try testing.expectEqual(@as(usize, 1), rtf_get_run_count(plain));
+    rtf_free(plain);
+    
+    // Failures leave the context usable
+    try testing.expect(rtf_parse_with(context, "not rtf", 7) == null);
+    
+    const last = rtf_parse_with(context, notes[0].ptr, notes[0].len).?;
+    
+    // The context outlives its owner while documents still use it
+    rtf_context_free(context);
+    try testing.expectEqualStrings("First note", std.mem.span(rtf_get_text(last)));
+    try testing.expectEqual(@as(usize, 1), rtf_get_font_count(last));
+    rtf_free(last);
+}
+
+test "c api formatted - table cells are viewed in place" {
+    const testing = std.testing;
+    
+    const rtf_data = "{\\rtf1\\trowd\\cellx1000\\cellx2500 plain\\cell mixed \\b bold\\b0\\cell\\row}";
+    const doc = rtf_parse(rtf_data.ptr, rtf_data.len).?;
+    defer rtf_free(doc);
+    
+    const table = rtf_get_table(doc, 0).?;
+    try testing.expectEqual(@as(usize, 1), rtf_table_get_row_count(table));
+    try testing.expectEqual(@as(usize, 2), rtf_table_get_cell_count(table, 0));
+    try testing.expectEqual(@as(u32, 2500), rtf_table_get_cell_width(table, 0, 1));
+    
+    // A single-run cell hands out the run text itself
+    const plain = rtf_table_get_cell_text(table, 0, 0).?;
+    try testing.expectEqual(rtf_get_run(doc, 0).?.text, plain);
+    try testing.expectEqualStrings("plain", std.mem.span(plain));
+    
+    // Multi-run cells are joined once, then reused
+    const mixed = rtf_table_get_cell_text(table, 0, 1).?;
+    try testing.expectEqualStrings("mixed bold", std.mem.span(mixed));
+    try testing.expectEqual(mixed, rtf_table_get_cell_text(table, 0, 1).?);
+    
+    try testing.expect(rtf_table_get_cell_text(table, 0, 2) == null);
+    try testing.expect(rtf_table_get_cell_text(table, 1, 0) == null);
+}
+
+test "c api formatted - character offset index" {
+    const testing = std.testing;
+    
+    const rtf_data = "{\\rtf1 One \\b two\\b0\\par Three\\par\\trowd\\cellx1000 cell\\cell\\row\\par Four}";
+    const doc = rtf_parse(rtf_data.ptr, rtf_data.len).?;
+    defer rtf_free(doc);
+    
+    const text = std.mem.span(rtf_get_text(doc));
+    
+    // Every offset maps back to the run whose text is there
+    for (0..rtf_get_run_count(doc)) |i| {
+        const run = rtf_get_run(doc, i).?;
+        const offset = rtf_get_run_offset(doc, i);
+        try testing.expectEqualStrings(std.mem.span(run.text), text[offset..][0..run.length]);
+        try testing.expectEqual(i, rtf_find_run_at(doc, offset + run.length - 1));
+    }
+    try testing.expectEqual(RTF_NPOS, rtf_find_run_at(doc, text.len));
+    
+    // One two | Three | cell | Four
+    try testing.expectEqual(@as(usize, 4), rtf_get_paragraph_count(doc));
+    const third = rtf_get_paragraph(doc, 2).?;
+    try testing.expectEqualStrings("cell\t", text[third.start..][0..third.len]);
+    try testing.expectEqual(rtf_table_get_text_offset(rtf_get_table(doc, 0)), third.start);
+    try testing.expectEqual(@as(usize, 3), rtf_find_paragraph_at(doc, std.mem.indexOf(u8, text, "Four").?));
+    
+    var first: usize = undefined;
+    try testing.expectEqual(@as(usize, 2), rtf_get_runs_in_range(doc, 0, std.mem.indexOf(u8, text, "Three").?, &first));
+    try testing.expectEqual(@as(usize, 0), first);
+}
+
+test "c api formatted - source map" {
+    const testing = std.testing;
+    
+    const rtf_data = "{\\rtf1 One \\b two\\b0\\par\\trowd\\cellx1000 cell\\cell\\row\\par{\\pict\\pngblip 89504e47}}";
+    const doc = rtf_parse_ex(rtf_data.ptr, rtf_data.len, RTF_PARSE_SOURCE_MAP).?;
+    defer rtf_free(doc);
+    
+    var range: SourceRange = undefined;
+    try testing.expectEqual(RTF_OK, rtf_get_run_source(doc, 1, &range));
+    try testing.expectEqualStrings("two", rtf_data[range.start..range.end]);
+    
+    try testing.expectEqual(RTF_OK, rtf_get_paragraph_source(doc, 0, &range));
+    try testing.expectEqualStrings("One \\b two", rtf_data[range.start..range.end]);
+    
+    const table = rtf_get_table(doc, 0).?;
+    try testing.expectEqual(RTF_OK, rtf_table_get_source(table, &range));
+    try testing.expectEqualStrings("\\trowd\\cellx1000 cell\\cell\\row", rtf_data[range.start..range.end]);
+    try testing.expectEqual(RTF_OK, rtf_table_get_cell_source(table, 0, 0, &range));
+    try testing.expectEqualStrings("cell\\cell", rtf_data[range.start..range.end]);
+    
+    try testing.expectEqual(RTF_OK, rtf_get_image_source(doc, 0, &range));
+    try testing.expectEqualStrings("{\\pict\\pngblip 89504e47}", rtf_data[range.start..range.end]);
+    try testing.expectEqual(RTF_INVALID, rtf_get_run_source(doc, 3, &range));
+    
+    // Only recorded on request
+    const plain = rtf_parse(rtf_data.ptr, rtf_data.len).?;
+    defer rtf_free(plain);
+    try testing.expectEqual(RTF_INVALID, rtf_get_run_source(plain, 0, &range));
+}
+
+test "c api formatted - checkpointed range parsing" {
+    const testing = std.testing;
+    
+    var rtf = std.ArrayList(u8).init(testing.allocator);
+    defer rtf.deinit();
+    try rtf.appendSlice("{\\rtf1{\\fonttbl{\\f0 Arial;}}\\b ");
+    for (0..200) |i| try rtf.writer().print("Paragraph {d}\\par ", .{i});
+    try rtf.append('}');
+    
+    var checkpoints: ?*Checkpoints = null;
+    const doc = rtf_parse_checkpointed(rtf.items.ptr, rtf.items.len, 512, &checkpoints).?;
+    defer rtf_free(doc);
+    defer rtf_checkpoints_free(checkpoints);
+    
+    const count = rtf_checkpoints_count(checkpoints);
+    try testing.expect(count > 4);
+    
+    // A page from the middle keeps the formatting set at the top
+    const start = rtf_checkpoint_offset(checkpoints, 3);
+    const end = rtf_checkpoint_offset(checkpoints, 4);
+    const page = rtf_parse_range(rtf.items.ptr, rtf.items.len, checkpoints, start, end).?;
+    defer rtf_free(page);
+    
+    try testing.expect(rtf_get_run_count(page) > 0);
+    try testing.expect(rtf_get_run(page, 0).?.bold);
+    try testing.expect(std.mem.indexOf(u8, std.mem.span(rtf_get_text(doc)), std.mem.span(rtf_get_text(page))) != null);
+    try testing.expectEqual(RTF_NPOS, rtf_checkpoint_offset(checkpoints, count));
+    
+    try testing.expect(rtf_parse_range(rtf.items.ptr, 10, checkpoints, 0, 10) == null);
+}
+
+test "c api formatted - editor" {
+    const testing = std.testing;
+    
+    const rtf_data = "{\\rtf1 Hello world\\par \\trowd\\cellx1000 A\\cell\\row}";
+    const doc = rtf_parse(rtf_data.ptr, rtf_data.len).?;
+    defer rtf_free(doc);
+    
+    const editor = rtf_editor_new(doc).?;
+    defer rtf_editor_free(editor);
+    
+    try testing.expectEqual(RTF_OK, rtf_editor_insert_text(editor, 5, ",", 1));
+    try testing.expectEqual(RTF_OK, rtf_editor_set_style(editor, 0, 6, RTF_STYLE_BOLD, 0));
+    try testing.expectEqual(RTF_OK, rtf_editor_delete(editor, 6, 12)); // " world"
+    try testing.expectEqual(RTF_INVALID, rtf_editor_delete(editor, 0, rtf_editor_length(editor) + 1));
+    
+    const table_offset = rtf_editor_table_offset(editor, 0);
+    try testing.expect(table_offset != RTF_NPOS);
+    const cells = [_]?[*:0]const u8{"B"};
+    try testing.expectEqual(RTF_OK, rtf_editor_insert_table_row(editor, table_offset, 1, &cells, cells.len));
+    try testing.expectEqual(RTF_INVALID, rtf_editor_insert_table_row(editor, 0, 0, &cells, cells.len));
+    
+    const edited = rtf_editor_to_document(editor).?;
+    defer rtf_free(edited);
+    try testing.expect(rtf_get_run(edited, 0).?.bold);
+    try testing.expectEqualStrings("Hello,", std.mem.span(rtf_get_run(edited, 0).?.text));
+    try testing.expectEqual(@as(usize, 2), rtf_table_get_row_count(rtf_get_table(edited, 0)));
+    
+    const rtf = rtf_editor_generate(editor).?;
+    defer rtf_free_string(rtf);
+    try testing.expect(std.mem.indexOf(u8, std.mem.span(rtf), "Hello,") != null);
+}
+
+test "c api formatted - editor copy-through" {
+    const testing = std.testing;
+    
+    const rtf_data = "{\\rtf1{\\*\\custom data}Keep {\\*\\mine x}this\\par Change this\\par}";
+    const doc = rtf_parse_ex(rtf_data.ptr, rtf_data.len, RTF_PARSE_SOURCE_MAP).?;
+    defer rtf_free(doc);
+    const editor = rtf_editor_new(doc).?;
+    defer rtf_editor_free(editor);
+    try testing.expectEqual(RTF_OK, rtf_editor_delete(editor, 10, 22)); // "Change this\n"
+    
+    var buffer = std.ArrayList(u8).init(testing.allocator);
+    defer buffer.deinit();
+    var writer = RtfWriter{ .write = appendToBuffer, .context = &buffer };
+    try testing.expectEqual(RTF_OK, rtf_editor_write(editor, rtf_data.ptr, rtf_data.len, &writer));
+    try testing.expectEqualStrings("{\\rtf1{\\*\\custom data}Keep {\\*\\mine x}this\\par }", buffer.items);
+    
+    try testing.expectEqual(RTF_INVALID, rtf_editor_write(editor, rtf_data.ptr, 4, &writer));
+}
+
+test "c api formatted - json export" {
+    const testing = std.testing;
+    
+    const rtf_data = "{\\rtf1 Hello \\b world\\b0\\par Second}";
+    var from_input = std.ArrayList(u8).init(testing.allocator);
+    defer from_input.deinit();
+    var writer = RtfWriter{ .write = appendToBuffer, .context = &from_input };
+    try testing.expectEqual(RTF_OK, rtf_export_json_input(rtf_data.ptr, rtf_data.len, &writer, RTF_JSON_LINES));
+    try testing.expectEqual(@as(usize, 2), std.mem.count(u8, from_input.items, "\n"));
+    try testing.expect(std.mem.indexOf(u8, from_input.items, "{\"text\":\"world\",\"bold\":true}") != null);
+    
+    // Same output from a parsed document
+    const doc = rtf_parse(rtf_data.ptr, rtf_data.len).?;
+    defer rtf_free(doc);
+    var from_document = std.ArrayList(u8).init(testing.allocator);
+    defer from_document.deinit();
+    writer.context = &from_document;
+    try testing.expectEqual(RTF_OK, rtf_export_json(doc, &writer, RTF_JSON_LINES));
+    try testing.expectEqualStrings(from_input.items, from_document.items);
+    
+    try testing.expectEqual(RTF_ERROR, rtf_export_json_input("not rtf", 7, &writer, 0));
+}
+
+test "c api formatted - html and markdown" {
+    const testing = std.testing;
+    
+    const rtf_data = "{\\rtf1 Hello \\b world\\b0\\par {\\pict\\jpegblip ffd8}}";
+    var html = std.ArrayList(u8).init(testing.allocator);
+    defer html.deinit();
+    var writer = RtfWriter{ .write = appendToBuffer, .context = &html };
+    try testing.expectEqual(RTF_OK, rtf_to_html(rtf_data.ptr, rtf_data.len, &writer, 0));
+    try testing.expect(std.mem.startsWith(u8, html.items, "<p>Hello <b>world</b></p>\n"));
+    try testing.expect(std.mem.indexOf(u8, html.items, "data:image/jpeg;base64,/9g=") != null);
+    
+    var markdown = std.ArrayList(u8).init(testing.allocator);
+    defer markdown.deinit();
+    writer.context = &markdown;
+    try testing.expectEqual(RTF_OK, rtf_to_markdown(rtf_data.ptr, rtf_data.len, &writer, RTF_CONVERT_IMAGE_REFS));
+    try testing.expect(std.mem.startsWith(u8, markdown.items, "Hello **world**\n\n![](image0.jpg)"));
+    
+    try testing.expectEqual(RTF_INVALID, rtf_to_html(null, 0, &writer, 0));
+    try testing.expectEqual(RTF_ERROR, rtf_to_markdown("not rtf", 7, &writer, 0));
+}
+
+test "c api formatted - tables to csv" {
+    const testing = std.testing;
+    
+    const Failing = struct {
+        fn write(context: ?*anyopaque, data: ?*const anyopaque, count: usize) callconv(.C) c_int {
+            _ = context;
+            _ = data;
+            _ = count;
+            return -1;
+        }
+    };
+    
+    const rtf_data = "{\\rtf1 \\trowd\\cellx1000\\cellx2000 a\\cell b\\cell\\row\\par " ++
+        "\\trowd\\cellx1000\\cellx2000 c,d\\cell e\\cell\\row\\par}";
+    var output = std.ArrayList(u8).init(testing.allocator);
+    defer output.deinit();
+    var writer = RtfWriter{ .write = appendToBuffer, .context = &output };
+    try testing.expectEqual(RTF_OK, rtf_tables_to_csv(rtf_data.ptr, rtf_data.len, &writer, 0, RTF_ALL_TABLES));
+    try testing.expectEqualStrings("a,b\n\n\"c,d\",e\n", output.items);
+    
+    output.clearRetainingCapacity();
+    try testing.expectEqual(RTF_OK, rtf_tables_to_csv(rtf_data.ptr, rtf_data.len, &writer, RTF_CSV_TSV, 1));
+    try testing.expectEqualStrings("c,d\te\n", output.items);
+    
+    var failing = RtfWriter{ .write = Failing.write, .context = null };
+    try testing.expectEqual(RTF_ERROR, rtf_tables_to_csv(rtf_data.ptr, rtf_data.len, &failing, 0, RTF_ALL_TABLES));
+    try testing.expectEqualStrings("Could not write CSV", std.mem.span(rtf_errmsg()));
+}
+
+test "c api formatted - search" {
+    const testing = std.testing;
+    
+    const Collector = struct {
+        found: std.ArrayList(u8),
+        
+        fn record(context: ?*anyopaque, hit: *const text_search.Hit) callconv(.C) c_int {
+            const self: *@This() = @ptrCast(@alignCast(context.?));
+            self.found.writer().print("{d}:{s}@{d} ", .{ hit.pattern, hit.text[0..hit.text_length], hit.start }) catch return 1;
+            return 0;
+        }
+        
+        fn stop(_: ?*anyopaque, _: *const text_search.Hit) callconv(.C) c_int {
+            return 1;
+        }
+    };
+    
+    const rtf_data = "{\\rtf1{\\*\\comment hidden}Quarterly \\b Rev\\b0 enue\\par revenue {\\fldinst HYPERLINK x}}";
+    var collector = Collector{ .found = std.ArrayList(u8).init(testing.allocator) };
+    defer collector.found.deinit();
+    try testing.expectEqual(RTF_OK, rtf_search(rtf_data.ptr, rtf_data.len, "revenue", 0, Collector.record, &collector));
+    try testing.expectEqualStrings("0:revenue@54 ", collector.found.items);
+    
+    collector.found.clearRetainingCapacity();
+    try testing.expectEqual(RTF_OK, rtf_search(rtf_data.ptr, rtf_data.len, "REVENUE\nhidden\nhyperlink", RTF_SEARCH_LINES | RTF_SEARCH_IGNORE_CASE, Collector.record, &collector));
+    try testing.expectEqualStrings("0:Revenue@38 0:revenue@54 ", collector.found.items);
+    
+    try testing.expectEqual(RTF_ERROR, rtf_search(rtf_data.ptr, rtf_data.len, "revenue", 0, Collector.stop, null));
+    try testing.expectEqual(RTF_INVALID, rtf_search(rtf_data.ptr, rtf_data.len, "", 0, Collector.record, null));
+    try testing.expectEqual(RTF_INVALID, rtf_search("plain", 5, "plain", 0, Collector.record, null));
+}
+
+test "c api formatted - count" {
+    const testing = std.testing;
+    
+    const rtf_data = "{\\rtf1{\\fonttbl{\\f0 Arial;}}One two\\par \\trowd\\cellx1000 three\\cell\\row\\pard\\par{\\pict 00}}";
+    var counts: stats.Counts = undefined;
+    try testing.expectEqual(RTF_OK, rtf_count(rtf_data.ptr, rtf_data.len, &counts));
+    try testing.expectEqual(@as(usize, 3), counts.words);
+    try testing.expectEqual(@as(usize, 2), counts.paragraphs);
+    try testing.expectEqual(@as(usize, 1), counts.tables);
+    try testing.expectEqual(@as(usize, 1), counts.cells);
+    try testing.expectEqual(@as(usize, 1), counts.images);
+    
+    try testing.expectEqual(RTF_INVALID, rtf_count("text", 4, &counts));
+    try testing.expectEqual(RTF_INVALID, rtf_count(rtf_data.ptr, rtf_data.len, null));
+}
+
+test "c api formatted - probe" {
+    const testing = std.testing;
+    
+    const rtf_data =
+        "{\\rtf1\\ansi\\ansicpg1252\\deff0{\\fonttbl{\\f0\\fswiss\\fcharset0 Arial;}}{\\colortbl;\\red0\\green0\\blue255;}" ++
+        "{\\info{\\title Notes}{\\creatim\\yr2025\\mo3\\dy9}{\\nofwords2}}\\pard Hello world\\par}";
+    var info: ProbeInfo = undefined;
+    try testing.expectEqual(RTF_OK, rtf_probe(rtf_data.ptr, rtf_data.len, &info));
+    defer rtf_probe_free(&info);
+    
+    try testing.expectEqual(@as(u32, 1), info.version);
+    try testing.expectEqualStrings("ansi", std.mem.span(info.charset));
+    try testing.expectEqual(@as(u32, 1252), info.code_page);
+    try testing.expectEqual(@as(i32, 0), info.default_font);
+    try testing.expectEqual(@as(usize, 1), info.font_count);
+    try testing.expectEqualStrings("Arial", std.mem.span(info.fonts[0].name));
+    try testing.expectEqual(@as(u8, 2), info.fonts[0].family); // Swiss
+    try testing.expectEqualSlices(u32, &.{ RTF_COLOR_AUTO, 0x0000ff }, info.colors[0..info.color_count]);
+    try testing.expectEqualStrings("Notes", std.mem.span(info.title));
+    try testing.expectEqualStrings("", std.mem.span(info.author));
+    try testing.expectEqual(@as(u16, 2025), info.created.year);
+    try testing.expectEqual(@as(i64, 2), info.words);
+    try testing.expectEqual(@as(i64, -1), info.pages);
+    try testing.expect(std.mem.startsWith(u8, rtf_data[info.header_length..], "\\pard"));
+    
+    var invalid: ProbeInfo = undefined;
+    try testing.expectEqual(RTF_INVALID, rtf_probe("text", 4, &invalid));
+    rtf_probe_free(&invalid); // Nothing to release
+    try testing.expectEqual(RTF_INVALID, rtf_probe(rtf_data.ptr, rtf_data.len, null));
+}
+
+test "c api formatted - parse preview" {
+    const testing = std.testing;
+    
+    const rtf_data = "{\\rtf1 \\b First\\b0  paragraph\\par Second\\par{\\pict\\pngblip 89504e47}Third\\par}";
+    var truncated: c_int = -1;
+    
+    const head = rtf_parse_preview(rtf_data.ptr, rtf_data.len, 0, 2, &truncated).?;
+    defer rtf_free(head);
+    try testing.expectEqualStrings("First paragraph\n\nSecond\n\n", std.mem.span(rtf_get_text(head)));
+    try testing.expectEqual(@as(c_int, 1), truncated);
+    try testing.expectEqual(@as(usize, 0), rtf_get_image_count(head));
+    
+    const start = rtf_parse_preview(rtf_data.ptr, rtf_data.len, 5, 0, &truncated).?;
+    defer rtf_free(start);
+    try testing.expectEqualStrings("First", std.mem.span(rtf_get_text(start)));
+    try testing.expectEqual(@as(c_int, 1), truncated);
+    
+    const whole = rtf_parse_preview(rtf_data.ptr, rtf_data.len, 1000, 10, &truncated).?;
+    defer rtf_free(whole);
+    try testing.expectEqual(@as(c_int, 0), truncated);
+    try testing.expectEqual(@as(usize, 1), rtf_get_image_count(whole));
+    
+    try testing.expect(rtf_parse_preview(rtf_data.ptr, 0, 5, 0, null) == null);
+}
+
+test "c api formatted - arrow export" {
+    const testing = std.testing;
+    
+    const first_rtf = "{\\rtf1 One \\b two}";
+    const second_rtf = "{\\rtf1 Three}";
+    const first = rtf_parse(first_rtf.ptr, first_rtf.len).?;
+    defer rtf_free(first);
+    const second = rtf_parse(second_rtf.ptr, second_rtf.len).?;
+    defer rtf_free(second);
+    const docs = [_]?*EnhancedDocument{ first, second };
+    
+    var output = std.ArrayList(u8).init(testing.allocator);
+    defer output.deinit();
+    var writer = RtfWriter{ .write = appendToBuffer, .context = &output };
+    try testing.expectEqual(RTF_OK, rtf_export_arrow(&docs, docs.len, &writer, 0));
+    
+    // Schema and one batch, each starting with the continuation marker,
+    // then the end-of-stream marker; all the text is in the batch body
+    try testing.expect(std.mem.startsWith(u8, output.items, "\xff\xff\xff\xff"));
+    try testing.expect(std.mem.endsWith(u8, output.items, "\xff\xff\xff\xff\x00\x00\x00\x00"));
+    try testing.expect(std.mem.indexOf(u8, output.items, "One twoThree") != null);
+    try testing.expectEqual(@as(usize, 0), output.items.len % 8);
+    
+    try testing.expectEqual(RTF_INVALID, rtf_export_arrow(null, 1, &writer, 0));
+    try testing.expectEqual(RTF_INVALID, rtf_export_arrow(&docs, docs.len, &writer, 0x1));
+}
+
+test "c api formatted - bulk runs" {
+    const testing = std.testing;
+    
+    const rtf_data = "{\\rtf1 One \\b two\\b0  three}";
+    const doc = rtf_parse(rtf_data.ptr, rtf_data.len).?;
+    defer rtf_free(doc);
+    
+    // The whole array in one call, in rtf_get_run() order
+    var count: usize = 0;
+    const runs = rtf_get_runs_ptr(doc, &count).?;
+    try testing.expectEqual(rtf_get_run_count(doc), count);
+    try testing.expectEqual(rtf_get_run(doc, 1).?, &runs[1]);
+    try testing.expect(runs[1].bold);
+    
+    // Or a copy of a window of it
+    var window: [4]FormattedRun = undefined;
+    try testing.expectEqual(@as(usize, 2), rtf_get_runs(doc, 1, window.len, &window));
+    try testing.expectEqualStrings("two", window[0].text[0..window[0].length]);
+    try testing.expectEqualStrings(" three", std.mem.span(window[1].text));
+    try testing.expectEqual(@as(usize, 0), rtf_get_runs(doc, 3, window.len, &window));
+    try testing.expectEqual(@as(usize, 0), rtf_get_runs(doc, 0, 0, null));
+    
+    try testing.expect(rtf_get_runs_ptr(null, &count) == null);
+    try testing.expectEqual(@as(usize, 0), count);
+}
+
+test "c api formatted - compact runs" {
+    const testing = std.testing;
+    
+    const rtf_data = "{\\rtf1 One \\b two\\b0  three\\par \\qc\\b Four}";
+    const doc = rtf_parse(rtf_data.ptr, rtf_data.len).?;
+    defer rtf_free(doc);
+    
+    var count: usize = 0;
+    const runs = rtf_get_runs_v2(doc, &count).?;
+    try testing.expectEqual(rtf_get_run_count(doc), count);
+    var style_count: usize = 0;
+    const styles = rtf_get_styles(doc, &style_count).?;
+    try testing.expectEqual(@as(usize, 2), style_count);
+    
+    // Text is a range of the document text, same as rtf_get_run()
+    const text = rtf_get_text(doc);
+    for (runs[0..count], 0..) |run, i| {
+        const v1 = rtf_get_run(doc, i).?;
+        try testing.expectEqualStrings(v1.text[0..v1.length], text[run.text_offset..][0..run.text_length]);
+        try testing.expectEqual(v1.bold, run.flags & RTF_RUN_BOLD != 0);
+        try testing.expectEqual(styles[run.style].flags, run.flags);
+        try testing.expectEqual(v1.font_size, run.font_size);
+    }
+    
+    // Both bold runs share a style, and paragraphs number as rtf_get_paragraph()
+    try testing.expectEqual(runs[1].style, runs[count - 1].style);
+    try testing.expectEqual(@as(u32, 0), runs[1].paragraph);
+    try testing.expectEqual(@as(u32, 1), runs[count - 1].paragraph);
+    try testing.expectEqual(@as(u8, 1), runs[count - 1].alignment);
+    try testing.expectEqualStrings("Default", std.mem.span(styles[0].font_name));
+    
+    try testing.expect(rtf_get_styles(null, &style_count) == null);
+    try testing.expectEqual(@as(usize, 0), style_count);
+}
+
+test "c api formatted - struct layouts match c_api.h" {
+    const testing = std.testing;
+    const header = @cImport(@cInclude("c_api.h"));
+    
+    const pairs = .{
+        .{ FormattedRun, header.rtf_run },
+        .{ RunV2, header.rtf_run_v2 },
+        .{ RunStyle, header.rtf_style },
+        .{ ImageInfo, header.rtf_image },
+        .{ text_search.Hit, header.rtf_search_hit },
+        .{ stats.Counts, header.rtf_counts },
+        .{ header_probe.Time, header.rtf_time },
+        .{ ProbeFont, header.rtf_probe_font },
+        .{ ProbeInfo, header.rtf_probe_info },
+    };
+    inline for (pairs) |pair| {
+        try testing.expectEqual(@sizeOf(pair[1]), @sizeOf(pair[0]));
+        inline for (std.meta.fields(pair[0])) |field| {
+            try testing.expectEqual(@offsetOf(pair[1], field.name), @offsetOf(pair[0], field.name));
+        }
+    }
+    try testing.expectEqual(@as(c_int, RTF_RUN_SUBSCRIPT), header.RTF_RUN_SUBSCRIPT);
+    try testing.expectEqual(RTF_COLOR_AUTO, header.RTF_COLOR_AUTO);
+}
+
+test "c api formatted - diff" {
+    const testing = std.testing;
+    
+    const old_rtf = "{\\rtf1 Keep this.\\par Old words.}";
+    const new_rtf = "{\\rtf1 Keep \\i this\\i0 .\\par New words.}";
+    const doc_a = rtf_parse(old_rtf.ptr, old_rtf.len).?;
+    defer rtf_free(doc_a);
+    const doc_b = rtf_parse(new_rtf.ptr, new_rtf.len).?;
+    defer rtf_free(doc_b);
+    
+    const Collector = struct {
+        kinds: [8]doc_diff.Change.Kind = undefined,
+        count: usize = 0,
+        
+        fn record(context: ?*anyopaque, change: *const doc_diff.Change) callconv(.C) c_int {
+            const self: *@This() = @ptrCast(@alignCast(context.?));
+            self.kinds[self.count] = change.kind;
+            self.count += 1;
+            return 0;
+        }
+        
+        fn stop(_: ?*anyopaque, _: *const doc_diff.Change) callconv(.C) c_int {
+            return 1;
+        }
+    };
+    
+    var collector = Collector{};
+    try testing.expectEqual(RTF_OK, rtf_diff(doc_a, doc_b, Collector.record, &collector));
+    try testing.expectEqual(@as(usize, 3), collector.count); // "this" italic, "Old" -> "New"
+    try testing.expectEqual(doc_diff.Change.Kind.format, collector.kinds[0]);
+    try testing.expectEqual(doc_diff.Change.Kind.delete, collector.kinds[1]);
+    try testing.expectEqual(doc_diff.Change.Kind.insert, collector.kinds[2]);
+    
+    try testing.expectEqual(RTF_ERROR, rtf_diff(doc_a, doc_b, Collector.stop, null));
+    try testing.expectEqual(RTF_INVALID, rtf_diff(doc_a, null, Collector.record, null));
+}
+
+test "c api formatted - reparse an edit" {
+    const testing = std.testing;
+    
+    var rtf = std.ArrayList(u8).init(testing.allocator);
+    defer rtf.deinit();
+    try rtf.appendSlice("{\\rtf1 ");
+    for (0..200) |i| try rtf.writer().print("Line {d} \\b bold\\b0\\par ", .{i});
+    try rtf.append('}');
+    
+    var checkpoints: ?*Checkpoints = null;
+    const doc = rtf_parse_checkpointed(rtf.items.ptr, rtf.items.len, 512, &checkpoints).?;
+    defer rtf_free(doc);
+    defer rtf_checkpoints_free(checkpoints);
+    
+    // "Line 150" -> "Row 150"
+    const start = std.mem.indexOf(u8, rtf.items, "Line 150").?;
+    try rtf.replaceRange(start, 4, "Row");
+    try testing.expectEqual(RTF_OK, rtf_reparse_edit(doc, checkpoints, rtf.items.ptr, rtf.items.len, start, start + 4, 3));
+    
+    const expected = rtf_parse(rtf.items.ptr, rtf.items.len).?;
+    defer rtf_free(expected);
+    try testing.expectEqualStrings(std.mem.span(rtf_get_text(expected)), std.mem.span(rtf_get_text(doc)));
+    try testing.expectEqual(rtf_get_run_count(expected), rtf_get_run_count(doc));
+    
+    // Later edits replace the views built for earlier ones
+    for (0..3) |_| {
+        try testing.expectEqual(RTF_OK, rtf_reparse_edit(doc, checkpoints, rtf.items.ptr, rtf.items.len, start, start + 3, 3));
+    }
+    try testing.expectEqualStrings(std.mem.span(rtf_get_text(expected)), std.mem.span(rtf_get_text(doc)));
+    try testing.expectEqual(rtf_get_run_count(expected), rtf_get_run_count(doc));
+    
+    // Shared documents are left alone
+    _ = rtf_retain(doc);
+    try testing.expectEqual(RTF_INVALID, rtf_reparse_edit(doc, checkpoints, rtf.items.ptr, rtf.items.len, 0, 0, 0));
+    rtf_free(doc);
+}
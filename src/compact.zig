@@ -0,0 +1,293 @@
+const std = @import("std");
+const doc_model = @import("document_model.zig");
+const source_map = @import("source_map.zig");
+
+// =============================================================================
+// DOCUMENT COMPACTION
+// =============================================================================
+// Relocates a finished Document into one exactly sized allocation: content
+// elements, table rows and cells, font and color tables, and every string
+// they reference (run text, font names, URLs, image data, plain text), and
+// the source map if one was recorded.
+// Slack list capacity, the parse-time arena and any snapshot mapping are
+// released, and the document is afterwards freed with a single call.
+//
+// Lists in a compacted document are views into the block - the document is
+// read-only from then on (see Document.block).
+//
+// Layout is computed in two passes over the same traversal order: reserve()
+// sizes the block, pack() fills it. Keep the two in step.
+
+pub const alignment = doc_model.Document.block_alignment;
+
+comptime {
+    for ([_]type{ doc_model.ContentElement, doc_model.TableRow, doc_model.TableCell, doc_model.TextRun, doc_model.FontInfo, doc_model.ColorInfo, source_map.Anchor, source_map.Unit }) |T| {
+        std.debug.assert(@alignOf(T) <= alignment);
+    }
+}
+
+const Layout = struct {
+    size: usize = 0,
+
+    fn reserve(self: *Layout, comptime T: type, count: usize) void {
+        self.size = std.mem.alignForward(usize, self.size, @alignOf(T)) + count * @sizeOf(T);
+    }
+
+    fn reserveElements(self: *Layout, elements: []const doc_model.ContentElement) void {
+        self.reserve(doc_model.ContentElement, elements.len);
+        for (elements) |element| {
+            switch (element) {
+                .text_run => |run| self.reserve(u8, run.text.len + 1),
+                .hyperlink => |link| {
+                    self.reserve(u8, link.url.len);
+                    self.reserve(u8, link.display_text.len + 1);
+                },
+                .image => |image| self.reserve(u8, image.data.len),
+                .table => |table| {
+                    self.reserve(doc_model.TableRow, table.rows.items.len);
+                    self.reserve(doc_model.TableCell, table.cells.items.len);
+                    self.reserve(doc_model.TextRun, table.runs.items.len);
+                    for (table.runs.items) |run| self.reserve(u8, run.text.len + 1);
+                },
+                else => {},
+            }
+        }
+    }
+
+    fn reserveSourceMap(self: *Layout, map: source_map.SourceMap) void {
+        for ([_]source_map.RangeList{ map.runs, map.tables, map.cells, map.images }) |list| {
+            self.reserve(source_map.Anchor, list.anchors.len);
+            self.reserve(u8, list.bytes.len);
+        }
+        self.reserve(source_map.Unit, map.units.len);
+    }
+};
+
+const Packer = struct {
+    block: []align(alignment) u8,
+    allocator: std.mem.Allocator, // Recorded in list views, never used to free them
+    end: usize = 0,
+
+    fn take(self: *Packer, comptime T: type, count: usize) []T {
+        const start = std.mem.alignForward(usize, self.end, @alignOf(T));
+        self.end = start + count * @sizeOf(T);
+        const bytes = self.block[start..self.end];
+        return @as([*]T, @ptrCast(@alignCast(bytes.ptr)))[0..count];
+    }
+
+    fn dupe(self: *Packer, bytes: []const u8) []const u8 {
+        const copy = self.take(u8, bytes.len);
+        @memcpy(copy, bytes);
+        return copy;
+    }
+
+    fn dupeZ(self: *Packer, bytes: []const u8) [:0]const u8 {
+        const copy = self.take(u8, bytes.len + 1);
+        @memcpy(copy[0..bytes.len], bytes);
+        copy[bytes.len] = 0;
+        return copy[0..bytes.len :0];
+    }
+
+    fn view(self: *Packer, comptime T: type, items: []T) std.ArrayList(T) {
+        return .{ .items = items, .capacity = items.len, .allocator = self.allocator };
+    }
+
+    fn packElements(self: *Packer, elements: []const doc_model.ContentElement) []doc_model.ContentElement {
+        const packed_elements = self.take(doc_model.ContentElement, elements.len);
+        for (elements, packed_elements) |element, *out| {
+            out.* = switch (element) {
+                .text_run => |run| .{ .text_run = doc_model.TextRun.init(self.dupeZ(run.text), run.char_format, run.para_format) },
+                .hyperlink => |link| .{ .hyperlink = .{
+                    .url = self.dupe(link.url),
+                    .display_text = self.dupeZ(link.display_text),
+                } },
+                .image => |image| .{ .image = .{
+                    .format = image.format,
+                    .width = image.width,
+                    .height = image.height,
+                    .data = self.dupe(image.data),
+                } },
+                .table => |table| .{ .table = self.packTable(table) },
+                else => element,
+            };
+        }
+        return packed_elements;
+    }
+
+    fn packTable(self: *Packer, table: doc_model.Table) doc_model.Table {
+        const rows = self.take(doc_model.TableRow, table.rows.items.len);
+        @memcpy(rows, table.rows.items);
+
+        const cells = self.take(doc_model.TableCell, table.cells.items.len);
+        @memcpy(cells, table.cells.items);
+
+        const runs = self.take(doc_model.TextRun, table.runs.items.len);
+        for (table.runs.items, runs) |run, *out| {
+            out.* = doc_model.TextRun.init(self.dupeZ(run.text), run.char_format, run.para_format);
+        }
+
+        return .{
+            .rows = self.view(doc_model.TableRow, rows),
+            .cells = self.view(doc_model.TableCell, cells),
+            .runs = self.view(doc_model.TextRun, runs),
+        };
+    }
+
+    fn packRanges(self: *Packer, list: source_map.RangeList) source_map.RangeList {
+        const anchors = self.take(source_map.Anchor, list.anchors.len);
+        @memcpy(anchors, list.anchors);
+        return .{ .bytes = self.dupe(list.bytes), .anchors = anchors, .len = list.len };
+    }
+
+    fn packSourceMap(self: *Packer, map: source_map.SourceMap) source_map.SourceMap {
+        var packed_map = source_map.SourceMap{
+            .runs = self.packRanges(map.runs),
+            .tables = self.packRanges(map.tables),
+            .cells = self.packRanges(map.cells),
+            .images = self.packRanges(map.images),
+            .content_end = map.content_end,
+        };
+        const units = self.take(source_map.Unit, map.units.len);
+        @memcpy(units, map.units);
+        packed_map.units = units;
+        return packed_map;
+    }
+};
+
+// Compact `document` in place. On failure the document is left untouched.
+pub fn compact(document: *doc_model.Document) !void {
+    if (document.block != null) return;
+    _ = try compactReserving(document, 0);
+}
+
+// As compact(), with `extra` bytes left at the end of the block for data that
+// lives as long as the document (the C API's views). Returns that room.
+pub fn compactReserving(document: *doc_model.Document, extra: usize) ![]align(alignment) u8 {
+    if (document.block != null) return error.AlreadyCompacted;
+
+    const fonts = document.font_table.items;
+    const colors = document.color_table.items;
+
+    var layout = Layout{};
+    layout.reserveElements(document.content.items);
+    layout.reserve(doc_model.FontInfo, fonts.len);
+    for (fonts) |font| layout.reserve(u8, font.name.len + 1); // Names stay zero-terminated for the C API
+    layout.reserve(doc_model.ColorInfo, colors.len);
+    if (document.plain_text) |text| layout.reserve(u8, text.len + 1);
+    if (document.source_map) |map| layout.reserveSourceMap(map);
+    const reserved = std.mem.alignForward(usize, layout.size, alignment);
+    layout.size = reserved + extra;
+
+    const block = try document.allocator.alignedAlloc(u8, alignment, layout.size);
+    var packer = Packer{ .block = block, .allocator = document.allocator };
+
+    const content = packer.packElements(document.content.items);
+
+    const packed_fonts = packer.take(doc_model.FontInfo, fonts.len);
+    for (fonts, packed_fonts) |font, *out| {
+        out.* = font;
+        out.name = packer.dupeZ(font.name);
+    }
+
+    const packed_colors = packer.take(doc_model.ColorInfo, colors.len);
+    @memcpy(packed_colors, colors);
+
+    const plain_text = if (document.plain_text) |text| packer.dupeZ(text) else null;
+    const packed_source_map = if (document.source_map) |map| packer.packSourceMap(map) else null;
+    std.debug.assert(packer.end <= reserved and reserved + extra == block.len);
+
+    // Everything now lives in the block - drop the parse-time storage
+    const allocator = document.allocator;
+    for (document.content.items) |*element| element.deinit();
+    document.content.deinit();
+    document.font_table.deinit();
+    document.color_table.deinit();
+    document.arena.deinit();
+    document.arena = std.heap.ArenaAllocator.init(allocator);
+    if (document.mapping) |mapping| {
+        mapping.unmap(allocator);
+        document.mapping = null;
+    }
+
+    document.content = packer.view(doc_model.ContentElement, content);
+    document.font_table = packer.view(doc_model.FontInfo, packed_fonts);
+    document.color_table = packer.view(doc_model.ColorInfo, packed_colors);
+    document.plain_text = plain_text;
+    document.source_map = packed_source_map;
+    document.block = block;
+    return @alignCast(block[reserved..]);
+}
+
+// =============================================================================
+// TESTS
+// =============================================================================
+
+const formatted_parser = @import("formatted_parser.zig");
+
+test "compact preserves the document" {
+    const testing = std.testing;
+
+    const rtf_data = "{\\rtf1\\ansi\\deff0 {\\fonttbl{\\f0\\fswiss Arial;}{\\f1\\froman Times;}}" ++
+        "{\\colortbl;\\red255\\green0\\blue0;}" ++
+        "Hello \\b\\f1\\cf1 bold\\b0 \\qc centered\\par" ++
+        "\\trowd\\cellx1000\\cellx2000 A1\\cell B1\\cell\\row\\par After" ++
+        "{\\pict\\pngblip\\picw10\\pich20 89504e47}}";
+
+    var stream = std.io.fixedBufferStream(rtf_data);
+    var parser = try formatted_parser.FormattedParser.init(stream.reader().any(), testing.allocator);
+    defer parser.deinit();
+    var reference = try parser.parse();
+    defer reference.deinit();
+    const reference_rtf = try reference.generateRtf(testing.allocator);
+    defer testing.allocator.free(reference_rtf);
+
+    var document_stream = std.io.fixedBufferStream(rtf_data);
+    var document_parser = try formatted_parser.FormattedParser.init(document_stream.reader().any(), testing.allocator);
+    defer document_parser.deinit();
+    var document = try document_parser.parse();
+    defer document.deinit(); // Frees the block - leaks would fail the test
+    _ = try document.getPlainText();
+
+    try compact(&document);
+    try compact(&document); // Already compact - no-op
+
+    try testing.expect(document.block != null);
+    try testing.expectEqual(@as(usize, 0), document.arena.queryCapacity());
+    try testing.expectEqual(document.content.items.len, document.content.capacity);
+
+    try testing.expectEqualStrings(try reference.getPlainText(), try document.getPlainText());
+    try testing.expectEqualStrings("Times", document.getFont(1).?.name);
+    try testing.expectEqual(@as(u8, 0), document.getFont(1).?.name.ptr[5]);
+    try testing.expectEqual(@as(u32, 0xFF0000), document.getColor(2).?.toU32());
+
+    const compacted_rtf = try document.generateRtf(testing.allocator);
+    defer testing.allocator.free(compacted_rtf);
+    try testing.expectEqualStrings(reference_rtf, compacted_rtf);
+}
+
+test "compact empty document" {
+    var document = try doc_model.Document.init(std.testing.allocator);
+    defer document.deinit();
+
+    try compact(&document);
+    try std.testing.expectEqual(@as(usize, 0), document.content.items.len);
+}
+
+test "compact keeps the source map" {
+    const rtf_data = "{\\rtf1 One \\b two\\b0 {\\pict\\pngblip 89504e47}}";
+
+    var stream = std.io.fixedBufferStream(rtf_data);
+    var parser = try formatted_parser.FormattedParser.init(stream.reader().any(), std.testing.allocator);
+    defer parser.deinit();
+    parser.recordSourceMap();
+
+    var document = try parser.parse();
+    defer document.deinit();
+    try compact(&document);
+
+    const map = document.source_map.?;
+    try std.testing.expectEqual(@as(usize, 2), map.runs.len);
+    const range = map.runs.get(1).?;
+    try std.testing.expectEqualStrings("two", rtf_data[range.start..range.end]);
+    try std.testing.expectEqual(@as(usize, 1), map.images.len);
+}
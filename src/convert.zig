@@ -0,0 +1,604 @@
+const std = @import("std");
+const doc_model = @import("document_model.zig");
+const io = @import("io.zig");
+
+// =============================================================================
+// HTML AND MARKDOWN CONVERSION
+// =============================================================================
+// Renders a document as an HTML fragment or as Markdown in one pass. Both
+// converters are sinks for the same walk over the content, which reports
+//
+//   paragraph(para_format) run(text, char_format) lineBreak()
+//   image(image, index) endParagraph() table(table) pageBreak()
+//
+// in document order, so each sink only decides how to spell them. Inline
+// formatting is tracked across runs: tags and markers are opened and closed
+// where the formatting changes, not around every run. The parser does not
+// turn fields into hyperlink elements, so links are not written; one found
+// in a document is written as its display text.
+//
+// Images are embedded as data: URIs unless Options.image_refs is set, in
+// which case they are referenced as image<N>.<ext>, N counting images from
+// 0 in document order, and the caller stores them under those names.
+//
+// Output is UTF-8: \'xx bytes kept by the parser are decoded through the
+// document's code page (see doc_model.TextDecoder).
+
+pub const Options = struct {
+    image_refs: bool = false,
+};
+
+pub fn toHtml(document: *const doc_model.Document, writer: anytype, options: Options) !void {
+    var buffered = io.exportWriter(writer);
+    var sink = HtmlSink(@TypeOf(buffered.writer())){ .out = buffered.writer(), .document = document, .options = options };
+    try walk(document, &sink);
+    try buffered.flush();
+}
+
+// `allocator` holds the text of one stretch of equally formatted runs
+pub fn toMarkdown(allocator: std.mem.Allocator, document: *const doc_model.Document, writer: anytype, options: Options) !void {
+    var buffered = io.exportWriter(writer);
+    var sink = MarkdownSink(@TypeOf(buffered.writer())){
+        .out = buffered.writer(),
+        .options = options,
+        .code_page = document.code_page,
+        .pending = std.ArrayList(u8).init(allocator),
+    };
+    defer sink.pending.deinit();
+    try walk(document, &sink);
+    try buffered.flush();
+}
+
+fn walk(document: *const doc_model.Document, sink: anytype) !void {
+    var paragraph_open = false;
+    var image_count: usize = 0;
+    for (document.content.items) |element| {
+        switch (element) {
+            .text_run => |run| {
+                if (!paragraph_open) try sink.paragraph(run.para_format);
+                paragraph_open = true;
+                try sink.run(run.text, run.char_format);
+            },
+            .hyperlink => |link| {
+                if (!paragraph_open) try sink.paragraph(.{});
+                paragraph_open = true;
+                try sink.run(link.display_text, .{});
+            },
+            .line_break => {
+                if (!paragraph_open) try sink.paragraph(.{});
+                paragraph_open = true;
+                try sink.lineBreak();
+            },
+            .image => |image| {
+                if (!paragraph_open) try sink.paragraph(.{});
+                paragraph_open = true;
+                try sink.image(image, image_count);
+                image_count += 1;
+            },
+            .paragraph_break => {
+                if (!paragraph_open) try sink.paragraph(.{});
+                try sink.endParagraph();
+                paragraph_open = false;
+            },
+            .page_break => {
+                if (paragraph_open) try sink.endParagraph();
+                paragraph_open = false;
+                try sink.pageBreak();
+            },
+            .table => |table| {
+                if (paragraph_open) try sink.endParagraph();
+                paragraph_open = false;
+                try sink.table(table);
+            },
+        }
+    }
+    if (paragraph_open) try sink.endParagraph();
+}
+
+// =============================================================================
+// HTML
+// =============================================================================
+
+const Tag = enum {
+    span, // Font, size and color
+    bold,
+    italic,
+    underline,
+    strikethrough,
+    superscript,
+    subscript,
+
+    fn name(tag: Tag) []const u8 {
+        return switch (tag) {
+            .span => "span",
+            .bold => "b",
+            .italic => "i",
+            .underline => "u",
+            .strikethrough => "s",
+            .superscript => "sup",
+            .subscript => "sub",
+        };
+    }
+};
+
+// The parts of a run's format that go in a span's style. Settings equal to
+// the document defaults are left out, so most runs need no span.
+const Style = struct {
+    font_id: ?u16 = null,
+    font_size: ?u16 = null,
+    color_id: ?u16 = null,
+
+    fn of(document: *const doc_model.Document, format: doc_model.CharFormat) Style {
+        var style = Style{};
+        if (format.font_id) |id| {
+            if (id != document.default_font) style.font_id = id;
+        }
+        if (format.font_size) |size| {
+            if (size != document.default_font_size) style.font_size = size;
+        }
+        if (format.color_id) |id| {
+            if (id != 0) style.color_id = id; // 0 is the automatic color
+        }
+        return style;
+    }
+
+    fn isEmpty(style: Style) bool {
+        return style.font_id == null and style.font_size == null and style.color_id == null;
+    }
+};
+
+fn HtmlSink(comptime Writer: type) type {
+    return struct {
+        out: Writer,
+        document: *const doc_model.Document,
+        options: Options,
+        open: [std.meta.fields(Tag).len]Tag = undefined, // Outermost first
+        open_count: usize = 0,
+        span: Style = .{}, // Of the open span, if any
+        items: usize = 0, // In the open paragraph or cell
+
+        const Self = @This();
+
+        fn paragraph(self: *Self, para_format: doc_model.ParaFormat) !void {
+            try self.out.writeAll("<p");
+            const has_style = para_format.alignment != .left or para_format.left_indent != 0 or
+                para_format.right_indent != 0 or para_format.first_line_indent != 0 or
+                para_format.space_before != 0 or para_format.space_after != 0;
+            if (has_style) {
+                try self.out.writeAll(" style=\"");
+                if (para_format.alignment != .left) try self.out.print("text-align:{s};", .{@tagName(para_format.alignment)});
+                inline for (.{
+                    .{ "left_indent", "margin-left" },
+                    .{ "right_indent", "margin-right" },
+                    .{ "first_line_indent", "text-indent" },
+                    .{ "space_before", "margin-top" },
+                    .{ "space_after", "margin-bottom" },
+                }) |property| {
+                    const twips = @field(para_format, property[0]);
+                    if (twips != 0) try self.out.print(property[1] ++ ":{d}pt;", .{@as(f64, @floatFromInt(twips)) / 20});
+                }
+                try self.out.writeByte('"');
+            }
+            try self.out.writeByte('>');
+            self.items = 0;
+        }
+
+        fn run(self: *Self, text: []const u8, format: doc_model.CharFormat) !void {
+            try self.setFormat(format);
+            try writeHtml(self.out, text, self.document.code_page);
+            self.items += 1;
+        }
+
+        fn lineBreak(self: *Self) !void {
+            try self.out.writeAll("<br>");
+            self.items += 1;
+        }
+
+        fn image(self: *Self, info: doc_model.ImageInfo, index: usize) !void {
+            try self.out.writeAll("<img src=\"");
+            try writeImageSource(self.out, info, index, self.options);
+            try self.out.writeByte('"');
+            // Twips to CSS pixels (96 per inch)
+            if (info.width != 0) try self.out.print(" width=\"{d}\"", .{info.width / 15});
+            if (info.height != 0) try self.out.print(" height=\"{d}\"", .{info.height / 15});
+            try self.out.writeAll(" alt=\"\">");
+            self.items += 1;
+        }
+
+        fn endParagraph(self: *Self) !void {
+            try self.closeTags(0);
+            // Keep empty paragraphs from collapsing
+            if (self.items == 0) try self.out.writeAll("<br>");
+            try self.out.writeAll("</p>\n");
+        }
+
+        fn pageBreak(self: *Self) !void {
+            try self.out.writeAll("<hr>\n");
+        }
+
+        fn table(self: *Self, info: doc_model.Table) !void {
+            try self.out.writeAll("<table>\n");
+            for (0..info.rowCount()) |row_index| {
+                try self.out.writeAll("<tr>");
+                for (info.rowCells(row_index)) |cell| {
+                    try self.out.writeAll("<td>");
+                    for (info.cellRuns(cell)) |cell_run| try self.run(cell_run.text, cell_run.char_format);
+                    try self.closeTags(0);
+                    try self.out.writeAll("</td>");
+                }
+                try self.out.writeAll("</tr>\n");
+            }
+            try self.out.writeAll("</table>\n");
+        }
+
+        // Keep the open tags the new format still wants, up to the first
+        // one it does not; close the rest and open what is missing
+        fn setFormat(self: *Self, format: doc_model.CharFormat) !void {
+            const style = Style.of(self.document, format);
+            var keep: usize = 0;
+            while (keep < self.open_count and self.wants(self.open[keep], format, style)) keep += 1;
+            try self.closeTags(keep);
+
+            inline for (std.meta.fields(Tag)) |field| {
+                const tag: Tag = @enumFromInt(field.value);
+                if (self.wants(tag, format, style) and !self.isOpen(tag)) {
+                    if (tag == .span) {
+                        try self.openSpan(style);
+                    } else {
+                        try self.out.print("<{s}>", .{tag.name()});
+                    }
+                    self.open[self.open_count] = tag;
+                    self.open_count += 1;
+                }
+            }
+        }
+
+        fn wants(self: *const Self, tag: Tag, format: doc_model.CharFormat, style: Style) bool {
+            return switch (tag) {
+                .span => !style.isEmpty() and (!self.isOpen(.span) or std.meta.eql(self.span, style)),
+                .bold => format.bold,
+                .italic => format.italic,
+                .underline => format.underline,
+                .strikethrough => format.strikethrough,
+                .superscript => format.superscript,
+                .subscript => format.subscript,
+            };
+        }
+
+        fn isOpen(self: *const Self, tag: Tag) bool {
+            return std.mem.indexOfScalar(Tag, self.open[0..self.open_count], tag) != null;
+        }
+
+        fn closeTags(self: *Self, keep: usize) !void {
+            while (self.open_count > keep) {
+                self.open_count -= 1;
+                try self.out.print("</{s}>", .{self.open[self.open_count].name()});
+            }
+        }
+
+        fn openSpan(self: *Self, style: Style) !void {
+            try self.out.writeAll("<span style=\"");
+            if (style.font_id) |id| {
+                if (self.document.getFont(id)) |font| {
+                    try self.out.writeAll("font-family:&quot;");
+                    try writeHtml(self.out, font.name, self.document.code_page);
+                    try self.out.writeAll("&quot;;");
+                }
+            }
+            if (style.font_size) |size| {
+                try self.out.print("font-size:{d}pt;", .{@as(f64, @floatFromInt(size)) / 2});
+            }
+            if (style.color_id) |id| {
+                if (self.document.getColor(id)) |color| {
+                    try self.out.print("color:#{x:0>2}{x:0>2}{x:0>2};", .{ color.red, color.green, color.blue });
+                }
+            }
+            try self.out.writeAll("\">");
+            self.span = style;
+        }
+    };
+}
+
+// Text and attribute values, decoded to UTF-8 through `code_page`
+pub fn writeHtml(out: anytype, text: []const u8, code_page: u16) !void {
+    try doc_model.writeDecoded(out, text, code_page, writeEscapedHtml);
+}
+
+// Runs of ordinary bytes are written in one piece
+fn writeEscapedHtml(out: anytype, text: []const u8) !void {
+    var start: usize = 0;
+    for (text, 0..) |byte, index| {
+        const entity: []const u8 = switch (byte) {
+            '&' => "&amp;",
+            '<' => "&lt;",
+            '>' => "&gt;",
+            '"' => "&quot;",
+            '\'' => "&#39;",
+            else => continue,
+        };
+        try out.writeAll(text[start..index]);
+        try out.writeAll(entity);
+        start = index + 1;
+    }
+    try out.writeAll(text[start..]);
+}
+
+fn mediaType(format: doc_model.ImageInfo.ImageFormat) []const u8 {
+    return switch (format) {
+        .png => "image/png",
+        .jpeg => "image/jpeg",
+        .emf => "image/emf",
+        .wmf => "image/wmf",
+        .pict => "image/x-pict",
+        .unknown => "application/octet-stream",
+    };
+}
+
+fn extension(format: doc_model.ImageInfo.ImageFormat) []const u8 {
+    return switch (format) {
+        .jpeg => "jpg",
+        .unknown => "bin",
+        else => @tagName(format),
+    };
+}
+
+fn writeImageSource(out: anytype, info: doc_model.ImageInfo, index: usize, options: Options) !void {
+    if (options.image_refs) {
+        try out.print("image{d}.{s}", .{ index, extension(info.format) });
+        return;
+    }
+
+    try out.print("data:{s};base64,", .{mediaType(info.format)});
+    // Whole groups of 3 bytes per chunk, so only the last one is padded
+    const encoder = std.base64.standard.Encoder;
+    var encoded: [4096]u8 = undefined;
+    var rest = info.data;
+    while (rest.len > 0) {
+        const chunk = rest[0..@min(rest.len, encoded.len / 4 * 3)];
+        try out.writeAll(encoder.encode(&encoded, chunk));
+        rest = rest[chunk.len..];
+    }
+}
+
+// =============================================================================
+// MARKDOWN
+// =============================================================================
+
+// The formatting Markdown can express. Underline, superscript and subscript
+// use the inline HTML most renderers accept; fonts and colors are dropped.
+const Marks = struct {
+    bold: bool = false,
+    italic: bool = false,
+    strikethrough: bool = false,
+    underline: bool = false,
+    superscript: bool = false,
+    subscript: bool = false,
+
+    fn of(format: doc_model.CharFormat) Marks {
+        var marks = Marks{};
+        inline for (std.meta.fields(Marks)) |field| @field(marks, field.name) = @field(format, field.name);
+        return marks;
+    }
+};
+
+fn MarkdownSink(comptime Writer: type) type {
+    return struct {
+        out: Writer,
+        options: Options,
+        code_page: u16,
+        // Text of consecutive runs with the same marks. Emphasis must not
+        // start or end with whitespace, so the marks wait for the whole stretch.
+        pending: std.ArrayList(u8),
+        marks: Marks = .{},
+        line_start: bool = true, // Nothing written yet on this line of the block
+        in_table: bool = false,
+
+        const Self = @This();
+
+        fn paragraph(self: *Self, para_format: doc_model.ParaFormat) !void {
+            _ = para_format; // Markdown has no alignment or indents
+            self.line_start = true;
+        }
+
+        fn run(self: *Self, text: []const u8, format: doc_model.CharFormat) !void {
+            const marks = Marks.of(format);
+            if (!std.meta.eql(marks, self.marks)) try self.flush();
+            self.marks = marks;
+            try doc_model.appendDecoded(&self.pending, text, self.code_page);
+        }
+
+        fn lineBreak(self: *Self) !void {
+            try self.flush();
+            // Cells must stay on one line
+            try self.out.writeAll(if (self.in_table) "<br>" else "\\\n");
+            self.line_start = true;
+        }
+
+        fn image(self: *Self, info: doc_model.ImageInfo, index: usize) !void {
+            try self.flush();
+            try self.out.writeAll("![](");
+            try writeImageSource(self.out, info, index, self.options);
+            try self.out.writeByte(')');
+            self.line_start = false;
+        }
+
+        fn endParagraph(self: *Self) !void {
+            try self.flush();
+            try self.out.writeAll("\n\n");
+        }
+
+        fn pageBreak(self: *Self) !void {
+            try self.out.writeAll("---\n\n");
+        }
+
+        // A pipe table. Markdown wants a header row, so the first row is it.
+        fn table(self: *Self, info: doc_model.Table) !void {
+            var columns: usize = 1;
+            for (0..info.rowCount()) |row_index| columns = @max(columns, info.rowCells(row_index).len);
+
+            self.in_table = true;
+            defer self.in_table = false;
+            for (0..info.rowCount()) |row_index| {
+                const cells = info.rowCells(row_index);
+                try self.out.writeByte('|');
+                for (0..columns) |column| {
+                    try self.out.writeByte(' ');
+                    if (column < cells.len) {
+                        self.line_start = false;
+                        for (info.cellRuns(cells[column])) |cell_run| try self.run(cell_run.text, cell_run.char_format);
+                        try self.flush();
+                    }
+                    try self.out.writeAll(" |");
+                }
+                try self.out.writeByte('\n');
+                if (row_index == 0) {
+                    try self.out.writeByte('|');
+                    for (0..columns) |_| try self.out.writeAll(" --- |");
+                    try self.out.writeByte('\n');
+                }
+            }
+            try self.out.writeByte('\n');
+        }
+
+        // Write the pending text inside its marks, whitespace outside them
+        fn flush(self: *Self) !void {
+            var text = self.pending.items;
+            defer self.pending.clearRetainingCapacity();
+            if (text.len == 0) return;
+
+            // Leading spaces would indent the block (four make it code)
+            if (self.line_start) text = std.mem.trimLeft(u8, text, " \t");
+            const core = std.mem.trim(u8, text, " \t");
+            if (core.len == 0) {
+                try self.out.writeAll(text);
+                return;
+            }
+            const leading = std.mem.indexOf(u8, text, core).?;
+            try self.out.writeAll(text[0..leading]);
+            inline for (.{
+                .{ "bold", "**" },       .{ "italic", "*" },        .{ "strikethrough", "~~" },
+                .{ "underline", "<u>" }, .{ "superscript", "<sup>" }, .{ "subscript", "<sub>" },
+            }) |mark| {
+                if (@field(self.marks, mark[0])) try self.out.writeAll(mark[1]);
+            }
+            try self.writeText(core);
+            inline for (.{
+                .{ "subscript", "</sub>" }, .{ "superscript", "</sup>" }, .{ "underline", "</u>" },
+                .{ "strikethrough", "~~" },  .{ "italic", "*" },         .{ "bold", "**" },
+            }) |mark| {
+                if (@field(self.marks, mark[0])) try self.out.writeAll(mark[1]);
+            }
+            try self.out.writeAll(text[leading + core.len ..]);
+        }
+
+        fn writeText(self: *Self, text: []const u8) !void {
+            var start: usize = 0;
+            if (self.line_start and text.len > 0) {
+                // Would start a list, heading underline or thematic break
+                if (std.mem.indexOfScalar(u8, "-+=", text[0]) != null) {
+                    try self.out.writeByte('\\');
+                }
+                self.line_start = false;
+            }
+            for (text, 0..) |byte, index| {
+                if (!markdown_special[byte]) continue;
+                try self.out.writeAll(text[start..index]);
+                try self.out.writeByte('\\');
+                start = index;
+            }
+            try self.out.writeAll(text[start..]);
+        }
+    };
+}
+
+// Bytes escaped with a backslash wherever they appear in text
+const markdown_special = blk: {
+    var table = [_]bool{false} ** 256;
+    for ("\\`*_[]<>#|~!") |byte| table[byte] = true;
+    break :blk table;
+};
+
+// =============================================================================
+// TESTS
+// =============================================================================
+
+const formatted_parser = @import("formatted_parser.zig");
+
+test "html conversion" {
+    const testing = std.testing;
+
+    const rtf_data = "{\\rtf1{\\fonttbl{\\f0 Arial;}{\\f1 Courier New;}}{\\colortbl;\\red255\\green0\\blue0;}" ++
+        "\\qc A \\b bold \\i both\\b0  italic\\i0  <&>\\line\\par\\par " ++
+        "\\pard\\f1\\cf1 code\\f0\\cf0\\par " ++
+        "\\trowd\\cellx1000\\cellx2000 A\\cell \\b B\\b0\\cell\\row\\par " ++
+        "{\\pict\\pngblip\\picw1500\\pich750 89504e47}\\page End}";
+
+    var stream = std.io.fixedBufferStream(rtf_data);
+    var parser = try formatted_parser.FormattedParser.init(stream.reader().any(), testing.allocator);
+    defer parser.deinit();
+    var document = try parser.parse();
+    defer document.deinit();
+
+    var html = std.ArrayList(u8).init(testing.allocator);
+    defer html.deinit();
+    try toHtml(&document, html.writer(), .{});
+
+    // Tags change only where the formatting does, and nest properly
+    try testing.expect(std.mem.startsWith(u8, html.items, "<p style=\"text-align:center;\">A <b>bold <i>both</i></b><i> italic</i> &lt;&amp;&gt;<br></p>\n"));
+    try testing.expect(std.mem.indexOf(u8, html.items, "<p><br></p>\n") != null);
+    try testing.expect(std.mem.indexOf(u8, html.items, "<span style=\"font-family:&quot;Courier New&quot;;color:#ff0000;\">code</span>") != null);
+    try testing.expect(std.mem.indexOf(u8, html.items, "<table>\n<tr><td>A</td><td><b>B</b></td></tr>\n</table>\n") != null);
+    try testing.expect(std.mem.indexOf(u8, html.items, "<img src=\"data:image/png;base64,iVBORw==\" width=\"100\" height=\"50\" alt=\"\">") != null);
+    try testing.expect(std.mem.indexOf(u8, html.items, "<hr>\n<p>End</p>\n") != null);
+
+    var referenced = std.ArrayList(u8).init(testing.allocator);
+    defer referenced.deinit();
+    try toHtml(&document, referenced.writer(), .{ .image_refs = true });
+    try testing.expect(std.mem.indexOf(u8, referenced.items, "<img src=\"image0.png\"") != null);
+}
+
+test "markdown conversion" {
+    const testing = std.testing;
+
+    const rtf_data = "{\\rtf1 Say \\b hello \\b0 world_1\\line next\\par " ++
+        "- not a list\\par " ++
+        "\\trowd\\cellx1000\\cellx2000 H1\\cell H|2\\cell\\row " ++
+        "\\trowd\\cellx1000 \\i x\\i0\\cell\\row\\par}";
+
+    var stream = std.io.fixedBufferStream(rtf_data);
+    var parser = try formatted_parser.FormattedParser.init(stream.reader().any(), testing.allocator);
+    defer parser.deinit();
+    var document = try parser.parse();
+    defer document.deinit();
+
+    var markdown = std.ArrayList(u8).init(testing.allocator);
+    defer markdown.deinit();
+    try toMarkdown(testing.allocator, &document, markdown.writer(), .{});
+
+    // Markers hug the text; the space after "hello" stays outside
+    try testing.expect(std.mem.startsWith(u8, markdown.items, "Say **hello** world\\_1\\\nnext\n\n"));
+    try testing.expect(std.mem.indexOf(u8, markdown.items, "\\- not a list\n\n") != null);
+    try testing.expect(std.mem.indexOf(u8, markdown.items, "| H1 | H\\|2 |\n| --- | --- |\n| *x* |  |\n") != null);
+}
+
+test "conversion decodes code page bytes" {
+    const testing = std.testing;
+
+    const rtf_data = "{\\rtf1 Caf\\'e9 \\'93ol\\'e9\\'94\\par}";
+
+    var stream = std.io.fixedBufferStream(rtf_data);
+    var parser = try formatted_parser.FormattedParser.init(stream.reader().any(), testing.allocator);
+    defer parser.deinit();
+    var document = try parser.parse();
+    defer document.deinit();
+
+    var html = std.ArrayList(u8).init(testing.allocator);
+    defer html.deinit();
+    try toHtml(&document, html.writer(), .{});
+    try testing.expect(std.mem.indexOf(u8, html.items, "<p>Caf\u{e9} \u{201c}ol\u{e9}\u{201d}</p>") != null);
+
+    var markdown = std.ArrayList(u8).init(testing.allocator);
+    defer markdown.deinit();
+    try toMarkdown(testing.allocator, &document, markdown.writer(), .{});
+    try testing.expect(std.mem.startsWith(u8, markdown.items, "Caf\u{e9} \u{201c}ol\u{e9}\u{201d}\n\n"));
+}
@@ -0,0 +1,172 @@
+/*
+ * C++ wrapper benchmark
+ *
+ * Runs the same reads through the raw C API and through zigrtf.hpp, so
+ * any cost the wrapper adds shows up as a gap between the two columns.
+ * Input is generated: paragraphs of mixed formatting plus a table.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "zigrtf.hpp"
+
+namespace {
+
+constexpr int paragraphs = 20000;
+constexpr int rounds = 50;
+constexpr int batch_documents = 256;
+
+std::string make_document(int paragraph_count) {
+    std::string rtf = "{\\rtf1\\ansi{\\fonttbl{\\f0 Arial;}{\\f1 Times;}}{\\colortbl;\\red200\\green0\\blue0;}";
+    for (int i = 0; i < paragraph_count; i++) {
+        rtf += "Plain text, then \\b bold\\b0 , \\i italic\\i0  and \\f1\\cf1 colored\\f0\\cf0  words ";
+        rtf += std::to_string(i);
+        rtf += "\\par ";
+    }
+    for (int i = 0; i < paragraph_count / 100; i++) {
+        rtf += "\\trowd\\cellx2000\\cellx4000 Name \\b ";
+        rtf += std::to_string(i);
+        rtf += "\\b0\\cell Value\\cell\\row ";
+    }
+    rtf += "}";
+    return rtf;
+}
+
+/* Best of `rounds`, in nanoseconds per call of `body` */
+template <class Body>
+double time_ns(Body&& body) {
+    double best = 1e300;
+    for (int round = 0; round < rounds; round++) {
+        auto start = std::chrono::steady_clock::now();
+        body();
+        std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+        if (elapsed.count() < best) best = elapsed.count();
+    }
+    return best;
+}
+
+void report(const char* name, double c_ns, double cpp_ns, size_t items) {
+    std::printf("  %-22s C %9.2f ns/item   C++ %9.2f ns/item   (%+.1f%%)\n", name, c_ns / items, cpp_ns / items,
+                (cpp_ns / c_ns - 1.0) * 100.0);
+}
+
+/* Results are summed here so the loops can't be optimized away */
+volatile size_t checksum;
+
+} /* namespace */
+
+int main() {
+    std::printf("=== ZigRTF C++ Wrapper Benchmark ===\n\n");
+
+    const std::string input = make_document(paragraphs);
+    rtf::document doc = rtf::document::parse(input);
+    rtf_document* raw = doc.get();
+    std::printf("Input: %.2f MB, %zu runs, %zu paragraphs, %zu tables\n\n", input.size() / 1048576.0,
+                doc.runs().size(), doc.paragraphs().size(), doc.tables().size());
+
+    /* Bold bytes: a pass over the compact run array */
+    double c_runs = time_ns([&] {
+        size_t count = 0;
+        const rtf_run_v2* runs = rtf_get_runs_v2(raw, &count);
+        size_t bold = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (runs[i].flags & RTF_RUN_BOLD) bold += runs[i].text_length;
+        }
+        checksum = checksum + bold;
+    });
+    double cpp_runs = time_ns([&] {
+        size_t bold = 0;
+        for (const rtf_run_v2& run : doc.runs()) {
+            if (run.flags & RTF_RUN_BOLD) bold += run.text_length;
+        }
+        checksum = checksum + bold;
+    });
+
+    /* Styled text per paragraph: the callback walk against its C loop */
+    double c_walk = time_ns([&] {
+        size_t count = 0;
+        const rtf_run_v2* runs = rtf_get_runs_v2(raw, &count);
+        const rtf_style* styles = rtf_get_styles(raw, &count);
+        size_t total = 0;
+        const size_t paragraph_count = rtf_get_paragraph_count(raw);
+        for (size_t p = 0; p < paragraph_count; p++) {
+            const rtf_paragraph* paragraph = rtf_get_paragraph(raw, p);
+            for (size_t i = paragraph->first_run; i < paragraph->first_run + paragraph->run_count; i++) {
+                if (styles[runs[i].style].color_id != 0) total += runs[i].text_length;
+            }
+            total++;
+        }
+        checksum = checksum + total;
+    });
+    double cpp_walk = time_ns([&] {
+        struct counter {
+            size_t total = 0;
+            void on_run(std::string_view text, const rtf_run_v2&, const rtf_style& style) {
+                if (style.color_id != 0) total += text.size();
+            }
+            void on_paragraph_end(const rtf_paragraph&) { total++; }
+        } handler;
+        rtf::visit(doc, handler);
+        checksum = checksum + handler.total;
+    });
+
+    /* Every cell's text */
+    size_t cells = 0;
+    double c_cells = time_ns([&] {
+        size_t bytes = 0;
+        cells = 0;
+        const size_t table_count = rtf_get_table_count(raw);
+        for (size_t t = 0; t < table_count; t++) {
+            const rtf_table* table = rtf_get_table(raw, t);
+            const size_t row_count = rtf_table_get_row_count(table);
+            for (size_t r = 0; r < row_count; r++) {
+                const size_t cell_count = rtf_table_get_cell_count(table, r);
+                for (size_t c = 0; c < cell_count; c++) {
+                    const char* text = rtf_table_get_cell_text(table, r, c);
+                    bytes += std::string_view(text).size();
+                    cells++;
+                }
+            }
+        }
+        checksum = checksum + bytes;
+    });
+    double cpp_cells = time_ns([&] {
+        size_t bytes = 0;
+        for (rtf::table table : doc.tables()) {
+            for (rtf::row row : table) {
+                for (rtf::cell cell : row) bytes += cell.text().size();
+            }
+        }
+        checksum = checksum + bytes;
+    });
+
+    std::printf("Access (best of %d):\n", rounds);
+    report("runs", c_runs, cpp_runs, doc.runs().size());
+    report("paragraph walk", c_walk, cpp_walk, doc.runs().size());
+    report("table cells", c_cells, cpp_cells, cells);
+
+    /* Batches: one thread with rtf_parse() against parse_batch() */
+    const std::string small = make_document(50);
+    std::vector<std::string_view> inputs(batch_documents, small);
+    auto start = std::chrono::steady_clock::now();
+    for (std::string_view rtf : inputs) {
+        rtf_document* parsed = rtf_parse(rtf.data(), rtf.size());
+        checksum = checksum + rtf_get_run_count(parsed);
+        rtf_free(parsed);
+    }
+    std::chrono::duration<double, std::milli> sequential = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for (auto& parsed : rtf::parse_batch(inputs)) checksum = checksum + parsed.get().runs().size();
+    std::chrono::duration<double, std::milli> batched = std::chrono::steady_clock::now() - start;
+
+    std::printf("\nParsing %d documents:\n", batch_documents);
+    std::printf("  rtf_parse loop   %8.2f ms\n", sequential.count());
+    std::printf("  rtf::parse_batch %8.2f ms (%u threads, %.1fx)\n", batched.count(),
+                std::thread::hardware_concurrency(), sequential.count() / batched.count());
+    return 0;
+}
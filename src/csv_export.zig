@@ -0,0 +1,196 @@
+const std = @import("std");
+const doc_model = @import("document_model.zig");
+const io = @import("io.zig");
+const table_parsers = @import("table_parser.zig");
+
+// =============================================================================
+// CSV EXPORT
+// =============================================================================
+// Writes table rows as CSV or TSV while the parser reads them. Rows reach
+// the writer through TableParser's row sink (see
+// FormattedParser.streamTableRows), so neither a whole table nor the
+// document's tables are ever held in memory.
+//
+// One line per row, one field per cell holding the text of its runs.
+// Fields containing the separator, a quote or a line break are quoted, with
+// quotes doubled (RFC 4180). Rows keep their own cell counts. When every
+// table is exported, tables are separated by an empty line. Output is
+// UTF-8, with \'xx bytes decoded through Options.code_page.
+
+pub const Options = struct {
+    separator: u8 = ',', // '\t' for TSV
+    table: ?usize = null, // Only this table, counting from 0 in document order
+    code_page: u16 = 1252, // Of \'xx bytes in cell text, decoded to UTF-8 (Document.code_page)
+};
+
+pub fn CsvWriter(comptime Writer: type) type {
+    return struct {
+        buffered: io.ExportWriter(Writer),
+        options: Options,
+        rows: usize = 0,
+        last_table: usize = 0,
+        failed: bool = false, // The writer failed, rather than the parse
+
+        const Self = @This();
+
+        pub fn init(writer: Writer, options: Options) Self {
+            return .{ .buffered = io.exportWriter(writer), .options = options };
+        }
+
+        // For FormattedParser.streamTableRows(). `self` must stay in place.
+        pub fn rowSink(self: *Self) table_parsers.TableParser.RowSink {
+            return .{ .context = self, .emit = emit };
+        }
+
+        // Write out what is still buffered once the parse is done
+        pub fn finish(self: *Self) !void {
+            self.buffered.flush() catch |err| {
+                self.failed = true;
+                return err;
+            };
+        }
+
+        fn emit(context: *anyopaque, table_index: usize, table: *const doc_model.Table) anyerror!void {
+            const self: *Self = @ptrCast(@alignCast(context));
+            if (self.options.table) |wanted| {
+                if (table_index != wanted) return;
+            }
+            self.writeRow(table_index, table) catch |err| {
+                self.failed = true;
+                return err;
+            };
+        }
+
+        fn writeRow(self: *Self, table_index: usize, table: *const doc_model.Table) !void {
+            const out = self.buffered.writer();
+            if (self.rows > 0 and table_index != self.last_table) try out.writeByte('\n');
+            self.rows += 1;
+            self.last_table = table_index;
+
+            for (table.rowCells(0), 0..) |cell, cell_index| {
+                if (cell_index > 0) try out.writeByte(self.options.separator);
+                try self.writeField(table.cellRuns(cell));
+            }
+            try out.writeByte('\n');
+        }
+
+        fn writeField(self: *Self, runs: []const doc_model.TextRun) !void {
+            const out = self.buffered.writer();
+            const quoted = for (runs) |run| {
+                if (std.mem.indexOfAny(u8, run.text, "\"\r\n") != null) break true;
+                if (std.mem.indexOfScalar(u8, run.text, self.options.separator) != null) break true;
+            } else false;
+
+            const code_page = self.options.code_page;
+            if (!quoted) {
+                for (runs) |run| try doc_model.writeDecoded(out, run.text, code_page, doc_model.writeVerbatim);
+                return;
+            }
+            try out.writeByte('"');
+            for (runs) |run| try doc_model.writeDecoded(out, run.text, code_page, writeQuoted);
+            try out.writeByte('"');
+        }
+    };
+}
+
+// Field text with its quotes doubled
+fn writeQuoted(out: anytype, text: []const u8) !void {
+    var rest = text;
+    while (std.mem.indexOfScalar(u8, rest, '"')) |quote| {
+        try out.writeAll(rest[0 .. quote + 1]);
+        try out.writeByte('"');
+        rest = rest[quote + 1 ..];
+    }
+    try out.writeAll(rest);
+}
+
+// =============================================================================
+// TESTS
+// =============================================================================
+
+const formatted_parser = @import("formatted_parser.zig");
+
+test "csv export streams table rows" {
+    const testing = std.testing;
+
+    const rtf_data = "{\\rtf1 Intro\\par " ++
+        "\\trowd\\cellx1000\\cellx2000 Name\\cell \\b Price\\b0\\cell\\row " ++
+        "\\trowd\\cellx1000\\cellx2000 Tea, green\\cell 3\\cell\\row " ++
+        "\\trowd\\cellx1000\\cellx2000 Say \"hi\"\\cell 4\\cell\\row\\par Between\\par " ++
+        "\\trowd\\cellx1000 Second\\cell\\row\\par End}";
+
+    var output = std.ArrayList(u8).init(testing.allocator);
+    defer output.deinit();
+    var csv = CsvWriter(@TypeOf(output.writer())).init(output.writer(), .{});
+
+    var stream = std.io.fixedBufferStream(rtf_data);
+    var parser = try formatted_parser.FormattedParser.init(stream.reader().any(), testing.allocator);
+    defer parser.deinit();
+    parser.streamTableRows(csv.rowSink());
+    var document = try parser.parse();
+    defer document.deinit();
+    try csv.finish();
+
+    // Tables went to the writer, not the document
+    for (document.content.items) |element| try testing.expect(element != .table);
+    try testing.expectEqualStrings("Name,Price\n\"Tea, green\",3\n\"Say \"\"hi\"\"\",4\n\nSecond\n", output.items);
+}
+
+test "tsv export of one table" {
+    const testing = std.testing;
+
+    const rtf_data = "{\\rtf1 \\trowd\\cellx1000\\cellx2000 a\\cell b,c\\cell\\row\\par Text\\par " ++
+        "\\trowd\\cellx1000\\cellx2000 x\\cell y\\tab z\\cell\\row\\par}";
+
+    var output = std.ArrayList(u8).init(testing.allocator);
+    defer output.deinit();
+    var csv = CsvWriter(@TypeOf(output.writer())).init(output.writer(), .{ .separator = '\t', .table = 1 });
+
+    var stream = std.io.fixedBufferStream(rtf_data);
+    var parser = try formatted_parser.FormattedParser.init(stream.reader().any(), testing.allocator);
+    defer parser.deinit();
+    parser.streamTableRows(csv.rowSink());
+    var document = try parser.parse();
+    defer document.deinit();
+    try csv.finish();
+    try testing.expectEqualStrings("x\t\"y\tz\"\n", output.items);
+}
+
+test "csv export keeps empty cells" {
+    const testing = std.testing;
+
+    const rtf_data = "{\\rtf1 \\trowd\\cellx1000\\cellx2000\\cellx3000 a\\cell\\cell c\\cell\\row\\par " ++
+        "\\trowd\\cellx1000\\cellx2000 \\cell d\\cell\\row\\par}";
+
+    var output = std.ArrayList(u8).init(testing.allocator);
+    defer output.deinit();
+    var csv = CsvWriter(@TypeOf(output.writer())).init(output.writer(), .{});
+
+    var stream = std.io.fixedBufferStream(rtf_data);
+    var parser = try formatted_parser.FormattedParser.init(stream.reader().any(), testing.allocator);
+    defer parser.deinit();
+    parser.streamTableRows(csv.rowSink());
+    var document = try parser.parse();
+    defer document.deinit();
+    try csv.finish();
+    try testing.expectEqualStrings("a,,c\n,d\n", output.items);
+}
+
+test "csv export writes UTF-8" {
+    const testing = std.testing;
+
+    const rtf_data = "{\\rtf1 \\trowd\\cellx1000\\cellx2000 Caf\\'e9\\cell \\'93a, b\\'94\\cell\\row\\par}";
+
+    var output = std.ArrayList(u8).init(testing.allocator);
+    defer output.deinit();
+    var csv = CsvWriter(@TypeOf(output.writer())).init(output.writer(), .{});
+
+    var stream = std.io.fixedBufferStream(rtf_data);
+    var parser = try formatted_parser.FormattedParser.init(stream.reader().any(), testing.allocator);
+    defer parser.deinit();
+    parser.streamTableRows(csv.rowSink());
+    var document = try parser.parse();
+    defer document.deinit();
+    try csv.finish();
+    try testing.expectEqualStrings("Caf\u{e9},\"\u{201c}a, b\u{201d}\"\n", output.items);
+}
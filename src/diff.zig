@@ -0,0 +1,505 @@
+const std = @import("std");
+const doc_model = @import("document_model.zig");
+const text_index = @import("text_index.zig");
+
+// =============================================================================
+// DOCUMENT DIFF
+// =============================================================================
+// Reports inserted, deleted and reformatted text between two documents, as
+// ranges of their plain text (Document.getPlainText).
+//
+// Paragraphs (see text_index.zig) are aligned first, by hash: unchanged
+// paragraphs at both ends are skipped in one pass and Myers' algorithm aligns
+// the rest. Only paragraphs left unmatched are compared byte by byte, pairwise
+// in order, again with Myers. For mostly similar documents the cost stays
+// close to linear in their size. Aligned text whose runs differ in formatting
+// is reported as reformatted.
+//
+// Myers takes O((N+M)D) time and O(D^2) memory for D edits, so the number of
+// edits it looks for is capped. Past the cap the region counts as replaced.
+
+pub const Input = struct {
+    text: []const u8,
+    index: *const text_index.TextIndex,
+    runs: []const doc_model.TextRun, // As Document.getTextRuns returns them
+};
+
+// Layout matches rtf_diff_change in c_api.h
+pub const Change = extern struct {
+    kind: Kind,
+    a_start: usize, // Range in the first text (empty for insertions)
+    a_end: usize,
+    b_start: usize, // Range in the second text (empty for deletions)
+    b_end: usize,
+
+    pub const Kind = enum(c_int) {
+        insert = 1,
+        delete = 2,
+        format = 3,
+    };
+};
+
+// Receives changes in text order; returning false stops the diff
+pub const Sink = struct {
+    context: *anyopaque,
+    emit: *const fn (context: *anyopaque, change: *const Change) bool,
+};
+
+pub const max_paragraph_edits = 1024;
+pub const max_text_edits = 1024;
+
+pub fn diff(allocator: std.mem.Allocator, a: Input, b: Input, sink: Sink) !void {
+    const hashes_a = try hashParagraphs(allocator, a);
+    defer allocator.free(hashes_a);
+    const hashes_b = try hashParagraphs(allocator, b);
+    defer allocator.free(hashes_b);
+
+    var differ = Differ{
+        .allocator = allocator,
+        .a = a,
+        .b = b,
+        .hashes_a = hashes_a,
+        .hashes_b = hashes_b,
+        .emitter = .{ .sink = sink },
+    };
+
+    const paragraphs = ParagraphEql{ .differ = &differ };
+    var alignment = try Alignment.find(allocator, paragraphs, hashes_a.len, hashes_b.len, max_paragraph_edits);
+    defer alignment.deinit(allocator);
+    try alignment.walk(&differ);
+
+    try differ.emitter.flush();
+}
+
+const ParagraphHash = struct {
+    text: u64,
+    format: u64, // Run boundaries and formats
+};
+
+fn hashParagraphs(allocator: std.mem.Allocator, input: Input) ![]ParagraphHash {
+    const paragraphs = input.index.paragraphs;
+    const hashes = try allocator.alloc(ParagraphHash, paragraphs.len);
+
+    for (paragraphs, hashes) |paragraph, *hash| {
+        var format = std.hash.Wyhash.init(0);
+        for (paragraph.first_run..paragraph.first_run + paragraph.run_count) |run_index| {
+            const span = input.index.runs[run_index];
+            const run = input.runs[run_index];
+            std.hash.autoHash(&format, span.start - paragraph.start);
+            std.hash.autoHash(&format, span.len);
+            std.hash.autoHash(&format, run.char_format);
+            std.hash.autoHash(&format, run.para_format);
+        }
+        hash.* = .{
+            .text = std.hash.Wyhash.hash(0, input.text[paragraph.start..][0..paragraph.len]),
+            .format = format.final(),
+        };
+    }
+    return hashes;
+}
+
+const Differ = struct {
+    allocator: std.mem.Allocator,
+    a: Input,
+    b: Input,
+    hashes_a: []const ParagraphHash,
+    hashes_b: []const ParagraphHash,
+    emitter: Emitter,
+
+    // Paragraphs with the same text - only their formatting can differ
+    fn same(self: *Differ, a_first: usize, b_first: usize, count: usize) !void {
+        for (a_first..a_first + count, b_first..b_first + count) |i, j| {
+            if (self.hashes_a[i].format == self.hashes_b[j].format) continue;
+            const paragraph = self.a.index.paragraphs[i];
+            try self.compareFormat(paragraph.start, self.b.index.paragraphs[j].start, paragraph.len);
+        }
+    }
+
+    // Unmatched paragraphs: pair them up in order and diff their text; the
+    // rest were inserted or deleted whole
+    fn changed(self: *Differ, a_from: usize, a_to: usize, b_from: usize, b_to: usize) !void {
+        const pairs = @min(a_to - a_from, b_to - b_from);
+        for (a_from..a_from + pairs, b_from..b_from + pairs) |i, j| {
+            try self.diffText(self.a.index.paragraphs[i], self.b.index.paragraphs[j]);
+        }
+
+        const a_rest = extentStart(self.a, a_from + pairs);
+        const b_rest = extentStart(self.b, b_from + pairs);
+        if (a_to > a_from + pairs) {
+            try self.emitter.emit(.{ .kind = .delete, .a_start = a_rest, .a_end = extentStart(self.a, a_to), .b_start = b_rest, .b_end = b_rest });
+        }
+        if (b_to > b_from + pairs) {
+            try self.emitter.emit(.{ .kind = .insert, .a_start = a_rest, .a_end = a_rest, .b_start = b_rest, .b_end = extentStart(self.b, b_to) });
+        }
+    }
+
+    fn diffText(self: *Differ, paragraph_a: text_index.Paragraph, paragraph_b: text_index.Paragraph) !void {
+        var text = TextDiffer{
+            .differ = self,
+            .a = self.a.text[paragraph_a.start..][0..paragraph_a.len],
+            .b = self.b.text[paragraph_b.start..][0..paragraph_b.len],
+            .a_base = paragraph_a.start,
+            .b_base = paragraph_b.start,
+        };
+        var alignment = try Alignment.find(self.allocator, BytesEql{ .a = text.a, .b = text.b }, text.a.len, text.b.len, max_text_edits);
+        defer alignment.deinit(self.allocator);
+        try alignment.walk(&text);
+    }
+
+    // Report where runs over equal text [a_start, +len) and [b_start, +len)
+    // are formatted differently
+    fn compareFormat(self: *Differ, a_start: usize, b_start: usize, len: usize) !void {
+        var done: usize = 0;
+        while (done < len) {
+            const a_offset = a_start + done;
+            const b_offset = b_start + done;
+            const run_a = runAt(self.a, a_offset);
+            const run_b = runAt(self.b, b_offset);
+
+            // Text between runs (cell separators) has no format of its own
+            if (run_a == null or run_b == null) {
+                done += 1;
+                continue;
+            }
+            const step = @min(len - done, runEnd(self.a, run_a.?) - a_offset, runEnd(self.b, run_b.?) - b_offset);
+            if (!sameFormat(self.a.runs[run_a.?], self.b.runs[run_b.?])) {
+                try self.emitter.emit(.{ .kind = .format, .a_start = a_offset, .a_end = a_offset + step, .b_start = b_offset, .b_end = b_offset + step });
+            }
+            done += step;
+        }
+    }
+};
+
+const TextDiffer = struct {
+    differ: *Differ,
+    a: []const u8,
+    b: []const u8,
+    a_base: usize,
+    b_base: usize,
+
+    fn same(self: *TextDiffer, a_first: usize, b_first: usize, count: usize) !void {
+        if (count == 0) return;
+        try self.differ.compareFormat(self.a_base + a_first, self.b_base + b_first, count);
+    }
+
+    fn changed(self: *TextDiffer, a_from: usize, a_to: usize, b_from: usize, b_to: usize) !void {
+        const a_start = self.a_base + a_from;
+        const a_end = self.a_base + a_to;
+        const b_start = self.b_base + b_from;
+        const b_end = self.b_base + b_to;
+        if (a_end > a_start) {
+            try self.differ.emitter.emit(.{ .kind = .delete, .a_start = a_start, .a_end = a_end, .b_start = b_start, .b_end = b_start });
+        }
+        if (b_end > b_start) {
+            try self.differ.emitter.emit(.{ .kind = .insert, .a_start = a_end, .a_end = a_end, .b_start = b_start, .b_end = b_end });
+        }
+    }
+};
+
+// Offset of paragraph `index`, or the text end past the last paragraph.
+// Whole paragraphs are reported with the breaks that follow them.
+fn extentStart(input: Input, index: usize) usize {
+    const paragraphs = input.index.paragraphs;
+    return if (index < paragraphs.len) paragraphs[index].start else input.text.len;
+}
+
+fn runAt(input: Input, offset: usize) ?usize {
+    const run = input.index.findRun(offset) orelse return null;
+    return if (offset < runEnd(input, run)) run else null;
+}
+
+fn runEnd(input: Input, run: usize) usize {
+    const span = input.index.runs[run];
+    return span.start + span.len;
+}
+
+fn sameFormat(a: doc_model.TextRun, b: doc_model.TextRun) bool {
+    return a.char_format.equals(b.char_format) and std.meta.eql(a.para_format, b.para_format);
+}
+
+const ParagraphEql = struct {
+    differ: *const Differ,
+
+    fn eql(self: ParagraphEql, i: usize, j: usize) bool {
+        if (self.differ.hashes_a[i].text != self.differ.hashes_b[j].text) return false;
+        const paragraph_a = self.differ.a.index.paragraphs[i];
+        const paragraph_b = self.differ.b.index.paragraphs[j];
+        return std.mem.eql(
+            u8,
+            self.differ.a.text[paragraph_a.start..][0..paragraph_a.len],
+            self.differ.b.text[paragraph_b.start..][0..paragraph_b.len],
+        );
+    }
+};
+
+const BytesEql = struct {
+    a: []const u8,
+    b: []const u8,
+
+    fn eql(self: BytesEql, i: usize, j: usize) bool {
+        return self.a[i] == self.b[j];
+    }
+};
+
+// Coalesces adjacent changes of the same kind before passing them on
+const Emitter = struct {
+    sink: Sink,
+    pending: ?Change = null,
+
+    fn emit(self: *Emitter, change: Change) !void {
+        if (self.pending) |*pending| {
+            if (pending.kind == change.kind and pending.a_end == change.a_start and pending.b_end == change.b_start) {
+                pending.a_end = change.a_end;
+                pending.b_end = change.b_end;
+                return;
+            }
+        }
+        try self.flush();
+        self.pending = change;
+    }
+
+    fn flush(self: *Emitter) !void {
+        const pending = self.pending orelse return;
+        self.pending = null;
+        if (!self.sink.emit(self.sink.context, &pending)) return error.Stopped;
+    }
+};
+
+// =============================================================================
+// ALIGNMENT
+// =============================================================================
+
+// Equal stretches a[a..a+len] == b[b..b+len]
+const Match = struct {
+    a: usize,
+    b: usize,
+    len: usize,
+};
+
+const Alignment = struct {
+    n: usize,
+    m: usize,
+    prefix: usize,
+    suffix: usize,
+    matches: ?[]Match, // Between prefix and suffix; null if over the edit cap
+
+    // `context.eql(i, j)` compares element i of the first sequence with
+    // element j of the second
+    fn find(allocator: std.mem.Allocator, context: anytype, n: usize, m: usize, max_edits: usize) !Alignment {
+        const shorter = @min(n, m);
+        var prefix: usize = 0;
+        while (prefix < shorter and context.eql(prefix, prefix)) prefix += 1;
+        var suffix: usize = 0;
+        while (suffix < shorter - prefix and context.eql(n - 1 - suffix, m - 1 - suffix)) suffix += 1;
+
+        return .{
+            .n = n,
+            .m = m,
+            .prefix = prefix,
+            .suffix = suffix,
+            .matches = try myers(allocator, context, prefix, n - prefix - suffix, prefix, m - prefix - suffix, max_edits),
+        };
+    }
+
+    fn deinit(self: *Alignment, allocator: std.mem.Allocator) void {
+        if (self.matches) |matches| allocator.free(matches);
+    }
+
+    // Hand equal and changed stretches to `handler.same` and
+    // `handler.changed`, in order
+    fn walk(self: Alignment, handler: anytype) !void {
+        try handler.same(0, 0, self.prefix);
+
+        var a = self.prefix;
+        var b = self.prefix;
+        for (self.matches orelse &.{}) |match| {
+            try handler.changed(a, match.a, b, match.b);
+            try handler.same(match.a, match.b, match.len);
+            a = match.a + match.len;
+            b = match.b + match.len;
+        }
+        try handler.changed(a, self.n - self.suffix, b, self.m - self.suffix);
+        try handler.same(self.n - self.suffix, self.m - self.suffix, self.suffix);
+    }
+};
+
+// Myers' greedy diff of a[a_offset..][0..n] against b[b_offset..][0..m].
+// Returns the equal stretches, or null if more than `max_edits` edits are
+// needed. The furthest x on each diagonal k is kept for every edit count d
+// (2d + 1 values, stored back to back) so the path can be traced back.
+fn myers(allocator: std.mem.Allocator, context: anytype, a_offset: usize, n: usize, b_offset: usize, m: usize, max_edits: usize) !?[]Match {
+    if (n == 0 or m == 0) return try allocator.alloc(Match, 0);
+
+    const max = @min(n + m, max_edits);
+    const v = try allocator.alloc(usize, 2 * max + 2);
+    defer allocator.free(v);
+    v[max + 1] = 0;
+
+    var trace = std.ArrayList(usize).init(allocator);
+    defer trace.deinit();
+
+    for (0..max + 1) |d| {
+        const di: isize = @intCast(d);
+        var k: isize = -di;
+        while (k <= di) : (k += 2) {
+            const i: usize = @intCast(k + @as(isize, @intCast(max)));
+            var x = if (k == -di or (k != di and v[i - 1] < v[i + 1])) v[i + 1] else v[i - 1] + 1;
+            var y: usize = @intCast(@as(isize, @intCast(x)) - k);
+            while (x < n and y < m and context.eql(a_offset + x, b_offset + y)) {
+                x += 1;
+                y += 1;
+            }
+            v[i] = x;
+
+            if (x >= n and y >= m) {
+                return try traceBack(allocator, trace.items, d, n, m, a_offset, b_offset);
+            }
+        }
+        try trace.appendSlice(v[max - d .. max + d + 1]);
+    }
+    return null;
+}
+
+fn traceBack(allocator: std.mem.Allocator, trace: []const usize, edits: usize, n: usize, m: usize, a_offset: usize, b_offset: usize) ![]Match {
+    var matches = std.ArrayList(Match).init(allocator);
+    defer matches.deinit();
+
+    var x: isize = @intCast(n);
+    var y: isize = @intCast(m);
+    var d = edits;
+    while (d > 0) : (d -= 1) {
+        // Diagonals of step d - 1, k = -(d - 1) .. d - 1
+        const previous = trace[(d - 1) * (d - 1) ..][0 .. 2 * d - 1];
+        const di: isize = @intCast(d);
+
+        const k = x - y;
+        const down = k == -di or (k != di and furthest(previous, di - 1, k - 1) < furthest(previous, di - 1, k + 1));
+        const previous_k = if (down) k + 1 else k - 1;
+        const previous_x = furthest(previous, di - 1, previous_k);
+        const snake_x = if (down) previous_x else previous_x + 1;
+
+        if (x > snake_x) {
+            try matches.append(.{
+                .a = a_offset + @as(usize, @intCast(snake_x)),
+                .b = b_offset + @as(usize, @intCast(snake_x - k)),
+                .len = @intCast(x - snake_x),
+            });
+        }
+        x = previous_x;
+        y = previous_x - previous_k;
+    }
+    if (x > 0) try matches.append(.{ .a = a_offset, .b = b_offset, .len = @intCast(x) });
+
+    std.mem.reverse(Match, matches.items);
+    return matches.toOwnedSlice();
+}
+
+// Furthest x on diagonal k in the values of step d
+fn furthest(values: []const usize, d: isize, k: isize) isize {
+    return @intCast(values[@intCast(k + d)]);
+}
+
+// =============================================================================
+// TESTS
+// =============================================================================
+
+const formatted_parser = @import("formatted_parser.zig");
+
+const TestSide = struct {
+    document: doc_model.Document,
+    index: text_index.TextIndex,
+    runs: []doc_model.TextRun,
+    text: []const u8,
+
+    fn init(rtf_data: []const u8) !TestSide {
+        const allocator = std.testing.allocator;
+        var stream = std.io.fixedBufferStream(rtf_data);
+        var parser = try formatted_parser.FormattedParser.init(stream.reader().any(), allocator);
+        defer parser.deinit();
+
+        var side: TestSide = undefined;
+        side.document = try parser.parse();
+        side.text = try side.document.getPlainText();
+        side.runs = try side.document.getTextRuns(allocator);
+        side.index = try text_index.TextIndex.build(&side.document, allocator);
+        return side;
+    }
+
+    fn deinit(self: *TestSide) void {
+        self.index.deinit(std.testing.allocator);
+        std.testing.allocator.free(self.runs);
+        self.document.deinit();
+    }
+
+    fn input(self: *const TestSide) Input {
+        return .{ .text = self.text, .index = &self.index, .runs = self.runs };
+    }
+};
+
+const ChangeList = struct {
+    changes: std.ArrayList(Change),
+
+    fn emit(context: *anyopaque, change: *const Change) bool {
+        const self: *ChangeList = @ptrCast(@alignCast(context));
+        self.changes.append(change.*) catch return false;
+        return true;
+    }
+};
+
+test "diff reports text and formatting changes" {
+    const testing = std.testing;
+
+    var a = try TestSide.init("{\\rtf1 Intro stays.\\par The quick fox jumps.\\par Dropped paragraph.\\par Plain words here.\\par End}");
+    defer a.deinit();
+    var b = try TestSide.init("{\\rtf1 Intro stays.\\par The quick brown fox jumps.\\par Plain \\b words\\b0  here.\\par End}");
+    defer b.deinit();
+
+    var list = ChangeList{ .changes = std.ArrayList(Change).init(testing.allocator) };
+    defer list.changes.deinit();
+    try diff(testing.allocator, a.input(), b.input(), .{ .context = &list, .emit = ChangeList.emit });
+
+    const changes = list.changes.items;
+    try testing.expectEqual(@as(usize, 3), changes.len);
+
+    try testing.expectEqual(Change.Kind.insert, changes[0].kind);
+    try testing.expectEqualStrings("brown ", b.text[changes[0].b_start..changes[0].b_end]);
+    try testing.expectEqual(changes[0].a_start, changes[0].a_end);
+
+    try testing.expectEqual(Change.Kind.delete, changes[1].kind);
+    try testing.expectEqualStrings("Dropped paragraph.\n\n", a.text[changes[1].a_start..changes[1].a_end]);
+
+    try testing.expectEqual(Change.Kind.format, changes[2].kind);
+    try testing.expectEqualStrings("words", a.text[changes[2].a_start..changes[2].a_end]);
+    try testing.expectEqualStrings("words", b.text[changes[2].b_start..changes[2].b_end]);
+
+    // Identical documents have no changes; a stopping sink ends the diff
+    list.changes.clearRetainingCapacity();
+    try diff(testing.allocator, a.input(), a.input(), .{ .context = &list, .emit = ChangeList.emit });
+    try testing.expectEqual(@as(usize, 0), list.changes.items.len);
+
+    const stop = struct {
+        fn emit(_: *anyopaque, _: *const Change) bool {
+            return false;
+        }
+    }.emit;
+    try testing.expectError(error.Stopped, diff(testing.allocator, a.input(), b.input(), .{ .context = &list, .emit = stop }));
+}
+
+test "myers finds the shortest edit script" {
+    const testing = std.testing;
+
+    const a = "ABCABBA";
+    const b = "CBABAC";
+    const matches = (try myers(testing.allocator, BytesEql{ .a = a, .b = b }, 0, a.len, 0, b.len, 100)).?;
+    defer testing.allocator.free(matches);
+
+    // D = 5 for this classic pair, so 4 characters are matched
+    var matched: usize = 0;
+    for (matches) |match| {
+        try testing.expectEqualStrings(a[match.a..][0..match.len], b[match.b..][0..match.len]);
+        matched += match.len;
+    }
+    try testing.expectEqual(@as(usize, 4), matched);
+
+    try testing.expect(try myers(testing.allocator, BytesEql{ .a = a, .b = b }, 0, a.len, 0, b.len, 2) == null);
+}
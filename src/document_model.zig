@@ -1,4 +1,7 @@
 const std = @import("std");
+const io = @import("io.zig");
+
+pub const SourceMap = @import("source_map.zig").SourceMap;
 
 // =============================================================================
 // COMPLETE RTF DOCUMENT MODEL
@@ -9,7 +12,7 @@ const std = @import("std");
 // Font table entry
 pub const FontInfo = struct {
     id: u16,
-    name: []const u8,
+    name: [:0]const u8, // Zero-terminated for the C API
     family: FontFamily = .dontcare,
     charset: u8 = 0,
     
@@ -79,6 +82,21 @@ pub const CharFormat = struct {
                self.font_size == other.font_size and
                self.color_id == other.color_id;
     }
+    
+    // One integer per distinct format, for deduplicating styles. Bits 0-5
+    // hold the flags, then font, size and color, each with a presence bit.
+    pub fn key(self: CharFormat) u64 {
+        var result: u64 = 0;
+        const flags = [_][]const u8{ "bold", "italic", "underline", "strikethrough", "superscript", "subscript" };
+        inline for (flags, 0..) |name, bit| {
+            if (@field(self, name)) result |= 1 << bit;
+        }
+        const numbers = [_][]const u8{ "font_id", "font_size", "color_id" };
+        inline for (numbers, 0..) |name, slot| {
+            if (@field(self, name)) |value| result |= (@as(u64, value) | 1 << 16) << (8 + 17 * slot);
+        }
+        return result;
+    }
 };
 
 // Paragraph formatting state
@@ -120,41 +138,22 @@ pub const ParaFormat = struct {
 };
 
 // Table cell information
+// Content is the run range first_run..first_run + run_count of the table's runs
 pub const TableCell = struct {
-    content: std.ArrayList(ContentElement),
-    width: u32, // Twips
+    width: u32 = 0, // Twips
     border_left: bool = false,
     border_right: bool = false,
     border_top: bool = false,
     border_bottom: bool = false,
-    
-    pub fn init(allocator: std.mem.Allocator) TableCell {
-        return .{ .content = std.ArrayList(ContentElement).init(allocator), .width = 0 };
-    }
-    
-    pub fn deinit(self: *TableCell) void {
-        for (self.content.items) |*element| {
-            element.deinit();
-        }
-        self.content.deinit();
-    }
+    first_run: u32 = 0,
+    run_count: u32 = 0,
 };
 
 // Table row information
+// Cells are first_cell up to the next row's first_cell (or the table's end)
 pub const TableRow = struct {
-    cells: std.ArrayList(TableCell),
+    first_cell: u32 = 0,
     height: u32 = 0, // Twips
-    
-    pub fn init(allocator: std.mem.Allocator) TableRow {
-        return .{ .cells = std.ArrayList(TableCell).init(allocator) };
-    }
-    
-    pub fn deinit(self: *TableRow) void {
-        for (self.cells.items) |*cell| {
-            cell.deinit();
-        }
-        self.cells.deinit();
-    }
 };
 
 // Image/object information
@@ -179,7 +178,7 @@ pub const ImageInfo = struct {
 // Hyperlink information
 pub const HyperlinkInfo = struct {
     url: []const u8,
-    display_text: []const u8,
+    display_text: [:0]const u8,
     
     // No deinit needed - data is allocated in document arena
 };
@@ -208,12 +207,13 @@ pub const ContentElement = union(enum) {
 };
 
 // Text run with formatting
+// Text is zero-terminated so the C API can hand it out without copying
 pub const TextRun = struct {
-    text: []const u8,
+    text: [:0]const u8,
     char_format: CharFormat,
     para_format: ParaFormat,
     
-    pub fn init(text: []const u8, char_fmt: CharFormat, para_fmt: ParaFormat) TextRun {
+    pub fn init(text: [:0]const u8, char_fmt: CharFormat, para_fmt: ParaFormat) TextRun {
         return .{
             .text = text,
             .char_format = char_fmt,
@@ -228,21 +228,140 @@ pub const TextRun = struct {
 };
 
 // Table structure
+// Stored flat - one row array, one cell array and one run array per table -
+// so a table costs the same handful of allocations however many cells it has.
+// Cell text lives in the runs, which point into the document arena.
 pub const Table = struct {
     rows: std.ArrayList(TableRow),
+    cells: std.ArrayList(TableCell),
+    runs: std.ArrayList(TextRun),
     
     pub fn init(allocator: std.mem.Allocator) Table {
-        return .{ .rows = std.ArrayList(TableRow).init(allocator) };
+        return .{
+            .rows = std.ArrayList(TableRow).init(allocator),
+            .cells = std.ArrayList(TableCell).init(allocator),
+            .runs = std.ArrayList(TextRun).init(allocator),
+        };
     }
     
     pub fn deinit(self: *Table) void {
-        for (self.rows.items) |*row| {
-            row.deinit();
-        }
         self.rows.deinit();
+        self.cells.deinit();
+        self.runs.deinit();
+    }
+    
+    pub fn rowCount(self: Table) usize {
+        return self.rows.items.len;
+    }
+    
+    // Cells of one row
+    pub fn rowCells(self: Table, row_index: usize) []const TableCell {
+        const first = self.rows.items[row_index].first_cell;
+        const end = if (row_index + 1 < self.rows.items.len)
+            self.rows.items[row_index + 1].first_cell
+        else
+            @as(u32, @intCast(self.cells.items.len));
+        return self.cells.items[first..end];
+    }
+    
+    // Text runs of one cell
+    pub fn cellRuns(self: Table, cell: TableCell) []const TextRun {
+        return self.runs.items[cell.first_run..][0..cell.run_count];
+    }
+    
+    // Start a new row; following cells belong to it
+    pub fn addRow(self: *Table, height: u32) !void {
+        try self.rows.append(.{ .first_cell = @intCast(self.cells.items.len), .height = height });
+    }
+    
+    // Append a complete cell to the last row
+    pub fn addCell(self: *Table, cell: TableCell, runs: []const TextRun) !void {
+        var owned = cell;
+        owned.first_run = @intCast(self.runs.items.len);
+        owned.run_count = @intCast(runs.len);
+        try self.runs.appendSlice(runs);
+        try self.cells.append(owned);
+    }
+};
+
+// Code point of a \'xx byte in `code_page`, or null if that
+// code page is not decoded. Windows-1252, the default, is the only one.
+pub fn decodeCodePageByte(code_page: u16, byte: u8) ?u21 {
+    if (code_page != 1252) return null;
+    if (byte < 0x80 or byte >= 0xa0) return byte;
+    return windows_1252[byte - 0x80];
+}
+
+// Document text as UTF-8. The parser keeps \'xx bytes as they are, so text
+// is split into stretches of valid UTF-8 and single bytes outside them, the
+// latter decoded through the code page (U+FFFD where it is not decoded).
+pub const TextDecoder = struct {
+    text: []const u8,
+    code_page: u16,
+    pos: usize = 0,
+    
+    pub const Piece = union(enum) {
+        utf8: []const u8,
+        code_point: u21,
+    };
+    
+    pub fn next(self: *TextDecoder) ?Piece {
+        if (self.pos >= self.text.len) return null;
+        const start = self.pos;
+        while (self.pos < self.text.len) {
+            const byte = self.text[self.pos];
+            if (byte < 0x80) {
+                self.pos += 1;
+                continue;
+            }
+            const len = std.unicode.utf8ByteSequenceLength(byte) catch 0;
+            if (len > 0 and self.pos + len <= self.text.len and std.unicode.utf8ValidateSlice(self.text[self.pos..][0..len])) {
+                self.pos += len;
+                continue;
+            }
+            if (self.pos > start) return .{ .utf8 = self.text[start..self.pos] };
+            self.pos += 1;
+            return .{ .code_point = decodeCodePageByte(self.code_page, byte) orelse 0xfffd };
+        }
+        return .{ .utf8 = self.text[start..] };
     }
 };
 
+// Write `text` as UTF-8 (see TextDecoder). Stretches that already are go
+// through `writeUtf8(out, stretch)`, for exporters to escape; decoded
+// characters are never ASCII and are written as they are.
+pub fn writeDecoded(out: anytype, text: []const u8, code_page: u16, comptime writeUtf8: anytype) !void {
+    var decoder = TextDecoder{ .text = text, .code_page = code_page };
+    while (decoder.next()) |piece| {
+        switch (piece) {
+            .utf8 => |bytes| try writeUtf8(out, bytes),
+            .code_point => |code_point| {
+                var buffer: [4]u8 = undefined;
+                const len = std.unicode.utf8Encode(code_point, &buffer) catch unreachable;
+                try out.writeAll(buffer[0..len]);
+            },
+        }
+    }
+}
+
+// For writeDecoded(), where nothing needs escaping
+pub fn writeVerbatim(out: anytype, text: []const u8) !void {
+    try out.writeAll(text);
+}
+
+pub fn appendDecoded(list: *std.ArrayList(u8), text: []const u8, code_page: u16) !void {
+    try writeDecoded(list.writer(), text, code_page, writeVerbatim);
+}
+
+// Code points of 0x80-0x9F in Windows-1252; the five unassigned bytes map to
+// the C1 controls of the same value
+const windows_1252 = [32]u21{
+    0x20AC, 0x0081, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+    0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008D, 0x017D, 0x008F,
+    0x0090, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+    0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x009D, 0x017E, 0x0178,
+};
+
 // Complete document structure
 pub const Document = struct {
     allocator: std.mem.Allocator,
@@ -261,6 +380,27 @@ pub const Document = struct {
     code_page: u16 = 1252, // Windows-1252
     rtf_version: u16 = 1,
     
+    // Plain text cache - filled by getPlainText() or preset by snapshot loading
+    plain_text: ?[:0]const u8 = null,
+    
+    // Guards lazily computed views (and the arena they live in) so a finished
+    // document can be read from several threads at once
+    view_mutex: std.Thread.Mutex = .{},
+    
+    // Input byte ranges of runs, tables, cells and images, when the parser was
+    // asked to record them. Lives in the arena; not kept by snapshots.
+    source_map: ?SourceMap = null,
+    
+    // Read-only file backing the document (snapshots), unmapped on deinit.
+    // Mapped with `allocator`.
+    mapping: ?io.FileBytes = null,
+    
+    // Single allocation holding a compacted document (see compact.zig). The
+    // lists above are then views into it and the document is read-only.
+    block: ?[]align(block_alignment) u8 = null,
+    
+    pub const block_alignment = 16;
+    
     pub fn init(allocator: std.mem.Allocator) !Document {
         return .{
             .allocator = allocator,
@@ -272,35 +412,90 @@ pub const Document = struct {
     }
     
     pub fn deinit(self: *Document) void {
+        if (self.block) |block| {
+            // Lists and elements are views into the block
+            self.allocator.free(block);
+        } else {
+            for (self.content.items) |*element| {
+                element.deinit();
+            }
+            self.content.deinit();
+            self.font_table.deinit();
+            self.color_table.deinit();
+        }
+        self.arena.deinit();
+        
+        if (self.mapping) |mapping| mapping.unmap(self.allocator);
+    }
+    
+    // Empty the document for reuse by another parse. List capacity is kept,
+    // and so are arena chunks up to `retain_limit` bytes.
+    pub fn reset(self: *Document, retain_limit: usize) void {
+        if (self.block) |block| {
+            self.allocator.free(block);
+            self.block = null;
+            self.content = std.ArrayList(ContentElement).init(self.allocator);
+            self.font_table = std.ArrayList(FontInfo).init(self.allocator);
+            self.color_table = std.ArrayList(ColorInfo).init(self.allocator);
+        }
+        
         for (self.content.items) |*element| {
             element.deinit();
         }
-        self.content.deinit();
-        self.font_table.deinit();
-        self.color_table.deinit();
-        self.arena.deinit();
+        self.content.clearRetainingCapacity();
+        self.font_table.clearRetainingCapacity();
+        self.color_table.clearRetainingCapacity();
+        _ = self.arena.reset(.{ .retain_with_limit = retain_limit });
+        
+        if (self.mapping) |mapping| {
+            mapping.unmap(self.allocator);
+            self.mapping = null;
+        }
+        
+        self.default_font = 0;
+        self.default_font_size = 24;
+        self.code_page = 1252;
+        self.rtf_version = 1;
+        self.plain_text = null;
+        self.source_map = null;
+    }
+    
+    // Move the finished document into one exactly sized allocation, releasing
+    // list slack and the arena. Read-only afterwards. See compact.zig.
+    pub fn compact(self: *Document) !void {
+        return @import("compact.zig").compact(self);
+    }
+    
+    // As compact(), leaving `extra` bytes at the end of the block, which are
+    // returned for data that lives as long as the document
+    pub fn compactReserving(self: *Document, extra: usize) ![]align(block_alignment) u8 {
+        return @import("compact.zig").compactReserving(self, extra);
     }
     
     // Add content element to document
     pub fn addElement(self: *Document, element: ContentElement) !void {
+        std.debug.assert(self.block == null); // Compacted documents are read-only
         try self.content.append(element);
+        self.plain_text = null;
     }
     
     // Add text run with current formatting
     pub fn addTextRun(self: *Document, text: []const u8, char_fmt: CharFormat, para_fmt: ParaFormat) !void {
-        // Store text in arena
-        const owned_text = try self.arena.allocator().dupe(u8, text);
+        // Store text in arena (zero-terminated, see TextRun)
+        const owned_text = try self.arena.allocator().dupeZ(u8, text);
         const run = TextRun.init(owned_text, char_fmt, para_fmt);
         try self.addElement(.{ .text_run = run });
     }
     
     // Add font to font table
     pub fn addFont(self: *Document, font: FontInfo) !void {
+        std.debug.assert(self.block == null);
         try self.font_table.append(font);
     }
     
     // Add color to color table  
     pub fn addColor(self: *Document, color: ColorInfo) !void {
+        std.debug.assert(self.block == null);
         try self.color_table.append(color);
     }
     
@@ -320,8 +515,30 @@ pub const Document = struct {
         return null;
     }
     
-    // Extract plain text from document
-    pub fn getPlainText(self: *Document) ![]const u8 {
+    // Extract plain text from document (computed once, then cached).
+    // Safe to call concurrently on a document that is no longer being built.
+    pub fn getPlainText(self: *Document) ![:0]const u8 {
+        self.view_mutex.lock();
+        defer self.view_mutex.unlock();
+        
+        if (self.plain_text) |cached| return cached;
+        
+        const result = try self.buildPlainText(self.arena.allocator());
+        self.plain_text = result;
+        return result;
+    }
+    
+    // Recompute the cached plain text into `allocator` instead of the arena,
+    // for callers that rebuild it after every edit and free the previous one
+    // themselves. Not for documents being read concurrently.
+    pub fn refreshPlainText(self: *Document, allocator: std.mem.Allocator) ![:0]const u8 {
+        self.plain_text = null;
+        const result = try self.buildPlainText(allocator);
+        self.plain_text = result;
+        return result;
+    }
+    
+    fn buildPlainText(self: *Document, allocator: std.mem.Allocator) ![:0]const u8 {
         var text = std.ArrayList(u8).init(self.allocator);
         defer text.deinit();
         
@@ -333,14 +550,9 @@ pub const Document = struct {
                 .page_break => try text.appendSlice("\n\n"),
                 .hyperlink => |link| try text.appendSlice(link.display_text),
                 .table => |table| {
-                    for (table.rows.items) |row| {
-                        for (row.cells.items) |cell| {
-                            for (cell.content.items) |cell_element| {
-                                switch (cell_element) {
-                                    .text_run => |run| try text.appendSlice(run.text),
-                                    else => {},
-                                }
-                            }
+                    for (0..table.rowCount()) |row_index| {
+                        for (table.rowCells(row_index)) |cell| {
+                            for (table.cellRuns(cell)) |run| try text.appendSlice(run.text);
                             try text.append('\t'); // Tab between cells
                         }
                         try text.append('\n'); // Newline after row
@@ -350,7 +562,7 @@ pub const Document = struct {
             }
         }
         
-        return try self.arena.allocator().dupe(u8, text.items);
+        return allocator.dupeZ(u8, text.items);
     }
     
     // Get all text runs for C API compatibility
@@ -367,16 +579,8 @@ pub const Document = struct {
                     try runs.append(run);
                 },
                 .table => |table| {
-                    for (table.rows.items) |row| {
-                        for (row.cells.items) |cell| {
-                            for (cell.content.items) |cell_element| {
-                                switch (cell_element) {
-                                    .text_run => |run| try runs.append(run),
-                                    else => {},
-                                }
-                            }
-                        }
-                    }
+                    // Cell runs are stored in cell order
+                    try runs.appendSlice(table.runs.items);
                 },
                 else => {},
             }
@@ -435,7 +639,8 @@ pub const Document = struct {
         return rtf.toOwnedSlice();
     }
     
-    fn generateContent(self: *const Document, rtf: *std.ArrayList(u8)) !void {
+    // Content elements only, without header or closing brace
+    pub fn generateContent(self: *const Document, rtf: *std.ArrayList(u8)) !void {
         for (self.content.items) |element| {
             switch (element) {
                 .text_run => |run| {
@@ -477,47 +682,7 @@ pub const Document = struct {
             needs_group = true;
         }
         
-        // Character formatting
-        if (run.char_format.bold) try rtf.appendSlice("\\b ");
-        if (run.char_format.italic) try rtf.appendSlice("\\i ");
-        if (run.char_format.underline) try rtf.appendSlice("\\ul ");
-        if (run.char_format.strikethrough) try rtf.appendSlice("\\strike ");
-        if (run.char_format.superscript) try rtf.appendSlice("\\super ");
-        if (run.char_format.subscript) try rtf.appendSlice("\\sub ");
-        
-        if (run.char_format.font_id) |font_id| {
-            try rtf.writer().print("\\f{} ", .{font_id});
-        }
-        
-        if (run.char_format.font_size) |size| {
-            try rtf.writer().print("\\fs{} ", .{size});
-        }
-        
-        if (run.char_format.color_id) |color_id| {
-            try rtf.writer().print("\\cf{} ", .{color_id});
-        }
-        
-        // Paragraph formatting (only if different from default)
-        if (run.para_format.alignment != .left) {
-            switch (run.para_format.alignment) {
-                .center => try rtf.appendSlice("\\qc "),
-                .right => try rtf.appendSlice("\\qr "),
-                .justify => try rtf.appendSlice("\\qj "),
-                .left => {},
-            }
-        }
-        
-        if (run.para_format.left_indent != 0) {
-            try rtf.writer().print("\\li{} ", .{run.para_format.left_indent});
-        }
-        
-        if (run.para_format.right_indent != 0) {
-            try rtf.writer().print("\\ri{} ", .{run.para_format.right_indent});
-        }
-        
-        if (run.para_format.first_line_indent != 0) {
-            try rtf.writer().print("\\fi{} ", .{run.para_format.first_line_indent});
-        }
+        try generateFormat(rtf, run.char_format, run.para_format);
         
         // Escape special characters and output text
         try escapeRtfText(rtf, run.text);
@@ -530,24 +695,21 @@ pub const Document = struct {
     
     fn generateTable(self: *const Document, rtf: *std.ArrayList(u8), table: Table) !void {
         
-        for (table.rows.items) |row| {
+        for (0..table.rowCount()) |row_index| {
+            const cells = table.rowCells(row_index);
+            
             // Table row definition
             try rtf.appendSlice("\\trowd ");
             
             var cell_x: u32 = 0;
-            for (row.cells.items) |cell| {
+            for (cells) |cell| {
                 cell_x += cell.width;
                 try rtf.writer().print("\\cellx{} ", .{cell_x});
             }
             
             // Table row content
-            for (row.cells.items) |cell| {
-                for (cell.content.items) |cell_element| {
-                    switch (cell_element) {
-                        .text_run => |run| try self.generateTextRun(rtf, run),
-                        else => {},
-                    }
-                }
+            for (cells) |cell| {
+                for (table.cellRuns(cell)) |run| try self.generateTextRun(rtf, run);
                 try rtf.appendSlice("\\cell ");
             }
             
@@ -582,6 +744,52 @@ pub const Document = struct {
     }
 };
 
+// Control words for the non-default parts of a format, each followed by a
+// space. Character and paragraph state is otherwise inherited.
+pub fn generateFormat(rtf: *std.ArrayList(u8), char_format: CharFormat, para_format: ParaFormat) !void {
+    // Character formatting
+    if (char_format.bold) try rtf.appendSlice("\\b ");
+    if (char_format.italic) try rtf.appendSlice("\\i ");
+    if (char_format.underline) try rtf.appendSlice("\\ul ");
+    if (char_format.strikethrough) try rtf.appendSlice("\\strike ");
+    if (char_format.superscript) try rtf.appendSlice("\\super ");
+    if (char_format.subscript) try rtf.appendSlice("\\sub ");
+    
+    if (char_format.font_id) |font_id| {
+        try rtf.writer().print("\\f{} ", .{font_id});
+    }
+    
+    if (char_format.font_size) |size| {
+        try rtf.writer().print("\\fs{} ", .{size});
+    }
+    
+    if (char_format.color_id) |color_id| {
+        try rtf.writer().print("\\cf{} ", .{color_id});
+    }
+    
+    // Paragraph formatting (only if different from default)
+    if (para_format.alignment != .left) {
+        switch (para_format.alignment) {
+            .center => try rtf.appendSlice("\\qc "),
+            .right => try rtf.appendSlice("\\qr "),
+            .justify => try rtf.appendSlice("\\qj "),
+            .left => {},
+        }
+    }
+    
+    if (para_format.left_indent != 0) {
+        try rtf.writer().print("\\li{} ", .{para_format.left_indent});
+    }
+    
+    if (para_format.right_indent != 0) {
+        try rtf.writer().print("\\ri{} ", .{para_format.right_indent});
+    }
+    
+    if (para_format.first_line_indent != 0) {
+        try rtf.writer().print("\\fi{} ", .{para_format.first_line_indent});
+    }
+}
+
 fn escapeRtfText(rtf: *std.ArrayList(u8), text: []const u8) !void {
     for (text) |char| {
         switch (char) {
@@ -0,0 +1,922 @@
+const std = @import("std");
+const doc_model = @import("document_model.zig");
+const source_map = @import("source_map.zig");
+
+// =============================================================================
+// EDITABLE DOCUMENTS
+// =============================================================================
+// Parsed documents are write-once. An Editor copies one into a piece table -
+// an append-only text buffer plus a sequence of pieces, each a slice of the
+// buffer with one interned format - and edits that instead. Pieces sit in a
+// treap ordered by position and weighted by text length, so locating an
+// offset, inserting and deleting cost O(log n) in the number of pieces, and
+// formatting a range only touches the pieces inside it. toDocument() turns
+// the current state back into a Document, for generateRtf() or the C views.
+//
+// Positions are byte offsets into the editor text (see getText). Breaks are
+// one byte each, as in Word: '\n' ends a paragraph, 0x0B is a line break and
+// 0x0C a page break. Tables, images and hyperlinks are kept whole, each as a
+// single object_mark byte. Deleted text stays in the buffer until deinit.
+//
+// An editor made from a document with a source map remembers which source
+// map unit (top-level paragraph or table) each piece came from and which
+// units edits touch. writeRtfFrom() then copies untouched units straight
+// from the original input and only serializes the rest.
+
+pub const paragraph_mark = '\n';
+pub const line_mark = 0x0B;
+pub const page_mark = 0x0C;
+pub const object_mark = 0x01;
+
+const marks = [_]u8{ paragraph_mark, line_mark, page_mark };
+
+const nil = std.math.maxInt(u32);
+
+const Piece = struct {
+    start: usize, // Into Editor.buffer
+    len: usize,
+    format: u32, // Into Editor.formats
+    object: u32 = nil, // Into Editor.objects, for an object_mark
+    unit: u32 = nil, // Into Editor.units, for pieces of the original document
+};
+
+const Node = struct {
+    piece: Piece,
+    left: u32 = nil,
+    right: u32 = nil,
+    priority: u32,
+    size: usize, // Text length of the subtree
+};
+
+const Split = struct {
+    left: u32,
+    right: u32,
+};
+
+// Character formatting changes for Editor.applyFormat; null fields are kept
+pub const FormatPatch = struct {
+    bold: ?bool = null,
+    italic: ?bool = null,
+    underline: ?bool = null,
+    strikethrough: ?bool = null,
+    superscript: ?bool = null,
+    subscript: ?bool = null,
+    font_id: ?u16 = null,
+    font_size: ?u16 = null, // Half-points
+    color_id: ?u16 = null,
+
+    fn apply(self: FormatPatch, format: doc_model.FormatState) doc_model.FormatState {
+        var result = format;
+        inline for (std.meta.fields(FormatPatch)) |field| {
+            if (@field(self, field.name)) |value| @field(result.char_format, field.name) = value;
+        }
+        return result;
+    }
+};
+
+pub const Editor = struct {
+    allocator: std.mem.Allocator,
+    arena: std.heap.ArenaAllocator, // Object contents, font names, cell text
+
+    buffer: std.ArrayList(u8),
+    nodes: std.ArrayList(Node),
+    free_nodes: std.ArrayList(u32),
+    root: u32 = nil,
+    prng: std.Random.DefaultPrng,
+
+    // Interned formats - index 0 is the default format
+    formats: std.ArrayList(doc_model.FormatState),
+    format_ids: std.AutoHashMap(doc_model.FormatState, u32),
+
+    objects: std.ArrayList(doc_model.ContentElement),
+
+    font_table: std.ArrayList(doc_model.FontInfo),
+    color_table: std.ArrayList(doc_model.ColorInfo),
+    default_font: u16 = 0,
+    default_font_size: u16 = 24,
+    code_page: u16 = 1252,
+    rtf_version: u16 = 1,
+
+    // Source map units of the original document, and those edits touched
+    units: []const source_map.Unit = &.{},
+    content_end: ?usize = null, // Null without a source map
+    edited: std.DynamicBitSetUnmanaged = .{},
+
+    pub const Error = error{ OutOfBounds, InvalidText, NotATable, OutOfMemory };
+
+    // Width of cells added to a table with no row to copy widths from
+    pub const default_cell_width = 1440; // Twips
+
+    // Copy `document` for editing. The editor does not refer to it afterwards.
+    pub fn init(allocator: std.mem.Allocator, document: *const doc_model.Document) !Editor {
+        var editor = Editor{
+            .allocator = allocator,
+            .arena = std.heap.ArenaAllocator.init(allocator),
+            .buffer = std.ArrayList(u8).init(allocator),
+            .nodes = std.ArrayList(Node).init(allocator),
+            .free_nodes = std.ArrayList(u32).init(allocator),
+            .prng = std.Random.DefaultPrng.init(0x5eed),
+            .formats = std.ArrayList(doc_model.FormatState).init(allocator),
+            .format_ids = std.AutoHashMap(doc_model.FormatState, u32).init(allocator),
+            .objects = std.ArrayList(doc_model.ContentElement).init(allocator),
+            .font_table = std.ArrayList(doc_model.FontInfo).init(allocator),
+            .color_table = std.ArrayList(doc_model.ColorInfo).init(allocator),
+            .default_font = document.default_font,
+            .default_font_size = document.default_font_size,
+            .code_page = document.code_page,
+            .rtf_version = document.rtf_version,
+        };
+        errdefer editor.deinit();
+
+        const arena = editor.arena.allocator();
+        for (document.font_table.items) |font| {
+            var copy = font;
+            copy.name = try arena.dupeZ(u8, font.name);
+            try editor.font_table.append(copy);
+        }
+        try editor.color_table.appendSlice(document.color_table.items);
+
+        if (document.source_map) |map| {
+            editor.units = try arena.dupe(source_map.Unit, map.units);
+            editor.content_end = map.content_end;
+            editor.edited = try std.DynamicBitSetUnmanaged.initEmpty(allocator, map.units.len);
+        }
+
+        // Breaks and objects take the format of the text before them
+        var format = try editor.intern(.{});
+        var unit: u32 = nil;
+        var next_unit: u32 = 0;
+        for (document.content.items, 0..) |element, index| {
+            while (next_unit < editor.units.len and editor.units[next_unit].element <= index) : (next_unit += 1) {
+                unit = next_unit;
+            }
+            switch (element) {
+                .text_run => |run| {
+                    format = try editor.intern(.{ .char_format = run.char_format, .para_format = run.para_format });
+                    try editor.appendPiece(run.text, format, nil, unit);
+                },
+                .paragraph_break => try editor.appendPiece(&.{paragraph_mark}, format, nil, unit),
+                .line_break => try editor.appendPiece(&.{line_mark}, format, nil, unit),
+                .page_break => try editor.appendPiece(&.{page_mark}, format, nil, unit),
+                .table, .image, .hyperlink => {
+                    try editor.objects.ensureUnusedCapacity(1);
+                    const object: u32 = @intCast(editor.objects.items.len);
+                    editor.objects.appendAssumeCapacity(try copyElement(element, arena, allocator));
+                    try editor.appendPiece(&.{object_mark}, format, object, unit);
+                },
+            }
+        }
+
+        return editor;
+    }
+
+    pub fn deinit(self: *Editor) void {
+        for (self.objects.items) |*object| object.deinit();
+        self.objects.deinit();
+        self.buffer.deinit();
+        self.nodes.deinit();
+        self.free_nodes.deinit();
+        self.formats.deinit();
+        self.format_ids.deinit();
+        self.font_table.deinit();
+        self.color_table.deinit();
+        self.edited.deinit(self.allocator);
+        self.arena.deinit();
+    }
+
+    // Length of the editor text in bytes
+    pub fn len(self: *const Editor) usize {
+        return self.size(self.root);
+    }
+
+    // The editor text, with breaks and objects as single marks
+    pub fn getText(self: *const Editor, allocator: std.mem.Allocator) ![]u8 {
+        var collector = TextCollector{ .editor = self, .text = std.ArrayList(u8).init(allocator) };
+        errdefer collector.text.deinit();
+        try collector.text.ensureTotalCapacity(self.len());
+        try self.walk(self.root, &collector);
+        return collector.text.toOwnedSlice();
+    }
+
+    // Insert `text` at `offset` with the formatting of the text before it.
+    // '\n', 0x0B and 0x0C in `text` become paragraph, line and page breaks.
+    pub fn insertText(self: *Editor, offset: usize, text: []const u8) Error!void {
+        if (offset > self.len()) return error.OutOfBounds;
+        if (std.mem.indexOfScalar(u8, text, object_mark) != null) return error.InvalidText;
+        if (text.len == 0) return;
+
+        const format = self.insertionFormat(offset);
+        try self.nodes.ensureUnusedCapacity(2);
+        self.touchInsertion(offset);
+        const start = self.buffer.items.len;
+        try self.buffer.appendSlice(text);
+
+        const parts = self.split(self.root, offset);
+        // Typing at the end of a piece just grows it
+        if (self.extendLast(parts.left, start, text.len, format)) {
+            self.root = self.merge(parts.left, parts.right);
+            return;
+        }
+        const inserted = self.newNode(.{ .start = start, .len = text.len, .format = format });
+        self.root = self.merge(self.merge(parts.left, inserted), parts.right);
+    }
+
+    pub fn insertParagraph(self: *Editor, offset: usize) Error!void {
+        return self.insertText(offset, &.{paragraph_mark});
+    }
+
+    // Remove [start, end)
+    pub fn delete(self: *Editor, start: usize, end: usize) Error!void {
+        if (start > end or end > self.len()) return error.OutOfBounds;
+        if (start == end) return;
+
+        try self.nodes.ensureUnusedCapacity(2);
+        try self.free_nodes.ensureTotalCapacity(self.nodes.items.len + 2);
+
+        const before = self.split(self.root, start);
+        const removed = self.split(before.right, end - start);
+        self.touchTree(removed.left);
+        self.freeTree(removed.left);
+        self.root = self.merge(before.left, removed.right);
+    }
+
+    // Change character formatting of [start, end)
+    pub fn applyFormat(self: *Editor, start: usize, end: usize, patch: FormatPatch) Error!void {
+        return self.reformat(start, end, patch);
+    }
+
+    // Reset character formatting of [start, end) to the defaults
+    pub fn clearFormat(self: *Editor, start: usize, end: usize) Error!void {
+        return self.reformat(start, end, null);
+    }
+
+    // Insert a row before `row_index` (or append it, at rowCount) into the
+    // table whose object mark is at `offset`. Cell widths come from the row
+    // above, or below for a new first row.
+    pub fn insertTableRow(self: *Editor, offset: usize, row_index: usize, cells: []const []const u8) Error!void {
+        const piece = self.pieceAt(offset) orelse return error.OutOfBounds;
+        if (piece.object == nil or self.objects.items[piece.object] != .table) return error.NotATable;
+
+        const table = &self.objects.items[piece.object].table;
+        if (row_index > table.rowCount()) return error.OutOfBounds;
+
+        var rebuilt = doc_model.Table.init(self.allocator);
+        errdefer rebuilt.deinit();
+        try rebuilt.rows.ensureTotalCapacity(table.rows.items.len + 1);
+        try rebuilt.cells.ensureTotalCapacity(table.cells.items.len + cells.len);
+        try rebuilt.runs.ensureTotalCapacity(table.runs.items.len + cells.len);
+
+        const template: []const doc_model.TableCell = if (table.rowCount() == 0)
+            &.{}
+        else
+            table.rowCells(if (row_index > 0) row_index - 1 else 0);
+
+        for (0..table.rowCount() + 1) |index| {
+            if (index == row_index) {
+                try rebuilt.addRow(0);
+                for (cells, 0..) |text, cell_index| {
+                    const width = if (cell_index < template.len) template[cell_index].width else default_cell_width;
+                    const run = doc_model.TextRun.init(try self.arena.allocator().dupeZ(u8, text), .{}, .{});
+                    try rebuilt.addCell(.{ .width = width }, if (text.len > 0) &.{run} else &.{});
+                }
+            }
+            if (index == table.rowCount()) break;
+
+            try rebuilt.addRow(table.rows.items[index].height);
+            for (table.rowCells(index)) |cell| try rebuilt.addCell(cell, table.cellRuns(cell));
+        }
+
+        table.deinit();
+        table.* = rebuilt;
+        self.touch(piece);
+    }
+
+    // Offset of the object mark of the table_index'th table, or null
+    pub fn tableOffset(self: *const Editor, table_index: usize) ?usize {
+        var finder = TableFinder{ .editor = self, .wanted = table_index };
+        self.walk(self.root, &finder) catch unreachable;
+        return finder.found;
+    }
+
+    // The current state as a parsed document would hold it
+    pub fn toDocument(self: *const Editor, allocator: std.mem.Allocator) !doc_model.Document {
+        var document = try doc_model.Document.init(allocator);
+        errdefer document.deinit();
+
+        const arena = document.arena.allocator();
+        for (self.font_table.items) |font| {
+            var copy = font;
+            copy.name = try arena.dupeZ(u8, font.name);
+            try document.addFont(copy);
+        }
+        for (self.color_table.items) |color| try document.addColor(color);
+        document.default_font = self.default_font;
+        document.default_font_size = self.default_font_size;
+        document.code_page = self.code_page;
+        document.rtf_version = self.rtf_version;
+
+        var builder = DocumentBuilder{ .editor = self, .document = &document, .text = std.ArrayList(u8).init(allocator) };
+        defer builder.text.deinit();
+        try self.walk(self.root, &builder);
+        try builder.flush();
+
+        return document;
+    }
+
+    pub fn generateRtf(self: *const Editor, allocator: std.mem.Allocator) ![]u8 {
+        var document = try self.toDocument(allocator);
+        defer document.deinit();
+        return document.generateRtf(allocator);
+    }
+
+    // Write RTF for the current state, reusing `original` - the input the
+    // editor's document was parsed from - wherever edits left it alone. The
+    // header, the end of the input and every unit whose pieces were not
+    // touched are copied byte for byte, with whatever control words and
+    // destinations the parser skipped; only touched units and inserted text
+    // are serialized again. Most of the output is then a few large slices of
+    // `original`, passed to `writer` as they are. Without a source map this
+    // writes generateRtf().
+    pub fn writeRtfFrom(self: *const Editor, original: []const u8, writer: anytype) !void {
+        const content_end = self.content_end orelse {
+            const rtf = try self.generateRtf(self.allocator);
+            defer self.allocator.free(rtf);
+            return writer.writeAll(rtf);
+        };
+        if (original.len < content_end) return error.SourceMismatch;
+
+        const header_end = if (self.units.len > 0) self.units[0].offset else content_end;
+        try writer.writeAll(original[0..header_end]);
+
+        var scratch = try doc_model.Document.init(self.allocator);
+        defer scratch.deinit();
+        var copier = CopyThrough(@TypeOf(writer)){
+            .editor = self,
+            .original = original,
+            .writer = writer,
+            .builder = .{ .editor = self, .document = &scratch, .text = std.ArrayList(u8).init(self.allocator) },
+            .rtf = std.ArrayList(u8).init(self.allocator),
+            .position = header_end,
+        };
+        defer copier.builder.text.deinit();
+        defer copier.rtf.deinit();
+
+        try self.walk(self.root, &copier);
+        try copier.flush();
+        try writer.writeAll(original[content_end..]);
+    }
+
+    pub fn generateRtfFrom(self: *const Editor, original: []const u8, allocator: std.mem.Allocator) ![]u8 {
+        var rtf = std.ArrayList(u8).init(allocator);
+        errdefer rtf.deinit();
+        try self.writeRtfFrom(original, rtf.writer());
+        return rtf.toOwnedSlice();
+    }
+
+    // =========================================================================
+    // Pieces
+    // =========================================================================
+
+    fn intern(self: *Editor, format: doc_model.FormatState) !u32 {
+        try self.formats.ensureUnusedCapacity(1);
+        try self.format_ids.ensureUnusedCapacity(1);
+        return self.internAssumeCapacity(format);
+    }
+
+    fn internAssumeCapacity(self: *Editor, format: doc_model.FormatState) u32 {
+        const entry = self.format_ids.getOrPutAssumeCapacity(format);
+        if (!entry.found_existing) {
+            entry.value_ptr.* = @intCast(self.formats.items.len);
+            self.formats.appendAssumeCapacity(format);
+        }
+        return entry.value_ptr.*;
+    }
+
+    fn appendPiece(self: *Editor, text: []const u8, format: u32, object: u32, unit: u32) !void {
+        if (text.len == 0) return;
+        try self.nodes.ensureUnusedCapacity(1);
+        const start = self.buffer.items.len;
+        try self.buffer.appendSlice(text);
+        const node = self.newNode(.{ .start = start, .len = text.len, .format = format, .object = object, .unit = unit });
+        self.root = self.merge(self.root, node);
+    }
+
+    // Format for text inserted at `offset`
+    fn insertionFormat(self: *const Editor, offset: usize) u32 {
+        const before = if (offset > 0) self.pieceAt(offset - 1) else null;
+        const piece = before orelse self.pieceAt(offset) orelse return 0;
+        return piece.format;
+    }
+
+    fn pieceAt(self: *const Editor, offset: usize) ?Piece {
+        var index = self.root;
+        var rest = offset;
+        while (index != nil) {
+            const node = self.nodes.items[index];
+            const left = self.size(node.left);
+            if (rest < left) {
+                index = node.left;
+            } else if (rest < left + node.piece.len) {
+                return node.piece;
+            } else {
+                rest -= left + node.piece.len;
+                index = node.right;
+            }
+        }
+        return null;
+    }
+
+    fn reformat(self: *Editor, start: usize, end: usize, patch: ?FormatPatch) Error!void {
+        if (start > end or end > self.len()) return error.OutOfBounds;
+        if (start == end) return;
+
+        try self.nodes.ensureUnusedCapacity(2);
+        const before = self.split(self.root, start);
+        const range = self.split(before.right, end - start);
+        defer self.root = self.merge(self.merge(before.left, range.left), range.right);
+
+        // At most one new format per piece - reserve so restyling cannot fail
+        const pieces: u32 = @intCast(self.countNodes(range.left));
+        try self.formats.ensureUnusedCapacity(pieces);
+        try self.format_ids.ensureUnusedCapacity(pieces);
+        self.restyle(range.left, patch);
+    }
+
+    fn restyle(self: *Editor, index: u32, patch: ?FormatPatch) void {
+        if (index == nil) return;
+        const piece = &self.nodes.items[index].piece;
+        var format = self.formats.items[piece.format];
+        if (patch) |changes| format = changes.apply(format) else format.resetCharFormat();
+        const id = self.internAssumeCapacity(format);
+        if (id != piece.format) self.touch(piece.*);
+        piece.format = id;
+
+        self.restyle(self.nodes.items[index].left, patch);
+        self.restyle(self.nodes.items[index].right, patch);
+    }
+
+    // =========================================================================
+    // Edited units
+    // =========================================================================
+
+    fn touch(self: *Editor, piece: Piece) void {
+        if (piece.unit != nil) self.edited.set(piece.unit);
+    }
+
+    // Text inserted inside a unit changes it; text between two units or
+    // next to inserted text does not
+    fn touchInsertion(self: *Editor, offset: usize) void {
+        const before = if (offset > 0) self.pieceAt(offset - 1) else null;
+        const after = self.pieceAt(offset);
+        if (before != null and after != null and before.?.unit == after.?.unit) self.touch(before.?);
+    }
+
+    fn touchTree(self: *Editor, index: u32) void {
+        if (index == nil) return;
+        self.touch(self.nodes.items[index].piece);
+        self.touchTree(self.nodes.items[index].left);
+        self.touchTree(self.nodes.items[index].right);
+    }
+
+    // End of a unit's input, taking in any units after it without content
+    fn unitEnd(self: *const Editor, index: u32) usize {
+        const element = self.units[index].element;
+        for (self.units[index + 1 ..]) |next| {
+            if (next.element > element) return next.offset;
+        }
+        return self.content_end.?;
+    }
+
+    // =========================================================================
+    // Treap
+    // =========================================================================
+    // Nodes are indices into `nodes`, with `nil` for none. Callers reserve
+    // node capacity first: split() needs one node per cut piece.
+
+    fn size(self: *const Editor, index: u32) usize {
+        return if (index == nil) 0 else self.nodes.items[index].size;
+    }
+
+    fn update(self: *Editor, index: u32) void {
+        const node = &self.nodes.items[index];
+        node.size = node.piece.len + self.size(node.left) + self.size(node.right);
+    }
+
+    fn newNode(self: *Editor, piece: Piece) u32 {
+        const node = Node{ .piece = piece, .priority = self.prng.random().int(u32), .size = piece.len };
+        if (self.free_nodes.pop()) |index| {
+            self.nodes.items[index] = node;
+            return index;
+        }
+        self.nodes.appendAssumeCapacity(node);
+        return @intCast(self.nodes.items.len - 1);
+    }
+
+    fn merge(self: *Editor, left: u32, right: u32) u32 {
+        if (left == nil) return right;
+        if (right == nil) return left;
+
+        if (self.nodes.items[left].priority > self.nodes.items[right].priority) {
+            const merged = self.merge(self.nodes.items[left].right, right);
+            self.nodes.items[left].right = merged;
+            self.update(left);
+            return left;
+        }
+        const merged = self.merge(left, self.nodes.items[right].left);
+        self.nodes.items[right].left = merged;
+        self.update(right);
+        return right;
+    }
+
+    // Split into the first `offset` bytes and the rest, cutting a piece if needed
+    fn split(self: *Editor, index: u32, offset: usize) Split {
+        if (index == nil) return .{ .left = nil, .right = nil };
+
+        const left_size = self.size(self.nodes.items[index].left);
+        const piece = self.nodes.items[index].piece;
+
+        if (offset <= left_size) {
+            const parts = self.split(self.nodes.items[index].left, offset);
+            self.nodes.items[index].left = parts.right;
+            self.update(index);
+            return .{ .left = parts.left, .right = index };
+        }
+        if (offset >= left_size + piece.len) {
+            const parts = self.split(self.nodes.items[index].right, offset - left_size - piece.len);
+            self.nodes.items[index].right = parts.left;
+            self.update(index);
+            return .{ .left = index, .right = parts.right };
+        }
+
+        // Inside this piece (never an object - those are one byte)
+        const cut = offset - left_size;
+        const tail = self.newNode(.{ .start = piece.start + cut, .len = piece.len - cut, .format = piece.format, .unit = piece.unit });
+        const right = self.nodes.items[index].right;
+        self.nodes.items[index].piece.len = cut;
+        self.nodes.items[index].right = nil;
+        self.update(index);
+        return .{ .left = index, .right = self.merge(tail, right) };
+    }
+
+    // Grow the last piece of the tree by `extra` bytes if the buffer bytes at
+    // `start` directly follow it
+    fn extendLast(self: *Editor, index: u32, start: usize, extra: usize, format: u32) bool {
+        if (index == nil) return false;
+
+        const node = &self.nodes.items[index];
+        const extended = if (node.right != nil)
+            self.extendLast(node.right, start, extra, format)
+        else if (node.piece.object == nil and node.piece.unit == nil and node.piece.format == format and node.piece.start + node.piece.len == start) blk: {
+            node.piece.len += extra;
+            break :blk true;
+        } else false;
+
+        if (extended) node.size += extra;
+        return extended;
+    }
+
+    fn freeTree(self: *Editor, index: u32) void {
+        if (index == nil) return;
+        self.freeTree(self.nodes.items[index].left);
+        self.freeTree(self.nodes.items[index].right);
+        self.free_nodes.appendAssumeCapacity(index);
+    }
+
+    fn countNodes(self: *const Editor, index: u32) usize {
+        if (index == nil) return 0;
+        return 1 + self.countNodes(self.nodes.items[index].left) + self.countNodes(self.nodes.items[index].right);
+    }
+
+    // Visit pieces in text order. The error set is spelled out because
+    // inferred error sets cannot be recursive.
+    fn walk(self: *const Editor, index: u32, visitor: anytype) @TypeOf(visitor.*).Error!void {
+        if (index == nil) return;
+        const node = self.nodes.items[index];
+        try self.walk(node.left, visitor);
+        try visitor.visit(node.piece);
+        try self.walk(node.right, visitor);
+    }
+};
+
+const TextCollector = struct {
+    editor: *const Editor,
+    text: std.ArrayList(u8),
+
+    const Error = error{OutOfMemory};
+
+    fn visit(self: *TextCollector, piece: Piece) Error!void {
+        try self.text.appendSlice(self.editor.buffer.items[piece.start..][0..piece.len]);
+    }
+};
+
+const TableFinder = struct {
+    editor: *const Editor,
+    wanted: usize,
+    offset: usize = 0,
+    seen: usize = 0,
+    found: ?usize = null,
+
+    const Error = error{};
+
+    fn visit(self: *TableFinder, piece: Piece) Error!void {
+        if (self.found == null and piece.object != nil and self.editor.objects.items[piece.object] == .table) {
+            if (self.seen == self.wanted) self.found = self.offset;
+            self.seen += 1;
+        }
+        self.offset += piece.len;
+    }
+};
+
+// Collects consecutive pieces of one format into text runs
+const DocumentBuilder = struct {
+    editor: *const Editor,
+    document: *doc_model.Document,
+    text: std.ArrayList(u8),
+    format: u32 = 0,
+
+    const Error = error{OutOfMemory};
+
+    fn visit(self: *DocumentBuilder, piece: Piece) Error!void {
+        if (piece.object != nil) {
+            try self.flush();
+            const object = self.editor.objects.items[piece.object];
+            var copy = try copyElement(object, self.document.arena.allocator(), self.document.allocator);
+            errdefer copy.deinit();
+            try self.document.addElement(copy);
+            return;
+        }
+        if (piece.format != self.format) {
+            try self.flush();
+            self.format = piece.format;
+        }
+
+        const bytes = self.editor.buffer.items[piece.start..][0..piece.len];
+        var pos: usize = 0;
+        while (std.mem.indexOfAnyPos(u8, bytes, pos, &marks)) |mark| {
+            try self.text.appendSlice(bytes[pos..mark]);
+            try self.flush();
+            try self.document.addElement(switch (bytes[mark]) {
+                paragraph_mark => .paragraph_break,
+                line_mark => .line_break,
+                else => .page_break,
+            });
+            pos = mark + 1;
+        }
+        try self.text.appendSlice(bytes[pos..]);
+    }
+
+    fn flush(self: *DocumentBuilder) Error!void {
+        if (self.text.items.len == 0) return;
+        const format = self.editor.formats.items[self.format];
+        try self.document.addTextRun(self.text.items, format.char_format, format.para_format);
+        self.text.clearRetainingCapacity();
+    }
+};
+
+// Copies untouched units from the original input and serializes everything
+// else (see Editor.writeRtfFrom)
+fn CopyThrough(comptime Writer: type) type {
+    return struct {
+        editor: *const Editor,
+        original: []const u8,
+        writer: Writer,
+        builder: DocumentBuilder, // Pieces to serialize, since the last copy
+        rtf: std.ArrayList(u8),
+        position: ?usize, // End of the input copied last, null after serialized content
+        copied: u32 = nil, // Unit copied last
+
+        const Self = @This();
+        const Error = Writer.Error || error{OutOfMemory};
+
+        fn visit(self: *Self, piece: Piece) Error!void {
+            const unit = piece.unit;
+            if (unit == nil or self.editor.edited.isSet(unit)) return self.builder.visit(piece);
+            if (unit == self.copied) return; // Went out whole with its first piece
+
+            try self.flush();
+            const start = self.editor.units[unit].offset;
+            const end = self.editor.unitEnd(unit);
+            // Anywhere but after its predecessor, the unit needs its format set up
+            if (self.position == null or self.position.? != start) {
+                const format = self.editor.units[unit].format;
+                self.rtf.clearRetainingCapacity();
+                try self.rtf.appendSlice("\\plain\\pard ");
+                try doc_model.generateFormat(&self.rtf, format.char_format, format.para_format);
+                try self.writer.writeAll(self.rtf.items);
+            }
+            try self.writer.writeAll(self.original[start..end]);
+            self.position = end;
+            self.copied = unit;
+        }
+
+        fn flush(self: *Self) Error!void {
+            try self.builder.flush();
+            const document = self.builder.document;
+            if (document.content.items.len == 0) return;
+
+            self.rtf.clearRetainingCapacity();
+            // Copied input may leave formatting switched on
+            if (self.position != null) try self.rtf.appendSlice("\\plain\\pard ");
+            try document.generateContent(&self.rtf);
+            try self.writer.writeAll(self.rtf.items);
+
+            for (document.content.items) |*element| element.deinit();
+            document.content.clearRetainingCapacity();
+            self.position = null;
+        }
+    };
+}
+
+// Deep copy of a table, image or hyperlink. Strings go to `arena`, table
+// lists to `allocator`.
+fn copyElement(element: doc_model.ContentElement, arena: std.mem.Allocator, allocator: std.mem.Allocator) !doc_model.ContentElement {
+    switch (element) {
+        .hyperlink => |link| return .{ .hyperlink = .{
+            .url = try arena.dupe(u8, link.url),
+            .display_text = try arena.dupeZ(u8, link.display_text),
+        } },
+        .image => |image| {
+            var copy = image;
+            copy.data = try arena.dupe(u8, image.data);
+            return .{ .image = copy };
+        },
+        .table => |table| {
+            var copy = doc_model.Table.init(allocator);
+            errdefer copy.deinit();
+            try copy.rows.appendSlice(table.rows.items);
+            try copy.cells.appendSlice(table.cells.items);
+            try copy.runs.ensureTotalCapacity(table.runs.items.len);
+            for (table.runs.items) |run| {
+                copy.runs.appendAssumeCapacity(doc_model.TextRun.init(try arena.dupeZ(u8, run.text), run.char_format, run.para_format));
+            }
+            return .{ .table = copy };
+        },
+        else => return element,
+    }
+}
+
+// =============================================================================
+// TESTS
+// =============================================================================
+
+const formatted_parser = @import("formatted_parser.zig");
+
+test "editor edits survive generateRtf" {
+    const testing = std.testing;
+
+    var stream = std.io.fixedBufferStream("{\\rtf1{\\fonttbl{\\f0 Arial;}}Hello \\b world\\b0 \\par Second line}");
+    var parser = try formatted_parser.FormattedParser.init(stream.reader().any(), testing.allocator);
+    defer parser.deinit();
+    var document = try parser.parse();
+    defer document.deinit();
+
+    var editor = try Editor.init(testing.allocator, &document);
+    defer editor.deinit();
+
+    const text = try editor.getText(testing.allocator);
+    defer testing.allocator.free(text);
+    try testing.expectEqualStrings("Hello world\nSecond line", text);
+
+    try editor.insertText(5, ",");
+    try editor.delete(13, 20); // "Second "
+    try editor.applyFormat(0, 6, .{ .italic = true });
+    try editor.clearFormat(7, 12); // "world" loses its bold
+    try editor.insertParagraph(editor.len());
+    try editor.insertText(editor.len(), "Third");
+    try testing.expectError(error.OutOfBounds, editor.delete(3, editor.len() + 1));
+    try testing.expectError(error.InvalidText, editor.insertText(0, &.{object_mark}));
+
+    const rtf = try editor.generateRtf(testing.allocator);
+    defer testing.allocator.free(rtf);
+
+    var reparsed_stream = std.io.fixedBufferStream(rtf);
+    var reparsed_parser = try formatted_parser.FormattedParser.init(reparsed_stream.reader().any(), testing.allocator);
+    defer reparsed_parser.deinit();
+    var reparsed = try reparsed_parser.parse();
+    defer reparsed.deinit();
+    try testing.expectEqualStrings("Hello, world\n\nline\n\nThird", try reparsed.getPlainText());
+
+    const runs = try reparsed.getTextRuns(testing.allocator);
+    defer testing.allocator.free(runs);
+    try testing.expectEqualStrings("Hello,", runs[0].text);
+    try testing.expect(runs[0].char_format.italic);
+    for (runs[1..]) |run| try testing.expect(!run.char_format.bold);
+    try testing.expectEqualStrings("Arial", reparsed.getFont(0).?.name);
+}
+
+test "editor table rows and many edits" {
+    const testing = std.testing;
+
+    var stream = std.io.fixedBufferStream("{\\rtf1 Before\\par \\trowd\\cellx1000\\cellx3000 A\\cell B\\cell\\row\\par After}");
+    var parser = try formatted_parser.FormattedParser.init(stream.reader().any(), testing.allocator);
+    defer parser.deinit();
+    var document = try parser.parse();
+    defer document.deinit();
+
+    var editor = try Editor.init(testing.allocator, &document);
+    defer editor.deinit();
+
+    const offset = editor.tableOffset(0).?;
+    try testing.expectEqual(@as(?usize, null), editor.tableOffset(1));
+    try editor.insertTableRow(offset, 1, &.{ "C", "D" });
+    try editor.insertTableRow(offset, 0, &.{"Head"});
+    try testing.expectError(error.NotATable, editor.insertTableRow(0, 0, &.{}));
+
+    var edited = try editor.toDocument(testing.allocator);
+    defer edited.deinit();
+    const table = edited.content.items[2].table;
+    try testing.expectEqual(@as(usize, 3), table.rowCount());
+    try testing.expectEqualStrings("C", table.cellRuns(table.rowCells(2)[0])[0].text);
+    try testing.expectEqual(@as(u32, 2000), table.rowCells(2)[1].width);
+    try testing.expectEqual(@as(u32, 1000), table.rowCells(0)[0].width);
+
+    // Random edits against a plain byte array
+    var expected = std.ArrayList(u8).init(testing.allocator);
+    defer expected.deinit();
+    const initial = try editor.getText(testing.allocator);
+    defer testing.allocator.free(initial);
+    try expected.appendSlice(initial);
+
+    var prng = std.Random.DefaultPrng.init(42);
+    const random = prng.random();
+    for (0..500) |_| {
+        const at = random.uintAtMost(usize, expected.items.len);
+        if (random.boolean() or expected.items.len < 10) {
+            const insert = "xyz"[0 .. random.uintAtMost(usize, 2) + 1];
+            try editor.insertText(at, insert);
+            try expected.insertSlice(at, insert);
+        } else {
+            const end = @min(expected.items.len, at + random.uintAtMost(usize, 4));
+            try editor.delete(at, end);
+            try expected.replaceRange(at, end - at, "");
+        }
+        if (random.uintLessThan(u8, 8) == 0) {
+            try editor.applyFormat(at / 2, at, .{ .bold = random.boolean() });
+        }
+    }
+
+    const text = try editor.getText(testing.allocator);
+    defer testing.allocator.free(text);
+    try testing.expectEqualStrings(expected.items, text);
+    try testing.expectEqual(expected.items.len, editor.len());
+}
+
+test "editor copies untouched units from the original input" {
+    const testing = std.testing;
+
+    const rtf_data = "{\\rtf1\\ansi{\\fonttbl{\\f0 Arial;}}{\\*\\generator Test;}\\pard\\plain\\f0 " ++
+        "First \\b bold\\b0 \\par {\\*\\unknown keep}Second\\par \\qc Third\\par Last}";
+
+    var stream = std.io.fixedBufferStream(rtf_data);
+    var parser = try formatted_parser.FormattedParser.init(stream.reader().any(), testing.allocator);
+    defer parser.deinit();
+    parser.recordSourceMap();
+    var document = try parser.parse();
+    defer document.deinit();
+
+    var editor = try Editor.init(testing.allocator, &document);
+    defer editor.deinit();
+
+    // Nothing edited - the input comes back as it was
+    const unchanged = try editor.generateRtfFrom(rtf_data, testing.allocator);
+    defer testing.allocator.free(unchanged);
+    try testing.expectEqualStrings(rtf_data, unchanged);
+
+    // Edit inside the second paragraph, add one between the last two
+    const text = try editor.getText(testing.allocator);
+    defer testing.allocator.free(text);
+    try editor.insertText(std.mem.indexOf(u8, text, "Second").? + 6, "!");
+    try editor.insertText(std.mem.indexOf(u8, text, "Last").? + 1, "New\n");
+    try testing.expectError(error.SourceMismatch, editor.generateRtfFrom(rtf_data[0..20], testing.allocator));
+
+    const rtf = try editor.generateRtfFrom(rtf_data, testing.allocator);
+    defer testing.allocator.free(rtf);
+
+    // Header and first paragraph as they were, the second serialized again
+    // (dropping what the parser skipped), the others copied
+    const second = std.mem.indexOf(u8, rtf_data, "{\\*\\unknown").?;
+    try testing.expect(std.mem.startsWith(u8, rtf, rtf_data[0..second]));
+    try testing.expect(std.mem.indexOf(u8, rtf, "\\unknown") == null);
+    try testing.expect(std.mem.indexOf(u8, rtf, "\\qc Third\\par ") != null);
+    try testing.expect(std.mem.endsWith(u8, rtf, "Last}"));
+
+    var reparsed_stream = std.io.fixedBufferStream(rtf);
+    var reparsed_parser = try formatted_parser.FormattedParser.init(reparsed_stream.reader().any(), testing.allocator);
+    defer reparsed_parser.deinit();
+    var reparsed = try reparsed_parser.parse();
+    defer reparsed.deinit();
+    var expected = try editor.toDocument(testing.allocator);
+    defer expected.deinit();
+    try testing.expectEqualStrings(try expected.getPlainText(), try reparsed.getPlainText());
+
+    const runs = try reparsed.getTextRuns(testing.allocator);
+    defer testing.allocator.free(runs);
+    const expected_runs = try expected.getTextRuns(testing.allocator);
+    defer testing.allocator.free(expected_runs);
+    try testing.expectEqual(expected_runs.len, runs.len);
+    for (expected_runs, runs) |want, got| {
+        try testing.expectEqualStrings(want.text, got.text);
+        try testing.expect(want.char_format.bold == got.char_format.bold);
+        try testing.expectEqual(want.para_format.alignment, got.para_format.alignment);
+    }
+}
@@ -1,6 +1,7 @@
 const std = @import("std");
 const doc_model = @import("document_model.zig");
 const table_parsers = @import("table_parser.zig");
+const source_map = @import("source_map.zig");
 
 // =============================================================================
 // FORMATTED RTF PARSER 
@@ -15,6 +16,7 @@ const ByteReader = struct {
     pos: usize = 0,
     len: usize = 0,
     eof: bool = false,
+    consumed: usize = 0, // Input bytes dropped from the buffer before `pos`
     
     fn init(source: std.io.AnyReader) ByteReader {
         return .{ .source = source };
@@ -25,9 +27,11 @@ const ByteReader = struct {
         
         if (self.pos > 0 and self.pos < self.len) {
             std.mem.copyForwards(u8, self.buffer[0..], self.buffer[self.pos..self.len]);
+            self.consumed += self.pos;
             self.len -= self.pos;
             self.pos = 0;
         } else if (self.pos >= self.len) {
+            self.consumed += self.pos;
             self.pos = 0;
             self.len = 0;
         }
@@ -61,6 +65,11 @@ const ByteReader = struct {
         return byte;
     }
     
+    // Offset of the next byte in the input
+    fn offset(self: *const ByteReader) usize {
+        return self.consumed + self.pos;
+    }
+    
     fn skipWhitespace(self: *ByteReader) !void {
         while (try self.peek()) |byte| {
             if (!std.ascii.isWhitespace(byte)) break;
@@ -76,7 +85,7 @@ const ControlWord = enum {
     super, super0, sub, sub0, plain, fs, f, cf,
     
     // Paragraph formatting  
-    par, line, tab, ql, qc, qr, qj, li, ri, fi, sb, sa,
+    par, pard, line, tab, ql, qc, qr, qj, li, ri, fi, sb, sa,
     
     // Special characters
     u, bin, lquote, rquote, ldblquote, rdblquote, bullet, emdash, endash,
@@ -164,6 +173,7 @@ const ControlWord = enum {
             },
             'p' => {
                 if (std.mem.eql(u8, word, "par")) return .par;
+                if (std.mem.eql(u8, word, "pard")) return .pard;
                 if (std.mem.eql(u8, word, "plain")) return .plain;
                 if (std.mem.eql(u8, word, "pict")) return .pict;
                 if (std.mem.eql(u8, word, "picw")) return .picw;
@@ -286,6 +296,28 @@ const DestinationType = enum {
 
 // Complete formatting-aware parser
 pub const FormattedParser = struct {
+    // Receives body and table cell text in reading order (see streamText)
+    pub const TextSink = struct {
+        context: *anyopaque,
+        text: *const fn (context: *anyopaque, text: []const u8, format: doc_model.CharFormat) anyerror!void,
+        // A paragraph, line, cell or row ended, so text either side is not contiguous
+        boundary: *const fn (context: *anyopaque) anyerror!void,
+    };
+    
+    // Limits of a preview parse (see limitPreview)
+    pub const Preview = struct {
+        max_characters: usize = std.math.maxInt(usize),
+        max_paragraphs: usize = std.math.maxInt(usize), // Table rows count as paragraphs
+        characters: usize = 0,
+        paragraphs: usize = 0,
+        truncated: bool = false, // Parsing stopped before the input ended
+        continuation_bytes: u8 = 0, // Still to come after a UTF-8 lead byte
+        
+        fn full(self: Preview) bool {
+            return self.characters >= self.max_characters or self.paragraphs >= self.max_paragraphs;
+        }
+    };
+    
     reader: ByteReader,
     document: doc_model.Document,
     
@@ -304,6 +336,24 @@ pub const FormattedParser = struct {
     // Current text buffer (accumulated until format change)
     text_buffer: std.ArrayList(u8),
     
+    // Input offsets: start of the token being handled, and the input range
+    // the buffered text came from
+    token_start: usize = 0,
+    text_start: usize = 0,
+    text_end: usize = 0,
+    
+    // Source map recording, off unless recordSourceMap() is called
+    source: ?source_map.Recorder = null,
+    
+    // Checkpoint recording for the next parse (see recordCheckpoints)
+    checkpoints: ?*Checkpoints = null,
+    
+    // Receiver of body text instead of the document (see streamText)
+    text_sink: ?TextSink = null,
+    
+    // Where parsing stops early (see limitPreview)
+    preview: ?Preview = null,
+    
     // Specialized table parsers
     font_table_parser: table_parsers.FontTableParser,
     color_table_parser: table_parsers.ColorTableParser,
@@ -357,6 +407,94 @@ pub const FormattedParser = struct {
         self.picture_data.deinit();
         self.object_class.deinit();
         self.object_data.deinit();
+        if (self.source) |*recorder| recorder.deinit();
+    }
+    
+    // Record checkpoints into `checkpoints` during the next parse(), for
+    // parseRange(). The parser does not take ownership.
+    pub fn recordCheckpoints(self: *FormattedParser, checkpoints: *Checkpoints) void {
+        checkpoints.clear();
+        self.checkpoints = checkpoints;
+    }
+    
+    // Record the input byte range of every run, table, cell and image in
+    // the documents this parser returns (Document.source_map)
+    pub fn recordSourceMap(self: *FormattedParser) void {
+        if (self.source == null) {
+            self.source = source_map.Recorder.init(self.text_buffer.allocator);
+        }
+    }
+    
+    // Hand each table row to `sink` as soon as it is finished, instead of
+    // adding tables to the documents this parser returns. Not combined with
+    // source maps or checkpoints.
+    pub fn streamTableRows(self: *FormattedParser, sink: table_parsers.TableParser.RowSink) void {
+        self.table_parser.row_sink = sink;
+    }
+    
+    // Hand body and table cell text to `sink` as it is read, instead of
+    // adding runs and tables to the documents this parser returns, for
+    // consumers that never look at the document (indexers). Not combined
+    // with source maps, checkpoints or streamTableRows().
+    pub fn streamText(self: *FormattedParser, sink: TextSink) void {
+        self.text_sink = sink;
+    }
+    
+    // Stop parsing once `max_characters` characters of visible text or
+    // `max_paragraphs` paragraphs have been read, and finish the document
+    // there as if the input ended, so the rest of the input - trailing
+    // tables and images included - is never read. Afterwards
+    // `preview.?.truncated` tells whether anything was left unread.
+    pub fn limitPreview(self: *FormattedParser, max_characters: usize, max_paragraphs: usize) void {
+        self.preview = .{ .max_characters = max_characters, .max_paragraphs = max_paragraphs };
+    }
+    
+    // Prepare for another document from `source`. Stacks and scratch buffers
+    // keep their capacity, so a long-lived parser stops allocating once warm.
+    pub fn reset(self: *FormattedParser, source: std.io.AnyReader) void {
+        self.reader = ByteReader.init(source);
+        
+        self.format_stack.clearRetainingCapacity();
+        self.current_format = .{};
+        self.destination_stack.clearRetainingCapacity();
+        self.current_destination = .normal;
+        self.group_depth = 0;
+        self.text_buffer.clearRetainingCapacity();
+        self.token_start = 0;
+        self.text_start = 0;
+        self.text_end = 0;
+        if (self.source) |*recorder| recorder.reset();
+        if (self.preview) |*preview| self.limitPreview(preview.max_characters, preview.max_paragraphs);
+        
+        self.font_table_parser.reset();
+        self.color_table_parser = table_parsers.ColorTableParser.init();
+        self.table_parser.reset();
+        
+        self.in_field = false;
+        self.field_instruction.clearRetainingCapacity();
+        self.field_result.clearRetainingCapacity();
+        
+        self.picture_format = .unknown;
+        self.picture_width = 0;
+        self.picture_height = 0;
+        self.picture_data.clearRetainingCapacity();
+        
+        self.object_type = .embedded;
+        self.object_class.clearRetainingCapacity();
+        self.object_width = 0;
+        self.object_height = 0;
+        self.object_data.clearRetainingCapacity();
+        
+        // Discard anything a failed parse left behind
+        self.document.reset(std.math.maxInt(usize));
+    }
+    
+    // Hand back a document from parse() that has been emptied with
+    // Document.reset(). Its lists and arena chunks are reused by the next
+    // parse. Only call between parses.
+    pub fn recycleDocument(self: *FormattedParser, document: doc_model.Document) void {
+        self.document.deinit();
+        self.document = document;
     }
     
     pub fn parse(self: *FormattedParser) !doc_model.Document {
@@ -382,9 +520,65 @@ pub const FormattedParser = struct {
         // Skip any whitespace after RTF declaration
         try self.reader.skipWhitespace();
         
-        // Parse content until end
+        try self.parseContent(std.math.maxInt(usize));
+        return self.finishDocument();
+    }
+    
+    // Parse `data[start..end]` only, resuming from the last checkpoint at or
+    // before `start` (so the document may begin up to one checkpoint interval
+    // early). Parsing stops at the first token boundary at or past `end`, and
+    // the document is finished as if the input ended there. `checkpoints`
+    // must have been recorded from a full parse of the same `data`.
+    pub fn parseRange(self: *FormattedParser, data: []const u8, checkpoints: *const Checkpoints, start: usize, end: usize) !doc_model.Document {
+        if (checkpoints.parsed_len == 0 or data.len < checkpoints.parsed_len) return error.CheckpointMismatch;
+        const checkpoint = checkpoints.find(start) orelse return error.CheckpointMismatch;
+        self.checkpoints = null; // Not recording while resuming
+        
+        var stream = std.io.fixedBufferStream(data[checkpoint.offset..]);
+        try self.resumeAt(stream.reader().any(), checkpoints, checkpoint);
+        
+        try self.parseContent(end);
+        return self.finishDocument();
+    }
+    
+    // Reset the parser to continue from `checkpoint`, reading the input from
+    // the checkpoint's offset on through `source`
+    pub fn resumeAt(self: *FormattedParser, source: std.io.AnyReader, checkpoints: *const Checkpoints, checkpoint: Checkpoint) !void {
+        const recording = self.checkpoints;
+        self.reset(source);
+        self.checkpoints = recording;
+        self.reader.consumed = checkpoint.offset; // Offsets stay absolute
+        try checkpoints.restore(self, checkpoint);
+        if (self.source) |*recorder| {
+            if (checkpoint.element_count > 0) recorder.resumeUnits();
+        }
+    }
+    
+    // Parse tokens until the root group closes or the input offset reaches
+    // `end`. The token at `end` is left unread, so parsing can continue with
+    // a further call.
+    pub fn parseContent(self: *FormattedParser, end: usize) !void {
         while (self.group_depth > 0) {
+            self.token_start = self.reader.offset();
+            if (self.token_start >= end) break;
+            if (self.group_depth == 1) {
+                if (self.source) |*recorder| try self.recordUnit(recorder);
+            }
+            if (self.checkpoints) |checkpoints| {
+                if (self.token_start >= checkpoints.next_offset) try checkpoints.capture(self);
+            }
+            
             const byte = try self.reader.next() orelse break;
+            if (self.preview) |*preview| {
+                // Once full, anything but closing groups and the rest of a
+                // UTF-8 character is left unread
+                if (preview.truncated) break;
+                const continues = preview.continuation_bytes > 0 and byte & 0xc0 == 0x80;
+                if (preview.full() and !continues and byte != '}' and byte != '\r' and byte != '\n') {
+                    preview.truncated = true;
+                    break;
+                }
+            }
             
             switch (byte) {
                 '{' => {
@@ -450,7 +644,10 @@ pub const FormattedParser = struct {
                 },
             }
         }
-        
+    }
+    
+    // Close what is still open and hand the document to the caller
+    pub fn finishDocument(self: *FormattedParser) !doc_model.Document {
         // Flush any remaining text
         try self.flushTextBuffer();
         
@@ -459,6 +656,16 @@ pub const FormattedParser = struct {
             try self.finishCurrentTable();
         }
         
+        if (self.source) |*recorder| {
+            // The root group's closing brace is the last token read, if the input has one
+            const content_end = if (self.group_depth == 0) self.token_start else self.reader.offset();
+            self.document.source_map = try recorder.finish(self.document.arena.allocator(), self.document.content.items.len, content_end);
+        }
+        if (self.checkpoints) |checkpoints| {
+            try checkpoints.finish(&self.document, self.reader.offset());
+            self.checkpoints = null;
+        }
+        
         // Return document (caller takes ownership)
         // Move ownership from parser to caller
         const result = self.document;
@@ -490,10 +697,18 @@ pub const FormattedParser = struct {
         return true;
     }
     
+    // Unit boundaries for the source map (see source_map.Unit)
+    fn recordUnit(self: *FormattedParser, recorder: *source_map.Recorder) !void {
+        if (self.current_destination != .normal or self.text_buffer.items.len != 0) return;
+        if (self.table_parser.current_table != null) return;
+        try recorder.unitBoundary(self.token_start, self.document.content.items, self.current_format);
+    }
+    
     fn handleGroupStart(self: *FormattedParser) !void {
         // Push current state onto stacks
         try self.format_stack.append(self.current_format.copy());
         try self.destination_stack.append(self.current_destination);
+        if (self.source) |*recorder| try recorder.group_starts.append(self.token_start);
         
         // Check for ignorable group {\*\...}
         try self.reader.skipWhitespace();
@@ -571,6 +786,8 @@ pub const FormattedParser = struct {
                 self.current_destination = prev_dest;
             }
         }
+        
+        if (self.source) |*recorder| _ = recorder.group_starts.pop();
     }
     
     fn parseControl(self: *FormattedParser) !void {
@@ -583,7 +800,9 @@ pub const FormattedParser = struct {
                 '\\', '{', '}' => try self.addChar(symbol),
                 '\n', '\r' => {
                     try self.flushTextBuffer();
+                    try self.textBoundary();
                     try self.document.addElement(.paragraph_break);
+                    self.previewBreak();
                 },
                 '\'' => try self.parseHexByte(),
                 '*' => {
@@ -821,13 +1040,20 @@ pub const FormattedParser = struct {
                     self.current_destination = .normal;
                 }
                 
+                try self.textBoundary();
                 try self.document.addElement(.paragraph_break);
+                self.previewBreak();
             },
             .line => {
                 try self.flushTextBuffer();
+                try self.textBoundary();
                 try self.document.addElement(.line_break);
             },
             .tab => try self.addChar('\t'),
+            .pard => {
+                try self.flushTextBuffer();
+                self.current_format.resetParaFormat();
+            },
             .ql => {
                 self.current_format.para_format.alignment = .left;
             },
@@ -884,15 +1110,15 @@ pub const FormattedParser = struct {
             .rdblquote => try self.addChar('"'),
             .bullet => {
                 // Unicode bullet point as UTF-8
-                try self.text_buffer.appendSlice("•");
+                try self.addText("•");
             },
             .emdash => {
                 // Unicode em dash as UTF-8
-                try self.text_buffer.appendSlice("—");
+                try self.addText("—");
             },
             .endash => {
                 // Unicode en dash as UTF-8
-                try self.text_buffer.appendSlice("–");
+                try self.addText("–");
             },
             
             // Tables
@@ -909,6 +1135,7 @@ pub const FormattedParser = struct {
             },
             .row => {
                 try self.endTableRow();
+                self.previewBreak();
             },
             
             // Document properties
@@ -1164,28 +1391,71 @@ pub const FormattedParser = struct {
         
         try self.table_parser.startRow();
         self.current_destination = .table_content;
+        
+        if (self.source) |*recorder| {
+            if (recorder.table_start == null) recorder.table_start = self.token_start;
+            recorder.cell_start = self.reader.offset();
+        }
     }
     
     fn setCellWidth(self: *FormattedParser, width: u32) !void {
         try self.table_parser.setCellWidth(width);
+        
+        // Cell content follows the row's cell definitions
+        if (self.source) |*recorder| recorder.cell_start = self.reader.offset();
     }
     
     fn endTableCell(self: *FormattedParser) !void {
         try self.flushTextBuffer();
+        try self.textBoundary();
+        const cell_count = self.tableCellCount();
         try self.table_parser.finishCell();
+        try self.recordTableCells(cell_count, self.tableCellCount());
+        if (self.source) |*recorder| recorder.table_end = self.reader.offset();
     }
     
     fn endTableRow(self: *FormattedParser) !void {
         try self.flushTextBuffer();
+        try self.textBoundary();
+        const cell_count = self.tableCellCount();
         try self.table_parser.finishRow();
+        try self.recordTableCells(cell_count, self.tableCellCount());
+        if (self.source) |*recorder| recorder.table_end = self.reader.offset();
         // Don't finish the table here - rows can continue!
         // Table will be finished when we see non-table content
     }
     
     fn finishCurrentTable(self: *FormattedParser) !void {
-        if (try self.table_parser.finishTable()) |table| {
-            try self.document.addElement(.{ .table = table });
+        const cell_count = self.tableCellCount();
+        const finished = try self.table_parser.finishTable();
+        
+        if (self.source) |*recorder| {
+            if (finished) |table| try self.recordTableCells(cell_count, table.cells.items.len);
+            try recorder.finishTable(finished != null);
         }
+        
+        if (finished) |table| {
+            if (self.table_parser.row_sink != null or self.text_sink != null) {
+                // Its rows or text have gone to a sink already
+                var emptied = table;
+                emptied.deinit();
+            } else {
+                try self.document.addElement(.{ .table = table });
+            }
+        }
+    }
+    
+    fn tableCellCount(self: *const FormattedParser) usize {
+        const table = self.table_parser.current_table orelse return 0;
+        return table.cells.items.len;
+    }
+    
+    // Source ranges of the cells the table parser just closed (at most one)
+    fn recordTableCells(self: *FormattedParser, before: usize, after: usize) !void {
+        const recorder = if (self.source) |*recorder| recorder else return;
+        const end = self.reader.offset();
+        if (after > before) try recorder.tableCell(end);
+        recorder.cell_start = end;
     }
     
     fn finishPicture(self: *FormattedParser) !void {
@@ -1214,6 +1484,7 @@ pub const FormattedParser = struct {
             };
             
             try self.document.addElement(.{ .image = image });
+            try self.recordImage();
         }
         
         self.picture_data.clearRetainingCapacity();
@@ -1248,6 +1519,7 @@ pub const FormattedParser = struct {
             };
             
             try self.document.addElement(.{ .image = image });
+            try self.recordImage();
         }
         
         self.object_class.clearRetainingCapacity();
@@ -1257,8 +1529,60 @@ pub const FormattedParser = struct {
         self.object_height = 0;
     }
     
+    // Images are recorded when their group closes, so the range is the group
+    fn recordImage(self: *FormattedParser) !void {
+        const recorder = if (self.source) |*recorder| recorder else return;
+        const start = recorder.group_starts.getLastOrNull() orelse self.token_start;
+        try recorder.images.append(.{ .start = start, .end = self.reader.offset() });
+    }
+    
     fn addChar(self: *FormattedParser, char: u8) !void {
+        if (!self.previewTake(char)) return;
+        if (self.text_buffer.items.len == 0) self.text_start = self.token_start;
         try self.text_buffer.append(char);
+        self.text_end = self.reader.offset();
+    }
+    
+    fn addText(self: *FormattedParser, text: []const u8) !void {
+        for (text) |byte| {
+            if (!self.previewTake(byte)) return;
+        }
+        if (self.text_buffer.items.len == 0) self.text_start = self.token_start;
+        try self.text_buffer.appendSlice(text);
+        self.text_end = self.reader.offset();
+    }
+    
+    // Count a byte of visible text against the preview limit; false once
+    // the limit is full and the byte is dropped
+    fn previewTake(self: *FormattedParser, byte: u8) bool {
+        const preview = if (self.preview) |*preview| preview else return true;
+        switch (self.current_destination) {
+            .normal, .field_result, .table_content => {},
+            else => return true,
+        }
+        if (preview.truncated) return false;
+        // Bytes from \'xx are kept raw, so 0x80-0xBF only continues a
+        // character right after a UTF-8 lead byte
+        if (preview.continuation_bytes > 0 and byte & 0xc0 == 0x80) {
+            preview.continuation_bytes -= 1;
+            return true;
+        }
+        preview.continuation_bytes = 0;
+        if (preview.full()) {
+            preview.truncated = true;
+            return false;
+        }
+        preview.characters += 1;
+        if (byte >= 0xc0) preview.continuation_bytes = (std.unicode.utf8ByteSequenceLength(byte) catch 1) - 1;
+        return true;
+    }
+    
+    fn previewBreak(self: *FormattedParser) void {
+        if (self.preview) |*preview| preview.paragraphs += 1;
+    }
+    
+    fn textBoundary(self: *FormattedParser) !void {
+        if (self.text_sink) |sink| try sink.boundary(sink.context);
     }
     
     fn flushTextBuffer(self: *FormattedParser) !void {
@@ -1266,23 +1590,41 @@ pub const FormattedParser = struct {
         
         switch (self.current_destination) {
             .normal => {
+                if (self.text_sink) |sink| {
+                    try sink.text(sink.context, self.text_buffer.items, self.current_format.char_format);
+                    self.text_buffer.clearRetainingCapacity();
+                    return;
+                }
                 try self.document.addTextRun(
                     self.text_buffer.items,
                     self.current_format.char_format,
                     self.current_format.para_format
                 );
+                if (self.source) |*recorder| {
+                    try recorder.runs.append(.{ .start = self.text_start, .end = self.text_end });
+                }
             },
             .field_result => {
                 try self.field_result.appendSlice(self.text_buffer.items);
             },
             .table_content => {
+                if (self.text_sink) |sink| {
+                    try sink.text(sink.context, self.text_buffer.items, self.current_format.char_format);
+                    self.text_buffer.clearRetainingCapacity();
+                    return;
+                }
+                
                 // Add text run to current table cell
+                const text_allocator = self.table_parser.rowTextAllocator(self.document.arena.allocator());
                 const run = doc_model.TextRun.init(
-                    try self.document.arena.allocator().dupe(u8, self.text_buffer.items),
+                    try text_allocator.dupeZ(u8, self.text_buffer.items),
                     self.current_format.char_format,
                     self.current_format.para_format
                 );
-                try self.table_parser.addCellContent(.{ .text_run = run });
+                try self.table_parser.addCellRun(run);
+                if (self.source) |*recorder| {
+                    try recorder.tableRun(.{ .start = self.text_start, .end = self.text_end });
+                }
             },
             else => {}, // Skip for other destinations
         }
@@ -1291,6 +1633,253 @@ pub const FormattedParser = struct {
     }
 };
 
+// =============================================================================
+// CHECKPOINTS
+// =============================================================================
+// Parser state captured every `interval` input bytes during a full parse, so
+// FormattedParser.parseRange() can start mid-document with the right
+// formatting instead of re-parsing from byte 0. Checkpoints sit on token
+// boundaries in body text - never inside a font table, picture, field or
+// table cell - and hold the group depth, the format and destination stacks
+// and the table state. The stacks of all checkpoints share one array each.
+//
+// The font and color tables and document properties, which every range
+// needs, are copied once when the parse finishes; a checkpoint records how
+// many fonts and colors were defined before it.
+
+pub const Checkpoint = struct {
+    offset: usize,
+    group_depth: u32,
+    format: doc_model.FormatState,
+    destination: DestinationType,
+    first_frame: u32, // Into Checkpoints.formats and .destinations
+    frame_count: u32,
+    table: enum(u8) { none, between_rows, in_row },
+    first_width: u32, // Into Checkpoints.cell_widths
+    width_count: u32,
+    font_count: u32, // Fonts and colors defined before the checkpoint
+    color_count: u32,
+    
+    // No text run or table is half built here, so the content before and
+    // after the checkpoint comes from disjoint input (see reparse.zig)
+    exact: bool,
+    element_count: u32, // Document content and source map sizes
+    run_count: u32,
+    table_count: u32,
+    cell_count: u32,
+    image_count: u32,
+};
+
+pub const Checkpoints = struct {
+    interval: usize,
+    points: std.ArrayList(Checkpoint),
+    formats: std.ArrayList(doc_model.FormatState),
+    destinations: std.ArrayList(DestinationType),
+    cell_widths: std.ArrayList(u32),
+    next_offset: usize = 0,
+    awaiting_exact: bool = false, // This interval only has an inexact checkpoint so far
+    
+    // Document-wide state, filled in when the parse finishes
+    parsed_len: usize = 0,
+    arena: std.heap.ArenaAllocator,
+    fonts: std.ArrayList(doc_model.FontInfo),
+    colors: std.ArrayList(doc_model.ColorInfo),
+    default_font: u16 = 0,
+    default_font_size: u16 = 24,
+    code_page: u16 = 1252,
+    rtf_version: u16 = 1,
+    
+    // Document arena bytes held by content that reparseEdit() has replaced
+    // since the document was last parsed in full
+    replaced_bytes: usize = 0,
+    
+    pub const default_interval = 64 * 1024;
+    
+    pub fn init(allocator: std.mem.Allocator, interval: usize) Checkpoints {
+        return .{
+            .interval = if (interval == 0) default_interval else interval,
+            .points = std.ArrayList(Checkpoint).init(allocator),
+            .formats = std.ArrayList(doc_model.FormatState).init(allocator),
+            .destinations = std.ArrayList(DestinationType).init(allocator),
+            .cell_widths = std.ArrayList(u32).init(allocator),
+            .arena = std.heap.ArenaAllocator.init(allocator),
+            .fonts = std.ArrayList(doc_model.FontInfo).init(allocator),
+            .colors = std.ArrayList(doc_model.ColorInfo).init(allocator),
+        };
+    }
+    
+    pub fn deinit(self: *Checkpoints) void {
+        self.points.deinit();
+        self.formats.deinit();
+        self.destinations.deinit();
+        self.cell_widths.deinit();
+        self.arena.deinit();
+        self.fonts.deinit();
+        self.colors.deinit();
+    }
+    
+    fn clear(self: *Checkpoints) void {
+        self.points.clearRetainingCapacity();
+        self.formats.clearRetainingCapacity();
+        self.destinations.clearRetainingCapacity();
+        self.cell_widths.clearRetainingCapacity();
+        self.next_offset = 0;
+        self.awaiting_exact = false;
+        self.parsed_len = 0;
+        self.replaced_bytes = 0;
+        _ = self.arena.reset(.retain_capacity);
+        self.fonts.clearRetainingCapacity();
+        self.colors.clearRetainingCapacity();
+    }
+    
+    pub fn count(self: *const Checkpoints) usize {
+        return self.points.items.len;
+    }
+    
+    // Last checkpoint at or before `offset` (the first one for earlier offsets)
+    pub fn find(self: *const Checkpoints, offset: usize) ?Checkpoint {
+        if (self.points.items.len == 0) return null;
+        const after = std.sort.upperBound(Checkpoint, self.points.items, offset, offsetOrder);
+        return self.points.items[if (after == 0) 0 else after - 1];
+    }
+    
+    fn offsetOrder(offset: usize, checkpoint: Checkpoint) std.math.Order {
+        return std.math.order(offset, checkpoint.offset);
+    }
+    
+    // Called before each token once the next interval is reached. Positions
+    // where resuming would not reproduce the full parse are passed over. An
+    // inexact position (inside a text run or table) is recorded, and capture
+    // then keeps trying until it finds an exact one for the same interval.
+    fn capture(self: *Checkpoints, parser: *const FormattedParser) !void {
+        switch (parser.current_destination) {
+            .normal, .table_content => {},
+            else => return,
+        }
+        const table_parser = &parser.table_parser;
+        if (table_parser.in_cell) return;
+        
+        const table: @FieldType(Checkpoint, "table") = if (table_parser.current_table == null)
+            .none
+        else if (table_parser.in_row)
+            .in_row
+        else
+            .between_rows;
+        const exact = table == .none and parser.text_buffer.items.len == 0;
+        if (!exact and self.awaiting_exact) return;
+        
+        const widths = if (table == .in_row) table_parser.cell_widths.items else &[_]u32{};
+        const recorder: ?*const source_map.Recorder = if (parser.source) |*source| source else null;
+        
+        try self.points.append(.{
+            .offset = parser.token_start,
+            .group_depth = parser.group_depth,
+            .format = parser.current_format,
+            .destination = parser.current_destination,
+            .first_frame = @intCast(self.formats.items.len),
+            .frame_count = @intCast(parser.format_stack.items.len),
+            .table = table,
+            .first_width = @intCast(self.cell_widths.items.len),
+            .width_count = @intCast(widths.len),
+            .font_count = @intCast(parser.document.font_table.items.len),
+            .color_count = @intCast(parser.document.color_table.items.len),
+            .exact = exact,
+            .element_count = @intCast(parser.document.content.items.len),
+            .run_count = if (recorder) |r| @intCast(r.runs.len) else 0,
+            .table_count = if (recorder) |r| @intCast(r.tables.len) else 0,
+            .cell_count = if (recorder) |r| @intCast(r.cells.len) else 0,
+            .image_count = if (recorder) |r| @intCast(r.images.len) else 0,
+        });
+        try self.formats.appendSlice(parser.format_stack.items);
+        try self.destinations.appendSlice(parser.destination_stack.items);
+        try self.cell_widths.appendSlice(widths);
+        
+        self.awaiting_exact = !exact;
+        if (exact) self.next_offset = parser.token_start + self.interval;
+    }
+    
+    // Whether `parser` is in the state captured at `checkpoint`, with nothing
+    // half built - parsing on from here would repeat the original parse
+    pub fn matches(self: *const Checkpoints, checkpoint: Checkpoint, parser: *const FormattedParser) bool {
+        if (!checkpoint.exact) return false;
+        if (parser.text_buffer.items.len != 0 or parser.table_parser.current_table != null) return false;
+        if (parser.group_depth != checkpoint.group_depth) return false;
+        if (parser.current_destination != checkpoint.destination) return false;
+        if (!std.meta.eql(parser.current_format, checkpoint.format)) return false;
+        if (parser.document.font_table.items.len != checkpoint.font_count) return false;
+        if (parser.document.color_table.items.len != checkpoint.color_count) return false;
+        
+        const formats = self.formats.items[checkpoint.first_frame..][0..checkpoint.frame_count];
+        const destinations = self.destinations.items[checkpoint.first_frame..][0..checkpoint.frame_count];
+        if (parser.format_stack.items.len != formats.len) return false;
+        for (parser.format_stack.items, formats) |current, captured| {
+            if (!std.meta.eql(current, captured)) return false;
+        }
+        return std.mem.eql(DestinationType, parser.destination_stack.items, destinations);
+    }
+    
+    // Append `checkpoint` of `source` (possibly with adjusted offset and
+    // counts), copying its stacks. Used to rebuild a set after an edit.
+    pub fn appendFrom(self: *Checkpoints, source: *const Checkpoints, checkpoint: Checkpoint) !void {
+        var copy = checkpoint;
+        copy.first_frame = @intCast(self.formats.items.len);
+        copy.first_width = @intCast(self.cell_widths.items.len);
+        try self.formats.appendSlice(source.formats.items[checkpoint.first_frame..][0..checkpoint.frame_count]);
+        try self.destinations.appendSlice(source.destinations.items[checkpoint.first_frame..][0..checkpoint.frame_count]);
+        try self.cell_widths.appendSlice(source.cell_widths.items[checkpoint.first_width..][0..checkpoint.width_count]);
+        try self.points.append(copy);
+    }
+    
+    pub fn finish(self: *Checkpoints, document: *const doc_model.Document, parsed_len: usize) !void {
+        self.parsed_len = parsed_len;
+        self.fonts.clearRetainingCapacity();
+        self.colors.clearRetainingCapacity();
+        for (document.font_table.items) |font| {
+            var copy = font;
+            copy.name = try self.arena.allocator().dupeZ(u8, font.name);
+            try self.fonts.append(copy);
+        }
+        try self.colors.appendSlice(document.color_table.items);
+        self.default_font = document.default_font;
+        self.default_font_size = document.default_font_size;
+        self.code_page = document.code_page;
+        self.rtf_version = document.rtf_version;
+    }
+    
+    // Put a freshly reset parser in the state captured at `checkpoint`
+    fn restore(self: *const Checkpoints, parser: *FormattedParser, checkpoint: Checkpoint) !void {
+        try parser.format_stack.appendSlice(self.formats.items[checkpoint.first_frame..][0..checkpoint.frame_count]);
+        try parser.destination_stack.appendSlice(self.destinations.items[checkpoint.first_frame..][0..checkpoint.frame_count]);
+        parser.current_format = checkpoint.format;
+        parser.current_destination = checkpoint.destination;
+        parser.group_depth = checkpoint.group_depth;
+        
+        switch (checkpoint.table) {
+            .none => {},
+            .between_rows => try parser.table_parser.startTable(),
+            .in_row => {
+                try parser.table_parser.startRow();
+                for (self.cell_widths.items[checkpoint.first_width..][0..checkpoint.width_count]) |width| {
+                    try parser.table_parser.setCellWidth(width);
+                }
+            },
+        }
+        
+        // Tables defined after the checkpoint are parsed again
+        const document = &parser.document;
+        for (self.fonts.items[0..checkpoint.font_count]) |font| {
+            var copy = font;
+            copy.name = try document.arena.allocator().dupeZ(u8, font.name);
+            try document.addFont(copy);
+        }
+        for (self.colors.items[0..checkpoint.color_count]) |color| try document.addColor(color);
+        document.default_font = self.default_font;
+        document.default_font_size = self.default_font_size;
+        document.code_page = self.code_page;
+        document.rtf_version = self.rtf_version;
+    }
+};
+
 // Basic tests to ensure compilation and functionality
 test "formatted parser - simple text" {
     const testing = std.testing;
@@ -1461,4 +2050,145 @@ test "formatted parser - control word delimiters" {
         const text = try document.getPlainText();
         try testing.expectEqualStrings("test", text);
     }
-}
\ No newline at end of file
+}
+
+test "formatted parser - reset and recycle between documents" {
+    const testing = std.testing;
+    
+    var stream = std.io.fixedBufferStream("{\\rtf1{\\fonttbl{\\f0 Arial;}}\\b First\\b0  note}");
+    var parser = try FormattedParser.init(stream.reader().any(), testing.allocator);
+    defer parser.deinit();
+    
+    var first = try parser.parse();
+    try testing.expectEqualStrings("First note", try first.getPlainText());
+    try testing.expectEqual(@as(usize, 1), first.font_table.items.len);
+    
+    // The second document reuses the first one's storage
+    first.reset(64 * 1024);
+    parser.recycleDocument(first);
+    
+    var second_stream = std.io.fixedBufferStream("{\\rtf1 Second}");
+    parser.reset(second_stream.reader().any());
+    
+    var second = try parser.parse();
+    defer second.deinit();
+    try testing.expectEqualStrings("Second", try second.getPlainText());
+    try testing.expectEqual(@as(usize, 0), second.font_table.items.len);
+    
+    // A failed parse leaves nothing behind for the next one
+    var broken_stream = std.io.fixedBufferStream("{\\rtf1 {\\b unclosed");
+    parser.reset(broken_stream.reader().any());
+    if (parser.parse()) |partial| {
+        var owned = partial;
+        owned.deinit();
+    } else |_| {}
+    
+    var third_stream = std.io.fixedBufferStream("{\\rtf1 Third}");
+    parser.reset(third_stream.reader().any());
+    
+    var third = try parser.parse();
+    defer third.deinit();
+    try testing.expectEqualStrings("Third", try third.getPlainText());
+}
+
+test "formatted parser - checkpoints and range parsing" {
+    const testing = std.testing;
+    
+    const rtf_data = "{\\rtf1{\\fonttbl{\\f0 Arial;}{\\f1 Times;}}\\f1 Intro \\b bold start " ++
+        "{\\i nested one} more bold\\b0\\par Second para\\par" ++
+        "\\trowd\\cellx1000\\cellx2000 A\\cell B\\cell\\row\\trowd\\cellx1000 C\\cell\\row\\par End}";
+    
+    var checkpoints = Checkpoints.init(testing.allocator, 16);
+    defer checkpoints.deinit();
+    
+    var stream = std.io.fixedBufferStream(rtf_data);
+    var parser = try FormattedParser.init(stream.reader().any(), testing.allocator);
+    defer parser.deinit();
+    parser.recordCheckpoints(&checkpoints);
+    
+    var full = try parser.parse();
+    defer full.deinit();
+    const full_text = try full.getPlainText();
+    try testing.expect(checkpoints.count() > 4);
+    
+    // Resuming at any checkpoint reproduces the rest of the document
+    for (checkpoints.points.items) |checkpoint| {
+        var range = try parser.parseRange(rtf_data, &checkpoints, checkpoint.offset, rtf_data.len);
+        defer range.deinit();
+        const range_text = try range.getPlainText();
+        try testing.expect(std.mem.endsWith(u8, full_text, range_text));
+        try testing.expectEqual(full.font_table.items.len, range.font_table.items.len);
+    }
+    
+    // Formatting is in effect from the first byte of a range
+    const more = std.mem.indexOf(u8, rtf_data, "more bold").?;
+    var middle = try parser.parseRange(rtf_data, &checkpoints, more, more + 4);
+    defer middle.deinit();
+    const runs = try middle.getTextRuns(testing.allocator);
+    defer testing.allocator.free(runs);
+    const last = runs[runs.len - 1];
+    try testing.expect(std.mem.endsWith(u8, last.text, "more"));
+    try testing.expect(last.char_format.bold);
+    try testing.expectEqual(@as(?u16, 1), last.char_format.font_id);
+    try testing.expectEqualStrings("Times", middle.getFont(1).?.name);
+    
+    // Ranges stop at the end offset
+    var head = try parser.parseRange(rtf_data, &checkpoints, 0, std.mem.indexOf(u8, rtf_data, "Second").?);
+    defer head.deinit();
+    try testing.expectEqualStrings("Intro bold start nested one more bold\n\n", try head.getPlainText());
+    
+    try testing.expectError(error.CheckpointMismatch, parser.parseRange(rtf_data[0..10], &checkpoints, 0, 10));
+}
+
+test "formatted parser - preview stops early" {
+    const testing = std.testing;
+    
+    const rtf_data = "{\\rtf1{\\fonttbl{\\f0 Arial;}}\\b Cafe\\b0  one\\par Second para\\par Third\\par" ++
+        "{\\pict\\pngblip 89504e47}\\trowd\\cellx1000 cell\\cell\\row}";
+    
+    var stream = std.io.fixedBufferStream(rtf_data);
+    var parser = try FormattedParser.init(stream.reader().any(), testing.allocator);
+    defer parser.deinit();
+    
+    // Characters: the limit falls inside a run
+    parser.limitPreview(10, std.math.maxInt(usize));
+    var short = try parser.parse();
+    defer short.deinit();
+    try testing.expectEqualStrings("Cafe one\n\nSe", try short.getPlainText());
+    try testing.expect(short.content.items[0].text_run.char_format.bold);
+    try testing.expect(parser.preview.?.truncated);
+    
+    // Paragraphs: the picture and table after them are never read
+    var second_stream = std.io.fixedBufferStream(rtf_data);
+    parser.reset(second_stream.reader().any());
+    parser.limitPreview(std.math.maxInt(usize), 3);
+    var head = try parser.parse();
+    defer head.deinit();
+    try testing.expectEqualStrings("Cafe one\n\nSecond para\n\nThird\n\n", try head.getPlainText());
+    try testing.expect(parser.preview.?.truncated);
+    for (head.content.items) |element| try testing.expect(element != .image and element != .table);
+    
+    // A document within the limits is whole
+    var whole_stream = std.io.fixedBufferStream("{\\rtf1 Short\\par}");
+    parser.reset(whole_stream.reader().any());
+    var whole = try parser.parse();
+    defer whole.deinit();
+    try testing.expectEqualStrings("Short\n\n", try whole.getPlainText());
+    try testing.expect(!parser.preview.?.truncated);
+    
+    // Code page bytes count as characters of their own, UTF-8 sequences as one
+    var quoted_stream = std.io.fixedBufferStream("{\\rtf1 \\'93Hi\\'85\\'94 caf\\u233?}");
+    parser.reset(quoted_stream.reader().any());
+    parser.limitPreview(4, std.math.maxInt(usize));
+    var quoted = try parser.parse();
+    defer quoted.deinit();
+    try testing.expectEqualStrings("\x93Hi\x85", try quoted.getPlainText());
+    try testing.expect(parser.preview.?.truncated);
+    
+    var accented_stream = std.io.fixedBufferStream("{\\rtf1 \\'93Hi\\'85\\'94 caf\\u233?}");
+    parser.reset(accented_stream.reader().any());
+    parser.limitPreview(10, std.math.maxInt(usize));
+    var accented = try parser.parse();
+    defer accented.deinit();
+    try testing.expectEqualStrings("\x93Hi\x85\x94 caf\u{e9}", try accented.getPlainText());
+}
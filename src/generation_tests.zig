@@ -103,34 +103,14 @@ test "table generation" {
     var table = doc_model.Table.init(allocator);
     
     // First row
-    var row1 = doc_model.TableRow{
-        .cells = std.ArrayList(doc_model.TableCell).init(allocator),
-    };
-    var cell1_1 = doc_model.TableCell.init(allocator);
-    cell1_1.width = 1440;
-    try cell1_1.content.append(.{ .text_run = .{ .text = "Cell 1,1", .char_format = .{}, .para_format = .{} } });
-    try row1.cells.append(cell1_1);
-    
-    var cell1_2 = doc_model.TableCell.init(allocator);
-    cell1_2.width = 1440;
-    try cell1_2.content.append(.{ .text_run = .{ .text = "Cell 1,2", .char_format = .{}, .para_format = .{} } });
-    try row1.cells.append(cell1_2);
-    try table.rows.append(row1);
+    try table.addRow(0);
+    try table.addCell(.{ .width = 1440 }, &.{.{ .text = "Cell 1,1", .char_format = .{}, .para_format = .{} }});
+    try table.addCell(.{ .width = 1440 }, &.{.{ .text = "Cell 1,2", .char_format = .{}, .para_format = .{} }});
     
     // Second row
-    var row2 = doc_model.TableRow{
-        .cells = std.ArrayList(doc_model.TableCell).init(allocator),
-    };
-    var cell2_1 = doc_model.TableCell.init(allocator);
-    cell2_1.width = 1440;
-    try cell2_1.content.append(.{ .text_run = .{ .text = "Cell 2,1", .char_format = .{}, .para_format = .{} } });
-    try row2.cells.append(cell2_1);
-    
-    var cell2_2 = doc_model.TableCell.init(allocator);
-    cell2_2.width = 1440;
-    try cell2_2.content.append(.{ .text_run = .{ .text = "Cell 2,2", .char_format = .{}, .para_format = .{} } });
-    try row2.cells.append(cell2_2);
-    try table.rows.append(row2);
+    try table.addRow(0);
+    try table.addCell(.{ .width = 1440 }, &.{.{ .text = "Cell 2,1", .char_format = .{}, .para_format = .{} }});
+    try table.addCell(.{ .width = 1440 }, &.{.{ .text = "Cell 2,2", .char_format = .{}, .para_format = .{} }});
     
     try document.addElement(.{ .table = table });
     
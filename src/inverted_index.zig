@@ -0,0 +1,1066 @@
+const std = @import("std");
+const builtin = @import("builtin");
+const doc_model = @import("document_model.zig");
+const io = @import("io.zig");
+const formatted_parser = @import("formatted_parser.zig");
+
+// =============================================================================
+// INVERTED INDEX
+// =============================================================================
+// Full-text index over a corpus of RTF files. Text is tokenized while the
+// parser reads it (FormattedParser.streamText), so neither the plain text nor
+// the runs of a document are ever built. Each term's posting list holds the
+// documents it occurs in and, per document, its positions, each flagged bold
+// and/or heading from the character format.
+//
+// Builders fill in-memory segments over consecutive document ids, and write
+// them to disk once they reach a size limit; buildFiles() runs one builder
+// per thread over its share of the files and merges their segments into the
+// final index. Segments and the final index share one file format, opened
+// with Index.open() and queried in place from a read-only mapping.
+//
+// An index file is a Header followed by four sections, each padded to 8
+// bytes so its records can be used straight from the mapping. The header
+// is written last, over a placeholder, once the section offsets are known.
+// All integers are little-endian.
+//
+// The postings section is varint-coded: per term, a list of documents as id
+// deltas (the first one absolute), each followed by its positions as
+// (position delta << 2 | flags), the first delta counting from -1, and a 0
+// after the last position. The terms section is a TermEntry per term, sorted by
+// the term's bytes, pointing into postings and strings. The docs section is
+// a DocEntry per document id, naming its file. Strings holds the term bytes
+// and then the document names, without terminators.
+
+pub const magic = "ZRTFINDX".*;
+pub const version: u32 = 1;
+
+pub const Error = error{
+    InvalidIndex,
+    UnsupportedIndexVersion,
+    UnsupportedPlatform,
+    SegmentOrder,
+    TooManyDocuments,
+};
+
+// Position flags
+pub const flag_bold: u8 = 0x1;
+pub const flag_heading: u8 = 0x2;
+
+// Longer words are not indexed (they still take a position)
+pub const max_term_len = 64;
+
+pub const Options = struct {
+    heading_size: u16 = 28, // Half-points; text at least this large is a heading
+    segment_bytes: usize = 64 * 1024 * 1024, // Postings a builder holds before writing a segment
+    threads: usize = 0, // 0 for one per core
+};
+
+const Section = extern struct {
+    offset: u64 = 0,
+    len: u64 = 0,
+};
+
+const Header = extern struct {
+    magic: [8]u8 = magic,
+    version: u32 = version,
+    header_size: u32 = @sizeOf(Header),
+    first_doc: u64 = 0,
+    doc_count: u64 = 0,
+    term_count: u64 = 0,
+    postings: Section = .{},
+    terms: Section = .{},
+    docs: Section = .{},
+    strings: Section = .{},
+};
+
+const TermEntry = extern struct {
+    postings_offset: u64, // Into the postings section
+    postings_len: u64, // Including the final 0
+    string_offset: u64, // Into the strings section
+    string_len: u32,
+    doc_freq: u32,
+    last_doc: u32,
+    reserved: u32 = 0,
+};
+
+const DocEntry = extern struct {
+    name_offset: u64, // Into the strings section
+    name_len: u64,
+};
+
+const section_alignment = 8;
+
+// =============================================================================
+// TOKENIZER
+// =============================================================================
+
+// Splits text into terms: runs of ASCII letters and digits, lowercased, and
+// non-ASCII characters other than punctuation and spaces. Text arrives in
+// pieces, one per run, and a term continues across pieces until a separator
+// or boundary(); its flags are those of all its pieces combined.
+pub const Tokenizer = struct {
+    buffer: [max_term_len]u8 = undefined,
+    len: usize = 0,
+    too_long: bool = false,
+    flags: u8 = 0,
+    position: u32 = 0, // Of the next term
+
+    // Terms go to `consumer.addTerm(term, position, flags)`
+    pub fn feed(self: *Tokenizer, text: []const u8, flags: u8, consumer: anytype) !void {
+        var i: usize = 0;
+        while (i < text.len) {
+            const byte = text[i];
+            if (byte < 0x80) {
+                if (std.ascii.isAlphanumeric(byte)) {
+                    const lower = [1]u8{std.ascii.toLower(byte)};
+                    self.append(&lower, flags);
+                } else {
+                    try self.finishTerm(consumer);
+                }
+                i += 1;
+                continue;
+            }
+
+            // Bytes that are not UTF-8 (code page text) are word characters
+            const len = std.unicode.utf8ByteSequenceLength(byte) catch 1;
+            const end = @min(i + len, text.len);
+            if (end - i == len and isSeparator(text[i..end])) {
+                try self.finishTerm(consumer);
+            } else {
+                self.append(text[i..end], flags);
+            }
+            i = end;
+        }
+    }
+
+    // End the current term: the text that follows is not part of it
+    pub fn boundary(self: *Tokenizer, consumer: anytype) !void {
+        try self.finishTerm(consumer);
+    }
+
+    pub fn reset(self: *Tokenizer) void {
+        self.* = .{};
+    }
+
+    fn append(self: *Tokenizer, bytes: []const u8, flags: u8) void {
+        self.flags |= flags;
+        if (self.len + bytes.len > max_term_len) {
+            self.too_long = true;
+            return;
+        }
+        @memcpy(self.buffer[self.len..][0..bytes.len], bytes);
+        self.len += bytes.len;
+    }
+
+    fn finishTerm(self: *Tokenizer, consumer: anytype) !void {
+        if (self.len == 0 and !self.too_long) return;
+        if (!self.too_long) try consumer.addTerm(self.buffer[0..self.len], self.position, self.flags);
+        self.position +|= 1;
+        self.len = 0;
+        self.too_long = false;
+        self.flags = 0;
+    }
+};
+
+// Latin-1 punctuation and spaces, general and CJK punctuation, BOM
+fn isSeparator(sequence: []const u8) bool {
+    const code_point = std.unicode.utf8Decode(sequence) catch return false;
+    return switch (code_point) {
+        0x80...0xBF, 0xD7, 0xF7, 0x2000...0x206F, 0x3000...0x303F, 0xFEFF => true,
+        else => false,
+    };
+}
+
+// Normalize a query word the way the tokenizer does, into `buffer`. Null if
+// it is not exactly one term.
+pub fn queryTerm(buffer: *[max_term_len]u8, word: []const u8) ?[]const u8 {
+    const Single = struct {
+        out: *[max_term_len]u8,
+        len: ?usize = null,
+        count: usize = 0,
+
+        pub fn addTerm(self: *@This(), term: []const u8, position: u32, flags: u8) !void {
+            _ = position;
+            _ = flags;
+            self.count += 1;
+            @memcpy(self.out[0..term.len], term);
+            self.len = term.len;
+        }
+    };
+
+    var single = Single{ .out = buffer };
+    var tokenizer = Tokenizer{};
+    tokenizer.feed(word, 0, &single) catch unreachable;
+    tokenizer.boundary(&single) catch unreachable;
+    if (single.count != 1) return null;
+    return buffer[0..single.len.?];
+}
+
+// =============================================================================
+// SEGMENT BUILDER
+// =============================================================================
+
+// In-memory postings for documents first_doc, first_doc + 1, ...
+pub const SegmentBuilder = struct {
+    allocator: std.mem.Allocator,
+    term_strings: std.heap.ArenaAllocator,
+    terms: std.StringHashMapUnmanaged(TermPostings) = .{},
+    docs: std.ArrayListUnmanaged(DocEntry) = .{},
+    names: std.ArrayListUnmanaged(u8) = .{},
+    first_doc: u32,
+    postings_bytes: usize = 0,
+
+    const TermPostings = struct {
+        bytes: std.ArrayListUnmanaged(u8) = .{},
+        doc_freq: u32 = 0,
+        last_doc: u32 = 0,
+        last_position: u32 = 0,
+    };
+
+    pub fn init(allocator: std.mem.Allocator, first_doc: u32) SegmentBuilder {
+        return .{
+            .allocator = allocator,
+            .term_strings = std.heap.ArenaAllocator.init(allocator),
+            .first_doc = first_doc,
+        };
+    }
+
+    pub fn deinit(self: *SegmentBuilder) void {
+        var postings = self.terms.valueIterator();
+        while (postings.next()) |term| term.bytes.deinit(self.allocator);
+        self.terms.deinit(self.allocator);
+        self.term_strings.deinit();
+        self.docs.deinit(self.allocator);
+        self.names.deinit(self.allocator);
+    }
+
+    // Empty the builder for documents from `first_doc` on
+    pub fn reset(self: *SegmentBuilder, first_doc: u32) void {
+        var postings = self.terms.valueIterator();
+        while (postings.next()) |term| term.bytes.deinit(self.allocator);
+        self.terms.clearRetainingCapacity();
+        _ = self.term_strings.reset(.retain_capacity);
+        self.docs.clearRetainingCapacity();
+        self.names.clearRetainingCapacity();
+        self.first_doc = first_doc;
+        self.postings_bytes = 0;
+    }
+
+    pub fn documentCount(self: *const SegmentBuilder) usize {
+        return self.docs.items.len;
+    }
+
+    // Start the next document. Its terms follow, in position order.
+    pub fn beginDocument(self: *SegmentBuilder, name: []const u8) !u32 {
+        const id = std.math.cast(u32, self.first_doc + self.docs.items.len) orelse return error.TooManyDocuments;
+        try self.docs.append(self.allocator, .{ .name_offset = self.names.items.len, .name_len = name.len });
+        try self.names.appendSlice(self.allocator, name);
+        return id;
+    }
+
+    pub fn addTerm(self: *SegmentBuilder, term: []const u8, position: u32, flags: u8) !void {
+        std.debug.assert(self.docs.items.len > 0);
+        const doc: u32 = @intCast(self.first_doc + self.docs.items.len - 1);
+
+        const entry = try self.terms.getOrPut(self.allocator, term);
+        if (!entry.found_existing) {
+            entry.key_ptr.* = try self.term_strings.allocator().dupe(u8, term);
+            entry.value_ptr.* = .{};
+        }
+        const postings = entry.value_ptr;
+        const before = postings.bytes.items.len;
+
+        var delta: u64 = undefined;
+        if (postings.doc_freq == 0 or postings.last_doc != doc) {
+            if (postings.doc_freq > 0) try postings.bytes.append(self.allocator, 0);
+            try appendVarint(&postings.bytes, self.allocator, if (postings.doc_freq == 0) doc else doc - postings.last_doc);
+            postings.doc_freq += 1;
+            postings.last_doc = doc;
+            delta = @as(u64, position) + 1;
+        } else {
+            if (position == postings.last_position) return; // Saturated position
+            delta = position - postings.last_position;
+        }
+        postings.last_position = position;
+        try appendVarint(&postings.bytes, self.allocator, delta << 2 | flags);
+
+        self.postings_bytes += postings.bytes.items.len - before;
+    }
+
+    // Write the segment in index format. `file` must be seekable.
+    pub fn write(self: *const SegmentBuilder, file: std.fs.File) !void {
+        const Term = struct {
+            string: []const u8,
+            postings: *const TermPostings,
+
+            fn lessThan(_: void, a: @This(), b: @This()) bool {
+                return std.mem.lessThan(u8, a.string, b.string);
+            }
+        };
+
+        const sorted = try self.allocator.alloc(Term, self.terms.count());
+        defer self.allocator.free(sorted);
+        var terms = self.terms.iterator();
+        var i: usize = 0;
+        while (terms.next()) |entry| : (i += 1) {
+            sorted[i] = .{ .string = entry.key_ptr.*, .postings = entry.value_ptr };
+        }
+        std.mem.sort(Term, sorted, {}, Term.lessThan);
+
+        var out = try IndexWriter.begin(file);
+        out.header.first_doc = self.first_doc;
+        out.header.doc_count = self.docs.items.len;
+        out.header.term_count = sorted.len;
+
+        // Postings, each ending the last document's positions
+        const postings_start = try out.startSection();
+        for (sorted) |term| {
+            try out.writeAll(term.postings.bytes.items);
+            try out.writeAll(&.{0});
+        }
+        out.header.postings = out.endSection(postings_start);
+
+        var offset: u64 = 0;
+        var string_offset: u64 = 0;
+        const terms_start = try out.startSection();
+        for (sorted) |term| {
+            const len = term.postings.bytes.items.len + 1;
+            try out.writeRecord(TermEntry{
+                .postings_offset = offset,
+                .postings_len = len,
+                .string_offset = string_offset,
+                .string_len = @intCast(term.string.len),
+                .doc_freq = term.postings.doc_freq,
+                .last_doc = term.postings.last_doc,
+            });
+            offset += len;
+            string_offset += term.string.len;
+        }
+        out.header.terms = out.endSection(terms_start);
+
+        // Names follow the term strings
+        const docs_start = try out.startSection();
+        for (self.docs.items) |doc| {
+            try out.writeRecord(DocEntry{ .name_offset = string_offset + doc.name_offset, .name_len = doc.name_len });
+        }
+        out.header.docs = out.endSection(docs_start);
+
+        const strings_start = try out.startSection();
+        for (sorted) |term| try out.writeAll(term.string);
+        try out.writeAll(self.names.items);
+        out.header.strings = out.endSection(strings_start);
+
+        try out.finish();
+    }
+};
+
+const max_varint_len = 10;
+
+// LEB128: 7 bits per byte, low bits first, high bit set on all but the last
+fn encodeVarint(buffer: *[max_varint_len]u8, value: u64) []const u8 {
+    var rest = value;
+    var len: usize = 0;
+    while (rest >= 0x80) : (rest >>= 7) {
+        buffer[len] = @as(u8, @truncate(rest)) | 0x80;
+        len += 1;
+    }
+    buffer[len] = @intCast(rest);
+    return buffer[0 .. len + 1];
+}
+
+fn appendVarint(list: *std.ArrayListUnmanaged(u8), allocator: std.mem.Allocator, value: u64) !void {
+    var buffer: [max_varint_len]u8 = undefined;
+    try list.appendSlice(allocator, encodeVarint(&buffer, value));
+}
+
+fn readVarint(bytes: []const u8, pos: *usize) Error!u64 {
+    var value: u64 = 0;
+    var shift: u32 = 0;
+    while (pos.* < bytes.len and shift < 64) : (shift += 7) {
+        const byte = bytes[pos.*];
+        pos.* += 1;
+        value |= @as(u64, byte & 0x7f) << @intCast(shift);
+        if (byte < 0x80) return value;
+    }
+    return error.InvalidIndex;
+}
+
+// Sections of an index file, written front to back with the header last
+const IndexWriter = struct {
+    file: std.fs.File,
+    buffered: io.ExportWriter(std.fs.File.Writer),
+    offset: u64 = 0,
+    header: Header = .{},
+
+    fn begin(file: std.fs.File) !IndexWriter {
+        if (builtin.cpu.arch.endian() != .little) return error.UnsupportedPlatform;
+
+        var writer = IndexWriter{ .file = file, .buffered = io.exportWriter(file.writer()) };
+        try writer.writeAll(std.mem.asBytes(&writer.header)); // Placeholder
+        return writer;
+    }
+
+    fn writeAll(self: *IndexWriter, bytes: []const u8) !void {
+        try self.buffered.writer().writeAll(bytes);
+        self.offset += bytes.len;
+    }
+
+    fn writeRecord(self: *IndexWriter, record: anytype) !void {
+        try self.writeAll(std.mem.asBytes(&record));
+    }
+
+    fn startSection(self: *IndexWriter) !u64 {
+        const aligned = std.mem.alignForward(u64, self.offset, section_alignment);
+        try self.buffered.writer().writeByteNTimes(0, @intCast(aligned - self.offset));
+        self.offset = aligned;
+        return aligned;
+    }
+
+    fn endSection(self: *const IndexWriter, start: u64) Section {
+        return .{ .offset = start, .len = self.offset - start };
+    }
+
+    fn finish(self: *IndexWriter) !void {
+        try self.buffered.flush();
+        try self.file.seekTo(0);
+        try self.file.writeAll(std.mem.asBytes(&self.header));
+    }
+};
+
+// =============================================================================
+// READING
+// =============================================================================
+
+pub const Position = struct {
+    position: u32, // Term number within the document
+    flags: u8, // flag_bold, flag_heading
+};
+
+pub const PositionIterator = struct {
+    bytes: []const u8,
+    pos: usize = 0,
+    last: ?u32 = null,
+
+    pub fn next(self: *PositionIterator) Error!?Position {
+        if (self.pos >= self.bytes.len) return null;
+        const value = try readVarint(self.bytes, &self.pos);
+        const delta = value >> 2;
+        const position = if (self.last) |last| last + delta else delta -% 1;
+        if (delta == 0 or position > std.math.maxInt(u32)) return error.InvalidIndex;
+        self.last = @intCast(position);
+        return .{ .position = @intCast(position), .flags = @intCast(value & 0x3) };
+    }
+};
+
+pub const Occurrence = struct {
+    doc: u32,
+    positions: PositionIterator,
+};
+
+// Documents containing a term, in id order
+pub const Postings = struct {
+    bytes: []const u8,
+    doc_freq: u32,
+    pos: usize = 0,
+    last_doc: ?u32 = null,
+
+    pub fn next(self: *Postings) Error!?Occurrence {
+        if (self.pos >= self.bytes.len) return null;
+        const delta = try readVarint(self.bytes, &self.pos);
+        const doc = if (self.last_doc) |last| last + delta else delta;
+        if (doc > std.math.maxInt(u32) or (self.last_doc != null and delta == 0)) return error.InvalidIndex;
+        self.last_doc = @intCast(doc);
+
+        // Positions run to the 0 that ends them
+        const start = self.pos;
+        while (true) {
+            const end = self.pos;
+            if (try readVarint(self.bytes, &self.pos) == 0) {
+                return .{ .doc = @intCast(doc), .positions = .{ .bytes = self.bytes[start..end] } };
+            }
+        }
+    }
+};
+
+pub const Index = struct {
+    header: Header,
+    postings: []const u8,
+    terms: []const TermEntry,
+    docs: []const DocEntry,
+    strings: []const u8,
+
+    // Backing file, when opened from one, and the allocator it was mapped with
+    file: ?io.FileBytes = null,
+    allocator: ?std.mem.Allocator = null,
+
+    // Use an index in memory. The index borrows `bytes`.
+    pub fn fromBytes(bytes: []align(section_alignment) const u8) Error!Index {
+        if (builtin.cpu.arch.endian() != .little) return error.UnsupportedPlatform;
+        if (bytes.len < @sizeOf(Header)) return error.InvalidIndex;
+
+        const header = std.mem.bytesToValue(Header, bytes[0..@sizeOf(Header)]);
+        if (!std.mem.eql(u8, &header.magic, &magic)) return error.InvalidIndex;
+        if (header.version != version) return error.UnsupportedIndexVersion;
+        if (header.header_size != @sizeOf(Header)) return error.InvalidIndex;
+
+        const terms = try records(TermEntry, bytes, header.terms);
+        const docs = try records(DocEntry, bytes, header.docs);
+        if (terms.len != header.term_count or docs.len != header.doc_count) return error.InvalidIndex;
+        const end_doc = std.math.add(u64, header.first_doc, header.doc_count) catch return error.InvalidIndex;
+        if (end_doc > @as(u64, std.math.maxInt(u32)) + 1) return error.InvalidIndex;
+
+        return .{
+            .header = header,
+            .postings = try section(bytes, header.postings),
+            .terms = terms,
+            .docs = docs,
+            .strings = try section(bytes, header.strings),
+        };
+    }
+
+    // Open an index file. Where supported the file is memory-mapped
+    // read-only; otherwise it is read into memory from `allocator`.
+    pub fn open(path: []const u8, allocator: std.mem.Allocator) !Index {
+        const file = try std.fs.cwd().openFile(path, .{});
+        defer file.close();
+
+        const size: usize = @intCast(try file.getEndPos());
+        if (size < @sizeOf(Header)) return error.InvalidIndex;
+
+        const mapping = try io.FileBytes.map(file, allocator);
+        errdefer mapping.unmap(allocator);
+        var index = try fromBytes(mapping.bytes);
+        index.file = mapping;
+        index.allocator = allocator;
+        return index;
+    }
+
+    pub fn close(self: *Index) void {
+        if (self.file) |mapping| mapping.unmap(self.allocator.?);
+        self.* = undefined;
+    }
+
+    pub fn firstDocument(self: *const Index) u32 {
+        return @intCast(self.header.first_doc);
+    }
+
+    pub fn documentCount(self: *const Index) usize {
+        return self.docs.len;
+    }
+
+    pub fn documentName(self: *const Index, doc: u32) Error![]const u8 {
+        if (doc < self.header.first_doc or doc - self.header.first_doc >= self.docs.len) return error.InvalidIndex;
+        const entry = self.docs[doc - self.header.first_doc];
+        return slice(self.strings, entry.name_offset, entry.name_len);
+    }
+
+    pub fn termCount(self: *const Index) usize {
+        return self.terms.len;
+    }
+
+    pub fn term(self: *const Index, index: usize) Error![]const u8 {
+        const entry = self.terms[index];
+        return slice(self.strings, entry.string_offset, entry.string_len);
+    }
+
+    // Posting list of `word` (a term as the tokenizer produces it), or null
+    pub fn find(self: *const Index, word: []const u8) Error!?Postings {
+        var low: usize = 0;
+        var high: usize = self.terms.len;
+        while (low < high) {
+            const middle = low + (high - low) / 2;
+            switch (std.mem.order(u8, try self.term(middle), word)) {
+                .lt => low = middle + 1,
+                .gt => high = middle,
+                .eq => return try self.postingsAt(middle),
+            }
+        }
+        return null;
+    }
+
+    fn postingsAt(self: *const Index, index: usize) Error!Postings {
+        const entry = self.terms[index];
+        return .{
+            .bytes = try slice(self.postings, entry.postings_offset, entry.postings_len),
+            .doc_freq = entry.doc_freq,
+        };
+    }
+};
+
+fn slice(bytes: []const u8, offset: u64, len: u64) Error![]const u8 {
+    if (offset > bytes.len or len > bytes.len - offset) return error.InvalidIndex;
+    return bytes[@intCast(offset)..][0..@intCast(len)];
+}
+
+fn section(bytes: []const u8, entry: Section) Error![]const u8 {
+    if (entry.offset % section_alignment != 0) return error.InvalidIndex;
+    return slice(bytes, entry.offset, entry.len);
+}
+
+fn records(comptime T: type, bytes: []const u8, entry: Section) Error![]const T {
+    const data = try section(bytes, entry);
+    if (data.len % @sizeOf(T) != 0) return error.InvalidIndex;
+    const items: [*]const T = @ptrCast(@alignCast(data.ptr));
+    return items[0 .. data.len / @sizeOf(T)];
+}
+
+// =============================================================================
+// MERGING
+// =============================================================================
+
+// Merge segments holding consecutive document ranges, in document order,
+// into one index written to `file` (seekable). Posting lists of a term are
+// concatenated, so the merge streams and only holds the term directory.
+pub fn merge(allocator: std.mem.Allocator, segments: []const Index, file: std.fs.File) !void {
+    for (segments[0..segments.len -| 1], segments[@min(1, segments.len)..]) |segment, following| {
+        if (segment.header.first_doc + segment.header.doc_count != following.header.first_doc) return error.SegmentOrder;
+    }
+
+    const Cursor = struct {
+        segment: u32,
+        term: usize,
+        string: []const u8,
+
+        fn order(_: void, a: @This(), b: @This()) std.math.Order {
+            const by_term = std.mem.order(u8, a.string, b.string);
+            return if (by_term != .eq) by_term else std.math.order(a.segment, b.segment);
+        }
+    };
+    var queue = std.PriorityQueue(Cursor, void, Cursor.order).init(allocator, {});
+    defer queue.deinit();
+    for (segments, 0..) |*segment, index| {
+        if (segment.termCount() > 0) try queue.add(.{ .segment = @intCast(index), .term = 0, .string = try segment.term(0) });
+    }
+
+    var entries = std.ArrayList(TermEntry).init(allocator);
+    defer entries.deinit();
+    var strings = std.ArrayList([]const u8).init(allocator);
+    defer strings.deinit();
+
+    var out = try IndexWriter.begin(file);
+    if (segments.len > 0) out.header.first_doc = segments[0].header.first_doc;
+    for (segments) |segment| out.header.doc_count += segment.header.doc_count;
+
+    const postings_start = try out.startSection();
+    var string_offset: u64 = 0;
+    while (queue.removeOrNull()) |first| {
+        const postings_offset = out.offset - postings_start;
+        var entry = TermEntry{
+            .postings_offset = postings_offset,
+            .postings_len = 0,
+            .string_offset = string_offset,
+            .string_len = @intCast(first.string.len),
+            .doc_freq = 0,
+            .last_doc = 0,
+        };
+
+        // Segments holding the term come out of the queue in segment order
+        var cursor = first;
+        while (true) {
+            const segment = &segments[cursor.segment];
+            const source = segment.terms[cursor.term];
+            const bytes = (try segment.postingsAt(cursor.term)).bytes;
+            if (entry.doc_freq == 0) {
+                try out.writeAll(bytes);
+            } else {
+                // The first document id is absolute: make it a delta
+                var pos: usize = 0;
+                const doc = try readVarint(bytes, &pos);
+                if (doc <= entry.last_doc) return error.InvalidIndex;
+                var delta: [max_varint_len]u8 = undefined;
+                try out.writeAll(encodeVarint(&delta, doc - entry.last_doc));
+                try out.writeAll(bytes[pos..]);
+            }
+            entry.doc_freq += source.doc_freq;
+            entry.last_doc = source.last_doc;
+
+            if (cursor.term + 1 < segment.termCount()) {
+                try queue.add(.{ .segment = cursor.segment, .term = cursor.term + 1, .string = try segment.term(cursor.term + 1) });
+            }
+            const following = queue.peek() orelse break;
+            if (!std.mem.eql(u8, following.string, first.string)) break;
+            cursor = queue.remove();
+        }
+
+        entry.postings_len = out.offset - postings_start - postings_offset;
+        try entries.append(entry);
+        try strings.append(first.string);
+        string_offset += first.string.len;
+    }
+    out.header.postings = out.endSection(postings_start);
+    out.header.term_count = entries.items.len;
+
+    const terms_start = try out.startSection();
+    try out.writeAll(std.mem.sliceAsBytes(entries.items));
+    out.header.terms = out.endSection(terms_start);
+
+    // Names follow the term strings, segment by segment
+    const docs_start = try out.startSection();
+    var name_offset = string_offset;
+    for (segments) |segment| {
+        for (segment.docs) |doc| {
+            try out.writeRecord(DocEntry{ .name_offset = name_offset, .name_len = doc.name_len });
+            name_offset += doc.name_len;
+        }
+    }
+    out.header.docs = out.endSection(docs_start);
+
+    const strings_start = try out.startSection();
+    for (strings.items) |string| try out.writeAll(string);
+    for (segments) |*segment| {
+        for (0..segment.docs.len) |index| {
+            try out.writeAll(try segment.documentName(@intCast(segment.header.first_doc + index)));
+        }
+    }
+    out.header.strings = out.endSection(strings_start);
+
+    try out.finish();
+}
+
+// =============================================================================
+// INDEXING
+// =============================================================================
+
+// Parses documents into a SegmentBuilder, streaming their text through the
+// tokenizer. Runs and tables are never stored, and parser and document
+// storage are reused from one document to the next.
+pub const Indexer = struct {
+    parser: formatted_parser.FormattedParser,
+    builder: SegmentBuilder,
+    tokenizer: Tokenizer = .{},
+    options: Options,
+    input: std.io.FixedBufferStream([]const u8),
+
+    const retain_limit = 256 * 1024;
+
+    // Heap-allocated: the parser keeps pointers into it
+    pub fn create(allocator: std.mem.Allocator, first_doc: u32, options: Options) !*Indexer {
+        const self = try allocator.create(Indexer);
+        errdefer allocator.destroy(self);
+
+        self.input = std.io.fixedBufferStream(@as([]const u8, ""));
+        self.parser = try formatted_parser.FormattedParser.init(self.input.reader().any(), allocator);
+        self.builder = SegmentBuilder.init(allocator, first_doc);
+        self.tokenizer = .{};
+        self.options = options;
+        self.parser.streamText(.{ .context = self, .text = text, .boundary = boundary });
+        return self;
+    }
+
+    pub fn destroy(self: *Indexer) void {
+        const allocator = self.builder.allocator;
+        self.parser.deinit();
+        self.builder.deinit();
+        allocator.destroy(self);
+    }
+
+    // Index the next document. A document that fails to parse keeps its id
+    // and the terms read before the error.
+    pub fn addDocument(self: *Indexer, name: []const u8, source: std.io.AnyReader) !void {
+        _ = try self.builder.beginDocument(name);
+        self.tokenizer.reset();
+        self.parser.reset(source);
+
+        var document = self.parser.parse() catch |err| {
+            try self.tokenizer.boundary(&self.builder);
+            return err;
+        };
+        try self.tokenizer.boundary(&self.builder);
+        document.reset(retain_limit);
+        self.parser.recycleDocument(document);
+    }
+
+    fn text(context: *anyopaque, run_text: []const u8, format: doc_model.CharFormat) anyerror!void {
+        const self: *Indexer = @ptrCast(@alignCast(context));
+        var flags: u8 = 0;
+        if (format.bold) flags |= flag_bold;
+        if ((format.font_size orelse 0) >= self.options.heading_size) flags |= flag_heading;
+        try self.tokenizer.feed(run_text, flags, &self.builder);
+    }
+
+    fn boundary(context: *anyopaque) anyerror!void {
+        const self: *Indexer = @ptrCast(@alignCast(context));
+        try self.tokenizer.boundary(&self.builder);
+    }
+};
+
+pub const BuildResult = struct {
+    documents: usize = 0,
+    failed: usize = 0, // Unreadable or invalid RTF; indexed with what was read
+    segments: usize = 0,
+};
+
+// Index `paths` into the index file `out_path`. Document ids are positions in
+// `paths`. Each thread indexes a contiguous share of the files, writing
+// segments next to `out_path`, which are merged and deleted at the end.
+pub fn buildFiles(allocator: std.mem.Allocator, paths: []const []const u8, out_path: []const u8, options: Options) !BuildResult {
+    if (paths.len > @as(usize, std.math.maxInt(u32)) + 1) return error.TooManyDocuments;
+
+    const cpus = if (options.threads > 0) options.threads else std.Thread.getCpuCount() catch 1;
+    const thread_count = @max(1, @min(cpus, paths.len));
+
+    const workers = try allocator.alloc(Worker, thread_count);
+    defer allocator.free(workers);
+    for (workers, 0..) |*worker, index| {
+        worker.* = .{
+            .allocator = allocator,
+            .paths = paths,
+            .first = paths.len * index / thread_count,
+            .end = paths.len * (index + 1) / thread_count,
+            .out_path = out_path,
+            .options = options,
+            .id = index,
+        };
+    }
+    defer {
+        for (workers) |*worker| worker.deinit();
+    }
+
+    const threads = try allocator.alloc(?std.Thread, thread_count);
+    defer allocator.free(threads);
+    for (workers, threads) |*worker, *thread| {
+        thread.* = std.Thread.spawn(.{}, Worker.run, .{worker}) catch null;
+        if (thread.* == null) worker.run(); // Index this share here instead
+    }
+    for (threads) |thread| {
+        if (thread) |handle| handle.join();
+    }
+
+    // Segments are removed whether or not the build succeeds
+    var segment_paths = std.ArrayList([]const u8).init(allocator);
+    defer segment_paths.deinit();
+    defer {
+        for (segment_paths.items) |path| std.fs.cwd().deleteFile(path) catch {};
+    }
+    for (workers) |*worker| {
+        segment_paths.appendSlice(worker.segments.items) catch |err| {
+            for (worker.segments.items) |path| std.fs.cwd().deleteFile(path) catch {};
+            return err;
+        };
+    }
+
+    var result = BuildResult{ .documents = paths.len, .segments = segment_paths.items.len };
+    for (workers) |*worker| {
+        try worker.result;
+        result.failed += worker.failed;
+    }
+
+    const segments = try allocator.alloc(Index, segment_paths.items.len);
+    defer allocator.free(segments);
+    var opened: usize = 0;
+    defer {
+        for (segments[0..opened]) |*segment| segment.close();
+    }
+    for (segment_paths.items, segments) |path, *segment| {
+        segment.* = try Index.open(path, allocator);
+        opened += 1;
+    }
+
+    const file = try std.fs.cwd().createFile(out_path, .{});
+    defer file.close();
+    try merge(allocator, segments, file);
+    return result;
+}
+
+const Worker = struct {
+    allocator: std.mem.Allocator,
+    paths: []const []const u8,
+    first: usize,
+    end: usize,
+    out_path: []const u8,
+    options: Options,
+    id: usize,
+    segments: std.ArrayListUnmanaged([]const u8) = .{}, // Written, in document order
+    failed: usize = 0,
+    result: anyerror!void = {},
+
+    fn run(self: *Worker) void {
+        self.result = self.indexShare();
+    }
+
+    fn deinit(self: *Worker) void {
+        for (self.segments.items) |path| self.allocator.free(path);
+        self.segments.deinit(self.allocator);
+    }
+
+    fn indexShare(self: *Worker) !void {
+        if (self.first == self.end) return;
+        const indexer = try Indexer.create(self.allocator, @intCast(self.first), self.options);
+        defer indexer.destroy();
+
+        for (self.paths[self.first..self.end], self.first..) |path, doc| {
+            if (indexer.builder.postings_bytes >= self.options.segment_bytes) {
+                try self.writeSegment(&indexer.builder);
+                indexer.builder.reset(@intCast(doc));
+            }
+
+            const file = std.fs.cwd().openFile(path, .{}) catch {
+                _ = try indexer.builder.beginDocument(path);
+                self.failed += 1;
+                continue;
+            };
+            defer file.close();
+            indexer.addDocument(path, file.reader().any()) catch |err| switch (err) {
+                error.OutOfMemory => return err,
+                else => self.failed += 1,
+            };
+        }
+        try self.writeSegment(&indexer.builder);
+    }
+
+    fn writeSegment(self: *Worker, builder: *const SegmentBuilder) !void {
+        const path = try std.fmt.allocPrint(self.allocator, "{s}.{d}.{d}.seg", .{ self.out_path, self.id, self.segments.items.len });
+        self.segments.append(self.allocator, path) catch |err| {
+            self.allocator.free(path);
+            return err;
+        };
+
+        const file = try std.fs.cwd().createFile(path, .{});
+        defer file.close();
+        try builder.write(file);
+    }
+};
+
+// =============================================================================
+// TESTS
+// =============================================================================
+
+const TermCollector = struct {
+    terms: std.ArrayList(u8),
+    flags: std.ArrayList(u8),
+
+    pub fn addTerm(self: *TermCollector, term: []const u8, position: u32, flags: u8) !void {
+        try self.terms.writer().print("{s}@{d} ", .{ term, position });
+        try self.flags.append(flags);
+    }
+};
+
+test "tokenizer splits, lowercases and joins pieces" {
+    const testing = std.testing;
+
+    var collector = TermCollector{
+        .terms = std.ArrayList(u8).init(testing.allocator),
+        .flags = std.ArrayList(u8).init(testing.allocator),
+    };
+    defer collector.terms.deinit();
+    defer collector.flags.deinit();
+
+    var tokenizer = Tokenizer{};
+    try tokenizer.feed("Hello, wor", 0, &collector);
+    try tokenizer.feed("ld\tx2 ", flag_bold, &collector); // "world" spans two runs
+    try tokenizer.feed("caf\xc3\xa9\xe2\x80\x94na\xc3\xafve", 0, &collector); // Em dash separates
+    try tokenizer.boundary(&collector);
+    try tokenizer.feed("end", flag_heading, &collector);
+    try tokenizer.boundary(&collector);
+    try tokenizer.feed("a" ** (max_term_len + 1) ++ " after", 0, &collector);
+    try tokenizer.boundary(&collector);
+
+    try testing.expectEqualStrings("hello@0 world@1 x2@2 caf\xc3\xa9@3 na\xc3\xafve@4 end@5 after@7 ", collector.terms.items);
+    try testing.expectEqualSlices(u8, &.{ 0, flag_bold, flag_bold, 0, 0, flag_heading, 0 }, collector.flags.items);
+
+    var buffer: [max_term_len]u8 = undefined;
+    try testing.expectEqualStrings("rtf", queryTerm(&buffer, "RTF").?);
+    try testing.expect(queryTerm(&buffer, "two words") == null);
+}
+
+test "parser streams text without building runs" {
+    const testing = std.testing;
+
+    const Recorder = struct {
+        out: std.ArrayList(u8),
+
+        fn text(context: *anyopaque, run_text: []const u8, format: doc_model.CharFormat) anyerror!void {
+            const self: *@This() = @ptrCast(@alignCast(context));
+            try self.out.appendSlice(if (format.bold) "*" else "");
+            try self.out.appendSlice(run_text);
+        }
+
+        fn boundary(context: *anyopaque) anyerror!void {
+            const self: *@This() = @ptrCast(@alignCast(context));
+            try self.out.append('|');
+        }
+    };
+    var recorder = Recorder{ .out = std.ArrayList(u8).init(testing.allocator) };
+    defer recorder.out.deinit();
+
+    const rtf_data = "{\\rtf1 One \\b two\\b0\\par \\trowd\\cellx1000 Cell\\cell\\row\\par End}";
+    var stream = std.io.fixedBufferStream(rtf_data);
+    var parser = try formatted_parser.FormattedParser.init(stream.reader().any(), testing.allocator);
+    defer parser.deinit();
+    parser.streamText(.{ .context = &recorder, .text = Recorder.text, .boundary = Recorder.boundary });
+    var document = try parser.parse();
+    defer document.deinit();
+
+    try testing.expectEqualStrings("One *two|Cell|||End", recorder.out.items);
+    for (document.content.items) |element| {
+        try testing.expect(element != .text_run and element != .table);
+    }
+}
+
+fn writeSegmentForTest(dir: std.fs.Dir, name: []const u8, first_doc: u32, docs: []const []const u8) !void {
+    const indexer = try Indexer.create(std.testing.allocator, first_doc, .{});
+    defer indexer.destroy();
+    for (docs, 0..) |rtf_data, index| {
+        var doc_name: [16]u8 = undefined;
+        var stream = std.io.fixedBufferStream(rtf_data);
+        try indexer.addDocument(try std.fmt.bufPrint(&doc_name, "doc{d}", .{first_doc + index}), stream.reader().any());
+    }
+
+    const file = try dir.createFile(name, .{ .read = true });
+    defer file.close();
+    try indexer.builder.write(file);
+}
+
+test "segments merge into a queryable index" {
+    const testing = std.testing;
+
+    var tmp = testing.tmpDir(.{});
+    defer tmp.cleanup();
+
+    try writeSegmentForTest(tmp.dir, "a.seg", 0, &.{
+        "{\\rtf1 {\\fs36 Annual report}\\par The report covers \\b revenue\\b0 .}",
+        "{\\rtf1 Nothing to see}",
+    });
+    try writeSegmentForTest(tmp.dir, "b.seg", 2, &.{
+        "{\\rtf1 Revenue grew; see the report.}",
+    });
+
+    var path_buffer: [std.fs.max_path_bytes]u8 = undefined;
+    var segments: [2]Index = undefined;
+    segments[0] = try Index.open(try tmp.dir.realpath("a.seg", &path_buffer), testing.allocator);
+    defer segments[0].close();
+    segments[1] = try Index.open(try tmp.dir.realpath("b.seg", &path_buffer), testing.allocator);
+    defer segments[1].close();
+
+    // Out of order segments are refused
+    const unordered = try tmp.dir.createFile("bad.idx", .{ .read = true });
+    defer unordered.close();
+    try testing.expectError(error.SegmentOrder, merge(testing.allocator, &.{ segments[1], segments[0] }, unordered));
+
+    const merged_file = try tmp.dir.createFile("all.idx", .{ .read = true });
+    try merge(testing.allocator, &segments, merged_file);
+    merged_file.close();
+    var index = try Index.open(try tmp.dir.realpath("all.idx", &path_buffer), testing.allocator);
+    defer index.close();
+
+    try testing.expectEqual(@as(usize, 3), index.documentCount());
+    try testing.expectEqualStrings("doc2", try index.documentName(2));
+    try testing.expect(try index.find("missing") == null);
+
+    // "report": heading and body of doc 0, then doc 2
+    var postings = (try index.find("report")).?;
+    try testing.expectEqual(@as(u32, 2), postings.doc_freq);
+    var first = (try postings.next()).?;
+    try testing.expectEqual(@as(u32, 0), first.doc);
+    try testing.expectEqual(Position{ .position = 1, .flags = flag_heading }, (try first.positions.next()).?);
+    try testing.expectEqual(Position{ .position = 3, .flags = 0 }, (try first.positions.next()).?);
+    try testing.expect(try first.positions.next() == null);
+    const second = (try postings.next()).?;
+    try testing.expectEqual(@as(u32, 2), second.doc);
+    try testing.expect(try postings.next() == null);
+
+    var revenue = (try index.find("revenue")).?;
+    var bold = (try revenue.next()).?;
+    try testing.expectEqual(Position{ .position = 5, .flags = flag_bold }, (try bold.positions.next()).?);
+}
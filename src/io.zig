@@ -0,0 +1,56 @@
+const std = @import("std");
+const builtin = @import("builtin");
+
+// =============================================================================
+// OUTPUT AND FILE I/O
+// =============================================================================
+// Buffered writers shared by the exporters, and whole-file reads that map
+// the file where the platform allows it, for snapshots and index segments.
+
+// Exporters write through a buffer this size, so their writer sees few
+// large writes
+pub const export_buffer_size = 64 * 1024;
+
+pub fn ExportWriter(comptime Writer: type) type {
+    return std.io.BufferedWriter(export_buffer_size, Writer);
+}
+
+pub fn exportWriter(writer: anytype) ExportWriter(@TypeOf(writer)) {
+    return .{ .unbuffered_writer = writer };
+}
+
+// Whether documents can be backed by a read-only file mapping
+pub const supports_mmap = builtin.os.tag != .windows and builtin.os.tag != .wasi;
+
+// The whole of a file, read-only and 8-byte aligned: memory-mapped where
+// supported, otherwise read into memory from the allocator given to map().
+pub const FileBytes = struct {
+    bytes: []align(8) const u8,
+    mapped: bool,
+
+    pub fn map(file: std.fs.File, allocator: std.mem.Allocator) !FileBytes {
+        const size: usize = @intCast(try file.getEndPos());
+        if (comptime supports_mmap) {
+            if (size > 0) {
+                const mapping = try std.posix.mmap(null, size, std.posix.PROT.READ, .{ .TYPE = .PRIVATE }, file.handle, 0);
+                return .{ .bytes = mapping, .mapped = true };
+            }
+        }
+
+        const words = try allocator.alloc(u64, std.math.divCeil(usize, size, 8) catch unreachable);
+        errdefer allocator.free(words);
+        const bytes = std.mem.sliceAsBytes(words)[0..size];
+        try file.reader().readNoEof(bytes);
+        return .{ .bytes = bytes, .mapped = false };
+    }
+
+    // `allocator` must be the one given to map()
+    pub fn unmap(self: FileBytes, allocator: std.mem.Allocator) void {
+        if (self.mapped) {
+            if (comptime supports_mmap) std.posix.munmap(@alignCast(self.bytes));
+            return;
+        }
+        const words: [*]const u64 = @ptrCast(self.bytes.ptr);
+        allocator.free(words[0 .. std.math.divCeil(usize, self.bytes.len, 8) catch unreachable]);
+    }
+};
@@ -0,0 +1,340 @@
+const std = @import("std");
+const doc_model = @import("document_model.zig");
+const io = @import("io.zig");
+
+// =============================================================================
+// JSON EXPORT
+// =============================================================================
+// Writes a document as JSON in one pass, for pipelines that would otherwise
+// walk the C accessors a call at a time. The output is a series of records:
+// fonts, colors, then paragraphs, tables and page breaks in document order.
+//
+//   {"type":"font","id":0,"name":"Arial","family":"swiss","charset":0}
+//   {"type":"color","id":1,"red":255,"green":0,"blue":0}
+//   {"type":"paragraph","index":0,"alignment":"center","runs":[
+//     {"text":"Hello ","bold":true,"font_id":0},
+//     {"text":"our site","url":"https://example.com"},
+//     {"line_break":true},
+//     {"image":{"format":"png","width":1440,"height":720,"bytes":5321}}]}
+//   {"type":"table","index":0,"rows":[{"height":0,"cells":[{"width":1000,"runs":[...]}]}]}
+//   {"type":"page_break"}
+//
+// With Options.lines each record is one line (JSON Lines). Otherwise they
+// are wrapped as {"fonts":[...],"colors":[...],"blocks":[...]}. Run and
+// paragraph keys only appear when they differ from the defaults; paragraph
+// keys come from the text run that opens the paragraph, if one does.
+//
+// Text is written as UTF-8. The parser keeps \'xx bytes as they are, so
+// bytes that are not part of a UTF-8 sequence are decoded through the
+// document's code page, and written as U+FFFD where it is not decoded.
+
+pub const Options = struct {
+    lines: bool = false,
+};
+
+pub fn exportJson(document: *const doc_model.Document, writer: anytype, options: Options) !void {
+    var buffered = io.exportWriter(writer);
+    var exporter = Exporter(@TypeOf(buffered.writer())){ .out = buffered.writer(), .lines = options.lines };
+    try exporter.write(document);
+    try buffered.flush();
+}
+
+fn Exporter(comptime Writer: type) type {
+    return struct {
+        out: Writer,
+        lines: bool,
+        code_page: u16 = 1252,
+        records: usize = 0, // In the current list
+        paragraph_open: bool = false,
+        items: usize = 0, // In the open paragraph
+        paragraph_count: usize = 0,
+        table_count: usize = 0,
+
+        const Self = @This();
+
+        fn write(self: *Self, document: *const doc_model.Document) !void {
+            self.code_page = document.code_page;
+            try self.startList("{\"fonts\":[");
+            for (document.font_table.items) |font| {
+                try self.startRecord("font");
+                try self.out.print(",\"id\":{d},\"name\":", .{font.id});
+                try writeString(self.out, font.name, self.code_page);
+                try self.out.print(",\"family\":\"{s}\",\"charset\":{d}}}", .{ @tagName(font.family), font.charset });
+                try self.endRecord();
+            }
+
+            try self.startList("],\"colors\":[");
+            for (document.color_table.items) |color| {
+                try self.startRecord("color");
+                try self.out.print(",\"id\":{d},\"red\":{d},\"green\":{d},\"blue\":{d}}}", .{ color.id, color.red, color.green, color.blue });
+                try self.endRecord();
+            }
+
+            try self.startList("],\"blocks\":[");
+            for (document.content.items) |element| {
+                switch (element) {
+                    .text_run => |run| {
+                        try self.startItem(run.para_format);
+                        try writeRun(self.out, run.text, run.char_format, self.code_page);
+                    },
+                    .hyperlink => |link| {
+                        try self.startItem(.{});
+                        try self.out.writeAll("{\"text\":");
+                        try writeString(self.out, link.display_text, self.code_page);
+                        try self.out.writeAll(",\"url\":");
+                        try writeString(self.out, link.url, self.code_page);
+                        try self.out.writeByte('}');
+                    },
+                    .line_break => {
+                        try self.startItem(.{});
+                        try self.out.writeAll("{\"line_break\":true}");
+                    },
+                    .image => |image| {
+                        try self.startItem(.{});
+                        try self.out.print("{{\"image\":{{\"format\":\"{s}\",\"width\":{d},\"height\":{d},\"bytes\":{d}}}}}", .{
+                            @tagName(image.format), image.width, image.height, image.data.len,
+                        });
+                    },
+                    .paragraph_break => {
+                        // Empty paragraphs are kept, so indices match the text's
+                        if (!self.paragraph_open) try self.openParagraph(.{});
+                        try self.closeParagraph();
+                    },
+                    .page_break => {
+                        try self.closeParagraph();
+                        try self.startRecord("page_break");
+                        try self.out.writeByte('}');
+                        try self.endRecord();
+                    },
+                    .table => |table| {
+                        try self.closeParagraph();
+                        try self.writeTable(table);
+                    },
+                }
+            }
+            try self.closeParagraph();
+            if (!self.lines) try self.out.writeAll("]}");
+        }
+
+        fn startList(self: *Self, prefix: []const u8) !void {
+            if (!self.lines) try self.out.writeAll(prefix);
+            self.records = 0;
+        }
+
+        // Leaves the record open after its "type" key
+        fn startRecord(self: *Self, kind: []const u8) !void {
+            if (!self.lines and self.records > 0) try self.out.writeByte(',');
+            try self.out.print("{{\"type\":\"{s}\"", .{kind});
+        }
+
+        fn endRecord(self: *Self) !void {
+            if (self.lines) try self.out.writeByte('\n');
+            self.records += 1;
+        }
+
+        // Open a paragraph if needed, then separate the next run from the last
+        fn startItem(self: *Self, para_format: doc_model.ParaFormat) !void {
+            if (!self.paragraph_open) try self.openParagraph(para_format);
+            if (self.items > 0) try self.out.writeByte(',');
+            self.items += 1;
+        }
+
+        fn openParagraph(self: *Self, para_format: doc_model.ParaFormat) !void {
+            try self.startRecord("paragraph");
+            try self.out.print(",\"index\":{d}", .{self.paragraph_count});
+            if (para_format.alignment != .left) try self.out.print(",\"alignment\":\"{s}\"", .{@tagName(para_format.alignment)});
+            inline for (.{ "left_indent", "right_indent", "first_line_indent", "space_before", "space_after" }) |name| {
+                const value = @field(para_format, name);
+                if (value != 0) try self.out.print(",\"" ++ name ++ "\":{d}", .{value});
+            }
+            try self.out.writeAll(",\"runs\":[");
+            self.paragraph_open = true;
+            self.items = 0;
+            self.paragraph_count += 1;
+        }
+
+        fn closeParagraph(self: *Self) !void {
+            if (!self.paragraph_open) return;
+            try self.out.writeAll("]}");
+            try self.endRecord();
+            self.paragraph_open = false;
+        }
+
+        fn writeTable(self: *Self, table: doc_model.Table) !void {
+            try self.startRecord("table");
+            try self.out.print(",\"index\":{d},\"rows\":[", .{self.table_count});
+            self.table_count += 1;
+
+            for (0..table.rowCount()) |row_index| {
+                if (row_index > 0) try self.out.writeByte(',');
+                try self.out.print("{{\"height\":{d},\"cells\":[", .{table.rows.items[row_index].height});
+                for (table.rowCells(row_index), 0..) |cell, cell_index| {
+                    if (cell_index > 0) try self.out.writeByte(',');
+                    try self.out.print("{{\"width\":{d},\"runs\":[", .{cell.width});
+                    for (table.cellRuns(cell), 0..) |run, run_index| {
+                        if (run_index > 0) try self.out.writeByte(',');
+                        try writeRun(self.out, run.text, run.char_format, self.code_page);
+                    }
+                    try self.out.writeAll("]}");
+                }
+                try self.out.writeAll("]}");
+            }
+            try self.out.writeAll("]}");
+            try self.endRecord();
+        }
+    };
+}
+
+fn writeRun(out: anytype, text: []const u8, format: doc_model.CharFormat, code_page: u16) !void {
+    try out.writeAll("{\"text\":");
+    try writeString(out, text, code_page);
+    inline for (std.meta.fields(doc_model.CharFormat)) |field| {
+        const value = @field(format, field.name);
+        if (field.type == bool) {
+            if (value) try out.writeAll(",\"" ++ field.name ++ "\":true");
+        } else if (value) |number| {
+            try out.print(",\"" ++ field.name ++ "\":{d}", .{number});
+        }
+    }
+    try out.writeByte('}');
+}
+
+// Bytes that cannot appear in a JSON string as they are
+const needs_escape = blk: {
+    var table = [_]bool{false} ** 256;
+    for (0..0x20) |byte| table[byte] = true;
+    table['"'] = true;
+    table['\\'] = true;
+    break :blk table;
+};
+
+// Quoted JSON string, decoded to UTF-8 through `code_page`
+pub fn writeString(out: anytype, text: []const u8, code_page: u16) !void {
+    try out.writeByte('"');
+    try doc_model.writeDecoded(out, text, code_page, writeEscaped);
+    try out.writeByte('"');
+}
+
+// Runs of ordinary bytes are written in one piece
+fn writeEscaped(out: anytype, text: []const u8) !void {
+    var start: usize = 0;
+    for (text, 0..) |byte, index| {
+        if (!needs_escape[byte]) continue;
+        try out.writeAll(text[start..index]);
+        switch (byte) {
+            '"' => try out.writeAll("\\\""),
+            '\\' => try out.writeAll("\\\\"),
+            '\n' => try out.writeAll("\\n"),
+            '\r' => try out.writeAll("\\r"),
+            '\t' => try out.writeAll("\\t"),
+            else => try out.print("\\u{x:0>4}", .{byte}),
+        }
+        start = index + 1;
+    }
+    try out.writeAll(text[start..]);
+}
+
+// =============================================================================
+// TESTS
+// =============================================================================
+
+const formatted_parser = @import("formatted_parser.zig");
+
+test "json export of a document" {
+    const testing = std.testing;
+
+    const rtf_data = "{\\rtf1{\\fonttbl{\\f0\\fswiss Arial;}}{\\colortbl;\\red255\\green0\\blue0;}" ++
+        "\\qc Say \\b \"hi\"\\b0\\line\\par\\par " ++
+        "\\trowd\\cellx1000\\cellx2000 A\\cell B\\tab C\\cell\\row\\par " ++
+        "{\\pict\\pngblip\\picw10\\pich20 89504e47}\\page End}";
+
+    var stream = std.io.fixedBufferStream(rtf_data);
+    var parser = try formatted_parser.FormattedParser.init(stream.reader().any(), testing.allocator);
+    defer parser.deinit();
+    var document = try parser.parse();
+    defer document.deinit();
+
+    var json = std.ArrayList(u8).init(testing.allocator);
+    defer json.deinit();
+    try exportJson(&document, json.writer(), .{});
+
+    // Valid JSON with the expected shape
+    const parsed = try std.json.parseFromSlice(std.json.Value, testing.allocator, json.items, .{});
+    defer parsed.deinit();
+    const root = parsed.value.object;
+    try testing.expectEqualStrings("Arial", root.get("fonts").?.array.items[0].object.get("name").?.string);
+    try testing.expectEqual(@as(i64, 255), root.get("colors").?.array.items[1].object.get("red").?.integer);
+
+    const blocks = root.get("blocks").?.array.items;
+    const first = blocks[0].object;
+    try testing.expectEqualStrings("paragraph", first.get("type").?.string);
+    try testing.expectEqualStrings("center", first.get("alignment").?.string);
+    const runs = first.get("runs").?.array.items;
+    try testing.expectEqualStrings("\"hi\"", runs[1].object.get("text").?.string);
+    try testing.expect(runs[1].object.get("bold").?.bool);
+    try testing.expect(runs[0].object.get("bold") == null);
+    try testing.expect(runs[2].object.get("line_break").?.bool);
+
+    // The empty second paragraph is kept
+    try testing.expectEqual(@as(usize, 0), blocks[1].object.get("runs").?.array.items.len);
+    try testing.expectEqual(@as(i64, 1), blocks[1].object.get("index").?.integer);
+
+    const table = blocks[2].object;
+    try testing.expectEqualStrings("table", table.get("type").?.string);
+    const cells = table.get("rows").?.array.items[0].object.get("cells").?.array.items;
+    try testing.expectEqual(@as(i64, 2000 - 1000), cells[1].object.get("width").?.integer);
+    try testing.expectEqualStrings("B\tC", cells[1].object.get("runs").?.array.items[0].object.get("text").?.string);
+
+    // Image metadata only, then the page break
+    var saw_image = false;
+    var saw_page = false;
+    for (blocks[3..]) |block| {
+        const kind = block.object.get("type").?.string;
+        if (std.mem.eql(u8, kind, "page_break")) saw_page = true;
+        if (std.mem.eql(u8, kind, "paragraph")) {
+            for (block.object.get("runs").?.array.items) |run| {
+                const image = run.object.get("image") orelse continue;
+                try testing.expectEqualStrings("png", image.object.get("format").?.string);
+                try testing.expectEqual(@as(i64, 4), image.object.get("bytes").?.integer);
+                saw_image = true;
+            }
+        }
+    }
+    try testing.expect(saw_image and saw_page);
+}
+
+test "json lines export and escaping" {
+    const testing = std.testing;
+
+    var stream = std.io.fixedBufferStream("{\\rtf1{\\fonttbl{\\f0 Arial;}}One\\par Two\\par}");
+    var parser = try formatted_parser.FormattedParser.init(stream.reader().any(), testing.allocator);
+    defer parser.deinit();
+    var document = try parser.parse();
+    defer document.deinit();
+
+    var json = std.ArrayList(u8).init(testing.allocator);
+    defer json.deinit();
+    try exportJson(&document, json.writer(), .{ .lines = true });
+
+    // One record per line, each valid on its own
+    var lines = std.mem.splitScalar(u8, std.mem.trimRight(u8, json.items, "\n"), '\n');
+    var count: usize = 0;
+    while (lines.next()) |line| : (count += 1) {
+        const parsed = try std.json.parseFromSlice(std.json.Value, testing.allocator, line, .{});
+        parsed.deinit();
+    }
+    try testing.expectEqual(@as(usize, 3), count); // Font and two paragraphs
+
+    var escaped = std.ArrayList(u8).init(testing.allocator);
+    defer escaped.deinit();
+    try writeString(escaped.writer(), "a\"b\\c\n\x01\xc3\xa9", 1252);
+    try testing.expectEqualStrings("\"a\\\"b\\\\c\\n\\u0001\xc3\xa9\"", escaped.items);
+
+    // Code page bytes kept by the parser
+    escaped.clearRetainingCapacity();
+    try writeString(escaped.writer(), "caf\xe9 \x80\xc3", 1252);
+    try testing.expectEqualStrings("\"caf\u{e9} \u{20ac}\u{c3}\"", escaped.items);
+    escaped.clearRetainingCapacity();
+    try writeString(escaped.writer(), "\xe9", 932);
+    try testing.expectEqualStrings("\"\u{fffd}\"", escaped.items);
+}
@@ -1,5 +1,8 @@
 const std = @import("std");
 const Parser = @import("rtf.zig").Parser;
+const inverted_index = @import("inverted_index.zig");
+const text_search = @import("search.zig");
+const io = @import("io.zig");
 
 pub fn main() !void {
     var gpa = std.heap.GeneralPurposeAllocator(.{}){};
@@ -12,10 +15,20 @@ pub fn main() !void {
     
     if (args.len < 2) {
         std.debug.print("Usage: {s} <rtf-file>\n", .{args[0]});
-        std.debug.print("Extracts plain text from RTF documents\n", .{});
+        std.debug.print("       {s} index build <index-file> <rtf-file>... (- reads paths from stdin)\n", .{args[0]});
+        std.debug.print("       {s} index query <index-file> <word>\n", .{args[0]});
+        std.debug.print("       {s} grep [-i] [-e <pattern>]... [<pattern>] <rtf-file>...\n", .{args[0]});
+        std.debug.print("Extracts plain text from RTF documents, or indexes and searches them\n", .{});
         return;
     }
     
+    if (std.mem.eql(u8, args[1], "index")) {
+        return indexCommand(allocator, args);
+    }
+    if (std.mem.eql(u8, args[1], "grep")) {
+        return grepCommand(allocator, args);
+    }
+    
     const file_path = args[1];
     
     // Open RTF file
@@ -37,4 +50,146 @@ pub fn main() !void {
     // Output extracted text
     const text = parser.getText();
     std.debug.print("{s}", .{text});
-}
\ No newline at end of file
+}
+
+fn indexCommand(allocator: std.mem.Allocator, args: []const [:0]u8) !void {
+    if (args.len < 4) {
+        std.debug.print("Usage: {s} index build|query <index-file> ...\n", .{args[0]});
+        return;
+    }
+    
+    const index_path = args[3];
+    if (std.mem.eql(u8, args[2], "build")) {
+        var paths = std.ArrayList([]const u8).init(allocator);
+        defer paths.deinit();
+        
+        // Paths from stdin, one per line
+        var stdin_paths: []u8 = &.{};
+        defer allocator.free(stdin_paths);
+        
+        for (args[4..]) |arg| {
+            if (std.mem.eql(u8, arg, "-")) {
+                allocator.free(stdin_paths);
+                stdin_paths = try std.io.getStdIn().readToEndAlloc(allocator, std.math.maxInt(usize));
+                var lines = std.mem.tokenizeAny(u8, stdin_paths, "\r\n");
+                while (lines.next()) |line| try paths.append(line);
+            } else {
+                try paths.append(arg);
+            }
+        }
+        
+        var timer = try std.time.Timer.start();
+        const result = inverted_index.buildFiles(allocator, paths.items, index_path, .{}) catch |err| {
+            std.debug.print("Error building index '{s}': {}\n", .{ index_path, err });
+            return;
+        };
+        std.debug.print("Indexed {d} documents ({d} failed) from {d} segments in {d} ms\n", .{
+            result.documents,
+            result.failed,
+            result.segments,
+            timer.read() / std.time.ns_per_ms,
+        });
+    } else if (std.mem.eql(u8, args[2], "query")) {
+        if (args.len < 5) {
+            std.debug.print("Usage: {s} index query <index-file> <word>\n", .{args[0]});
+            return;
+        }
+        
+        var index = inverted_index.Index.open(index_path, allocator) catch |err| {
+            std.debug.print("Error opening index '{s}': {}\n", .{ index_path, err });
+            return;
+        };
+        defer index.close();
+        
+        var buffer: [inverted_index.max_term_len]u8 = undefined;
+        const term = inverted_index.queryTerm(&buffer, args[4]) orelse {
+            std.debug.print("Not a single indexable word: '{s}'\n", .{args[4]});
+            return;
+        };
+        
+        var out = std.io.bufferedWriter(std.io.getStdOut().writer());
+        const writer = out.writer();
+        var postings = try index.find(term) orelse return;
+        while (try postings.next()) |occurrence| {
+            var positions = occurrence.positions;
+            var count: usize = 0;
+            var bold: usize = 0;
+            var heading: usize = 0;
+            while (try positions.next()) |position| {
+                count += 1;
+                if (position.flags & inverted_index.flag_bold != 0) bold += 1;
+                if (position.flags & inverted_index.flag_heading != 0) heading += 1;
+            }
+            try writer.print("{s}\t{d}\tbold={d}\theading={d}\n", .{ try index.documentName(occurrence.doc), count, bold, heading });
+        }
+        try out.flush();
+    } else {
+        std.debug.print("Unknown index command '{s}'\n", .{args[2]});
+    }
+}
+
+// Prints `file:offset:match` for every match, offsets into the RTF file
+fn grepCommand(allocator: std.mem.Allocator, args: []const [:0]u8) !void {
+    var patterns = std.ArrayList([]const u8).init(allocator);
+    defer patterns.deinit();
+    var files = std.ArrayList([]const u8).init(allocator);
+    defer files.deinit();
+    var options = text_search.Options{};
+    
+    var i: usize = 2;
+    while (i < args.len) : (i += 1) {
+        if (std.mem.eql(u8, args[i], "-i")) {
+            options.ignore_case = true;
+        } else if (std.mem.eql(u8, args[i], "-e") and i + 1 < args.len) {
+            i += 1;
+            try patterns.append(args[i]);
+        } else if (patterns.items.len == 0) {
+            try patterns.append(args[i]);
+        } else {
+            try files.append(args[i]);
+        }
+    }
+    if (patterns.items.len == 0 or files.items.len == 0) {
+        std.debug.print("Usage: {s} grep [-i] [-e <pattern>]... [<pattern>] <rtf-file>...\n", .{args[0]});
+        return;
+    }
+    
+    var out = std.io.bufferedWriter(std.io.getStdOut().writer());
+    defer out.flush() catch {};
+    
+    const Printer = struct {
+        writer: @TypeOf(out.writer()),
+        path: []const u8,
+        failed: bool = false,
+        
+        fn emit(context: *anyopaque, hit: *const text_search.Hit) bool {
+            const self: *@This() = @ptrCast(@alignCast(context));
+            self.writer.print("{s}:{d}:{s}\n", .{ self.path, hit.start, hit.text[0..hit.text_length] }) catch {
+                self.failed = true;
+                return false;
+            };
+            return true;
+        }
+    };
+    
+    for (files.items) |path| {
+        const data = mapFile(allocator, path) catch |err| {
+            std.debug.print("Error opening file '{s}': {}\n", .{ path, err });
+            continue;
+        };
+        defer data.unmap(allocator);
+        
+        var printer = Printer{ .writer = out.writer(), .path = path };
+        text_search.search(allocator, data.bytes, patterns.items, options, .{ .context = &printer, .emit = Printer.emit }) catch |err| {
+            if (printer.failed) return; // Output closed
+            std.debug.print("Error searching '{s}': {}\n", .{ path, err });
+        };
+    }
+}
+
+// Whole file contents, memory-mapped where supported
+fn mapFile(allocator: std.mem.Allocator, path: []const u8) !io.FileBytes {
+    const file = try std.fs.cwd().openFile(path, .{});
+    defer file.close();
+    return io.FileBytes.map(file, allocator);
+}
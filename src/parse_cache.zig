@@ -0,0 +1,308 @@
+const std = @import("std");
+
+// =============================================================================
+// CONTENT-ADDRESSED PARSE CACHE
+// =============================================================================
+// Caches parsed documents keyed by a hash of their RTF input, so parsing the
+// same bytes again returns one shared, reference-counted document.
+//
+// The cache is split into shards, each with its own lock and LRU list, so
+// concurrent lookups of different inputs rarely contend. A shard keeps to an
+// even share of the byte budget, but takes a value larger than that share by
+// evicting its own entries and then the oldest entries of other shards, so
+// any value up to the whole budget is cached. Values must provide:
+//   retain()                  - take an additional reference
+//   release()                 - drop a reference (destroying at zero)
+//   memoryFootprint() usize   - bytes charged against the budget
+
+pub fn ParseCache(comptime Value: type) type {
+    return struct {
+        const Self = @This();
+
+        pub const shard_count = 16;
+
+        allocator: std.mem.Allocator,
+        seed: u64,
+        max_bytes: usize,
+        shard_budget: usize,
+        total_bytes: std.atomic.Value(usize) = std.atomic.Value(usize).init(0),
+        shards: [shard_count]Shard,
+
+        // Two independently seeded hashes plus the length identify an input.
+        // The seed is random per cache so collisions cannot be precomputed.
+        pub const Key = struct {
+            hash: u64,
+            check: u64,
+            len: usize,
+        };
+
+        const Entry = struct {
+            key: Key,
+            value: *Value,
+            size: usize,
+            prev: ?*Entry = null,
+            next: ?*Entry = null,
+        };
+
+        const Shard = struct {
+            mutex: std.Thread.Mutex = .{},
+            map: std.AutoHashMapUnmanaged(Key, *Entry) = .{},
+            head: ?*Entry = null, // Most recently used
+            tail: ?*Entry = null, // Next to evict
+            bytes: usize = 0,
+
+            fn unlink(self: *Shard, entry: *Entry) void {
+                if (entry.prev) |prev| prev.next = entry.next else self.head = entry.next;
+                if (entry.next) |next| next.prev = entry.prev else self.tail = entry.prev;
+                entry.prev = null;
+                entry.next = null;
+            }
+
+            fn pushFront(self: *Shard, entry: *Entry) void {
+                entry.prev = null;
+                entry.next = self.head;
+                if (self.head) |head| head.prev = entry else self.tail = entry;
+                self.head = entry;
+            }
+        };
+
+        pub fn init(allocator: std.mem.Allocator, max_bytes: usize) Self {
+            return .{
+                .allocator = allocator,
+                .seed = std.crypto.random.int(u64),
+                .max_bytes = max_bytes,
+                .shard_budget = max_bytes / shard_count,
+                .shards = [_]Shard{.{}} ** shard_count,
+            };
+        }
+
+        // Drops the cache's references; documents still held by callers stay alive
+        pub fn deinit(self: *Self) void {
+            for (&self.shards) |*shard| {
+                var next = shard.head;
+                while (next) |entry| {
+                    next = entry.next;
+                    entry.value.release();
+                    self.allocator.destroy(entry);
+                }
+                shard.map.deinit(self.allocator);
+            }
+        }
+
+        pub fn keyFor(self: *const Self, data: []const u8) Key {
+            return .{
+                .hash = std.hash.Wyhash.hash(self.seed, data),
+                .check = std.hash.Wyhash.hash(~self.seed, data),
+                .len = data.len,
+            };
+        }
+
+        fn shardFor(self: *Self, key: Key) *Shard {
+            return &self.shards[@intCast(key.hash % shard_count)];
+        }
+
+        // Look up a cached value. On a hit the returned value carries a new
+        // reference owned by the caller.
+        pub fn get(self: *Self, key: Key) ?*Value {
+            const shard = self.shardFor(key);
+            shard.mutex.lock();
+            defer shard.mutex.unlock();
+
+            const entry = shard.map.get(key) orelse return null;
+            shard.unlink(entry);
+            shard.pushFront(entry);
+            entry.value.retain();
+            return entry.value;
+        }
+
+        // Offer a freshly parsed value. `value` carries one reference owned by
+        // the caller, and so does the result - which is the already cached
+        // value if another thread inserted the same input first. Values larger
+        // than the whole budget, or failing allocations, are simply not cached.
+        pub fn put(self: *Self, key: Key, value: *Value) *Value {
+            const size = value.memoryFootprint();
+            if (size > self.max_bytes) return value;
+
+            const shard = self.shardFor(key);
+            var evicted: ?*Entry = null;
+
+            const result = insert: {
+                shard.mutex.lock();
+                defer shard.mutex.unlock();
+
+                const slot = shard.map.getOrPut(self.allocator, key) catch break :insert value;
+                if (slot.found_existing) {
+                    const existing = slot.value_ptr.*;
+                    shard.unlink(existing);
+                    shard.pushFront(existing);
+                    existing.value.retain();
+                    break :insert existing.value;
+                }
+
+                const entry = self.allocator.create(Entry) catch {
+                    _ = shard.map.remove(key);
+                    break :insert value;
+                };
+                entry.* = .{ .key = key, .value = value, .size = size };
+                slot.value_ptr.* = entry;
+
+                value.retain(); // Reference held by the cache
+                shard.pushFront(entry);
+                shard.bytes += size;
+                _ = self.total_bytes.fetchAdd(size, .monotonic);
+
+                // Back to the shard's share, or to the new entry alone
+                while (shard.bytes > self.shard_budget and shard.tail != entry) {
+                    self.evictTail(shard, &evicted);
+                }
+
+                break :insert value;
+            };
+
+            // An entry over the shard's share takes room from the others
+            var index = (key.hash + 1) % shard_count;
+            while (index != key.hash % shard_count and self.total_bytes.load(.monotonic) > self.max_bytes) : (index = (index + 1) % shard_count) {
+                const other = &self.shards[@intCast(index)];
+                other.mutex.lock();
+                defer other.mutex.unlock();
+                while (other.tail != null and self.total_bytes.load(.monotonic) > self.max_bytes) {
+                    self.evictTail(other, &evicted);
+                }
+            }
+
+            // Release outside the lock - freeing a document can take a while
+            if (result != value) value.release();
+            while (evicted) |entry| {
+                evicted = entry.next;
+                entry.value.release();
+                self.allocator.destroy(entry);
+            }
+
+            return result;
+        }
+
+        // Unlink the shard's least recently used entry onto `evicted`, to be
+        // released once the lock is dropped. The shard must be locked.
+        fn evictTail(self: *Self, shard: *Shard, evicted: *?*Entry) void {
+            const victim = shard.tail.?;
+            shard.unlink(victim);
+            _ = shard.map.remove(victim.key);
+            shard.bytes -= victim.size;
+            _ = self.total_bytes.fetchSub(victim.size, .monotonic);
+            victim.next = evicted.*;
+            evicted.* = victim;
+        }
+    };
+}
+
+// =============================================================================
+// TESTS
+// =============================================================================
+
+const TestValue = struct {
+    refs: std.atomic.Value(u32) = std.atomic.Value(u32).init(1),
+    size: usize,
+
+    pub fn retain(self: *TestValue) void {
+        _ = self.refs.fetchAdd(1, .monotonic);
+    }
+
+    pub fn release(self: *TestValue) void {
+        _ = self.refs.fetchSub(1, .acq_rel);
+    }
+
+    pub fn memoryFootprint(self: *const TestValue) usize {
+        return self.size;
+    }
+
+    fn refCount(self: *const TestValue) u32 {
+        return self.refs.load(.acquire);
+    }
+};
+
+const TestCache = ParseCache(TestValue);
+
+test "parse cache - hit returns the shared value" {
+    const testing = std.testing;
+
+    var cache = TestCache.init(testing.allocator, TestCache.shard_count * 1000);
+    defer cache.deinit();
+
+    var value = TestValue{ .size = 10 };
+    const key = cache.keyFor("{\\rtf1 Hello}");
+
+    try testing.expect(cache.get(key) == null);
+    try testing.expect(cache.put(key, &value) == &value);
+    try testing.expectEqual(@as(u32, 2), value.refCount()); // Caller + cache
+
+    try testing.expect(cache.get(key) == &value);
+    try testing.expectEqual(@as(u32, 3), value.refCount());
+
+    // Same length, different bytes
+    try testing.expect(cache.get(cache.keyFor("{\\rtf1 Hellp}")) == null);
+
+    // A racing insert of the same input gets the cached value back
+    var duplicate = TestValue{ .size = 10 };
+    try testing.expect(cache.put(key, &duplicate) == &value);
+    try testing.expectEqual(@as(u32, 0), duplicate.refCount());
+}
+
+test "parse cache - evicts least recently used under the byte budget" {
+    const testing = std.testing;
+
+    // Room for one value per shard
+    var cache = TestCache.init(testing.allocator, TestCache.shard_count * 100);
+
+    var values: [64]TestValue = undefined;
+    for (&values, 0..) |*value, i| {
+        value.* = .{ .size = 60 };
+        var name: [16]u8 = undefined;
+        const key = cache.keyFor(std.fmt.bufPrint(&name, "doc {}", .{i}) catch unreachable);
+        _ = cache.put(key, value);
+    }
+
+    var cached: usize = 0;
+    for (values) |value| {
+        if (value.refCount() == 2) cached += 1;
+    }
+    try testing.expect(cached <= TestCache.shard_count);
+    try testing.expectEqual(@as(u32, 2), values[values.len - 1].refCount());
+
+    // Too large for the whole cache - handed back uncached
+    var huge = TestValue{ .size = 2000 };
+    try testing.expect(cache.put(cache.keyFor("huge"), &huge) == &huge);
+    try testing.expectEqual(@as(u32, 1), huge.refCount());
+
+    cache.deinit();
+    for (values) |value| {
+        try testing.expectEqual(@as(u32, 1), value.refCount());
+    }
+}
+
+test "parse cache - values larger than a shard's share are cached" {
+    const testing = std.testing;
+
+    var cache = TestCache.init(testing.allocator, TestCache.shard_count * 100);
+    defer cache.deinit();
+
+    var small = [_]TestValue{.{ .size = 50 }} ** 8;
+    for (&small, 0..) |*value, i| {
+        var name: [16]u8 = undefined;
+        _ = cache.put(cache.keyFor(std.fmt.bufPrint(&name, "small {}", .{i}) catch unreachable), value);
+    }
+
+    // Ten shards' worth: kept, with the other shards making room
+    var large = TestValue{ .size = 1000 };
+    const large_key = cache.keyFor("large");
+    try testing.expect(cache.put(large_key, &large) == &large);
+    try testing.expect(cache.get(large_key) == &large);
+    large.release();
+    try testing.expect(cache.total_bytes.load(.monotonic) <= cache.max_bytes);
+
+    // A second one pushes the first out
+    var larger = TestValue{ .size = 1200 };
+    try testing.expect(cache.put(cache.keyFor("larger"), &larger) == &larger);
+    try testing.expectEqual(@as(u32, 1), large.refCount());
+    try testing.expectEqual(@as(u32, 2), larger.refCount());
+    try testing.expect(cache.total_bytes.load(.monotonic) <= cache.max_bytes);
+}
@@ -0,0 +1,482 @@
+const std = @import("std");
+const doc_model = @import("document_model.zig");
+const scanner = @import("scanner.zig");
+
+// =============================================================================
+// HEADER PROBE
+// =============================================================================
+// Reads what a document says about itself - RTF version, character set, code
+// page, default font, font and color tables and the \info group - and stops
+// at the first body content, without parsing the rest. Only the header is
+// read, so the time taken does not grow with the document.
+//
+// The scanner (see scanner.zig) is run with `read_destinations` set; groups
+// of the header that are not wanted (stylesheet, list tables, {\*...}) are
+// stepped over as a whole.
+
+pub const Charset = enum { ansi, mac, pc, pca };
+
+pub const Font = struct {
+    id: u16,
+    name: [:0]const u8,
+    family: doc_model.FontInfo.FontFamily = .dontcare,
+    charset: u8 = 0,
+};
+
+// Layout matches rtf_time in c_api.h. All zero when not given.
+pub const Time = extern struct {
+    year: u16 = 0,
+    month: u8 = 0,
+    day: u8 = 0,
+    hour: u8 = 0,
+    minute: u8 = 0,
+    second: u8 = 0,
+    reserved: u8 = 0,
+};
+
+pub const Probe = struct {
+    version: u32 = 0, // \rtfN
+    charset: Charset = .ansi,
+    code_page: ?u16 = null, // \ansicpgN
+    default_font: ?u16 = null, // \deffN
+    fonts: []const Font = &.{},
+    colors: []const ?u32 = &.{}, // 0xRRGGBB by color number, null for auto
+
+    // \info
+    title: [:0]const u8 = "",
+    subject: [:0]const u8 = "",
+    author: [:0]const u8 = "",
+    manager: [:0]const u8 = "",
+    company: [:0]const u8 = "",
+    last_author: [:0]const u8 = "", // \operator
+    category: [:0]const u8 = "",
+    keywords: [:0]const u8 = "",
+    comment: [:0]const u8 = "",
+    created: Time = .{},
+    revised: Time = .{},
+    printed: Time = .{},
+    pages: ?u32 = null,
+    words: ?u32 = null,
+    characters: ?u32 = null,
+    characters_with_spaces: ?u32 = null,
+    editing_minutes: ?u32 = null,
+
+    header_length: usize = 0, // Input bytes before the body
+};
+
+// Names, fonts and colors are allocated from `allocator` and not freed on
+// their own; pass an arena.
+pub fn probe(allocator: std.mem.Allocator, data: []const u8) !Probe {
+    var prober = Prober{ .allocator = allocator };
+    prober.probe.header_length = data.len;
+
+    var tokens = scanner.Scanner.init(data);
+    tokens.read_destinations = true;
+    while (try tokens.next()) |token| {
+        if (!try prober.header(&tokens, token)) {
+            prober.probe.header_length = token.start;
+            break;
+        }
+    }
+    prober.probe.fonts = prober.fonts.items;
+    prober.probe.colors = prober.colors.items;
+    return prober.probe;
+}
+
+const HeaderWord = enum { rtf, ansi, mac, pc, pca, deff, ansicpg, body };
+
+const header_words = std.StaticStringMap(HeaderWord).initComptime(.{
+    .{ "rtf", .rtf },
+    .{ "ansi", .ansi },
+    .{ "mac", .mac },
+    .{ "pc", .pc },
+    .{ "pca", .pca },
+    .{ "deff", .deff },
+    .{ "ansicpg", .ansicpg },
+    // Paragraph, section and table starts: the body has begun
+    .{ "pard", .body },
+    .{ "plain", .body },
+    .{ "par", .body },
+    .{ "sectd", .body },
+    .{ "sect", .body },
+    .{ "trowd", .body },
+    .{ "page", .body },
+    .{ "line", .body },
+});
+
+const HeaderGroup = enum { fonttbl, colortbl, info, skip };
+
+// Groups at the root that belong to the header; {\*...} groups do too
+const header_groups = std.StaticStringMap(HeaderGroup).initComptime(.{
+    .{ "fonttbl", .fonttbl },
+    .{ "colortbl", .colortbl },
+    .{ "info", .info },
+    .{ "stylesheet", .skip },
+    .{ "listtable", .skip },
+    .{ "listoverridetable", .skip },
+    .{ "revtbl", .skip },
+    .{ "rsidtbl", .skip },
+    .{ "filetbl", .skip },
+    .{ "generator", .skip },
+    .{ "pgdsctbl", .skip },
+    .{ "xmlnstbl", .skip },
+});
+
+const font_families = std.StaticStringMap(doc_model.FontInfo.FontFamily).initComptime(.{
+    .{ "fnil", .dontcare },
+    .{ "froman", .roman },
+    .{ "fswiss", .swiss },
+    .{ "fmodern", .modern },
+    .{ "fscript", .script },
+    .{ "fdecor", .decorative },
+    .{ "ftech", .dontcare },
+    .{ "fbidi", .dontcare },
+});
+
+const InfoWord = enum {
+    title, subject, author, manager, company, operator, category, keywords, doccomm,
+    creatim, revtim, printim,
+    yr, mo, dy, hr, min, sec,
+    nofpages, nofwords, nofchars, nofcharsws, edmins,
+};
+
+const info_words = std.StaticStringMap(InfoWord).initComptime(.{
+    .{ "title", .title },
+    .{ "subject", .subject },
+    .{ "author", .author },
+    .{ "manager", .manager },
+    .{ "company", .company },
+    .{ "operator", .operator },
+    .{ "category", .category },
+    .{ "keywords", .keywords },
+    .{ "doccomm", .doccomm },
+    .{ "comment", .doccomm },
+    .{ "creatim", .creatim },
+    .{ "revtim", .revtim },
+    .{ "printim", .printim },
+    .{ "yr", .yr },
+    .{ "mo", .mo },
+    .{ "dy", .dy },
+    .{ "hr", .hr },
+    .{ "min", .min },
+    .{ "sec", .sec },
+    .{ "nofpages", .nofpages },
+    .{ "nofwords", .nofwords },
+    .{ "nofchars", .nofchars },
+    .{ "nofcharsws", .nofcharsws },
+    .{ "edmins", .edmins },
+});
+
+const Prober = struct {
+    allocator: std.mem.Allocator,
+    probe: Probe = .{},
+    fonts: std.ArrayListUnmanaged(Font) = .{},
+    colors: std.ArrayListUnmanaged(?u32) = .{},
+
+    // Take a token at the root of the document; false once it is part of
+    // the body
+    fn header(self: *Prober, tokens: *scanner.Scanner, token: scanner.Token) !bool {
+        switch (token.kind) {
+            .text => return isBlank(token.text),
+            .control => {
+                const word = header_words.get(token.word) orelse return token.text.len == 0;
+                const param = token.param orelse 0;
+                switch (word) {
+                    .rtf => self.probe.version = number(u32, param),
+                    .ansi => self.probe.charset = .ansi,
+                    .mac => self.probe.charset = .mac,
+                    .pc => self.probe.charset = .pc,
+                    .pca => self.probe.charset = .pca,
+                    .deff => self.probe.default_font = number(u16, param),
+                    .ansicpg => self.probe.code_page = number(u16, param),
+                    .body => return false,
+                }
+                return true;
+            },
+            .group_start => {
+                const depth = tokens.depth;
+                const starred = isStarred(tokens.data, token.end);
+                const first = (try tokens.next()) orelse return true;
+                if (first.kind == .group_end) return true; // {}
+
+                const known = if (first.kind == .control) header_groups.get(first.word) else null;
+                const group = known orelse if (starred) HeaderGroup.skip else return false;
+                switch (group) {
+                    .fonttbl => try self.readFontTable(tokens, depth),
+                    .colortbl => try self.readColorTable(tokens, depth),
+                    .info => try self.readInfo(tokens, depth),
+                    .skip => skipTo(tokens, depth),
+                }
+                return true;
+            },
+            .destination, .group_end => return true,
+        }
+    }
+
+    // {\fonttbl{\f0\fswiss\fcharset0 Arial;}...}, entries in groups or not
+    fn readFontTable(self: *Prober, tokens: *scanner.Scanner, table_depth: u32) !void {
+        var font: ?Font = null;
+        var name = std.ArrayListUnmanaged(u8){};
+        defer name.deinit(self.allocator);
+
+        while (try tokens.next()) |token| {
+            if (tokens.depth < table_depth) break;
+            switch (token.kind) {
+                .group_start => {
+                    // \panose, \falt and the like, inside an entry
+                    if (font != null or tokens.depth > table_depth + 1) skipTo(tokens, tokens.depth);
+                },
+                .group_end => {
+                    if (tokens.depth == table_depth) try self.endFont(&font, &name);
+                },
+                .control => {
+                    if (std.mem.eql(u8, token.word, "f")) {
+                        try self.endFont(&font, &name);
+                        font = .{ .id = number(u16, token.param orelse 0), .name = "" };
+                    } else if (font) |*entry| {
+                        if (font_families.get(token.word)) |family| {
+                            entry.family = family;
+                        } else if (std.mem.eql(u8, token.word, "fcharset")) {
+                            entry.charset = number(u8, token.param orelse 0);
+                        }
+                    }
+                },
+                .text => {
+                    if (font == null) continue;
+                    var rest = token.text;
+                    while (std.mem.indexOfScalar(u8, rest, ';')) |end| {
+                        try name.appendSlice(self.allocator, rest[0..end]);
+                        try self.endFont(&font, &name);
+                        rest = rest[end + 1 ..];
+                        if (font == null) break;
+                    }
+                    if (font != null) try name.appendSlice(self.allocator, rest);
+                },
+                .destination => {},
+            }
+        }
+        try self.endFont(&font, &name);
+    }
+
+    fn endFont(self: *Prober, font: *?Font, name: *std.ArrayListUnmanaged(u8)) !void {
+        var entry = font.* orelse return;
+        entry.name = try self.allocator.dupeZ(u8, std.mem.trim(u8, name.items, " \t"));
+        try self.fonts.append(self.allocator, entry);
+        font.* = null;
+        name.clearRetainingCapacity();
+    }
+
+    // {\colortbl;\red255\green0\blue0;...}; an entry without components is
+    // auto
+    fn readColorTable(self: *Prober, tokens: *scanner.Scanner, table_depth: u32) !void {
+        var rgb: u32 = 0;
+        var given = false;
+        while (try tokens.next()) |token| {
+            if (tokens.depth < table_depth) break;
+            switch (token.kind) {
+                .group_start => skipTo(tokens, tokens.depth),
+                .control => {
+                    const shift: u5 = if (std.mem.eql(u8, token.word, "red"))
+                        16
+                    else if (std.mem.eql(u8, token.word, "green"))
+                        8
+                    else if (std.mem.eql(u8, token.word, "blue"))
+                        0
+                    else
+                        continue;
+                    rgb = (rgb & ~(@as(u32, 0xff) << shift)) | (@as(u32, number(u8, token.param orelse 0)) << shift);
+                    given = true;
+                },
+                .text => {
+                    for (0..std.mem.count(u8, token.text, ";")) |_| {
+                        try self.colors.append(self.allocator, if (given) rgb else null);
+                        rgb = 0;
+                        given = false;
+                    }
+                },
+                .group_end, .destination => {},
+            }
+        }
+    }
+
+    // {\info{\title ...}{\*\company ...}{\creatim\yr2024\mo5...}{\nofwords12}...}
+    fn readInfo(self: *Prober, tokens: *scanner.Scanner, info_depth: u32) !void {
+        var string: ?*[:0]const u8 = null; // Field whose text is being read
+        var time: ?*Time = null;
+        var field_depth: u32 = 0;
+        var text = std.ArrayListUnmanaged(u8){};
+        defer text.deinit(self.allocator);
+
+        while (try tokens.next()) |token| {
+            if (token.kind == .group_end and tokens.depth < field_depth) {
+                if (string) |field| field.* = try self.allocator.dupeZ(u8, std.mem.trim(u8, text.items, " \t\n"));
+                string = null;
+                time = null;
+                field_depth = 0;
+                text.clearRetainingCapacity();
+            }
+            if (tokens.depth < info_depth) break;
+
+            switch (token.kind) {
+                .text => if (string != null) try text.appendSlice(self.allocator, token.text),
+                .control => {
+                    const word = info_words.get(token.word) orelse {
+                        if (string != null) try text.appendSlice(self.allocator, token.text); // Tabs, quotes, dashes
+                        continue;
+                    };
+                    const param = token.param orelse 0;
+                    if (self.stringField(word)) |field| {
+                        string = field;
+                        field_depth = tokens.depth;
+                        continue;
+                    }
+                    switch (word) {
+                        .creatim => time = &self.probe.created,
+                        .revtim => time = &self.probe.revised,
+                        .printim => time = &self.probe.printed,
+                        .yr => if (time) |t| {
+                            t.year = number(u16, param);
+                        },
+                        .mo => if (time) |t| {
+                            t.month = number(u8, param);
+                        },
+                        .dy => if (time) |t| {
+                            t.day = number(u8, param);
+                        },
+                        .hr => if (time) |t| {
+                            t.hour = number(u8, param);
+                        },
+                        .min => if (time) |t| {
+                            t.minute = number(u8, param);
+                        },
+                        .sec => if (time) |t| {
+                            t.second = number(u8, param);
+                        },
+                        .nofpages => self.probe.pages = number(u32, param),
+                        .nofwords => self.probe.words = number(u32, param),
+                        .nofchars => self.probe.characters = number(u32, param),
+                        .nofcharsws => self.probe.characters_with_spaces = number(u32, param),
+                        .edmins => self.probe.editing_minutes = number(u32, param),
+                        else => {},
+                    }
+                    if (time != null and field_depth == 0) field_depth = tokens.depth;
+                },
+                .group_start, .group_end, .destination => {},
+            }
+        }
+    }
+
+    fn stringField(self: *Prober, word: InfoWord) ?*[:0]const u8 {
+        return switch (word) {
+            .title => &self.probe.title,
+            .subject => &self.probe.subject,
+            .author => &self.probe.author,
+            .manager => &self.probe.manager,
+            .company => &self.probe.company,
+            .operator => &self.probe.last_author,
+            .category => &self.probe.category,
+            .keywords => &self.probe.keywords,
+            .doccomm => &self.probe.comment,
+            else => null,
+        };
+    }
+};
+
+// Step over groups being read until the one opened at `depth` has closed
+fn skipTo(tokens: *scanner.Scanner, depth: u32) void {
+    while (tokens.depth >= depth) tokens.skipRest();
+}
+
+// The group starting before `pos` is a {\*...} group
+fn isStarred(data: []const u8, pos: usize) bool {
+    var i = pos;
+    while (i < data.len and std.ascii.isWhitespace(data[i])) i += 1;
+    return std.mem.startsWith(u8, data[i..], "\\*");
+}
+
+fn isBlank(text: []const u8) bool {
+    for (text) |byte| {
+        if (!std.ascii.isWhitespace(byte)) return false;
+    }
+    return true;
+}
+
+fn number(comptime T: type, param: i32) T {
+    return std.math.cast(T, @max(0, param)) orelse std.math.maxInt(T);
+}
+
+// =============================================================================
+// TESTS
+// =============================================================================
+
+test "probe reads the document header" {
+    const testing = std.testing;
+    var arena = std.heap.ArenaAllocator.init(testing.allocator);
+    defer arena.deinit();
+
+    const rtf_data =
+        "{\\rtf1\\ansi\\ansicpg1252\\deff1\\nouicompat" ++
+        "{\\fonttbl{\\f0\\froman\\fcharset0{\\*\\panose 02020603050405020304}Times New Roman{\\*\\falt Times};}" ++
+        "{\\f1\\fswiss\\fcharset238 Arial;}}\r\n" ++
+        "{\\colortbl ;\\red255\\green0\\blue0;\\blue128;}" ++
+        "{\\stylesheet{\\s0 Normal;}}{\\*\\generator Riched20 10.0;}" ++
+        "{\\info{\\title Quarterly \\'93Report\\'94}{\\author Ann}{\\operator Bob}{\\*\\company Acme}" ++
+        "{\\creatim\\yr2024\\mo5\\dy17\\hr9\\min30}{\\revtim\\yr2024\\mo6\\dy1\\hr14\\min5\\sec12}" ++
+        "{\\nofpages3}{\\nofwords250}{\\nofchars1400}{\\nofcharsws1650}{\\edmins42}}" ++
+        "\\viewkind4\\uc1 \n\\pard\\f0\\fs24 Body text that is never read\\par" ++
+        "{\\pict\\pngblip 89504e47}}";
+
+    const info = try probe(arena.allocator(), rtf_data);
+    try testing.expectEqual(@as(u32, 1), info.version);
+    try testing.expectEqual(Charset.ansi, info.charset);
+    try testing.expectEqual(@as(?u16, 1252), info.code_page);
+    try testing.expectEqual(@as(?u16, 1), info.default_font);
+
+    try testing.expectEqual(@as(usize, 2), info.fonts.len);
+    try testing.expectEqualStrings("Times New Roman", info.fonts[0].name);
+    try testing.expectEqual(doc_model.FontInfo.FontFamily.roman, info.fonts[0].family);
+    try testing.expectEqual(@as(u16, 1), info.fonts[1].id);
+    try testing.expectEqualStrings("Arial", info.fonts[1].name);
+    try testing.expectEqual(@as(u8, 238), info.fonts[1].charset);
+
+    try testing.expectEqualSlices(?u32, &.{ null, 0xff0000, 0x000080 }, info.colors);
+
+    try testing.expectEqualStrings("Quarterly \u{201c}Report\u{201d}", info.title);
+    try testing.expectEqualStrings("Ann", info.author);
+    try testing.expectEqualStrings("Bob", info.last_author);
+    try testing.expectEqualStrings("Acme", info.company);
+    try testing.expectEqualStrings("", info.subject);
+    try testing.expectEqual(Time{ .year = 2024, .month = 5, .day = 17, .hour = 9, .minute = 30 }, info.created);
+    try testing.expectEqual(Time{ .year = 2024, .month = 6, .day = 1, .hour = 14, .minute = 5, .second = 12 }, info.revised);
+    try testing.expectEqual(Time{}, info.printed);
+    try testing.expectEqual(@as(?u32, 3), info.pages);
+    try testing.expectEqual(@as(?u32, 250), info.words);
+    try testing.expectEqual(@as(?u32, 1650), info.characters_with_spaces);
+    try testing.expectEqual(@as(?u32, 42), info.editing_minutes);
+
+    try testing.expect(std.mem.startsWith(u8, rtf_data[info.header_length..], "\\pard"));
+}
+
+test "probe stops at the first body content" {
+    const testing = std.testing;
+    var arena = std.heap.ArenaAllocator.init(testing.allocator);
+    defer arena.deinit();
+
+    // Fonts without groups; text right after the tables
+    const plain = "{\\rtf1\\mac{\\fonttbl\\f0\\fnil Monaco;\\f1 Geneva;}Hello{\\info{\\title Too late}}}";
+    const info = try probe(arena.allocator(), plain);
+    try testing.expectEqual(Charset.mac, info.charset);
+    try testing.expectEqual(@as(?u16, null), info.default_font);
+    try testing.expectEqual(@as(usize, 2), info.fonts.len);
+    try testing.expectEqualStrings("Geneva", info.fonts[1].name);
+    try testing.expectEqualStrings("", info.title);
+    try testing.expectEqualStrings("Hello", plain[info.header_length..][0..5]);
+
+    // A formatted group is body; a document with no body is all header
+    const grouped = "{\\rtf1{\\colortbl;}{\\b Bold}}";
+    try testing.expectEqualStrings("{\\b", grouped[(try probe(arena.allocator(), grouped)).header_length..][0..3]);
+    const empty = "{\\rtf1{\\fonttbl{\\f0 Arial;}}}";
+    try testing.expectEqual(empty.len, (try probe(arena.allocator(), empty)).header_length);
+
+    try testing.expectError(error.InvalidRtf, probe(arena.allocator(), "no rtf"));
+}
@@ -0,0 +1,532 @@
+const std = @import("std");
+const doc_model = @import("document_model.zig");
+const formatted_parser = @import("formatted_parser.zig");
+const source_map = @import("source_map.zig");
+
+const FormattedParser = formatted_parser.FormattedParser;
+const Checkpoint = formatted_parser.Checkpoint;
+const Checkpoints = formatted_parser.Checkpoints;
+
+// =============================================================================
+// INCREMENTAL REPARSE
+// =============================================================================
+// Brings a document up to date with an edit of its RTF source by parsing
+// only around the edit. Parsing resumes at the last exact checkpoint before
+// the edit (see Checkpoint.exact) and stops at the first exact checkpoint
+// after it where the parser is back in the state of the original parse.
+// Content, source map ranges and checkpoints from there on are kept, with
+// their offsets shifted by the edit; only the region in between is replaced.
+//
+// The document is updated in place and stays valid if the reparse fails.
+// Replaced content stays in the document's arena, so once it takes up more
+// than half of the arena the whole input is parsed again into a fresh one.
+// An editing session thus holds at most about twice the document, and the
+// full parses are paid for by the edits that filled the arena.
+
+pub const Edit = struct {
+    start: usize, // Replaced range [start, end) of the old input
+    end: usize,
+    inserted_len: usize, // Length of the replacement at `start` in the new input
+
+    // New offset of an old offset at or after `end`
+    fn shift(self: Edit, offset: usize) usize {
+        return offset - self.end + self.start + self.inserted_len;
+    }
+};
+
+// Part of the new input that was parsed again
+pub const Result = struct {
+    start: usize,
+    end: usize,
+};
+
+pub fn reparseEdit(document: *doc_model.Document, checkpoints: *Checkpoints, new_data: []const u8, edit: Edit) !Result {
+    if (document.block != null) return error.ReadOnlyDocument;
+
+    // The old input is the new one with the edit undone
+    const removed = edit.end -| edit.start;
+    if (edit.start > edit.end or edit.start + edit.inserted_len > new_data.len) return error.CheckpointMismatch;
+    if (checkpoints.parsed_len == 0 or new_data.len + removed - edit.inserted_len < checkpoints.parsed_len) {
+        return error.CheckpointMismatch;
+    }
+
+    const resume_index = lastExactBefore(checkpoints, edit.start) orelse return reparseAll(document, checkpoints, new_data);
+    const resume_point = checkpoints.points.items[resume_index];
+    // Where the first source map unit starts is only known from the top
+    if (document.source_map != null and resume_point.element_count == 0) return reparseAll(document, checkpoints, new_data);
+    const allocator = document.allocator;
+
+    // Parse from the checkpoint, recording new checkpoints as we go
+    var stream = std.io.fixedBufferStream(new_data[resume_point.offset..]);
+    var parser = try FormattedParser.init(stream.reader().any(), allocator);
+    defer parser.deinit();
+    if (document.source_map != null) parser.recordSourceMap();
+
+    var fresh = Checkpoints.init(allocator, checkpoints.interval);
+    defer fresh.deinit();
+    parser.recordCheckpoints(&fresh);
+    try parser.resumeAt(stream.reader().any(), checkpoints, resume_point);
+    fresh.next_offset = resume_point.offset + fresh.interval;
+
+    // Stop at the first old checkpoint past the edit where the state matches
+    var sync: ?Checkpoint = null;
+    var candidate_index = resume_index + 1;
+    while (candidate_index < checkpoints.points.items.len) : (candidate_index += 1) {
+        const candidate = checkpoints.points.items[candidate_index];
+        if (!candidate.exact or candidate.offset < edit.end) continue;
+
+        const target = edit.shift(candidate.offset);
+        try parser.parseContent(target);
+        if (parser.token_start < target) break; // Input ended first
+        if (parser.token_start == target and checkpoints.matches(candidate, &parser)) {
+            sync = candidate;
+            break;
+        }
+    }
+    if (sync == null) try parser.parseContent(std.math.maxInt(usize));
+
+    var tail = try parser.finishDocument();
+    defer tail.deinit();
+
+    const splice = Splice{
+        .edit = edit,
+        .resume_point = resume_point,
+        .sync = sync,
+        .tail = &tail,
+    };
+    const parsed_len = if (sync != null) edit.shift(checkpoints.parsed_len) else fresh.parsed_len;
+
+    // Build everything first; the document is only touched once nothing can fail
+    var merged = Checkpoints.init(allocator, checkpoints.interval);
+    errdefer merged.deinit();
+    try splice.mergeCheckpoints(&merged, checkpoints, &fresh, candidate_index);
+
+    var content = try splice.spliceContent(document);
+    errdefer content.deinit();
+    var fonts = try splice.spliceFonts(document);
+    errdefer fonts.deinit();
+    var colors = try splice.spliceColors(document);
+    errdefer colors.deinit();
+    const new_map = if (document.source_map) |old_map| try splice.spliceSourceMap(document, old_map) else null;
+
+    // The checkpoints copy the final tables and properties - all from the tail
+    var final_tables = tail;
+    final_tables.font_table = fonts;
+    final_tables.color_table = colors;
+    try merged.finish(&final_tables, parsed_len);
+
+    const reuse_from = if (sync) |point| point.element_count else document.content.items.len;
+    merged.replaced_bytes = checkpoints.replaced_bytes + splice.replacedBytes(document, reuse_from);
+
+    // Commit
+    for (document.content.items[resume_point.element_count..reuse_from]) |*element| element.deinit();
+    document.content.deinit();
+    document.content = content;
+    tail.content.clearRetainingCapacity(); // Its elements now belong to the document
+
+    document.font_table.deinit();
+    document.font_table = fonts;
+    document.color_table.deinit();
+    document.color_table = colors;
+    document.source_map = new_map;
+    document.plain_text = null;
+    document.default_font = tail.default_font;
+    document.default_font_size = tail.default_font_size;
+    document.code_page = tail.code_page;
+    document.rtf_version = tail.rtf_version;
+
+    checkpoints.deinit();
+    checkpoints.* = merged;
+
+    const result = Result{
+        .start = resume_point.offset,
+        .end = if (sync) |point| edit.shift(point.offset) else parsed_len,
+    };
+    // Mostly replaced content - start over in a fresh arena. The edit is
+    // already applied, so a failure here only postpones that to the next one.
+    if (checkpoints.replaced_bytes > document.arena.queryCapacity() / 2) {
+        return reparseAll(document, checkpoints, new_data) catch result;
+    }
+    return result;
+}
+
+// No usable checkpoint before the edit - parse everything again
+fn reparseAll(document: *doc_model.Document, checkpoints: *Checkpoints, new_data: []const u8) !Result {
+    var stream = std.io.fixedBufferStream(new_data);
+    var parser = try FormattedParser.init(stream.reader().any(), document.allocator);
+    defer parser.deinit();
+    if (document.source_map != null) parser.recordSourceMap();
+
+    var fresh = Checkpoints.init(document.allocator, checkpoints.interval);
+    errdefer fresh.deinit();
+    parser.recordCheckpoints(&fresh);
+
+    const parsed = try parser.parse();
+    document.deinit();
+    document.* = parsed;
+    checkpoints.deinit();
+    checkpoints.* = fresh;
+
+    return .{ .start = 0, .end = fresh.parsed_len };
+}
+
+fn lastExactBefore(checkpoints: *const Checkpoints, offset: usize) ?usize {
+    var index = checkpoints.points.items.len;
+    while (index > 0) {
+        index -= 1;
+        const checkpoint = checkpoints.points.items[index];
+        // Strictly before: the token ending at a checkpoint peeks at its byte
+        if (checkpoint.exact and checkpoint.offset < offset) return index;
+    }
+    return null;
+}
+
+// Old document = head (before resume_point) + replaced + reused (from sync on)
+const Splice = struct {
+    edit: Edit,
+    resume_point: Checkpoint,
+    sync: ?Checkpoint,
+    tail: *doc_model.Document, // Content parsed from resume_point up to sync
+
+    fn spliceContent(self: Splice, document: *doc_model.Document) !std.ArrayList(doc_model.ContentElement) {
+        const old = document.content.items;
+        const head = old[0..self.resume_point.element_count];
+        const reused = if (self.sync) |point| old[point.element_count..] else old[old.len..];
+
+        var content = try std.ArrayList(doc_model.ContentElement).initCapacity(
+            document.allocator,
+            head.len + self.tail.content.items.len + reused.len,
+        );
+        errdefer content.deinit();
+
+        content.appendSliceAssumeCapacity(head);
+        for (self.tail.content.items) |*element| {
+            try adoptStrings(document, element);
+            content.appendAssumeCapacity(element.*);
+        }
+        content.appendSliceAssumeCapacity(reused);
+        return content;
+    }
+
+    // Arena bytes of what the splice replaces: the strings of the replaced
+    // content and fonts, and the whole old source map, which is rebuilt
+    fn replacedBytes(self: Splice, document: *const doc_model.Document, reuse_from: usize) usize {
+        var bytes: usize = 0;
+        for (document.content.items[self.resume_point.element_count..reuse_from]) |element| {
+            bytes += stringBytes(element);
+        }
+        const fonts_end = if (self.sync) |point| point.font_count else document.font_table.items.len;
+        for (document.font_table.items[self.resume_point.font_count..fonts_end]) |font| bytes += font.name.len + 1;
+        if (document.source_map) |map| {
+            for ([_]source_map.RangeList{ map.runs, map.tables, map.cells, map.images }) |list| {
+                bytes += list.bytes.len + list.anchors.len * @sizeOf(source_map.Anchor);
+            }
+            bytes += map.units.len * @sizeOf(source_map.Unit);
+        }
+        return bytes;
+    }
+
+    fn spliceFonts(self: Splice, document: *doc_model.Document) !std.ArrayList(doc_model.FontInfo) {
+        var fonts = std.ArrayList(doc_model.FontInfo).init(document.allocator);
+        errdefer fonts.deinit();
+
+        const old = document.font_table.items;
+        try fonts.appendSlice(old[0..self.resume_point.font_count]);
+        for (self.tail.font_table.items[self.resume_point.font_count..]) |font| {
+            var copy = font;
+            copy.name = try document.arena.allocator().dupeZ(u8, font.name);
+            try fonts.append(copy);
+        }
+        if (self.sync) |point| try fonts.appendSlice(old[point.font_count..]);
+        return fonts;
+    }
+
+    fn spliceColors(self: Splice, document: *doc_model.Document) !std.ArrayList(doc_model.ColorInfo) {
+        var colors = std.ArrayList(doc_model.ColorInfo).init(document.allocator);
+        errdefer colors.deinit();
+
+        const old = document.color_table.items;
+        try colors.appendSlice(old[0..self.resume_point.color_count]);
+        try colors.appendSlice(self.tail.color_table.items[self.resume_point.color_count..]);
+        if (self.sync) |point| try colors.appendSlice(old[point.color_count..]);
+        return colors;
+    }
+
+    fn spliceSourceMap(self: Splice, document: *doc_model.Document, old: source_map.SourceMap) !source_map.SourceMap {
+        const new = self.tail.source_map orelse source_map.SourceMap{};
+        const arena = document.arena.allocator();
+        const head = self.resume_point;
+        const sync = self.sync;
+
+        return .{
+            .runs = try self.spliceRanges(arena, document.allocator, old.runs, head.run_count, new.runs, if (sync) |point| point.run_count else null),
+            .tables = try self.spliceRanges(arena, document.allocator, old.tables, head.table_count, new.tables, if (sync) |point| point.table_count else null),
+            .cells = try self.spliceRanges(arena, document.allocator, old.cells, head.cell_count, new.cells, if (sync) |point| point.cell_count else null),
+            .images = try self.spliceRanges(arena, document.allocator, old.images, head.image_count, new.images, if (sync) |point| point.image_count else null),
+            .units = try self.spliceUnits(arena, old.units, new.units),
+            .content_end = if (sync != null) self.edit.shift(old.content_end) else new.content_end,
+        };
+    }
+
+    // Units are split by offset: the reparse starts and ends at checkpoints,
+    // and never records a unit at either (see Recorder.unitBoundary)
+    fn spliceUnits(self: Splice, arena: std.mem.Allocator, old: []const source_map.Unit, middle: []const source_map.Unit) ![]source_map.Unit {
+        const head = self.resume_point;
+        var keep: usize = 0;
+        while (keep < old.len and old[keep].offset <= head.offset) keep += 1;
+        var reuse_from = old.len;
+        if (self.sync) |point| {
+            reuse_from = keep;
+            while (reuse_from < old.len and old[reuse_from].offset < point.offset) reuse_from += 1;
+        }
+
+        const units = try arena.alloc(source_map.Unit, keep + middle.len + old.len - reuse_from);
+        @memcpy(units[0..keep], old[0..keep]);
+        for (middle, units[keep..][0..middle.len]) |unit, *out| {
+            out.* = unit;
+            out.element += head.element_count;
+        }
+
+        const sync = self.sync orelse return units;
+        const elements_at_sync = head.element_count + self.tail.content.items.len;
+        for (old[reuse_from..], units[keep + middle.len ..]) |unit, *out| {
+            out.* = unit;
+            out.offset = self.edit.shift(unit.offset);
+            out.element = unit.element - sync.element_count + elements_at_sync;
+        }
+        return units;
+    }
+
+    // old[0..keep] ++ middle ++ old[reuse_from..] shifted past the edit
+    fn spliceRanges(
+        self: Splice,
+        arena: std.mem.Allocator,
+        scratch: std.mem.Allocator,
+        old: source_map.RangeList,
+        keep: usize,
+        middle: source_map.RangeList,
+        reuse_from: ?usize,
+    ) !source_map.RangeList {
+        var builder = source_map.RangeListBuilder.init(scratch);
+        defer builder.deinit();
+
+        var old_ranges = old.iterator();
+        var index: usize = 0;
+        while (old_ranges.next()) |range| : (index += 1) {
+            if (index == keep) break;
+            try builder.append(range);
+        }
+
+        var middle_ranges = middle.iterator();
+        while (middle_ranges.next()) |range| try builder.append(range);
+
+        if (reuse_from) |first| {
+            old_ranges = old.iterator();
+            index = 0;
+            while (old_ranges.next()) |range| : (index += 1) {
+                if (index < first) continue;
+                try builder.append(.{ .start = self.edit.shift(range.start), .end = self.edit.shift(range.end) });
+            }
+        }
+
+        return builder.finish(arena);
+    }
+
+    // Old checkpoints up to resume_point, the ones recorded while reparsing,
+    // then the old ones from the sync point on, all renumbered
+    fn mergeCheckpoints(self: Splice, merged: *Checkpoints, old: *const Checkpoints, fresh: *const Checkpoints, sync_index: usize) !void {
+        for (old.points.items) |checkpoint| {
+            if (checkpoint.offset > self.resume_point.offset) break;
+            try merged.appendFrom(old, checkpoint);
+        }
+
+        const head = self.resume_point;
+        for (fresh.points.items) |checkpoint| {
+            var moved = checkpoint;
+            moved.element_count += head.element_count;
+            moved.run_count += head.run_count;
+            moved.table_count += head.table_count;
+            moved.cell_count += head.cell_count;
+            moved.image_count += head.image_count;
+            try merged.appendFrom(fresh, moved);
+        }
+
+        const sync = self.sync orelse return;
+        const tail_map = self.tail.source_map orelse source_map.SourceMap{};
+        const elements_at_sync = head.element_count + self.tail.content.items.len;
+        for (old.points.items[sync_index..]) |checkpoint| {
+            var moved = checkpoint;
+            moved.offset = self.edit.shift(checkpoint.offset);
+            moved.element_count = @intCast(checkpoint.element_count - sync.element_count + elements_at_sync);
+            moved.run_count = @intCast(checkpoint.run_count - sync.run_count + head.run_count + tail_map.runs.len);
+            moved.table_count = @intCast(checkpoint.table_count - sync.table_count + head.table_count + tail_map.tables.len);
+            moved.cell_count = @intCast(checkpoint.cell_count - sync.cell_count + head.cell_count + tail_map.cells.len);
+            moved.image_count = @intCast(checkpoint.image_count - sync.image_count + head.image_count + tail_map.images.len);
+            try merged.appendFrom(old, moved);
+        }
+    }
+};
+
+// Arena bytes of an element's strings, as adoptStrings() copies them
+fn stringBytes(element: doc_model.ContentElement) usize {
+    return switch (element) {
+        .text_run => |run| run.text.len + 1,
+        .hyperlink => |link| link.url.len + link.display_text.len + 1,
+        .image => |image| image.data.len,
+        .table => |table| blk: {
+            var bytes: usize = 0;
+            for (table.runs.items) |run| bytes += run.text.len + 1;
+            break :blk bytes;
+        },
+        else => 0,
+    };
+}
+
+// Copy the strings of an element parsed into another document into
+// `document`'s arena. Table lists move over as they are.
+fn adoptStrings(document: *doc_model.Document, element: *doc_model.ContentElement) !void {
+    const arena = document.arena.allocator();
+    switch (element.*) {
+        .text_run => |*run| run.text = try arena.dupeZ(u8, run.text),
+        .hyperlink => |*link| {
+            link.url = try arena.dupe(u8, link.url);
+            link.display_text = try arena.dupeZ(u8, link.display_text);
+        },
+        .image => |*image| image.data = try arena.dupe(u8, image.data),
+        .table => |*table| {
+            for (table.runs.items) |*run| run.text = try arena.dupeZ(u8, run.text);
+        },
+        else => {},
+    }
+}
+
+// =============================================================================
+// TESTS
+// =============================================================================
+
+fn applyEdit(allocator: std.mem.Allocator, data: []const u8, start: usize, end: usize, inserted: []const u8) ![]u8 {
+    return std.mem.concat(allocator, u8, &.{ data[0..start], inserted, data[end..] });
+}
+
+test "reparse after an edit matches a full parse" {
+    const testing = std.testing;
+
+    var original = std.ArrayList(u8).init(testing.allocator);
+    defer original.deinit();
+    try original.appendSlice("{\\rtf1{\\fonttbl{\\f0 Arial;}}");
+    for (0..100) |i| try original.writer().print("Paragraph {d} \\b bold\\b0 text\\par ", .{i});
+    try original.appendSlice("\\trowd\\cellx1000 cell\\cell\\row\\par End}");
+
+    var checkpoints = Checkpoints.init(testing.allocator, 256);
+    defer checkpoints.deinit();
+    var stream = std.io.fixedBufferStream(original.items);
+    var parser = try FormattedParser.init(stream.reader().any(), testing.allocator);
+    defer parser.deinit();
+    parser.recordSourceMap();
+    parser.recordCheckpoints(&checkpoints);
+    var document = try parser.parse();
+    defer document.deinit();
+    _ = try document.getPlainText();
+
+    // Replace "bold" in paragraph 50 with "strong words"
+    const start = std.mem.indexOf(u8, original.items, "Paragraph 50 \\b ").? + "Paragraph 50 \\b ".len;
+    const edited = try applyEdit(testing.allocator, original.items, start, start + 4, "strong words");
+    defer testing.allocator.free(edited);
+
+    const result = try reparseEdit(&document, &checkpoints, edited, .{ .start = start, .end = start + 4, .inserted_len = 12 });
+    try testing.expect(result.end - result.start < edited.len / 4); // Only a small window was parsed
+
+    // Same content, source map and checkpoints as parsing the edited input
+    var fresh_checkpoints = Checkpoints.init(testing.allocator, 256);
+    defer fresh_checkpoints.deinit();
+    var expected_stream = std.io.fixedBufferStream(edited);
+    var expected_parser = try FormattedParser.init(expected_stream.reader().any(), testing.allocator);
+    defer expected_parser.deinit();
+    expected_parser.recordSourceMap();
+    expected_parser.recordCheckpoints(&fresh_checkpoints);
+    var expected = try expected_parser.parse();
+    defer expected.deinit();
+
+    try testing.expectEqualStrings(try expected.getPlainText(), try document.getPlainText());
+
+    const runs = try document.getTextRuns(testing.allocator);
+    defer testing.allocator.free(runs);
+    const expected_runs = try expected.getTextRuns(testing.allocator);
+    defer testing.allocator.free(expected_runs);
+    try testing.expectEqual(expected_runs.len, runs.len);
+    for (expected_runs, runs) |want, got| {
+        try testing.expectEqualStrings(want.text, got.text);
+        try testing.expect(want.char_format.equals(got.char_format));
+    }
+
+    const map = document.source_map.?;
+    const expected_map = expected.source_map.?;
+    try testing.expectEqual(expected_map.runs.len, map.runs.len);
+    for (0..map.runs.len) |i| try testing.expectEqual(expected_map.runs.get(i).?, map.runs.get(i).?);
+    try testing.expectEqual(expected_map.tables.get(0).?, map.tables.get(0).?);
+    try testing.expectEqual(expected_map.units.len, map.units.len);
+    for (expected_map.units, map.units) |want, got| try testing.expectEqual(want, got);
+    try testing.expectEqual(expected_map.content_end, map.content_end);
+    try testing.expectEqual(fresh_checkpoints.parsed_len, checkpoints.parsed_len);
+
+    // A second edit works from the merged checkpoints
+    const end_offset = std.mem.indexOf(u8, edited, "End").?;
+    const final = try applyEdit(testing.allocator, edited, end_offset, end_offset + 3, "Fin");
+    defer testing.allocator.free(final);
+    _ = try reparseEdit(&document, &checkpoints, final, .{ .start = end_offset, .end = end_offset + 3, .inserted_len = 3 });
+    try testing.expect(std.mem.endsWith(u8, try document.getPlainText(), "Fin"));
+}
+
+test "reparse falls back to a full parse near the start" {
+    const testing = std.testing;
+
+    const original = "{\\rtf1 Hello world}";
+    var checkpoints = Checkpoints.init(testing.allocator, 4);
+    defer checkpoints.deinit();
+    var stream = std.io.fixedBufferStream(original);
+    var parser = try FormattedParser.init(stream.reader().any(), testing.allocator);
+    defer parser.deinit();
+    parser.recordSourceMap();
+    parser.recordCheckpoints(&checkpoints);
+    var document = try parser.parse();
+    defer document.deinit();
+
+    const edited = "{\\rtf2 Hello world}";
+    const result = try reparseEdit(&document, &checkpoints, edited, .{ .start = 5, .end = 6, .inserted_len = 1 });
+    try testing.expectEqual(@as(usize, 0), result.start);
+    try testing.expectEqualStrings("Hello world", try document.getPlainText());
+}
+
+test "reparse bounds the arena over many edits" {
+    const testing = std.testing;
+
+    var original = std.ArrayList(u8).init(testing.allocator);
+    defer original.deinit();
+    try original.appendSlice("{\\rtf1{\\fonttbl{\\f0 Arial;}}");
+    for (0..100) |i| try original.writer().print("Paragraph {d} \\b bold\\b0 text\\par ", .{i});
+    try original.appendSlice("End}");
+
+    var checkpoints = Checkpoints.init(testing.allocator, 256);
+    defer checkpoints.deinit();
+    var stream = std.io.fixedBufferStream(original.items);
+    var parser = try FormattedParser.init(stream.reader().any(), testing.allocator);
+    defer parser.deinit();
+    parser.recordSourceMap();
+    parser.recordCheckpoints(&checkpoints);
+    var document = try parser.parse();
+    defer document.deinit();
+    const initial_capacity = document.arena.queryCapacity();
+
+    // Swap "bold" and "BOLD" in paragraph 50 over and over
+    const start = std.mem.indexOf(u8, original.items, "Paragraph 50 \\b ").? + "Paragraph 50 \\b ".len;
+    var full_parses: usize = 0;
+    for (0..200) |i| {
+        @memcpy(original.items[start..][0..4], if (i % 2 == 0) "BOLD" else "bold");
+        const result = try reparseEdit(&document, &checkpoints, original.items, .{ .start = start, .end = start + 4, .inserted_len = 4 });
+        if (result.start == 0) full_parses += 1;
+        try testing.expect(checkpoints.replaced_bytes <= document.arena.queryCapacity() / 2);
+        try testing.expect(document.arena.queryCapacity() < initial_capacity * 4);
+    }
+    try testing.expect(full_parses > 0);
+    try testing.expect(std.mem.indexOf(u8, try document.getPlainText(), "Paragraph 50 bold text") != null);
+}
@@ -6,4 +6,5 @@ pub const Parser = @import("rtf.zig").Parser;
 test {
     std.testing.refAllDecls(@This());
     _ = @import("test_cases.zig");
+    _ = @import("inverted_index.zig");
 }
\ No newline at end of file
@@ -0,0 +1,441 @@
+const std = @import("std");
+const doc_model = @import("document_model.zig");
+
+// =============================================================================
+// RTF SCANNER
+// =============================================================================
+// One pass over RTF held in memory that yields its visible text, body
+// control words and groups, without building a document or allocating.
+// For consumers that touch every byte of large inputs once and keep
+// nothing (search, statistics).
+//
+// Destinations that are never displayed (font and color tables, stylesheet,
+// info, pictures, objects, field instructions, headers, footers, footnotes
+// and every {\*...} group) are stepped over as a whole. `\'xx`, `\uN` (with
+// its \uc fallback characters dropped) and the special-character control
+// words are decoded to UTF-8 as they are read. Text between control words is
+// handed out as slices of the input, found with a vector scan for the bytes
+// that can end it.
+//
+// With `read_destinations` set, those groups are read like any other and it
+// is up to the consumer to step over what it does not want (see skipRest),
+// for reading the document header (probe.zig).
+
+pub const max_depth = 2048; // As FormattedParser
+pub const max_word_len = 32;
+
+pub const Token = struct {
+    kind: Kind,
+    text: []const u8 = "", // Visible text (see `direct`)
+    word: []const u8 = "", // Control word without the backslash
+    param: ?i32 = null,
+    start: usize, // Input byte range of the token
+    end: usize,
+    direct: bool = false, // `text` is the input at start..end; otherwise it is decoded and valid until next()
+
+    pub const Kind = enum {
+        text, // Plain, escaped or encoded characters
+        control, // Control word in displayed content, with the text it stands for, if any
+        // Skipped group, from its control word ({ for {\*...}) to its end,
+        // which has no group_end of its own. Named by that control word,
+        // empty for {\* with none.
+        destination,
+        group_start, // Of a group that is read, other than the root group
+        group_end,
+    };
+};
+
+pub const Scanner = struct {
+    data: []const u8,
+    pos: usize = 0,
+    depth: u32 = 0,
+    started: bool = false,
+    code_page: u16 = 1252,
+    read_destinations: bool = false, // Do not skip destinations
+
+    // Characters after \uN that stand in for it, per group (\ucN)
+    fallback: [max_depth + 1]u8 = undefined,
+    pending_fallback: u32 = 0,
+    high_surrogate: ?u16 = null,
+
+    scratch: [4]u8 = undefined,
+
+    pub fn init(data: []const u8) Scanner {
+        var scanner = Scanner{ .data = data };
+        scanner.fallback[0] = 1;
+        return scanner;
+    }
+
+    // The next token, or null once the root group has closed or the input
+    // has ended
+    pub fn next(self: *Scanner) !?Token {
+        if (!self.started) {
+            while (self.pos < self.data.len and std.ascii.isWhitespace(self.data[self.pos])) self.pos += 1;
+            if (self.pos >= self.data.len or self.data[self.pos] != '{') return error.InvalidRtf;
+            self.started = true;
+        }
+
+        while (self.pos < self.data.len) {
+            const start = self.pos;
+            switch (self.data[start]) {
+                '{' => {
+                    if (try self.openGroup()) |token| return token;
+                },
+                '}' => {
+                    self.pos += 1;
+                    self.pending_fallback = 0;
+                    if (self.depth <= 1) {
+                        self.pos = self.data.len; // Root group closed
+                        return null;
+                    }
+                    self.depth -= 1;
+                    return .{ .kind = .group_end, .start = start, .end = self.pos };
+                },
+                '\\' => {
+                    if (try self.control()) |token| return token;
+                },
+                '\r', '\n' => self.pos += 1, // Line breaks in the source are not text
+                else => {
+                    const end = indexOfAny(self.data, start, "\\{}\r\n");
+                    if (self.pending_fallback > 0) {
+                        const dropped = @min(self.pending_fallback, end - start);
+                        self.pending_fallback -= @intCast(dropped);
+                        self.pos = start + dropped;
+                        continue;
+                    }
+                    self.pos = end;
+                    return .{ .kind = .text, .text = self.data[start..end], .start = start, .end = end, .direct = true };
+                },
+            }
+        }
+        return null;
+    }
+
+    fn openGroup(self: *Scanner) !?Token {
+        const start = self.pos;
+        self.pos += 1;
+        self.pending_fallback = 0;
+        if (self.depth >= max_depth) return error.TooManyNestedGroups;
+        self.depth += 1;
+        self.fallback[self.depth] = self.fallback[self.depth - 1];
+
+        // {\*\destination ...} is skipped, known or not
+        const group = Token{ .kind = .group_start, .start = start, .end = self.pos };
+        var pos = self.pos;
+        while (pos < self.data.len and std.ascii.isWhitespace(self.data[pos])) pos += 1;
+        if (self.read_destinations or !std.mem.startsWith(u8, self.data[pos..], "\\*")) return if (self.depth > 1) group else null;
+        pos += 2;
+        while (pos < self.data.len and std.ascii.isWhitespace(self.data[pos])) pos += 1;
+
+        var word: []const u8 = "";
+        if (pos + 1 < self.data.len and self.data[pos] == '\\' and std.ascii.isAlphabetic(self.data[pos + 1])) {
+            const word_start = pos + 1;
+            pos = word_start;
+            while (pos < self.data.len and pos - word_start < max_word_len and std.ascii.isAlphabetic(self.data[pos])) pos += 1;
+            word = self.data[word_start..pos];
+        }
+        self.pos = pos;
+        return self.skipGroup(start, word);
+    }
+
+    // Step over the rest of the group being read, its end included, which
+    // has no group_end token
+    pub fn skipRest(self: *Scanner) void {
+        _ = self.skipGroup(self.pos, "");
+    }
+
+    // Step over the rest of the group being read
+    fn skipGroup(self: *Scanner, start: usize, word: []const u8) Token {
+        var depth: usize = 1;
+        var pos = self.pos;
+        while (depth > 0) {
+            pos = indexOfAny(self.data, pos, "\\{}");
+            if (pos >= self.data.len) break;
+            switch (self.data[pos]) {
+                '{' => {
+                    depth += 1;
+                    pos += 1;
+                },
+                '}' => {
+                    depth -= 1;
+                    pos += 1;
+                },
+                else => {
+                    // Escapes, and \binN whose data may hold anything
+                    pos += 1;
+                    const word_start = pos;
+                    while (pos < self.data.len and std.ascii.isAlphabetic(self.data[pos])) pos += 1;
+                    if (pos == word_start) {
+                        pos = @min(pos + 1, self.data.len);
+                    } else if (std.mem.eql(u8, self.data[word_start..pos], "bin")) {
+                        const length = readParam(self.data, &pos) orelse 0;
+                        if (pos < self.data.len and self.data[pos] == ' ') pos += 1;
+                        pos += @min(@as(usize, @intCast(@max(0, length))), self.data.len - pos);
+                    }
+                },
+            }
+        }
+
+        self.pos = pos;
+        self.depth -= 1;
+        return .{ .kind = .destination, .word = word, .start = start, .end = pos };
+    }
+
+    fn control(self: *Scanner) !?Token {
+        const start = self.pos;
+        self.pos += 1;
+        if (self.pos >= self.data.len) return null;
+
+        const symbol = self.data[self.pos];
+        if (!std.ascii.isAlphabetic(symbol)) {
+            self.pos += 1;
+            if (symbol == '\'') {
+                // Two hex digits; a malformed escape still counts as a character
+                var value: u8 = 0;
+                for (0..2) |_| {
+                    if (self.pos >= self.data.len) break;
+                    const digit = std.fmt.charToDigit(self.data[self.pos], 16) catch break;
+                    value = value * 16 + digit;
+                    self.pos += 1;
+                }
+                if (self.takeFallback()) return null;
+                return .{ .kind = .text, .text = self.encodeByte(value), .start = start, .end = self.pos };
+            }
+            if (self.takeFallback()) return null;
+            const text: []const u8 = switch (symbol) {
+                '\\', '{', '}' => self.data[start + 1 .. self.pos],
+                '~' => "\u{a0}", // Non-breaking space
+                '_' => "-", // Non-breaking hyphen
+                '\r', '\n' => return .{ .kind = .control, .word = "par", .text = "\n", .start = start, .end = self.pos },
+                else => return null, // \- optional hyphen, \* outside a group start, index marks
+            };
+            return .{ .kind = .text, .text = text, .start = start, .end = self.pos };
+        }
+
+        const word_start = self.pos;
+        while (self.pos < self.data.len and std.ascii.isAlphabetic(self.data[self.pos])) self.pos += 1;
+        const word = self.data[word_start..@min(self.pos, word_start + max_word_len)];
+        const param = readParam(self.data, &self.pos);
+        if (self.pos < self.data.len and self.data[self.pos] == ' ') self.pos += 1;
+        self.pending_fallback = 0;
+
+        var token = Token{ .kind = .control, .word = word, .param = param, .start = start, .end = self.pos };
+        if (word.len == 1 and word[0] == 'u') {
+            if (param) |value| {
+                token.kind = .text;
+                token.text = self.encodeUnicode(@bitCast(@as(i16, @truncate(value))));
+                self.pending_fallback = self.fallback[self.depth];
+            }
+            return token;
+        }
+        self.high_surrogate = null;
+
+        switch (controlWord(word)) {
+            .bin => {
+                const length: usize = @intCast(@max(0, param orelse 0));
+                self.pos += @min(length, self.data.len - self.pos);
+                token.end = self.pos;
+            },
+            .uc => self.fallback[self.depth] = @intCast(std.math.clamp(param orelse 1, 0, 255)),
+            .ansicpg => self.code_page = @intCast(std.math.clamp(param orelse 1252, 0, 65535)),
+            .destination => {
+                // A destination word inside the root group itself is malformed; keep reading
+                if (self.depth > 1 and !self.read_destinations) return self.skipGroup(start, word);
+            },
+            .par, .line, .sect, .page, .row, .nestrow => token.text = "\n",
+            .tab, .cell, .nestcell => token.text = "\t",
+            .quote => token.text = "'",
+            .dblquote => token.text = "\"",
+            .bullet => token.text = "•",
+            .emdash => token.text = "—",
+            .endash => token.text = "–",
+            .space => token.text = " ",
+            .other => {},
+        }
+        return token;
+    }
+
+    // Drop a character that stands in for the \uN before it
+    fn takeFallback(self: *Scanner) bool {
+        if (self.pending_fallback == 0) return false;
+        self.pending_fallback -= 1;
+        return true;
+    }
+
+    // A \'xx byte. Code page 1252, the default, is decoded; other code pages
+    // are passed through as the parser does.
+    fn encodeByte(self: *Scanner, byte: u8) []const u8 {
+        const code_point = doc_model.decodeCodePageByte(self.code_page, byte) orelse {
+            self.scratch[0] = byte;
+            return self.scratch[0..1];
+        };
+        const len = std.unicode.utf8Encode(code_point, &self.scratch) catch unreachable;
+        return self.scratch[0..len];
+    }
+
+    // \uN is a signed UTF-16 unit; pairs of them encode code points past U+FFFF
+    fn encodeUnicode(self: *Scanner, unit: u16) []const u8 {
+        var code_point: u21 = unit;
+        if (std.unicode.utf16IsHighSurrogate(unit)) {
+            self.high_surrogate = unit;
+            return "";
+        }
+        if (std.unicode.utf16IsLowSurrogate(unit)) {
+            const high = self.high_surrogate orelse return "\u{fffd}";
+            code_point = std.unicode.utf16DecodeSurrogatePair(&[_]u16{ high, unit }) catch return "\u{fffd}";
+        }
+        self.high_surrogate = null;
+        const len = std.unicode.utf8Encode(code_point, &self.scratch) catch return "\u{fffd}";
+        return self.scratch[0..len];
+    }
+};
+
+const ControlWord = enum {
+    bin, uc, ansicpg, destination,
+    par, line, sect, page, row, nestrow,
+    tab, cell, nestcell,
+    quote, dblquote, bullet, emdash, endash, space,
+    other,
+};
+
+const control_words = std.StaticStringMap(ControlWord).initComptime(.{
+    .{ "bin", .bin },
+    .{ "uc", .uc },
+    .{ "ansicpg", .ansicpg },
+    // Not displayed
+    .{ "fonttbl", .destination },
+    .{ "colortbl", .destination },
+    .{ "stylesheet", .destination },
+    .{ "info", .destination },
+    .{ "pict", .destination },
+    .{ "object", .destination },
+    .{ "nonshppict", .destination },
+    .{ "fldinst", .destination },
+    .{ "generator", .destination },
+    .{ "header", .destination },
+    .{ "headerl", .destination },
+    .{ "headerr", .destination },
+    .{ "headerf", .destination },
+    .{ "footer", .destination },
+    .{ "footerl", .destination },
+    .{ "footerr", .destination },
+    .{ "footerf", .destination },
+    .{ "footnote", .destination },
+    .{ "listtable", .destination },
+    .{ "listoverridetable", .destination },
+    .{ "revtbl", .destination },
+    .{ "pntext", .destination }, // List numbers, generated
+    // Text
+    .{ "par", .par },
+    .{ "line", .line },
+    .{ "sect", .sect },
+    .{ "page", .page },
+    .{ "row", .row },
+    .{ "nestrow", .nestrow },
+    .{ "tab", .tab },
+    .{ "cell", .cell },
+    .{ "nestcell", .nestcell },
+    .{ "lquote", .quote },
+    .{ "rquote", .quote },
+    .{ "ldblquote", .dblquote },
+    .{ "rdblquote", .dblquote },
+    .{ "bullet", .bullet },
+    .{ "emdash", .emdash },
+    .{ "endash", .endash },
+    .{ "emspace", .space },
+    .{ "enspace", .space },
+    .{ "qmspace", .space },
+});
+
+fn controlWord(word: []const u8) ControlWord {
+    return control_words.get(word) orelse .other;
+}
+
+// Optional signed decimal parameter of a control word
+fn readParam(data: []const u8, pos: *usize) ?i32 {
+    var i = pos.*;
+    const negative = i < data.len and data[i] == '-';
+    if (negative) i += 1;
+    const digits_start = i;
+    var value: i64 = 0;
+    while (i < data.len and std.ascii.isDigit(data[i])) : (i += 1) {
+        if (i - digits_start < 10) value = value * 10 + (data[i] - '0');
+    }
+    if (i == digits_start) return null;
+    pos.* = i;
+    const clamped: i32 = @intCast(@min(value, std.math.maxInt(i32)));
+    return if (negative) -clamped else clamped;
+}
+
+// Index of the first byte at or after `start` that is one of `needles`, or
+// data.len. Compares a vector of input at a time.
+pub fn indexOfAny(data: []const u8, start: usize, needles: []const u8) usize {
+    const block = std.simd.suggestVectorLength(u8) orelse 16;
+    const Block = @Vector(block, u8);
+    const Mask = std.meta.Int(.unsigned, block);
+
+    var i = start;
+    while (i + block <= data.len) : (i += block) {
+        const chunk: Block = data[i..][0..block].*;
+        var mask: Mask = 0;
+        for (needles) |needle| mask |= @bitCast(chunk == @as(Block, @splat(needle)));
+        if (mask != 0) return i + @ctz(mask);
+    }
+    while (i < data.len) : (i += 1) {
+        if (std.mem.indexOfScalar(u8, needles, data[i]) != null) return i;
+    }
+    return data.len;
+}
+
+// =============================================================================
+// TESTS
+// =============================================================================
+
+fn visibleText(allocator: std.mem.Allocator, data: []const u8) ![]u8 {
+    var text = std.ArrayList(u8).init(allocator);
+    errdefer text.deinit();
+    var scanner = Scanner.init(data);
+    while (try scanner.next()) |token| try text.appendSlice(token.text);
+    return text.toOwnedSlice();
+}
+
+test "scanner decodes visible text" {
+    const testing = std.testing;
+
+    const rtf_data =
+        "{\\rtf1\\ansi{\\fonttbl{\\f0 Arial;}}{\\colortbl;\\red255\\green0\\blue0;}" ++
+        "{\\info{\\title Secret}}{\\*\\generator Word;}\n" ++
+        "Caf\\'e9 \\'80\\~5 \\b bold\\b0\\par\r\n" ++
+        "{\\pict\\pngblip 89504e47\\bin3 }}}}\\u8364?\\uc2\\u8212\\'3f\\'3f\\uc1\\u-10179?\\u-8704?end\\{x\\}}" ++
+        "trailing";
+    const text = try visibleText(testing.allocator, rtf_data);
+    defer testing.allocator.free(text);
+
+    try testing.expectEqualStrings("Caf\u{e9} \u{20ac}\u{a0}5 bold\n\u{20ac}\u{2014}\u{1f600}end{x}", text);
+}
+
+test "scanner tokens keep input offsets" {
+    const testing = std.testing;
+
+    const rtf_data = "{\\rtf1 ab\\'41{\\*\\bkmkstart x}{}\\par}";
+    var scanner = Scanner.init(rtf_data);
+
+    try testing.expectEqual(Token.Kind.control, (try scanner.next()).?.kind); // \rtf1
+    const plain = (try scanner.next()).?;
+    try testing.expect(plain.direct);
+    try testing.expectEqualStrings("ab", rtf_data[plain.start..plain.end]);
+    const escaped = (try scanner.next()).?;
+    try testing.expectEqualStrings("A", escaped.text);
+    try testing.expectEqualStrings("\\'41", rtf_data[escaped.start..escaped.end]);
+    const skipped = (try scanner.next()).?;
+    try testing.expectEqual(Token.Kind.destination, skipped.kind);
+    try testing.expectEqualStrings("bkmkstart", skipped.word);
+    try testing.expectEqualStrings("{\\*\\bkmkstart x}", rtf_data[skipped.start..skipped.end]);
+    try testing.expectEqual(Token.Kind.group_start, (try scanner.next()).?.kind);
+    try testing.expectEqual(Token.Kind.group_end, (try scanner.next()).?.kind);
+    try testing.expectEqualStrings("par", (try scanner.next()).?.word);
+    try testing.expect(try scanner.next() == null);
+
+    var invalid = Scanner.init("plain text");
+    try testing.expectError(error.InvalidRtf, invalid.next());
+}
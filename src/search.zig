@@ -0,0 +1,276 @@
+const std = @import("std");
+const scanner = @import("scanner.zig");
+
+// =============================================================================
+// TEXT SEARCH
+// =============================================================================
+// Finds literal patterns in the visible text of RTF (see scanner.zig) without
+// parsing it into a document. Text is decoded from the token stream as it is
+// read, so a match may span plain text, escapes and the control words that
+// display nothing: "re\b port" is found as "report".
+//
+// Matches are leftmost-longest and do not overlap. Only the text from the
+// earliest position that could still start a match is kept between tokens,
+// at most the longest pattern less one byte, together with the input ranges
+// it was decoded from. Candidates are found with a vector scan for the first
+// bytes of the patterns and only then compared.
+
+pub const Options = struct {
+    ignore_case: bool = false, // ASCII letters only
+};
+
+// Layout matches rtf_search_hit in c_api.h
+pub const Hit = extern struct {
+    text: [*]const u8, // As it appears in the visible text, not terminated
+    text_length: usize,
+    text_offset: usize, // In the visible text
+    start: usize, // Input bytes the match was decoded from
+    end: usize,
+    pattern: usize, // Index of the pattern found
+};
+
+// Receives hits in text order; returning false stops the search
+pub const Sink = struct {
+    context: *anyopaque,
+    emit: *const fn (context: *anyopaque, hit: *const Hit) bool,
+};
+
+// First bytes compared a vector at a time; more go through a table
+const max_vector_needles = 8;
+
+pub fn search(allocator: std.mem.Allocator, data: []const u8, patterns: []const []const u8, options: Options, sink: Sink) !void {
+    var searcher = try Searcher.init(allocator, patterns, options, sink);
+    defer searcher.deinit();
+
+    var tokens = scanner.Scanner.init(data);
+    while (try tokens.next()) |token| try searcher.feed(token);
+    try searcher.finish();
+}
+
+pub const Searcher = struct {
+    patterns: []const []const u8,
+    by_length: []usize, // Pattern indexes, longest first
+    options: Options,
+    sink: Sink,
+    allocator: std.mem.Allocator,
+
+    needles: [max_vector_needles]u8 = undefined,
+    needle_count: usize = 0,
+    first_bytes: [256]bool = [_]bool{false} ** 256,
+
+    // Text that may still hold the start of a match, and where it came from
+    window: std.ArrayListUnmanaged(u8) = .{},
+    spans: std.ArrayListUnmanaged(Span) = .{},
+    base: usize = 0, // Text offset of window[0]
+
+    const Span = struct {
+        text_offset: usize,
+        len: usize,
+        start: usize,
+        end: usize,
+        direct: bool, // Byte for byte from `start`
+    };
+
+    pub fn init(allocator: std.mem.Allocator, patterns: []const []const u8, options: Options, sink: Sink) !Searcher {
+        if (patterns.len == 0) return error.EmptyPattern;
+        for (patterns) |pattern| {
+            if (pattern.len == 0) return error.EmptyPattern;
+        }
+
+        const by_length = try allocator.alloc(usize, patterns.len);
+        for (by_length, 0..) |*index, i| index.* = i;
+        std.mem.sort(usize, by_length, patterns, longerFirst);
+
+        var searcher = Searcher{
+            .patterns = patterns,
+            .by_length = by_length,
+            .options = options,
+            .sink = sink,
+            .allocator = allocator,
+        };
+        for (patterns) |pattern| {
+            searcher.first_bytes[pattern[0]] = true;
+            if (options.ignore_case) {
+                searcher.first_bytes[std.ascii.toLower(pattern[0])] = true;
+                searcher.first_bytes[std.ascii.toUpper(pattern[0])] = true;
+            }
+        }
+        for (searcher.first_bytes, 0..) |first, byte| {
+            if (!first) continue;
+            if (searcher.needle_count < max_vector_needles) searcher.needles[searcher.needle_count] = @intCast(byte);
+            searcher.needle_count += 1;
+        }
+        return searcher;
+    }
+
+    pub fn deinit(self: *Searcher) void {
+        self.allocator.free(self.by_length);
+        self.window.deinit(self.allocator);
+        self.spans.deinit(self.allocator);
+    }
+
+    fn longerFirst(patterns: []const []const u8, a: usize, b: usize) bool {
+        return patterns[a].len > patterns[b].len;
+    }
+
+    // Text of the next token, in order
+    pub fn feed(self: *Searcher, token: scanner.Token) !void {
+        if (token.text.len == 0) return;
+        try self.spans.append(self.allocator, .{
+            .text_offset = self.base + self.window.items.len,
+            .len = token.text.len,
+            .start = token.start,
+            .end = token.end,
+            .direct = token.direct,
+        });
+        try self.window.appendSlice(self.allocator, token.text);
+        try self.scan(false);
+    }
+
+    // The text has ended: decide matches still waiting for more of it
+    pub fn finish(self: *Searcher) !void {
+        try self.scan(true);
+    }
+
+    fn scan(self: *Searcher, final: bool) !void {
+        const window = self.window.items;
+        var i: usize = 0;
+        while (true) {
+            i = self.nextCandidate(window, i);
+            if (i >= window.len) break;
+            switch (self.matchAt(window, i, final)) {
+                .undecided => break,
+                .none => i += 1,
+                .found => |pattern| {
+                    const len = self.patterns[pattern].len;
+                    const hit = Hit{
+                        .text = window[i..].ptr,
+                        .text_length = len,
+                        .text_offset = self.base + i,
+                        .start = self.inputStart(self.base + i),
+                        .end = self.inputEnd(self.base + i + len - 1),
+                        .pattern = pattern,
+                    };
+                    if (!self.sink.emit(self.sink.context, &hit)) return error.Stopped;
+                    i += len;
+                },
+            }
+        }
+        self.drop(i);
+    }
+
+    fn nextCandidate(self: *const Searcher, window: []const u8, from: usize) usize {
+        if (self.needle_count <= max_vector_needles) {
+            return scanner.indexOfAny(window, from, self.needles[0..self.needle_count]);
+        }
+        var i = from;
+        while (i < window.len and !self.first_bytes[window[i]]) i += 1;
+        return i;
+    }
+
+    const Match = union(enum) {
+        none,
+        undecided, // A pattern matches as far as the text goes
+        found: usize,
+    };
+
+    fn matchAt(self: *const Searcher, window: []const u8, i: usize, final: bool) Match {
+        for (self.by_length) |index| {
+            const pattern = self.patterns[index];
+            const available = @min(pattern.len, window.len - i);
+            if (!self.equal(window[i..][0..available], pattern[0..available])) continue;
+            if (available == pattern.len) return .{ .found = index };
+            if (!final) return .undecided;
+        }
+        return .none;
+    }
+
+    fn equal(self: *const Searcher, text: []const u8, pattern: []const u8) bool {
+        if (self.options.ignore_case) return std.ascii.eqlIgnoreCase(text, pattern);
+        return std.mem.eql(u8, text, pattern);
+    }
+
+    // Forget the first `count` bytes of the window
+    fn drop(self: *Searcher, count: usize) void {
+        const window = self.window.items;
+        std.mem.copyForwards(u8, window[0 .. window.len - count], window[count..]);
+        self.window.shrinkRetainingCapacity(window.len - count);
+        self.base += count;
+
+        var kept: usize = 0;
+        while (kept < self.spans.items.len) : (kept += 1) {
+            const span = self.spans.items[kept];
+            if (span.text_offset + span.len > self.base) break;
+        }
+        const spans = self.spans.items;
+        std.mem.copyForwards(Span, spans[0 .. spans.len - kept], spans[kept..]);
+        self.spans.shrinkRetainingCapacity(spans.len - kept);
+    }
+
+    fn spanOf(self: *const Searcher, text_offset: usize) Span {
+        for (self.spans.items) |span| {
+            if (text_offset < span.text_offset + span.len) return span;
+        }
+        unreachable; // Offsets passed in are in the window
+    }
+
+    fn inputStart(self: *const Searcher, text_offset: usize) usize {
+        const span = self.spanOf(text_offset);
+        return if (span.direct) span.start + (text_offset - span.text_offset) else span.start;
+    }
+
+    fn inputEnd(self: *const Searcher, text_offset: usize) usize {
+        const span = self.spanOf(text_offset);
+        return if (span.direct) span.start + (text_offset - span.text_offset) + 1 else span.end;
+    }
+};
+
+// =============================================================================
+// TESTS
+// =============================================================================
+
+const HitRecorder = struct {
+    hits: std.ArrayList(u8),
+    limit: usize = std.math.maxInt(usize),
+    count: usize = 0,
+
+    fn emit(context: *anyopaque, hit: *const Hit) bool {
+        const self: *HitRecorder = @ptrCast(@alignCast(context));
+        self.hits.writer().print("{d}:{s}@{d}-{d} ", .{ hit.pattern, hit.text[0..hit.text_length], hit.start, hit.end }) catch return false;
+        self.count += 1;
+        return self.count < self.limit;
+    }
+};
+
+test "search finds text across escapes and control words" {
+    const testing = std.testing;
+
+    var recorder = HitRecorder{ .hits = std.ArrayList(u8).init(testing.allocator) };
+    defer recorder.hits.deinit();
+
+    const rtf_data = "{\\rtf1{\\fonttbl{\\f0 Report;}}Re\\b port, caf\\'e9 REPORT\\par}";
+    try search(testing.allocator, rtf_data, &.{ "report", "caf\u{e9}" }, .{ .ignore_case = true }, .{
+        .context = &recorder,
+        .emit = HitRecorder.emit,
+    });
+    try testing.expectEqualStrings("0:Report@29-38 1:caf\u{e9}@40-47 0:REPORT@48-54 ", recorder.hits.items);
+}
+
+test "search prefers the longest match and can be stopped" {
+    const testing = std.testing;
+
+    var recorder = HitRecorder{ .hits = std.ArrayList(u8).init(testing.allocator), .limit = 2 };
+    defer recorder.hits.deinit();
+
+    const sink = Sink{ .context = &recorder, .emit = HitRecorder.emit };
+    try testing.expectError(error.Stopped, search(testing.allocator, "{\\rtf1 aaa ab abc ab}", &.{ "ab", "abc", "a" }, .{}, sink));
+    try testing.expectEqualStrings("2:a@7-8 2:a@8-9 ", recorder.hits.items);
+
+    recorder.hits.clearRetainingCapacity();
+    recorder.count = 0;
+    recorder.limit = std.math.maxInt(usize);
+    try search(testing.allocator, "{\\rtf1 x ab abc ab}", &.{ "ab", "abc" }, .{}, sink);
+    try testing.expectEqualStrings("0:ab@9-11 1:abc@12-15 0:ab@16-18 ", recorder.hits.items);
+
+    try testing.expectError(error.EmptyPattern, search(testing.allocator, "{\\rtf1}", &.{""}, .{}, sink));
+}
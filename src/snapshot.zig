@@ -0,0 +1,714 @@
+const std = @import("std");
+const builtin = @import("builtin");
+const doc_model = @import("document_model.zig");
+const io = @import("io.zig");
+
+// =============================================================================
+// BINARY DOCUMENT SNAPSHOTS
+// =============================================================================
+// Serializes a parsed Document into a versioned, position-independent layout
+// that can be memory-mapped and used in place instead of re-parsing the RTF.
+//
+// File layout (little-endian, section offsets relative to the file start):
+//   Header         magic, version, document properties, section directory
+//   strings        zero-terminated byte strings: run text, font names, URLs,
+//                  image data and the document's plain text
+//   formats        interned character + paragraph formats
+//   fonts, colors  font and color tables
+//   elements       top-level content elements
+//   cell_elements  content of table cells
+//   rows, cells    flattened table structure
+//
+// Every section starts on an 8-byte boundary so records are read in place.
+// Spans into the strings section are relative to the start of that section.
+
+pub const magic = "ZRTFSNAP".*;
+pub const version: u32 = 1;
+
+pub const Error = error{
+    InvalidSnapshot,
+    UnsupportedSnapshotVersion,
+    UnsupportedPlatform,
+};
+
+pub const Span = extern struct {
+    offset: u64 = 0,
+    len: u64 = 0,
+};
+
+const Section = enum(u8) {
+    strings,
+    formats,
+    fonts,
+    colors,
+    elements,
+    cell_elements,
+    rows,
+    cells,
+};
+
+const section_count = std.enums.values(Section).len;
+const section_alignment = 8;
+
+const SectionEntry = extern struct {
+    offset: u64 = 0,
+    count: u64 = 0,
+};
+
+const Header = extern struct {
+    magic: [8]u8,
+    version: u32,
+    header_size: u32,
+    file_size: u64,
+    default_font: u16,
+    default_font_size: u16,
+    code_page: u16,
+    rtf_version: u16,
+    plain_text: Span,
+    sections: [section_count]SectionEntry,
+};
+
+// Character and paragraph formatting packed into one record
+const FormatRecord = extern struct {
+    flags: u16,
+    alignment: u8,
+    line_spacing: u8,
+    font_id: u16,
+    font_size: u16,
+    color_id: u16,
+    space_before: u16,
+    space_after: u16,
+    reserved: u16 = 0,
+    left_indent: i32,
+    right_indent: i32,
+    first_line_indent: i32,
+
+    const bold: u16 = 1 << 0;
+    const italic: u16 = 1 << 1;
+    const underline: u16 = 1 << 2;
+    const strikethrough: u16 = 1 << 3;
+    const superscript: u16 = 1 << 4;
+    const subscript: u16 = 1 << 5;
+    const has_font: u16 = 1 << 6;
+    const has_size: u16 = 1 << 7;
+    const has_color: u16 = 1 << 8;
+
+    fn fromRun(run: doc_model.TextRun) FormatRecord {
+        const char_fmt = run.char_format;
+        const para_fmt = run.para_format;
+
+        var flags: u16 = 0;
+        if (char_fmt.bold) flags |= bold;
+        if (char_fmt.italic) flags |= italic;
+        if (char_fmt.underline) flags |= underline;
+        if (char_fmt.strikethrough) flags |= strikethrough;
+        if (char_fmt.superscript) flags |= superscript;
+        if (char_fmt.subscript) flags |= subscript;
+        if (char_fmt.font_id != null) flags |= has_font;
+        if (char_fmt.font_size != null) flags |= has_size;
+        if (char_fmt.color_id != null) flags |= has_color;
+
+        return .{
+            .flags = flags,
+            .alignment = @intFromEnum(para_fmt.alignment),
+            .line_spacing = @intFromEnum(para_fmt.line_spacing),
+            .font_id = char_fmt.font_id orelse 0,
+            .font_size = char_fmt.font_size orelse 0,
+            .color_id = char_fmt.color_id orelse 0,
+            .space_before = para_fmt.space_before,
+            .space_after = para_fmt.space_after,
+            .left_indent = para_fmt.left_indent,
+            .right_indent = para_fmt.right_indent,
+            .first_line_indent = para_fmt.first_line_indent,
+        };
+    }
+
+    fn charFormat(self: FormatRecord) doc_model.CharFormat {
+        return .{
+            .bold = self.flags & bold != 0,
+            .italic = self.flags & italic != 0,
+            .underline = self.flags & underline != 0,
+            .strikethrough = self.flags & strikethrough != 0,
+            .superscript = self.flags & superscript != 0,
+            .subscript = self.flags & subscript != 0,
+            .font_id = if (self.flags & has_font != 0) self.font_id else null,
+            .font_size = if (self.flags & has_size != 0) self.font_size else null,
+            .color_id = if (self.flags & has_color != 0) self.color_id else null,
+        };
+    }
+
+    fn paraFormat(self: FormatRecord) !doc_model.ParaFormat {
+        return .{
+            .alignment = std.meta.intToEnum(doc_model.ParaFormat.Alignment, self.alignment) catch return error.InvalidSnapshot,
+            .left_indent = self.left_indent,
+            .right_indent = self.right_indent,
+            .first_line_indent = self.first_line_indent,
+            .space_before = self.space_before,
+            .space_after = self.space_after,
+            .line_spacing = std.meta.intToEnum(doc_model.ParaFormat.LineSpacing, self.line_spacing) catch return error.InvalidSnapshot,
+        };
+    }
+};
+
+const FontRecord = extern struct {
+    id: u16,
+    family: u8,
+    charset: u8,
+    reserved: u32 = 0,
+    name: Span,
+};
+
+const ColorRecord = extern struct {
+    id: u16,
+    red: u8,
+    green: u8,
+    blue: u8,
+    reserved: u8 = 0,
+};
+
+const ElementKind = enum(u8) {
+    text_run,
+    paragraph_break,
+    line_break,
+    page_break,
+    table,
+    image,
+    hyperlink,
+};
+
+// primary/secondary depend on the kind:
+//   text_run  - primary: text
+//   table     - primary: row range (offset = first row, len = row count)
+//   image     - primary: data, secondary: offset = width, len = height
+//   hyperlink - primary: url, secondary: display text
+const ElementRecord = extern struct {
+    kind: u8,
+    image_format: u8 = 0,
+    reserved: u16 = 0,
+    format_index: u32 = 0,
+    primary: Span = .{},
+    secondary: Span = .{},
+};
+
+const RowRecord = extern struct {
+    first_cell: u64,
+    cell_count: u32,
+    height: u32,
+};
+
+const CellRecord = extern struct {
+    first_element: u64, // Index into cell_elements
+    element_count: u32,
+    width: u32,
+    borders: u8, // left, right, top, bottom in bits 0-3
+    reserved: [7]u8 = [_]u8{0} ** 7,
+};
+
+// =============================================================================
+// SAVING
+// =============================================================================
+
+const Builder = struct {
+    strings: std.ArrayList(u8),
+    formats: std.ArrayList(FormatRecord),
+    format_ids: std.AutoHashMap(FormatRecord, u32),
+    fonts: std.ArrayList(FontRecord),
+    colors: std.ArrayList(ColorRecord),
+    elements: std.ArrayList(ElementRecord),
+    cell_elements: std.ArrayList(ElementRecord),
+    rows: std.ArrayList(RowRecord),
+    cells: std.ArrayList(CellRecord),
+
+    fn init(allocator: std.mem.Allocator) Builder {
+        return .{
+            .strings = std.ArrayList(u8).init(allocator),
+            .formats = std.ArrayList(FormatRecord).init(allocator),
+            .format_ids = std.AutoHashMap(FormatRecord, u32).init(allocator),
+            .fonts = std.ArrayList(FontRecord).init(allocator),
+            .colors = std.ArrayList(ColorRecord).init(allocator),
+            .elements = std.ArrayList(ElementRecord).init(allocator),
+            .cell_elements = std.ArrayList(ElementRecord).init(allocator),
+            .rows = std.ArrayList(RowRecord).init(allocator),
+            .cells = std.ArrayList(CellRecord).init(allocator),
+        };
+    }
+
+    fn deinit(self: *Builder) void {
+        self.strings.deinit();
+        self.formats.deinit();
+        self.format_ids.deinit();
+        self.fonts.deinit();
+        self.colors.deinit();
+        self.elements.deinit();
+        self.cell_elements.deinit();
+        self.rows.deinit();
+        self.cells.deinit();
+    }
+
+    fn addString(self: *Builder, bytes: []const u8) !Span {
+        const offset = self.strings.items.len;
+        try self.strings.ensureUnusedCapacity(bytes.len + 1);
+        self.strings.appendSliceAssumeCapacity(bytes);
+        self.strings.appendAssumeCapacity(0);
+        return .{ .offset = offset, .len = bytes.len };
+    }
+
+    fn internFormat(self: *Builder, run: doc_model.TextRun) !u32 {
+        const record = FormatRecord.fromRun(run);
+        const entry = try self.format_ids.getOrPut(record);
+        if (!entry.found_existing) {
+            entry.value_ptr.* = @intCast(self.formats.items.len);
+            try self.formats.append(record);
+        }
+        return entry.value_ptr.*;
+    }
+
+    fn addDocument(self: *Builder, document: *const doc_model.Document) !void {
+        for (document.font_table.items) |font| {
+            try self.fonts.append(.{
+                .id = font.id,
+                .family = @intFromEnum(font.family),
+                .charset = font.charset,
+                .name = try self.addString(font.name),
+            });
+        }
+
+        for (document.color_table.items) |color| {
+            try self.colors.append(.{
+                .id = color.id,
+                .red = color.red,
+                .green = color.green,
+                .blue = color.blue,
+            });
+        }
+
+        try self.elements.ensureTotalCapacity(document.content.items.len);
+        for (document.content.items) |element| {
+            const record = switch (element) {
+                .table => |table| try self.encodeTable(table),
+                else => try self.encodeInline(element),
+            };
+            self.elements.appendAssumeCapacity(record);
+        }
+    }
+
+    fn encodeTable(self: *Builder, table: doc_model.Table) !ElementRecord {
+        const first_row = self.rows.items.len;
+
+        for (table.rows.items, 0..) |row, row_index| {
+            const first_cell = self.cells.items.len;
+
+            for (table.rowCells(row_index)) |cell| {
+                const first_element = self.cell_elements.items.len;
+
+                for (table.cellRuns(cell)) |run| {
+                    try self.cell_elements.append(try self.encodeInline(.{ .text_run = run }));
+                }
+
+                var borders: u8 = 0;
+                if (cell.border_left) borders |= 1 << 0;
+                if (cell.border_right) borders |= 1 << 1;
+                if (cell.border_top) borders |= 1 << 2;
+                if (cell.border_bottom) borders |= 1 << 3;
+
+                try self.cells.append(.{
+                    .first_element = first_element,
+                    .element_count = @intCast(self.cell_elements.items.len - first_element),
+                    .width = cell.width,
+                    .borders = borders,
+                });
+            }
+
+            try self.rows.append(.{
+                .first_cell = first_cell,
+                .cell_count = @intCast(self.cells.items.len - first_cell),
+                .height = row.height,
+            });
+        }
+
+        return .{
+            .kind = @intFromEnum(ElementKind.table),
+            .primary = .{ .offset = first_row, .len = table.rows.items.len },
+        };
+    }
+
+    fn encodeInline(self: *Builder, element: doc_model.ContentElement) !ElementRecord {
+        return switch (element) {
+            .text_run => |run| .{
+                .kind = @intFromEnum(ElementKind.text_run),
+                .format_index = try self.internFormat(run),
+                .primary = try self.addString(run.text),
+            },
+            .paragraph_break => .{ .kind = @intFromEnum(ElementKind.paragraph_break) },
+            .line_break => .{ .kind = @intFromEnum(ElementKind.line_break) },
+            .page_break => .{ .kind = @intFromEnum(ElementKind.page_break) },
+            .image => |image| .{
+                .kind = @intFromEnum(ElementKind.image),
+                .image_format = @intFromEnum(image.format),
+                .primary = try self.addString(image.data),
+                .secondary = .{ .offset = image.width, .len = image.height },
+            },
+            .hyperlink => |link| .{
+                .kind = @intFromEnum(ElementKind.hyperlink),
+                .primary = try self.addString(link.url),
+                .secondary = try self.addString(link.display_text),
+            },
+            .table => unreachable, // Handled by encodeTable
+        };
+    }
+};
+
+fn alignOffset(offset: u64) u64 {
+    return std.mem.alignForward(u64, offset, section_alignment);
+}
+
+// Write a snapshot of the document. The plain text is computed (and cached)
+// so loading never has to rebuild it.
+pub fn save(document: *doc_model.Document, writer: anytype) !void {
+    if (builtin.cpu.arch.endian() != .little) return error.UnsupportedPlatform;
+
+    var builder = Builder.init(document.allocator);
+    defer builder.deinit();
+
+    try builder.addDocument(document);
+    const plain_text = try builder.addString(try document.getPlainText());
+
+    const blobs = [section_count][]const u8{
+        builder.strings.items,
+        std.mem.sliceAsBytes(builder.formats.items),
+        std.mem.sliceAsBytes(builder.fonts.items),
+        std.mem.sliceAsBytes(builder.colors.items),
+        std.mem.sliceAsBytes(builder.elements.items),
+        std.mem.sliceAsBytes(builder.cell_elements.items),
+        std.mem.sliceAsBytes(builder.rows.items),
+        std.mem.sliceAsBytes(builder.cells.items),
+    };
+    const counts = [section_count]usize{
+        builder.strings.items.len,
+        builder.formats.items.len,
+        builder.fonts.items.len,
+        builder.colors.items.len,
+        builder.elements.items.len,
+        builder.cell_elements.items.len,
+        builder.rows.items.len,
+        builder.cells.items.len,
+    };
+
+    var header = Header{
+        .magic = magic,
+        .version = version,
+        .header_size = @sizeOf(Header),
+        .file_size = 0,
+        .default_font = document.default_font,
+        .default_font_size = document.default_font_size,
+        .code_page = document.code_page,
+        .rtf_version = document.rtf_version,
+        .plain_text = plain_text,
+        .sections = undefined,
+    };
+
+    var offset = alignOffset(@sizeOf(Header));
+    for (blobs, counts, 0..) |blob, count, i| {
+        header.sections[i] = .{ .offset = offset, .count = count };
+        offset = alignOffset(offset + blob.len);
+    }
+    header.file_size = offset;
+
+    try writer.writeAll(std.mem.asBytes(&header));
+    var written: u64 = @sizeOf(Header);
+    for (blobs, 0..) |blob, i| {
+        try writer.writeByteNTimes(0, @intCast(header.sections[i].offset - written));
+        try writer.writeAll(blob);
+        written = header.sections[i].offset + blob.len;
+    }
+    try writer.writeByteNTimes(0, @intCast(header.file_size - written));
+}
+
+// =============================================================================
+// LOADING
+// =============================================================================
+
+const View = struct {
+    strings: []const u8,
+    formats: []const FormatRecord,
+    fonts: []const FontRecord,
+    colors: []const ColorRecord,
+    elements: []const ElementRecord,
+    cell_elements: []const ElementRecord,
+    rows: []const RowRecord,
+    cells: []const CellRecord,
+
+    fn init(bytes: []align(section_alignment) const u8, header: *const Header) !View {
+        const sections = header.sections;
+        return .{
+            .strings = try sectionSlice(u8, bytes, sections[@intFromEnum(Section.strings)]),
+            .formats = try sectionSlice(FormatRecord, bytes, sections[@intFromEnum(Section.formats)]),
+            .fonts = try sectionSlice(FontRecord, bytes, sections[@intFromEnum(Section.fonts)]),
+            .colors = try sectionSlice(ColorRecord, bytes, sections[@intFromEnum(Section.colors)]),
+            .elements = try sectionSlice(ElementRecord, bytes, sections[@intFromEnum(Section.elements)]),
+            .cell_elements = try sectionSlice(ElementRecord, bytes, sections[@intFromEnum(Section.cell_elements)]),
+            .rows = try sectionSlice(RowRecord, bytes, sections[@intFromEnum(Section.rows)]),
+            .cells = try sectionSlice(CellRecord, bytes, sections[@intFromEnum(Section.cells)]),
+        };
+    }
+
+    // Strings are validated to be in bounds and zero-terminated
+    fn string(self: *const View, span: Span) ![:0]const u8 {
+        const end = std.math.add(u64, span.offset, span.len) catch return error.InvalidSnapshot;
+        if (end >= self.strings.len) return error.InvalidSnapshot;
+
+        const start: usize = @intCast(span.offset);
+        const stop: usize = @intCast(end);
+        if (self.strings[stop] != 0) return error.InvalidSnapshot;
+
+        return self.strings[start..stop :0];
+    }
+
+    fn decodeElement(self: *const View, record: ElementRecord, allocator: std.mem.Allocator, allow_tables: bool) !doc_model.ContentElement {
+        const kind = std.meta.intToEnum(ElementKind, record.kind) catch return error.InvalidSnapshot;
+
+        switch (kind) {
+            .text_run => {
+                if (record.format_index >= self.formats.len) return error.InvalidSnapshot;
+                const format = self.formats[record.format_index];
+                return .{ .text_run = doc_model.TextRun.init(
+                    try self.string(record.primary),
+                    format.charFormat(),
+                    try format.paraFormat(),
+                ) };
+            },
+            .paragraph_break => return .paragraph_break,
+            .line_break => return .line_break,
+            .page_break => return .page_break,
+            .table => {
+                if (!allow_tables) return error.InvalidSnapshot;
+                return .{ .table = try self.decodeTable(record.primary, allocator) };
+            },
+            .image => return .{ .image = .{
+                .format = std.meta.intToEnum(doc_model.ImageInfo.ImageFormat, record.image_format) catch return error.InvalidSnapshot,
+                .width = std.math.cast(u32, record.secondary.offset) orelse return error.InvalidSnapshot,
+                .height = std.math.cast(u32, record.secondary.len) orelse return error.InvalidSnapshot,
+                .data = try self.string(record.primary),
+            } },
+            .hyperlink => return .{ .hyperlink = .{
+                .url = try self.string(record.primary),
+                .display_text = try self.string(record.secondary),
+            } },
+        }
+    }
+
+    fn decodeTable(self: *const View, row_range: Span, allocator: std.mem.Allocator) !doc_model.Table {
+        const row_records = try subRange(RowRecord, self.rows, row_range.offset, row_range.len);
+
+        var table = doc_model.Table.init(allocator);
+        errdefer table.deinit();
+        try table.rows.ensureTotalCapacity(row_records.len);
+
+        for (row_records) |row_record| {
+            try table.addRow(row_record.height);
+
+            const cell_records = try subRange(CellRecord, self.cells, row_record.first_cell, row_record.cell_count);
+            try table.cells.ensureUnusedCapacity(cell_records.len);
+
+            for (cell_records) |cell_record| {
+                var cell = doc_model.TableCell{
+                    .width = cell_record.width,
+                    .border_left = cell_record.borders & (1 << 0) != 0,
+                    .border_right = cell_record.borders & (1 << 1) != 0,
+                    .border_top = cell_record.borders & (1 << 2) != 0,
+                    .border_bottom = cell_record.borders & (1 << 3) != 0,
+                    .first_run = std.math.cast(u32, table.runs.items.len) orelse return error.InvalidSnapshot,
+                };
+
+                // Cells hold text runs only
+                const contents = try subRange(ElementRecord, self.cell_elements, cell_record.first_element, cell_record.element_count);
+                try table.runs.ensureUnusedCapacity(contents.len);
+                for (contents) |content_record| {
+                    switch (try self.decodeElement(content_record, allocator, false)) {
+                        .text_run => |run| table.runs.appendAssumeCapacity(run),
+                        else => return error.InvalidSnapshot,
+                    }
+                }
+                cell.run_count = @intCast(contents.len);
+
+                table.cells.appendAssumeCapacity(cell);
+            }
+        }
+
+        return table;
+    }
+};
+
+fn sectionSlice(comptime T: type, bytes: []align(section_alignment) const u8, entry: SectionEntry) ![]const T {
+    const size = std.math.mul(u64, entry.count, @sizeOf(T)) catch return error.InvalidSnapshot;
+    const end = std.math.add(u64, entry.offset, size) catch return error.InvalidSnapshot;
+    if (end > bytes.len or entry.offset % section_alignment != 0) return error.InvalidSnapshot;
+
+    const start: usize = @intCast(entry.offset);
+    const items: [*]const T = @ptrCast(@alignCast(bytes.ptr + start));
+    return items[0..@intCast(entry.count)];
+}
+
+fn subRange(comptime T: type, items: []const T, first: u64, count: u64) ![]const T {
+    const end = std.math.add(u64, first, count) catch return error.InvalidSnapshot;
+    if (end > items.len) return error.InvalidSnapshot;
+    return items[@intCast(first)..@intCast(end)];
+}
+
+// Decode a snapshot into an existing (empty) document. All strings and image
+// data are borrowed from `bytes`, which must outlive the document.
+fn decodeInto(document: *doc_model.Document, bytes: []align(section_alignment) const u8) !void {
+    if (builtin.cpu.arch.endian() != .little) return error.UnsupportedPlatform;
+    if (bytes.len < @sizeOf(Header)) return error.InvalidSnapshot;
+
+    const header: *const Header = @ptrCast(bytes.ptr);
+    if (!std.mem.eql(u8, &header.magic, &magic)) return error.InvalidSnapshot;
+    if (header.version != version) return error.UnsupportedSnapshotVersion;
+    if (header.header_size != @sizeOf(Header) or header.file_size > bytes.len) return error.InvalidSnapshot;
+
+    const view = try View.init(bytes, header);
+    const allocator = document.allocator;
+
+    document.default_font = header.default_font;
+    document.default_font_size = header.default_font_size;
+    document.code_page = header.code_page;
+    document.rtf_version = header.rtf_version;
+
+    try document.font_table.ensureTotalCapacity(view.fonts.len);
+    for (view.fonts) |font| {
+        document.font_table.appendAssumeCapacity(.{
+            .id = font.id,
+            .name = try view.string(font.name),
+            .family = std.meta.intToEnum(doc_model.FontInfo.FontFamily, font.family) catch return error.InvalidSnapshot,
+            .charset = font.charset,
+        });
+    }
+
+    try document.color_table.ensureTotalCapacity(view.colors.len);
+    for (view.colors) |color| {
+        document.color_table.appendAssumeCapacity(.{
+            .id = color.id,
+            .red = color.red,
+            .green = color.green,
+            .blue = color.blue,
+        });
+    }
+
+    try document.content.ensureTotalCapacity(view.elements.len);
+    for (view.elements) |record| {
+        document.content.appendAssumeCapacity(try view.decodeElement(record, allocator, true));
+    }
+
+    document.plain_text = try view.string(header.plain_text);
+}
+
+// Load a snapshot from memory. The document borrows `bytes`.
+pub fn load(bytes: []align(section_alignment) const u8, allocator: std.mem.Allocator) !doc_model.Document {
+    var document = try doc_model.Document.init(allocator);
+    errdefer document.deinit();
+
+    try decodeInto(&document, bytes);
+    return document;
+}
+
+// Load a snapshot file. Where supported the file is memory-mapped read-only;
+// otherwise it is read into memory. Either way the document owns it.
+pub fn loadFile(path: []const u8, allocator: std.mem.Allocator) !doc_model.Document {
+    const file = try std.fs.cwd().openFile(path, .{});
+    defer file.close();
+
+    const size = try file.getEndPos();
+    if (size < @sizeOf(Header)) return error.InvalidSnapshot;
+
+    var document = try doc_model.Document.init(allocator);
+    errdefer document.deinit();
+
+    const mapping = try io.FileBytes.map(file, allocator);
+    document.mapping = mapping;
+    try decodeInto(&document, mapping.bytes);
+    return document;
+}
+
+// =============================================================================
+// TESTS
+// =============================================================================
+
+const formatted_parser = @import("formatted_parser.zig");
+
+// Copy serialized bytes into 8-byte aligned storage, as a mapping would be
+fn alignedCopy(allocator: std.mem.Allocator, bytes: []const u8) ![]u64 {
+    const words = try allocator.alloc(u64, std.math.divCeil(usize, bytes.len, 8) catch unreachable);
+    @memcpy(std.mem.sliceAsBytes(words)[0..bytes.len], bytes);
+    return words;
+}
+
+test "snapshot round-trip preserves the document" {
+    const testing = std.testing;
+
+    const rtf_data = "{\\rtf1\\ansi\\deff0 {\\fonttbl{\\f0\\fswiss Arial;}{\\f1\\froman Times;}}" ++
+        "{\\colortbl;\\red255\\green0\\blue0;}" ++
+        "Hello \\b\\f1\\cf1 bold\\b0 \\qc centered\\par" ++
+        "\\trowd\\cellx1000\\cellx2000 A1\\cell B1\\cell\\row\\par After" ++
+        "{\\pict\\pngblip\\picw10\\pich20 89504e47}}";
+
+    var stream = std.io.fixedBufferStream(rtf_data);
+    var parser = try formatted_parser.FormattedParser.init(stream.reader().any(), testing.allocator);
+    defer parser.deinit();
+    var original = try parser.parse();
+    defer original.deinit();
+
+    var buffer = std.ArrayList(u8).init(testing.allocator);
+    defer buffer.deinit();
+    try save(&original, buffer.writer());
+
+    const words = try alignedCopy(testing.allocator, buffer.items);
+    defer testing.allocator.free(words);
+    const bytes: []align(section_alignment) const u8 = std.mem.sliceAsBytes(words)[0..buffer.items.len];
+
+    var loaded = try load(bytes, testing.allocator);
+    defer loaded.deinit();
+
+    try testing.expectEqualStrings(try original.getPlainText(), try loaded.getPlainText());
+    try testing.expectEqual(original.content.items.len, loaded.content.items.len);
+    try testing.expectEqual(original.font_table.items.len, loaded.font_table.items.len);
+    try testing.expectEqualStrings("Times", loaded.getFont(1).?.name);
+    try testing.expectEqual(@as(u32, 0xFF0000), loaded.getColor(2).?.toU32());
+
+    // Regeneration is the strictest equality check we have
+    const original_rtf = try original.generateRtf(testing.allocator);
+    defer testing.allocator.free(original_rtf);
+    const loaded_rtf = try loaded.generateRtf(testing.allocator);
+    defer testing.allocator.free(loaded_rtf);
+    try testing.expectEqualStrings(original_rtf, loaded_rtf);
+}
+
+test "snapshot rejects corrupt input" {
+    const testing = std.testing;
+
+    var stream = std.io.fixedBufferStream("{\\rtf1 Some \\b text}");
+    var parser = try formatted_parser.FormattedParser.init(stream.reader().any(), testing.allocator);
+    defer parser.deinit();
+    var original = try parser.parse();
+    defer original.deinit();
+
+    var buffer = std.ArrayList(u8).init(testing.allocator);
+    defer buffer.deinit();
+    try save(&original, buffer.writer());
+
+    const words = try alignedCopy(testing.allocator, buffer.items);
+    defer testing.allocator.free(words);
+    const bytes = std.mem.sliceAsBytes(words);
+
+    // Truncated
+    try testing.expectError(error.InvalidSnapshot, load(bytes[0..16], testing.allocator));
+
+    // Wrong version
+    const header: *Header = @ptrCast(@alignCast(bytes.ptr));
+    header.version += 1;
+    try testing.expectError(error.UnsupportedSnapshotVersion, load(bytes, testing.allocator));
+    header.version -= 1;
+
+    // String span pointing past the strings section
+    header.plain_text.len = std.math.maxInt(u32);
+    try testing.expectError(error.InvalidSnapshot, load(bytes, testing.allocator));
+}
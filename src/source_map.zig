@@ -0,0 +1,396 @@
+const std = @import("std");
+const doc_model = @import("document_model.zig");
+
+// =============================================================================
+// SOURCE MAP
+// =============================================================================
+// Byte ranges of the RTF input behind each text run, table, table cell and
+// image, recorded by the parser on request (FormattedParser.recordSourceMap).
+// Callers can patch or highlight the original bytes without reparsing.
+//
+// Ranges are delta-encoded: each entry is the zigzag varint distance of its
+// start from the previous entry's start, followed by its varint length. Most
+// entries fit in two or three bytes. Every `anchor_interval`th entry gets an
+// anchor holding its absolute position, so a lookup decodes at most that many.
+
+pub const Range = struct {
+    start: usize,
+    end: usize, // Exclusive
+};
+
+pub const anchor_interval = 32;
+
+pub const Anchor = struct {
+    pos: usize, // Offset of the entry in the encoded bytes
+    base: usize, // Start of the entry before it
+};
+
+// Read-only list of delta-encoded ranges
+pub const RangeList = struct {
+    bytes: []const u8 = &.{},
+    anchors: []const Anchor = &.{},
+    len: usize = 0,
+
+    pub fn get(self: RangeList, index: usize) ?Range {
+        if (index >= self.len) return null;
+
+        const anchor = self.anchors[index / anchor_interval];
+        var decoder = Decoder{ .bytes = self.bytes, .pos = anchor.pos, .start = anchor.base };
+        var range: Range = undefined;
+        for (0..index % anchor_interval + 1) |_| range = decoder.next().?;
+        return range;
+    }
+
+    pub fn iterator(self: RangeList) Decoder {
+        return .{ .bytes = self.bytes };
+    }
+};
+
+// Sequential decoder, also used as the list iterator
+pub const Decoder = struct {
+    bytes: []const u8,
+    pos: usize = 0,
+    start: usize = 0,
+
+    pub fn next(self: *Decoder) ?Range {
+        if (self.pos >= self.bytes.len) return null;
+
+        const delta = unzigzag(self.readVarint());
+        self.start = @intCast(@as(i64, @intCast(self.start)) + delta);
+        const len: usize = @intCast(self.readVarint());
+        return .{ .start = self.start, .end = self.start + len };
+    }
+
+    fn readVarint(self: *Decoder) u64 {
+        var value: u64 = 0;
+        var shift: u6 = 0;
+        while (true) {
+            const byte = self.bytes[self.pos];
+            self.pos += 1;
+            value |= @as(u64, byte & 0x7F) << shift;
+            if (byte & 0x80 == 0) return value;
+            shift += 7;
+        }
+    }
+};
+
+pub const RangeListBuilder = struct {
+    bytes: std.ArrayList(u8),
+    anchors: std.ArrayList(Anchor),
+    len: usize = 0,
+    last_start: usize = 0,
+
+    pub fn init(allocator: std.mem.Allocator) RangeListBuilder {
+        return .{
+            .bytes = std.ArrayList(u8).init(allocator),
+            .anchors = std.ArrayList(Anchor).init(allocator),
+        };
+    }
+
+    pub fn deinit(self: *RangeListBuilder) void {
+        self.bytes.deinit();
+        self.anchors.deinit();
+    }
+
+    pub fn reset(self: *RangeListBuilder) void {
+        self.bytes.clearRetainingCapacity();
+        self.anchors.clearRetainingCapacity();
+        self.len = 0;
+        self.last_start = 0;
+    }
+
+    pub fn append(self: *RangeListBuilder, range: Range) !void {
+        std.debug.assert(range.end >= range.start);
+        if (self.len % anchor_interval == 0) {
+            try self.anchors.append(.{ .pos = self.bytes.items.len, .base = self.last_start });
+        }
+
+        const delta = @as(i64, @intCast(range.start)) - @as(i64, @intCast(self.last_start));
+        try self.writeVarint(zigzag(delta));
+        try self.writeVarint(range.end - range.start);
+        self.last_start = range.start;
+        self.len += 1;
+    }
+
+    // Copy the encoded list into `allocator` (normally the document arena)
+    pub fn finish(self: *const RangeListBuilder, allocator: std.mem.Allocator) !RangeList {
+        return .{
+            .bytes = try allocator.dupe(u8, self.bytes.items),
+            .anchors = try allocator.dupe(Anchor, self.anchors.items),
+            .len = self.len,
+        };
+    }
+
+    fn writeVarint(self: *RangeListBuilder, value: u64) !void {
+        var rest = value;
+        while (rest >= 0x80) : (rest >>= 7) {
+            try self.bytes.append(@as(u8, @truncate(rest)) | 0x80);
+        }
+        try self.bytes.append(@truncate(rest));
+    }
+};
+
+fn zigzag(value: i64) u64 {
+    return @bitCast((value << 1) ^ (value >> 63));
+}
+
+fn unzigzag(value: u64) i64 {
+    return @as(i64, @bitCast(value >> 1)) ^ -@as(i64, @bitCast(value & 1));
+}
+
+// A top-level paragraph or table of the input. It starts at a token in the
+// root group where nothing is half built, so the bytes up to the next unit
+// are balanced and produce exactly the content elements from `element` to
+// the next unit's. `format` is the parser state there, which has to be set
+// up again before the bytes can be copied anywhere but after their
+// predecessor (see Editor.writeRtfFrom).
+pub const Unit = struct {
+    offset: usize,
+    element: usize, // Index of its first content element
+    format: doc_model.FormatState,
+};
+
+// Ranges of one parsed document. Runs are numbered as Document.getTextRuns()
+// returns them; tables and images in content order; cells across all tables,
+// table by table in cell order. Only cells holding text are stored.
+pub const SourceMap = struct {
+    runs: RangeList = .{},
+    tables: RangeList = .{},
+    cells: RangeList = .{},
+    images: RangeList = .{},
+
+    // Units in input order. The input before the first is the header (font
+    // and color tables, stylesheet, info); from content_end on it is the
+    // root group's closing brace and anything after it.
+    units: []const Unit = &.{},
+    content_end: usize = 0,
+};
+
+// =============================================================================
+// RECORDING
+// =============================================================================
+// Parser-side state. A table's runs and cells are held back until the table
+// itself is added to the document, so that run numbering follows content order.
+
+pub const Recorder = struct {
+    runs: RangeListBuilder,
+    tables: RangeListBuilder,
+    cells: RangeListBuilder,
+    images: RangeListBuilder,
+
+    table_runs: std.ArrayList(Range),
+    table_cells: std.ArrayList(Range),
+    table_start: ?usize = null,
+    table_end: usize = 0,
+    cell_start: usize = 0, // Where the next table cell's content begins
+
+    group_starts: std.ArrayList(usize), // Offset of each open group's '{'
+
+    units: std.ArrayList(Unit),
+    first_unit: ?Unit = null, // Candidate start of the first unit
+    units_started: bool = false,
+    unit_element: usize = 0, // Content size when the last unit started
+
+    pub fn init(allocator: std.mem.Allocator) Recorder {
+        return .{
+            .runs = RangeListBuilder.init(allocator),
+            .tables = RangeListBuilder.init(allocator),
+            .cells = RangeListBuilder.init(allocator),
+            .images = RangeListBuilder.init(allocator),
+            .table_runs = std.ArrayList(Range).init(allocator),
+            .table_cells = std.ArrayList(Range).init(allocator),
+            .group_starts = std.ArrayList(usize).init(allocator),
+            .units = std.ArrayList(Unit).init(allocator),
+        };
+    }
+
+    pub fn deinit(self: *Recorder) void {
+        self.runs.deinit();
+        self.tables.deinit();
+        self.cells.deinit();
+        self.images.deinit();
+        self.table_runs.deinit();
+        self.table_cells.deinit();
+        self.group_starts.deinit();
+        self.units.deinit();
+    }
+
+    pub fn reset(self: *Recorder) void {
+        self.runs.reset();
+        self.tables.reset();
+        self.cells.reset();
+        self.images.reset();
+        self.table_runs.clearRetainingCapacity();
+        self.table_cells.clearRetainingCapacity();
+        self.table_start = null;
+        self.table_end = 0;
+        self.cell_start = 0;
+        self.group_starts.clearRetainingCapacity();
+        self.units.clearRetainingCapacity();
+        self.first_unit = null;
+        self.units_started = false;
+        self.unit_element = 0;
+    }
+
+    pub fn tableRun(self: *Recorder, range: Range) !void {
+        if (self.table_start == null) self.table_start = range.start;
+        try self.table_runs.append(range);
+        self.table_end = range.end;
+    }
+
+    pub fn tableCell(self: *Recorder, end: usize) !void {
+        try self.table_cells.append(.{ .start = @min(self.cell_start, end), .end = end });
+        self.table_end = end;
+    }
+
+    // The pending table was added to the document (or dropped, if `added` is false)
+    pub fn finishTable(self: *Recorder, added: bool) !void {
+        if (added) {
+            for (self.table_runs.items) |range| try self.runs.append(range);
+            for (self.table_cells.items) |range| try self.cells.append(range);
+            const start = self.table_start orelse self.table_end;
+            try self.tables.append(.{ .start = start, .end = @max(start, self.table_end) });
+        }
+        self.table_runs.clearRetainingCapacity();
+        self.table_cells.clearRetainingCapacity();
+        self.table_start = null;
+    }
+
+    // Called for each token in the root group where no text run or table is
+    // pending. The first unit starts at the last such token before any
+    // content, later ones at the first such token after a paragraph break,
+    // page break or table.
+    pub fn unitBoundary(self: *Recorder, offset: usize, content: []const doc_model.ContentElement, format: doc_model.FormatState) !void {
+        if (!self.units_started) {
+            if (content.len == 0) {
+                self.first_unit = .{ .offset = offset, .element = 0, .format = format };
+                return;
+            }
+            try self.startUnits(offset, format);
+        }
+        if (content.len == self.unit_element) return;
+        switch (content[content.len - 1]) {
+            .paragraph_break, .page_break, .table => {},
+            else => return,
+        }
+        try self.units.append(.{ .offset = offset, .element = content.len, .format = format });
+        self.unit_element = content.len;
+    }
+
+    // Parsing continues from a checkpoint with content before it: units
+    // are numbered from there and the first one is already known
+    pub fn resumeUnits(self: *Recorder) void {
+        self.units_started = true;
+        self.unit_element = 0;
+    }
+
+    fn startUnits(self: *Recorder, offset: usize, format: doc_model.FormatState) !void {
+        try self.units.append(self.first_unit orelse .{ .offset = offset, .element = 0, .format = format });
+        self.units_started = true;
+        self.unit_element = 0;
+    }
+
+    // Encode everything recorded into `allocator` and start over.
+    // `content_len` is the number of content elements parsed and
+    // `content_end` the offset of the root group's closing brace.
+    pub fn finish(self: *Recorder, allocator: std.mem.Allocator, content_len: usize, content_end: usize) !SourceMap {
+        if (!self.units_started and content_len > 0) try self.startUnits(content_end, .{});
+        const map = SourceMap{
+            .runs = try self.runs.finish(allocator),
+            .tables = try self.tables.finish(allocator),
+            .cells = try self.cells.finish(allocator),
+            .images = try self.images.finish(allocator),
+            .units = try allocator.dupe(Unit, self.units.items),
+            .content_end = content_end,
+        };
+        self.reset();
+        return map;
+    }
+};
+
+// =============================================================================
+// TESTS
+// =============================================================================
+
+test "range list round trip" {
+    const testing = std.testing;
+
+    var builder = RangeListBuilder.init(testing.allocator);
+    defer builder.deinit();
+
+    // Mostly increasing, with a few steps back and some large offsets
+    var expected: [100]Range = undefined;
+    for (&expected, 0..) |*range, i| {
+        const start: usize = if (i % 7 == 3) i * 10 - 25 else i * 1000 + (i % 5) * 300_000;
+        range.* = .{ .start = start, .end = start + i % 13 };
+        try builder.append(range.*);
+    }
+
+    const list = try builder.finish(testing.allocator);
+    defer testing.allocator.free(list.bytes);
+    defer testing.allocator.free(list.anchors);
+
+    try testing.expectEqual(@as(usize, 100), list.len);
+    try testing.expectEqual(@as(usize, 4), list.anchors.len);
+
+    // Random access across anchors
+    for (expected, 0..) |range, i| {
+        try testing.expectEqual(range, list.get(i).?);
+    }
+    try testing.expectEqual(@as(?Range, null), list.get(100));
+
+    // Sequential access
+    var iterator = list.iterator();
+    for (expected) |range| try testing.expectEqual(range, iterator.next().?);
+    try testing.expectEqual(@as(?Range, null), iterator.next());
+}
+
+test "source map of a parsed document" {
+    const testing = std.testing;
+    const formatted_parser = @import("formatted_parser.zig");
+
+    const rtf_data = "{\\rtf1 Hello \\b bold\\b0 \\par" ++
+        "\\trowd\\cellx1000\\cellx2000 A1\\cell B\\'e9\\cell\\row\\par" ++
+        "{\\pict\\pngblip 89504e47}After}";
+
+    var stream = std.io.fixedBufferStream(rtf_data);
+    var parser = try formatted_parser.FormattedParser.init(stream.reader().any(), testing.allocator);
+    defer parser.deinit();
+    parser.recordSourceMap();
+
+    var document = try parser.parse();
+    defer document.deinit();
+
+    const map = document.source_map.?;
+    const source = struct {
+        fn of(list: RangeList, index: usize) []const u8 {
+            const range = list.get(index).?;
+            return rtf_data[range.start..range.end];
+        }
+    }.of;
+
+    // "Hello ", "bold", "A1", "B\xe9", "After"
+    try testing.expectEqual(@as(usize, 5), map.runs.len);
+    try testing.expectEqualStrings("Hello ", source(map.runs, 0));
+    try testing.expectEqualStrings("bold", source(map.runs, 1));
+    try testing.expectEqualStrings("A1", source(map.runs, 2));
+    try testing.expectEqualStrings("B\\'e9", source(map.runs, 3));
+    try testing.expectEqualStrings("After", source(map.runs, 4));
+
+    try testing.expectEqual(@as(usize, 1), map.tables.len);
+    try testing.expectEqualStrings("\\trowd\\cellx1000\\cellx2000 A1\\cell B\\'e9\\cell\\row", source(map.tables, 0));
+    try testing.expectEqual(@as(usize, 2), map.cells.len);
+    try testing.expectEqualStrings("A1\\cell", source(map.cells, 0));
+    try testing.expectEqualStrings("B\\'e9\\cell", source(map.cells, 1));
+
+    try testing.expectEqual(@as(usize, 1), map.images.len);
+    try testing.expectEqualStrings("{\\pict\\pngblip 89504e47}", source(map.images, 0));
+
+    // Off unless requested
+    var plain_stream = std.io.fixedBufferStream(rtf_data);
+    var plain_parser = try formatted_parser.FormattedParser.init(plain_stream.reader().any(), testing.allocator);
+    defer plain_parser.deinit();
+    var plain = try plain_parser.parse();
+    defer plain.deinit();
+    try testing.expect(plain.source_map == null);
+}
@@ -0,0 +1,265 @@
+const std = @import("std");
+const scanner = @import("scanner.zig");
+
+// =============================================================================
+// DOCUMENT STATISTICS
+// =============================================================================
+// Character, word, paragraph, table and image counts in one pass over the
+// scanner's tokens (see scanner.zig), without parsing into a document.
+// Memory is fixed whatever the input: the font and color in effect per open
+// group, and one bit per font and color number.
+//
+// Text is counted a vector of bytes at a time. Characters are the bytes that
+// do not continue a UTF-8 sequence; a word starts at each byte other than
+// space, tab or line break that follows one of those, or a break.
+
+// Layout matches rtf_counts in c_api.h
+pub const Counts = extern struct {
+    characters: usize = 0, // Visible characters (code points), breaks excluded
+    characters_without_spaces: usize = 0,
+    words: usize = 0,
+    paragraphs: usize = 0, // With any text other than spaces, table cells included
+    page_breaks: usize = 0,
+    tables: usize = 0,
+    rows: usize = 0,
+    cells: usize = 0,
+    images: usize = 0,
+    objects: usize = 0,
+    fonts: usize = 0, // Distinct fonts text is set in
+    colors: usize = 0, // Distinct text colors, other than auto
+};
+
+pub fn count(data: []const u8) !Counts {
+    var counter = Counter.init();
+    var tokens = scanner.Scanner.init(data);
+    while (try tokens.next()) |token| counter.add(token, tokens.depth);
+    return counter.finish();
+}
+
+const Format = struct {
+    font: ?u16 = null, // Document default font
+    color: u16 = 0, // Auto
+};
+
+const Control = enum {
+    par, line, sect, page, cell, row, trowd, f, cf, plain, deff,
+};
+
+const control_words = std.StaticStringMap(Control).initComptime(.{
+    .{ "par", .par },
+    .{ "line", .line },
+    .{ "sect", .sect },
+    .{ "page", .page },
+    .{ "cell", .cell },
+    .{ "nestcell", .cell },
+    .{ "row", .row },
+    .{ "nestrow", .row },
+    .{ "trowd", .trowd },
+    .{ "f", .f },
+    .{ "cf", .cf },
+    .{ "plain", .plain },
+    .{ "deff", .deff },
+});
+
+pub const Counter = struct {
+    counts: Counts = .{},
+
+    in_word: bool = false, // The last text byte is part of a word
+    paragraph_text: bool = false,
+    in_table: bool = false,
+    in_row: bool = false, // Between \trowd and \row
+
+    default_font: u16 = 0,
+    format: [scanner.max_depth + 1]Format = undefined, // By group depth
+    fonts: std.StaticBitSet(1 << 16) = std.StaticBitSet(1 << 16).initEmpty(),
+    colors: std.StaticBitSet(1 << 16) = std.StaticBitSet(1 << 16).initEmpty(),
+
+    pub fn init() Counter {
+        var counter = Counter{};
+        counter.format[0] = .{};
+        counter.format[1] = .{};
+        return counter;
+    }
+
+    // `depth` is the scanner's, after reading the token
+    pub fn add(self: *Counter, token: scanner.Token, depth: u32) void {
+        switch (token.kind) {
+            .group_start => self.format[depth] = self.format[depth - 1],
+            .group_end => {},
+            .destination => {
+                if (std.mem.eql(u8, token.word, "pict") or std.mem.eql(u8, token.word, "shppict")) {
+                    self.counts.images += 1; // {\nonshppict} holds a copy, skipped unseen
+                } else if (std.mem.eql(u8, token.word, "object")) {
+                    self.counts.objects += 1;
+                }
+            },
+            .text => self.addText(token.text, depth),
+            .control => {
+                const control = control_words.get(token.word) orelse {
+                    self.addText(token.text, depth); // Tabs, quotes, dashes
+                    return;
+                };
+                switch (control) {
+                    .par, .sect => {
+                        self.endParagraph();
+                        if (self.in_table and !self.in_row) self.in_table = false;
+                    },
+                    .line => self.in_word = false,
+                    .page => {
+                        self.counts.page_breaks += 1;
+                        self.in_word = false;
+                    },
+                    .cell => {
+                        self.counts.cells += 1;
+                        self.endParagraph();
+                    },
+                    .row => {
+                        self.counts.rows += 1;
+                        self.in_row = false;
+                        self.in_word = false;
+                    },
+                    .trowd => {
+                        if (!self.in_table) self.counts.tables += 1;
+                        self.in_table = true;
+                        self.in_row = true;
+                    },
+                    .f => self.format[depth].font = number(token.param orelse 0),
+                    .cf => self.format[depth].color = number(token.param orelse 0),
+                    .plain => self.format[depth] = .{},
+                    .deff => self.default_font = number(token.param orelse 0),
+                }
+            },
+        }
+    }
+
+    pub fn finish(self: *Counter) Counts {
+        self.endParagraph();
+        self.counts.fonts = self.fonts.count();
+        self.counts.colors = self.colors.count();
+        return self.counts;
+    }
+
+    fn addText(self: *Counter, text: []const u8, depth: u32) void {
+        if (text.len == 0) return;
+        const counted = countText(text, &self.in_word);
+        self.counts.characters += counted.characters;
+        self.counts.characters_without_spaces += counted.characters - counted.spaces;
+        self.counts.words += counted.words;
+
+        if (counted.characters > counted.spaces) {
+            self.paragraph_text = true;
+            const format = self.format[depth];
+            self.fonts.set(format.font orelse self.default_font);
+            if (format.color != 0) self.colors.set(format.color);
+        }
+    }
+
+    fn endParagraph(self: *Counter) void {
+        if (self.paragraph_text) self.counts.paragraphs += 1;
+        self.paragraph_text = false;
+        self.in_word = false;
+    }
+};
+
+fn number(param: i32) u16 {
+    return @intCast(std.math.clamp(param, 0, std.math.maxInt(u16)));
+}
+
+const TextCounts = struct {
+    characters: usize = 0,
+    spaces: usize = 0,
+    words: usize = 0,
+};
+
+fn isSpace(byte: u8) bool {
+    return byte == ' ' or byte == '\t' or byte == '\n' or byte == '\r';
+}
+
+// Count `text`, continuing a word if `in_word` says the text before it ended
+// inside one
+fn countText(text: []const u8, in_word: *bool) TextCounts {
+    const block = std.simd.suggestVectorLength(u8) orelse 16;
+    const Block = @Vector(block, u8);
+    const Mask = std.meta.Int(.unsigned, block);
+
+    var counted = TextCounts{};
+    var space_before: Mask = @intFromBool(!in_word.*); // Bit 0: the byte before the block
+    var i: usize = 0;
+    while (i + block <= text.len) : (i += block) {
+        const chunk: Block = text[i..][0..block].*;
+        const continuation: Mask = @bitCast((chunk & @as(Block, @splat(0xc0))) == @as(Block, @splat(0x80)));
+        var space: Mask = 0;
+        inline for (" \t\n\r") |byte| space |= @bitCast(chunk == @as(Block, @splat(byte)));
+
+        counted.characters += block - @popCount(continuation);
+        counted.spaces += @popCount(space);
+        counted.words += @popCount(~space & ((space << 1) | space_before));
+        space_before = space >> (block - 1);
+    }
+
+    var after_space = space_before != 0;
+    for (text[i..]) |byte| {
+        if (byte & 0xc0 != 0x80) counted.characters += 1;
+        const space = isSpace(byte);
+        if (space) {
+            counted.spaces += 1;
+        } else if (after_space) {
+            counted.words += 1;
+        }
+        after_space = space;
+    }
+    in_word.* = !after_space;
+    return counted;
+}
+
+// =============================================================================
+// TESTS
+// =============================================================================
+
+test "count document statistics" {
+    const testing = std.testing;
+
+    const rtf_data =
+        "{\\rtf1\\ansi\\deff0{\\fonttbl{\\f0 Arial;}{\\f1 Times;}}{\\colortbl;\\red255\\green0\\blue0;}" ++
+        "{\\info{\\title Not counted}}" ++
+        "Hello \\b big\\b0  world.\\par\\par " ++
+        "{\\f1\\cf1 Caf\\'e9 au lait}\\tab x\\page\\par " ++
+        "\\trowd\\cellx1000\\cellx2000 a\\cell b c\\cell\\row " ++
+        "\\trowd\\cellx1000 d\\cell\\row\\pard\\par " ++
+        "{\\*\\shppict{\\pict\\pngblip 00}}{\\nonshppict{\\pict\\wmetafile8 00}}" ++
+        "{\\object\\objemb{\\*\\objdata 00}}" ++
+        "End}";
+
+    try testing.expectEqual(Counts{
+        .characters = 38,
+        .characters_without_spaces = 32,
+        .words = 12,
+        .paragraphs = 6,
+        .page_breaks = 1,
+        .tables = 1,
+        .rows = 2,
+        .cells = 3,
+        .images = 1,
+        .objects = 1,
+        .fonts = 2,
+        .colors = 1,
+    }, try count(rtf_data));
+}
+
+test "count text across vector blocks" {
+    const testing = std.testing;
+
+    // Long enough for several blocks, with words and characters split between them
+    const text = "  lorem ipsum dolor sit \u{e9}t\u{e9} amet, consectetur\tadipiscing elit " ** 3 ++ "end";
+    var in_word = false;
+    const counted = countText(text, &in_word);
+    try testing.expectEqual(@as(usize, 28), counted.words);
+    try testing.expectEqual(@as(usize, 189), counted.characters);
+    try testing.expectEqual(@as(usize, 33), counted.spaces);
+    try testing.expect(in_word);
+
+    // A word continues into the next piece of text
+    in_word = true;
+    try testing.expectEqual(@as(usize, 1), countText("tail and", &in_word).words);
+    try testing.expect(in_word);
+}
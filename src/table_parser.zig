@@ -24,6 +24,13 @@ pub const FontTableParser = struct {
         self.name_buffer.deinit();
     }
     
+    // Forget parse state, keeping the name buffer's capacity
+    pub fn reset(self: *FontTableParser) void {
+        self.current_font = .{ .id = 0, .name = "", .family = .dontcare, .charset = 0 };
+        self.name_buffer.clearRetainingCapacity();
+        self.in_font_entry = false;
+    }
+    
     pub fn startFontEntry(self: *FontTableParser, font_id: u16) void {
         // Reset for new font entry
         self.current_font = .{
@@ -66,7 +73,7 @@ pub const FontTableParser = struct {
         
         const font = doc_model.FontInfo{
             .id = self.current_font.id,
-            .name = try self.allocator.dupe(u8, trimmed_name), // Use dupe here, dupeZ will be used when moving to arena
+            .name = try self.allocator.dupeZ(u8, trimmed_name), // Copied into the document arena when added
             .family = self.current_font.family,
             .charset = self.current_font.charset,
         };
@@ -122,25 +129,59 @@ pub const ColorTableParser = struct {
 };
 
 // RTF table parser state
+// Builds the flat Table directly: rows are opened by \trowd, cells are
+// appended as \cell closes them, and their runs go straight into the table.
+//
+// With a row sink, each row is handed over as soon as it is finished and
+// then dropped, so the table never holds more than one row. Cell text then
+// belongs in rowTextAllocator(), which is reset after every row.
 pub const TableParser = struct {
     allocator: std.mem.Allocator,
     current_table: ?doc_model.Table = null,
-    current_row: ?doc_model.TableRow = null,
-    current_cell: ?doc_model.TableCell = null,
+    in_row: bool = false,
+    in_cell: bool = false,
+    current_cell: doc_model.TableCell = .{},
     cell_widths: std.ArrayList(u32),
+    row_sink: ?RowSink = null,
+    row_text: std.heap.ArenaAllocator,
+    tables_finished: usize = 0,
+    
+    // `table` holds only the finished row (row 0); `table_index` counts
+    // tables in document order. Errors abort the parse.
+    pub const RowSink = struct {
+        context: *anyopaque,
+        emit: *const fn (context: *anyopaque, table_index: usize, table: *const doc_model.Table) anyerror!void,
+    };
     
     pub fn init(allocator: std.mem.Allocator) TableParser {
         return .{
             .allocator = allocator,
             .cell_widths = std.ArrayList(u32).init(allocator),
+            .row_text = std.heap.ArenaAllocator.init(allocator),
         };
     }
     
     pub fn deinit(self: *TableParser) void {
         self.cell_widths.deinit();
+        self.row_text.deinit();
+        if (self.current_table) |*table| table.deinit();
+    }
+    
+    // Drop any unfinished table, keeping the width buffer's capacity
+    pub fn reset(self: *TableParser) void {
         if (self.current_table) |*table| table.deinit();
-        if (self.current_row) |*row| row.deinit();
-        if (self.current_cell) |*cell| cell.deinit();
+        self.current_table = null;
+        self.in_row = false;
+        self.in_cell = false;
+        self.cell_widths.clearRetainingCapacity();
+        _ = self.row_text.reset(.retain_capacity);
+        self.tables_finished = 0;
+    }
+    
+    // Where cell text should be allocated: the document's arena, unless
+    // rows are streamed and dropped
+    pub fn rowTextAllocator(self: *TableParser, document_allocator: std.mem.Allocator) std.mem.Allocator {
+        return if (self.row_sink != null) self.row_text.allocator() else document_allocator;
     }
     
     pub fn startTable(self: *TableParser) !void {
@@ -157,12 +198,10 @@ pub const TableParser = struct {
             try self.startTable();
         }
         
-        // Finish previous row if exists
-        if (self.current_row) |*row| {
-            try self.current_table.?.rows.append(row.*);
-        }
-        
-        self.current_row = doc_model.TableRow.init(self.allocator);
+        // The previous row, if still open, simply ends where this one starts
+        if (self.in_row and !self.in_cell) try self.emitRow();
+        try self.current_table.?.addRow(0);
+        self.in_row = true;
         self.cell_widths.clearRetainingCapacity();
     }
     
@@ -170,55 +209,72 @@ pub const TableParser = struct {
         try self.cell_widths.append(width);
     }
     
-    pub fn addCellContent(self: *TableParser, element: doc_model.ContentElement) !void {
-        if (self.current_cell == null) {
-            self.current_cell = doc_model.TableCell.init(self.allocator);
-            
-            // Set width if available
-            if (self.cell_widths.items.len > 0) {
-                const cell_index = if (self.current_row) |*row| row.cells.items.len else 0;
-                if (cell_index < self.cell_widths.items.len) {
-                    self.current_cell.?.width = self.cell_widths.items[cell_index];
-                }
-            }
+    pub fn addCellRun(self: *TableParser, run: doc_model.TextRun) !void {
+        if (self.current_table == null) {
+            try self.startTable();
         }
+        if (!self.in_cell) self.openCell();
+        
+        try self.current_table.?.runs.append(run);
+        self.current_cell.run_count += 1;
+    }
+    
+    fn openCell(self: *TableParser) void {
+        const table = &self.current_table.?;
+        self.current_cell = .{ .first_run = @intCast(table.runs.items.len) };
+        self.in_cell = true;
         
-        try self.current_cell.?.content.append(element);
+        // Set width if available
+        const cell_index = if (self.in_row) table.cells.items.len - table.rows.getLast().first_cell else 0;
+        if (cell_index < self.cell_widths.items.len) {
+            self.current_cell.width = self.cell_widths.items[cell_index];
+        }
     }
     
+    // End the cell at \cell. A cell without any text is still a cell, unless
+    // there is no table to put it in.
     pub fn finishCell(self: *TableParser) !void {
-        if (self.current_cell) |*cell| {
-            if (self.current_row == null) {
-                try self.startRow();
-            }
-            try self.current_row.?.cells.append(cell.*);
-            self.current_cell = null;
+        if (!self.in_cell) {
+            if (self.current_table == null) return;
+            self.openCell();
+        }
+        if (!self.in_row) {
+            try self.startRow();
         }
+        try self.current_table.?.cells.append(self.current_cell);
+        self.in_cell = false;
     }
     
     pub fn finishRow(self: *TableParser) !void {
         // Finish current cell if exists
-        try self.finishCell();
-        
-        if (self.current_row) |*row| {
-            if (self.current_table == null) {
-                try self.startTable();
-            }
-            try self.current_table.?.rows.append(row.*);
-            self.current_row = null;
-        }
+        if (self.in_cell) try self.finishCell();
+        if (self.in_row) try self.emitRow();
+        self.in_row = false;
     }
     
+    // With a row sink, the returned table has no rows left in it
     pub fn finishTable(self: *TableParser) !?doc_model.Table {
         try self.finishRow();
         
         if (self.current_table) |table| {
             self.current_table = null;
+            self.tables_finished += 1;
             return table;
         }
         
         return null;
     }
+    
+    // Hand the finished row to the sink, if there is one, and forget it
+    fn emitRow(self: *TableParser) !void {
+        const sink = self.row_sink orelse return;
+        const table = &self.current_table.?;
+        try sink.emit(sink.context, self.tables_finished, table);
+        table.rows.clearRetainingCapacity();
+        table.cells.clearRetainingCapacity();
+        table.runs.clearRetainingCapacity();
+        _ = self.row_text.reset(.retain_capacity);
+    }
 };
 
 // Tests
@@ -279,7 +335,7 @@ test "table parser basic" {
     
     // Add some content to cell
     const text_run = doc_model.TextRun.init("Cell 1", .{}, .{});
-    try parser.addCellContent(.{ .text_run = text_run });
+    try parser.addCellRun(text_run);
     
     try parser.finishCell();
     try parser.finishRow();
@@ -288,7 +344,94 @@ test "table parser basic" {
     defer if (table) |*t| t.deinit();
     
     try testing.expect(table != null);
-    try testing.expectEqual(@as(usize, 1), table.?.rows.items.len);
-    try testing.expectEqual(@as(usize, 1), table.?.rows.items[0].cells.items.len);
-    try testing.expectEqual(@as(u32, 1000), table.?.rows.items[0].cells.items[0].width);
-}
\ No newline at end of file
+    try testing.expectEqual(@as(usize, 1), table.?.rowCount());
+    try testing.expectEqual(@as(usize, 1), table.?.rowCells(0).len);
+    try testing.expectEqual(@as(u32, 1000), table.?.rowCells(0)[0].width);
+    try testing.expectEqualStrings("Cell 1", table.?.cellRuns(table.?.rowCells(0)[0])[0].text);
+}
+
+test "table parser stores cells flat" {
+    const testing = std.testing;
+    
+    var parser = TableParser.init(testing.allocator);
+    defer parser.deinit();
+    
+    // Two rows of 2 and 1 cells; the first cell has two runs
+    try parser.startRow();
+    try parser.setCellWidth(500);
+    try parser.setCellWidth(900);
+    try parser.addCellRun(doc_model.TextRun.init("A", .{}, .{}));
+    try parser.addCellRun(doc_model.TextRun.init("a", .{ .bold = true }, .{}));
+    try parser.finishCell();
+    try parser.addCellRun(doc_model.TextRun.init("B", .{}, .{}));
+    try parser.finishCell();
+    try parser.finishRow();
+    
+    try parser.startRow();
+    try parser.addCellRun(doc_model.TextRun.init("C", .{}, .{}));
+    try parser.finishCell();
+    
+    var table = (try parser.finishTable()).?;
+    defer table.deinit();
+    
+    try testing.expectEqual(@as(usize, 2), table.rowCount());
+    try testing.expectEqual(@as(usize, 3), table.cells.items.len);
+    try testing.expectEqual(@as(usize, 4), table.runs.items.len);
+    
+    const first_row = table.rowCells(0);
+    try testing.expectEqual(@as(usize, 2), first_row.len);
+    try testing.expectEqual(@as(u32, 900), first_row[1].width);
+    try testing.expectEqual(@as(usize, 2), table.cellRuns(first_row[0]).len);
+    try testing.expect(table.cellRuns(first_row[0])[1].char_format.bold);
+    
+    try testing.expectEqualStrings("C", table.cellRuns(table.rowCells(1)[0])[0].text);
+}
+
+test "table parser streams rows" {
+    const testing = std.testing;
+    
+    const Collector = struct {
+        rows: usize = 0,
+        cells: usize = 0,
+        last_table: usize = 0,
+        
+        fn emit(context: *anyopaque, table_index: usize, table: *const doc_model.Table) anyerror!void {
+            const self: *@This() = @ptrCast(@alignCast(context));
+            try std.testing.expectEqual(@as(usize, 1), table.rowCount());
+            self.rows += 1;
+            self.cells += table.rowCells(0).len;
+            self.last_table = table_index;
+        }
+    };
+    
+    var collector = Collector{};
+    var parser = TableParser.init(testing.allocator);
+    defer parser.deinit();
+    parser.row_sink = .{ .context = &collector, .emit = Collector.emit };
+    
+    // A row ends at \row, at the next \trowd or with the table
+    try parser.startRow();
+    try parser.addCellRun(doc_model.TextRun.init("A", .{}, .{}));
+    try parser.finishCell();
+    try parser.finishRow();
+    try parser.startRow();
+    try parser.addCellRun(doc_model.TextRun.init("B", .{}, .{}));
+    try parser.finishCell();
+    try parser.startRow();
+    try parser.addCellRun(doc_model.TextRun.init("C", .{}, .{}));
+    try parser.finishCell();
+    try testing.expectEqual(@as(usize, 2), collector.rows);
+    
+    var table = (try parser.finishTable()).?;
+    defer table.deinit();
+    try testing.expectEqual(@as(usize, 3), collector.rows);
+    try testing.expectEqual(@as(usize, 3), collector.cells);
+    try testing.expectEqual(@as(usize, 0), table.rowCount());
+    
+    // The next table gets the next index
+    try parser.startRow();
+    try parser.addCellRun(doc_model.TextRun.init("D", .{}, .{}));
+    var second = (try parser.finishTable()).?;
+    defer second.deinit();
+    try testing.expectEqual(@as(usize, 1), collector.last_table);
+}
@@ -0,0 +1,226 @@
+const std = @import("std");
+const doc_model = @import("document_model.zig");
+
+// =============================================================================
+// CHARACTER OFFSET INDEX
+// =============================================================================
+// Cumulative plain-text offsets (see Document.getPlainText) of every text run,
+// paragraph and table, so a viewer can find what is at a given position with
+// a binary search instead of walking the runs from the start.
+//
+// Runs are numbered as Document.getTextRuns() returns them. Paragraphs end at
+// paragraph and page breaks, and every table row is a paragraph of its own
+// (cells separated by tabs). The layout walk below must match getPlainText().
+
+// Byte range of a run in the plain text
+pub const Span = struct {
+    start: usize,
+    len: usize,
+
+    fn end(self: Span) usize {
+        return self.start + self.len;
+    }
+};
+
+// Layout matches rtf_paragraph in c_api.h
+pub const Paragraph = extern struct {
+    start: usize, // Text offset
+    len: usize, // Bytes, excluding the break that ends it
+    first_run: usize,
+    run_count: usize,
+};
+
+pub const TextIndex = struct {
+    runs: []Span,
+    paragraphs: []Paragraph,
+    table_starts: []usize, // Text offset of each table, in document order
+    text_len: usize,
+
+    pub fn build(document: *const doc_model.Document, allocator: std.mem.Allocator) !TextIndex {
+        var builder = Builder{
+            .runs = std.ArrayList(Span).init(allocator),
+            .paragraphs = std.ArrayList(Paragraph).init(allocator),
+            .table_starts = std.ArrayList(usize).init(allocator),
+        };
+        errdefer builder.deinit();
+
+        for (document.content.items) |element| {
+            switch (element) {
+                .text_run => |run| try builder.addRun(run.text.len),
+                .hyperlink => |link| try builder.addRun(link.display_text.len),
+                .paragraph_break, .page_break => {
+                    try builder.closeParagraph(true);
+                    builder.skip(2); // "\n\n"
+                },
+                .line_break => builder.offset += 1, // Stays in the paragraph
+                .table => |table| {
+                    try builder.closeParagraph(false);
+                    try builder.table_starts.append(builder.offset);
+
+                    for (0..table.rowCount()) |row_index| {
+                        for (table.rowCells(row_index)) |cell| {
+                            for (table.cellRuns(cell)) |run| try builder.addRun(run.text.len);
+                            builder.offset += 1; // Tab after each cell
+                        }
+                        try builder.closeParagraph(true);
+                        builder.skip(1); // Newline after each row
+                    }
+                    builder.after_table = true;
+                },
+                .image => {},
+            }
+        }
+        try builder.closeParagraph(false);
+
+        return .{
+            .runs = try builder.runs.toOwnedSlice(),
+            .paragraphs = try builder.paragraphs.toOwnedSlice(),
+            .table_starts = try builder.table_starts.toOwnedSlice(),
+            .text_len = builder.offset,
+        };
+    }
+
+    pub fn deinit(self: *TextIndex, allocator: std.mem.Allocator) void {
+        allocator.free(self.runs);
+        allocator.free(self.paragraphs);
+        allocator.free(self.table_starts);
+    }
+
+    // Index of the last run starting at or before `offset`. Offsets between
+    // runs (breaks, cell separators) resolve to the run before them.
+    pub fn findRun(self: TextIndex, offset: usize) ?usize {
+        if (offset >= self.text_len) return null;
+        const after = std.sort.upperBound(Span, self.runs, offset, startOrder);
+        return if (after == 0) null else after - 1;
+    }
+
+    // Index of the paragraph containing `offset`, or the one before a break
+    pub fn findParagraph(self: TextIndex, offset: usize) ?usize {
+        if (offset >= self.text_len) return null;
+        const after = std.sort.upperBound(Paragraph, self.paragraphs, offset, paragraphOrder);
+        return if (after == 0) null else after - 1;
+    }
+
+    // Runs overlapping the text range [start, end), as first index and count
+    pub fn runsInRange(self: TextIndex, start: usize, end: usize) struct { first: usize, count: usize } {
+        if (start >= end) return .{ .first = 0, .count = 0 };
+
+        // First run ending after `start`, first run starting at or after `end`
+        const first = std.sort.lowerBound(Span, self.runs, start + 1, endOrder);
+        const last = std.sort.lowerBound(Span, self.runs, end, startOrder);
+        return if (last > first) .{ .first = first, .count = last - first } else .{ .first = first, .count = 0 };
+    }
+
+    fn startOrder(offset: usize, run: Span) std.math.Order {
+        return std.math.order(offset, run.start);
+    }
+
+    fn endOrder(offset: usize, run: Span) std.math.Order {
+        return std.math.order(offset, run.end());
+    }
+
+    fn paragraphOrder(offset: usize, paragraph: Paragraph) std.math.Order {
+        return std.math.order(offset, paragraph.start);
+    }
+};
+
+const Builder = struct {
+    runs: std.ArrayList(Span),
+    paragraphs: std.ArrayList(Paragraph),
+    table_starts: std.ArrayList(usize),
+    offset: usize = 0,
+    paragraph_start: usize = 0,
+    paragraph_first_run: usize = 0,
+    after_table: bool = false, // The \par closing a table is not an empty paragraph
+
+    fn deinit(self: *Builder) void {
+        self.runs.deinit();
+        self.paragraphs.deinit();
+        self.table_starts.deinit();
+    }
+
+    fn addRun(self: *Builder, len: usize) !void {
+        try self.runs.append(.{ .start = self.offset, .len = len });
+        self.offset += len;
+        self.after_table = false;
+    }
+
+    fn skip(self: *Builder, len: usize) void {
+        self.offset += len;
+        self.paragraph_start = self.offset;
+        self.paragraph_first_run = self.runs.items.len;
+    }
+
+    // End the current paragraph at the current offset. Empty paragraphs are
+    // only recorded when an explicit break ends them.
+    fn closeParagraph(self: *Builder, explicit: bool) !void {
+        const run_count = self.runs.items.len - self.paragraph_first_run;
+        const len = self.offset - self.paragraph_start;
+        const empty = len == 0 and run_count == 0;
+        if (!empty or (explicit and !self.after_table)) {
+            try self.paragraphs.append(.{
+                .start = self.paragraph_start,
+                .len = len,
+                .first_run = self.paragraph_first_run,
+                .run_count = run_count,
+            });
+        }
+        self.paragraph_start = self.offset;
+        self.paragraph_first_run = self.runs.items.len;
+        self.after_table = false;
+    }
+};
+
+// =============================================================================
+// TESTS
+// =============================================================================
+
+const formatted_parser = @import("formatted_parser.zig");
+
+test "text index matches the plain text layout" {
+    const testing = std.testing;
+
+    const rtf_data = "{\\rtf1 First \\b bold\\b0 \\par Second\\line more\\par " ++
+        "\\trowd\\cellx1000\\cellx2000 A1\\cell B1\\cell\\row\\par After}";
+
+    var stream = std.io.fixedBufferStream(rtf_data);
+    var parser = try formatted_parser.FormattedParser.init(stream.reader().any(), testing.allocator);
+    defer parser.deinit();
+    var document = try parser.parse();
+    defer document.deinit();
+
+    const text = try document.getPlainText();
+    const runs = try document.getTextRuns(testing.allocator);
+    defer testing.allocator.free(runs);
+
+    var index = try TextIndex.build(&document, testing.allocator);
+    defer index.deinit(testing.allocator);
+
+    // Every run's span is exactly its text within the plain text
+    try testing.expectEqual(text.len, index.text_len);
+    try testing.expectEqual(runs.len, index.runs.len);
+    for (runs, index.runs) |run, span| {
+        try testing.expectEqualStrings(run.text, text[span.start..span.end()]);
+    }
+
+    // "First bold" | "Second\nmore" | "A1\tB1\t" | "After"
+    try testing.expectEqual(@as(usize, 4), index.paragraphs.len);
+    const paragraph_texts = [_][]const u8{ "First bold", "Second\nmore", "A1\tB1\t", "After" };
+    for (index.paragraphs, paragraph_texts) |paragraph, expected| {
+        try testing.expectEqualStrings(expected, text[paragraph.start..][0..paragraph.len]);
+    }
+    try testing.expectEqual(@as(usize, 2), index.paragraphs[2].run_count);
+    try testing.expectEqual(@as(usize, 1), index.table_starts.len);
+    try testing.expectEqualStrings("A1", text[index.table_starts[0]..][0..2]);
+
+    // Lookups
+    const bold_offset = std.mem.indexOf(u8, text, "bold").?;
+    try testing.expectEqualStrings("bold", runs[index.findRun(bold_offset + 2).?].text);
+    try testing.expectEqual(@as(?usize, null), index.findRun(text.len));
+    try testing.expectEqual(@as(?usize, 1), index.findParagraph(std.mem.indexOf(u8, text, "more").?));
+
+    const range = index.runsInRange(bold_offset, std.mem.indexOf(u8, text, "Second").? + 1);
+    try testing.expectEqual(@as(usize, 2), range.count);
+    try testing.expectEqualStrings("bold", runs[range.first].text);
+    try testing.expectEqual(@as(usize, 0), index.runsInRange(5, 5).count);
+}
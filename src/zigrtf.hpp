@@ -0,0 +1,493 @@
+/*
+ * ZigRTF C++ API - header-only wrapper over the C API (C++20)
+ *
+ * Owning handles for documents and contexts, and views straight over the
+ * document's own arrays: std::span for runs, styles and images, small
+ * index ranges for paragraphs, tables and cells. Callbacks are templates
+ * taken by reference, so handlers inline and nothing is type-erased.
+ * Every accessor is the C call it wraps and nothing more.
+ *
+ * Errors from parsing and exporting are thrown as rtf::error. Views stay
+ * valid while the document that handed them out is alive.
+ */
+
+#ifndef ZIGRTF_HPP
+#define ZIGRTF_HPP
+
+#if __has_include("zigrtf.h")
+#include "zigrtf.h"
+#else
+#include "c_api.h"
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <compare>
+#include <cstddef>
+#include <exception>
+#include <future>
+#include <iterator>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace rtf {
+
+/*
+ * ============================================================================
+ * ERRORS
+ * ============================================================================
+ */
+
+/* A failed call: the RTF_* result code and rtf_errmsg() at the time */
+class error : public std::runtime_error {
+public:
+    error(int code, const char* message) : std::runtime_error(message), code_(code) {}
+
+    int code() const noexcept { return code_; }
+
+private:
+    int code_;
+};
+
+namespace detail {
+
+[[noreturn]] inline void fail(int code) {
+    throw error(code, rtf_errmsg());
+}
+
+template <class T>
+std::span<const T> make_span(const T* data, size_t count) noexcept {
+    return data ? std::span<const T>(data, count) : std::span<const T>();
+}
+
+/* Random-access iterator over a range view with operator[](size_t), held by value */
+template <class Range>
+class index_iterator {
+public:
+    using iterator_category = std::random_access_iterator_tag;
+    using reference = decltype(std::declval<const Range&>()[0]);
+    using value_type = std::remove_cvref_t<reference>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+
+    index_iterator() noexcept = default;
+    index_iterator(const Range& range, size_t index) noexcept : range_(range), index_(index) {}
+
+    reference operator*() const { return range_[index_]; }
+    reference operator[](difference_type n) const { return range_[index_ + n]; }
+
+    index_iterator& operator++() noexcept { ++index_; return *this; }
+    index_iterator operator++(int) noexcept { auto old = *this; ++index_; return old; }
+    index_iterator& operator--() noexcept { --index_; return *this; }
+    index_iterator operator--(int) noexcept { auto old = *this; --index_; return old; }
+    index_iterator& operator+=(difference_type n) noexcept { index_ += n; return *this; }
+    index_iterator& operator-=(difference_type n) noexcept { index_ -= n; return *this; }
+
+    friend index_iterator operator+(index_iterator it, difference_type n) noexcept { return it += n; }
+    friend index_iterator operator+(difference_type n, index_iterator it) noexcept { return it += n; }
+    friend index_iterator operator-(index_iterator it, difference_type n) noexcept { return it -= n; }
+    friend difference_type operator-(index_iterator a, index_iterator b) noexcept {
+        return static_cast<difference_type>(a.index_) - static_cast<difference_type>(b.index_);
+    }
+    friend bool operator==(index_iterator a, index_iterator b) noexcept { return a.index_ == b.index_; }
+    friend auto operator<=>(index_iterator a, index_iterator b) noexcept { return a.index_ <=> b.index_; }
+
+private:
+    Range range_;
+    size_t index_ = 0;
+};
+
+/* Adapts a callable taking std::string_view to rtf_writer */
+template <class Sink>
+struct writer_adapter {
+    Sink& sink;
+    std::exception_ptr failure;
+
+    static int write(void* context, const void* data, size_t count) {
+        auto* self = static_cast<writer_adapter*>(context);
+        try {
+            self->sink(std::string_view(static_cast<const char*>(data), count));
+        } catch (...) {
+            /* Exceptions must not cross the library's frames */
+            self->failure = std::current_exception();
+            return -1;
+        }
+        return static_cast<int>(count); /* The library never asks for more than INT_MAX */
+    }
+
+    rtf_writer writer() noexcept { return rtf_writer{&write, this}; }
+
+    void check(int result) {
+        if (failure) std::rethrow_exception(failure);
+        if (result != RTF_OK) fail(result);
+    }
+};
+
+} /* namespace detail */
+
+/*
+ * ============================================================================
+ * TABLES
+ * ============================================================================
+ */
+
+/* One cell; text is borrowed from the document */
+class cell {
+public:
+    cell(const rtf_table* table, size_t row, size_t index) noexcept : table_(table), row_(row), index_(index) {}
+
+    std::string_view text() const {
+        const char* text = rtf_table_get_cell_text(table_, row_, index_);
+        return text ? std::string_view(text) : std::string_view();
+    }
+    uint32_t width() const { return rtf_table_get_cell_width(table_, row_, index_); }
+
+private:
+    const rtf_table* table_;
+    size_t row_;
+    size_t index_;
+};
+
+/* The cells of one table row */
+class row {
+public:
+    using iterator = detail::index_iterator<row>;
+
+    row() noexcept = default;
+    row(const rtf_table* table, size_t index) noexcept
+        : table_(table), index_(index), size_(rtf_table_get_cell_count(table, index)) {}
+
+    size_t size() const noexcept { return size_; }
+    bool empty() const noexcept { return size_ == 0; }
+    cell operator[](size_t index) const noexcept { return cell(table_, index_, index); }
+    iterator begin() const noexcept { return iterator(*this, 0); }
+    iterator end() const noexcept { return iterator(*this, size_); }
+
+private:
+    const rtf_table* table_ = nullptr;
+    size_t index_ = 0;
+    size_t size_ = 0;
+};
+
+/* A table's rows */
+class table {
+public:
+    using iterator = detail::index_iterator<table>;
+
+    table() noexcept = default;
+    explicit table(const rtf_table* handle) noexcept : handle_(handle), size_(rtf_table_get_row_count(handle)) {}
+
+    size_t size() const noexcept { return size_; }
+    bool empty() const noexcept { return size_ == 0; }
+    row operator[](size_t index) const noexcept { return row(handle_, index); }
+    iterator begin() const noexcept { return iterator(*this, 0); }
+    iterator end() const noexcept { return iterator(*this, size_); }
+
+    /* Where the table starts in document::text() */
+    size_t text_offset() const { return rtf_table_get_text_offset(handle_); }
+    const rtf_table* get() const noexcept { return handle_; }
+
+private:
+    const rtf_table* handle_ = nullptr;
+    size_t size_ = 0;
+};
+
+/* A document's tables */
+class table_range {
+public:
+    using iterator = detail::index_iterator<table_range>;
+
+    table_range() noexcept = default;
+    explicit table_range(rtf_document* doc) noexcept : doc_(doc), size_(doc ? rtf_get_table_count(doc) : 0) {}
+
+    size_t size() const noexcept { return size_; }
+    bool empty() const noexcept { return size_ == 0; }
+    table operator[](size_t index) const noexcept { return table(rtf_get_table(doc_, index)); }
+    iterator begin() const noexcept { return iterator(*this, 0); }
+    iterator end() const noexcept { return iterator(*this, size_); }
+
+private:
+    rtf_document* doc_ = nullptr;
+    size_t size_ = 0;
+};
+
+/* A document's paragraphs (see rtf_get_paragraph) */
+class paragraph_range {
+public:
+    using iterator = detail::index_iterator<paragraph_range>;
+
+    paragraph_range() noexcept = default;
+    explicit paragraph_range(rtf_document* doc) noexcept : doc_(doc), size_(doc ? rtf_get_paragraph_count(doc) : 0) {}
+
+    size_t size() const noexcept { return size_; }
+    bool empty() const noexcept { return size_ == 0; }
+    const rtf_paragraph& operator[](size_t index) const noexcept { return *rtf_get_paragraph(doc_, index); }
+    iterator begin() const noexcept { return iterator(*this, 0); }
+    iterator end() const noexcept { return iterator(*this, size_); }
+
+private:
+    rtf_document* doc_ = nullptr;
+    size_t size_ = 0;
+};
+
+/*
+ * ============================================================================
+ * DOCUMENTS
+ * ============================================================================
+ */
+
+/* Reusable parser state for one thread (rtf_context) */
+class context {
+public:
+    context() : ctx_(rtf_context_new()) {
+        if (!ctx_) detail::fail(RTF_NOMEM);
+    }
+    ~context() { rtf_context_free(ctx_); }
+
+    context(context&& other) noexcept : ctx_(std::exchange(other.ctx_, nullptr)) {}
+    context& operator=(context&& other) noexcept {
+        std::swap(ctx_, other.ctx_);
+        return *this;
+    }
+    context(const context&) = delete;
+    context& operator=(const context&) = delete;
+
+    rtf_context* get() const noexcept { return ctx_; }
+
+private:
+    rtf_context* ctx_;
+};
+
+/*
+ * Owns one reference to a parsed document. Move-only: share() takes another
+ * reference explicitly, for handing the document to another owner or thread.
+ */
+class document {
+public:
+    document() noexcept = default;
+    explicit document(rtf_document* doc) noexcept : doc_(doc) {} /* Adopts the reference */
+    ~document() { rtf_free(doc_); }
+
+    document(document&& other) noexcept : doc_(std::exchange(other.doc_, nullptr)) {}
+    document& operator=(document&& other) noexcept {
+        std::swap(doc_, other.doc_);
+        return *this;
+    }
+    document(const document&) = delete;
+    document& operator=(const document&) = delete;
+
+    static document parse(std::string_view rtf, unsigned flags = 0) {
+        return adopt(rtf_parse_ex(rtf.data(), rtf.size(), flags));
+    }
+    static document parse(context& ctx, std::string_view rtf) {
+        return adopt(rtf_parse_with(ctx.get(), rtf.data(), rtf.size()));
+    }
+    static document parse_file(const char* path) { return adopt(rtf_parse_file(path)); }
+
+    document share() const noexcept { return document(rtf_retain(doc_)); }
+    rtf_document* get() const noexcept { return doc_; }
+    rtf_document* release() noexcept { return std::exchange(doc_, nullptr); }
+    explicit operator bool() const noexcept { return doc_ != nullptr; }
+
+    /* Plain text, UTF-8; runs and paragraphs are byte ranges of it */
+    std::string_view text() const { return std::string_view(rtf_get_text(doc_), rtf_get_text_length(doc_)); }
+
+    /* Compact runs and the style table they index */
+    std::span<const rtf_run_v2> runs() const {
+        size_t count = 0;
+        const rtf_run_v2* runs = rtf_get_runs_v2(doc_, &count);
+        return detail::make_span(runs, count);
+    }
+    std::span<const rtf_style> styles() const {
+        size_t count = 0;
+        const rtf_style* styles = rtf_get_styles(doc_, &count);
+        return detail::make_span(styles, count);
+    }
+
+    /* The same runs as rtf_run, with text and font name pointers */
+    std::span<const rtf_run> formatted_runs() const {
+        size_t count = 0;
+        const rtf_run* runs = rtf_get_runs_ptr(doc_, &count);
+        return detail::make_span(runs, count);
+    }
+
+    std::span<const rtf_image> images() const {
+        size_t count = 0;
+        const rtf_image* images = rtf_get_images_ptr(doc_, &count);
+        return detail::make_span(images, count);
+    }
+
+    paragraph_range paragraphs() const noexcept { return paragraph_range(doc_); }
+    table_range tables() const noexcept { return table_range(doc_); }
+
+    /* Back to RTF */
+    std::string generate() const {
+        char* rtf = rtf_generate(doc_);
+        if (!rtf) detail::fail(RTF_ERROR);
+        std::string result(rtf);
+        rtf_free_string(rtf);
+        return result;
+    }
+
+private:
+    static document adopt(rtf_document* doc) {
+        if (!doc) detail::fail(RTF_ERROR);
+        return document(doc);
+    }
+
+    rtf_document* doc_ = nullptr;
+};
+
+/* Text of a run, given document::text() */
+inline std::string_view run_text(std::string_view text, const rtf_run_v2& run) noexcept {
+    return std::string_view(text.data() + run.text_offset, run.text_length);
+}
+
+/*
+ * Parse every input on `threads` worker threads (default: one per core),
+ * each with its own context. Futures are in input order and hold the
+ * document or the rtf::error. Inputs must stay alive until their future is
+ * ready.
+ */
+inline std::vector<std::future<document>> parse_batch(std::span<const std::string_view> inputs, unsigned threads = 0) {
+    struct batch {
+        std::vector<std::string_view> inputs;
+        std::vector<std::promise<document>> results;
+        std::atomic<size_t> next{0};
+    };
+    auto work = std::make_shared<batch>();
+    work->inputs.assign(inputs.begin(), inputs.end());
+    work->results.resize(inputs.size());
+
+    std::vector<std::future<document>> futures;
+    futures.reserve(inputs.size());
+    for (auto& result : work->results) futures.push_back(result.get_future());
+    if (inputs.empty()) return futures;
+
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = static_cast<unsigned>(std::min<size_t>(threads, inputs.size()));
+
+    for (unsigned i = 0; i < threads; i++) {
+        /* Workers share the batch and end when it runs out */
+        std::thread([work] {
+            std::unique_ptr<context> ctx;
+            try {
+                ctx = std::make_unique<context>();
+            } catch (...) {
+                /* Without a context, parse as rtf_parse() does */
+            }
+            for (size_t index; (index = work->next.fetch_add(1)) < work->inputs.size();) {
+                std::string_view input = work->inputs[index];
+                rtf_document* doc = rtf_parse_with(ctx ? ctx->get() : nullptr, input.data(), input.size());
+                if (doc) {
+                    work->results[index].set_value(document(doc));
+                } else {
+                    work->results[index].set_exception(std::make_exception_ptr(error(RTF_ERROR, rtf_errmsg())));
+                }
+            }
+        }).detach();
+    }
+    return futures;
+}
+
+/*
+ * ============================================================================
+ * CALLBACKS
+ * ============================================================================
+ */
+
+/*
+ * Walk the document paragraph by paragraph. The handler implements any of
+ *
+ *   on_paragraph(const rtf_paragraph&)
+ *   on_run(std::string_view text, const rtf_run_v2&, const rtf_style&)
+ *   on_paragraph_end(const rtf_paragraph&)
+ *
+ * and is called directly, so the walk compiles to the loop over the arrays.
+ */
+template <class Handler>
+void visit(const document& doc, Handler&& handler) {
+    const std::string_view text = doc.text();
+    const std::span<const rtf_run_v2> runs = doc.runs();
+    const std::span<const rtf_style> styles = doc.styles();
+
+    for (const rtf_paragraph& paragraph : doc.paragraphs()) {
+        if constexpr (requires { handler.on_paragraph(paragraph); }) handler.on_paragraph(paragraph);
+        if constexpr (requires { handler.on_run(text, runs[0], styles[0]); }) {
+            for (const rtf_run_v2& run : runs.subspan(paragraph.first_run, paragraph.run_count)) {
+                handler.on_run(run_text(text, run), run, styles[run.style]);
+            }
+        }
+        if constexpr (requires { handler.on_paragraph_end(paragraph); }) handler.on_paragraph_end(paragraph);
+    }
+}
+
+/*
+ * Compare two documents (rtf_diff), calling `handler(const rtf_diff_change&)`
+ * per change. A handler returning bool stops the diff by returning false.
+ * Returns false if it did.
+ */
+template <class Handler>
+bool diff(const document& a, const document& b, Handler&& handler) {
+    struct state {
+        Handler& handler;
+        std::exception_ptr failure;
+
+        static int call(void* context, const rtf_diff_change* change) {
+            auto* self = static_cast<state*>(context);
+            try {
+                if constexpr (std::is_same_v<decltype(self->handler(*change)), bool>) {
+                    return self->handler(*change) ? 0 : 1;
+                } else {
+                    self->handler(*change);
+                    return 0;
+                }
+            } catch (...) {
+                self->failure = std::current_exception();
+                return 1;
+            }
+        }
+    } run{handler, nullptr};
+
+    const int result = rtf_diff(a.get(), b.get(), &state::call, &run);
+    if (run.failure) std::rethrow_exception(run.failure);
+    if (result == RTF_ERROR) return false;
+    if (result != RTF_OK) detail::fail(result);
+    return true;
+}
+
+/*
+ * Exports, written to `sink(std::string_view)` as they are produced.
+ * Flags are the RTF_JSON_* / RTF_CONVERT_* ones of the C functions.
+ */
+template <class Sink>
+void export_json(const document& doc, Sink&& sink, unsigned flags = 0) {
+    detail::writer_adapter<Sink> adapter{sink, nullptr};
+    rtf_writer writer = adapter.writer();
+    adapter.check(rtf_export_json(doc.get(), &writer, flags));
+}
+
+template <class Sink>
+void to_html(std::string_view rtf, Sink&& sink, unsigned flags = 0) {
+    detail::writer_adapter<Sink> adapter{sink, nullptr};
+    rtf_writer writer = adapter.writer();
+    adapter.check(rtf_to_html(rtf.data(), rtf.size(), &writer, flags));
+}
+
+template <class Sink>
+void to_markdown(std::string_view rtf, Sink&& sink, unsigned flags = 0) {
+    detail::writer_adapter<Sink> adapter{sink, nullptr};
+    rtf_writer writer = adapter.writer();
+    adapter.check(rtf_to_markdown(rtf.data(), rtf.size(), &writer, flags));
+}
+
+} /* namespace rtf */
+
+#endif /* ZIGRTF_HPP */